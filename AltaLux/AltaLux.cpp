@@ -44,6 +44,9 @@ A "contributor" is any person that distributes its contribution under this licen
 #include "Filter/CAltaLuxFilterFactory.h"
 #include "UIDraw/UIDraw.h"
 #include "ScopedBitmapHeader.h"
+#include "ImageCopy/ImageCopy.h"
+#include "Session/CSessionBufferManager.h"
+#include "Preview/PreviewPipeline.h"
 #include <iostream>
 
 #include <dwmapi.h>
@@ -54,9 +57,6 @@ A "contributor" is any person that distributes its contribution under this licen
 
 #pragma comment(lib, "uxtheme.lib")
 
-using WeakImagePtr = std::weak_ptr<std::vector<unsigned char>>;
-using SharedImagePtr = std::shared_ptr<std::vector<unsigned char>>;
-
 const int RGB24_PIXEL_SIZE = 3;
 const int RGB32_PIXEL_SIZE = 4;
 
@@ -72,8 +72,6 @@ bool SkipProcessing;
 int ScaledImageWidth;
 int ScaledImageHeight;
 int ScalingFactor = 1;
-WeakImagePtr SrcImagePtr;				// source image
-WeakImagePtr ProcImagePtr;				// processed image
 WeakImagePtr ScaledSrcImagePtr;			// down-sampled source image
 WeakImagePtr ScaledProcImagePtr;		// processed image
 WeakImagePtr ScaledProcImageGridMPtr;	// processed image with lesser intensity
@@ -83,6 +81,9 @@ WeakImagePtr ScaledProcImageIntensityPPtr;	// processed image with finer grid
 /// GUI
 int FilterIntensity = AL_DEFAULT_STRENGTH;
 int FilterScale = DEFAULT_HOR_REGIONS;
+bool ApproximatePreview = false;		// previews use the faster approximate interpolation, final processing is always exact
+unsigned int PreviewIdentityTolerance = AL_DEFAULT_IDENTITY_TOLERANCE;	// previews skip the areas whose mappings are this close to the identity
+bool AutoStrength = false;		// the strength of each region is lowered according to its detail, for both previews and final processing
 bool CompleteVisualization = true;
 bool NoZoom = false;
 
@@ -105,21 +106,11 @@ BOOL APIENTRY DllMain(HANDLE hModule,
 	return TRUE;
 }
 
-void CopyScaledSrcImage(unsigned char* TargetImage)
-{
-	if (TargetImage == nullptr)
-		return;
-	auto ScaledSrcImage = ScaledSrcImagePtr.lock();
-	if (ScaledSrcImage == nullptr)
-		return;
-	memcpy(TargetImage, ScaledSrcImage.get()->data(), ScaledImageWidth * ScaledImageHeight * ImageBitDepth);
-}
-
 /// <summary>
 /// Creates and returns an instance of CBaseAltaLuxFilter based on image dimensions.
-/// The function determines whether to use a scaled or full-size image based on the availability of the scaled source image. 
+/// The preview is always computed on the scaled source image, that is shared with the source image when no scaling is needed.
 /// </summary>
-/// <param name="IsRescalingEnabled">A reference to a boolean that will be set to true if scaling is enabled (i.e., the scaled image was used to create the filter), or false if the full-size image was used.</param>
+/// <param name="IsRescalingEnabled">A reference to a boolean that will be set to true if the scaled source image is available, false otherwise.</param>
 /// <returns>A pointer to an instance of the AltaLux filter if successful, nullptr otherwise.</returns>
 CBaseAltaLuxFilter* InstantiateFilter(bool& IsRescalingEnabled)
 {
@@ -129,11 +120,19 @@ CBaseAltaLuxFilter* InstantiateFilter(bool& IsRescalingEnabled)
 		IsRescalingEnabled = (ScaledSrcImage != nullptr);
 		if (IsRescalingEnabled)		
 		{
-			return CAltaLuxFilterFactory::CreateAltaLuxFilter(ScaledImageWidth, ScaledImageHeight, FilterScale, FilterScale);			
+			CBaseAltaLuxFilter* PreviewFilter = CAltaLuxFilterFactory::CreateAltaLuxFilter(ScaledImageWidth, ScaledImageHeight, FilterScale, FilterScale);
+			if (PreviewFilter != nullptr)
+			{
+				PreviewFilter->SetApproximateInterpolation(ApproximatePreview);
+				PreviewFilter->SetIdentityTolerance(PreviewIdentityTolerance);
+				PreviewFilter->SetAutoStrength(AutoStrength);
+				PreviewFilter->SetPriority(FILTER_PRIORITY_INTERACTIVE);
+			}
+			return PreviewFilter;
 		}
 		else
 		{
-			return CAltaLuxFilterFactory::CreateAltaLuxFilter(ImageWidth, ImageHeight, FilterScale, FilterScale);			
+			return nullptr;
 		}
 	}
 	catch (std::exception& e)
@@ -142,6 +141,9 @@ CBaseAltaLuxFilter* InstantiateFilter(bool& IsRescalingEnabled)
 	}
 }
 
+/// <summary>
+/// recomputes all the preview buffers of the session with the current settings
+/// </summary>
 void DoProcessing()
 {
 	bool IsRescalingEnabled = false;
@@ -153,86 +155,28 @@ void DoProcessing()
 	{
 		std::unique_ptr<CBaseAltaLuxFilter> AltaLuxFilterPtr(AltaLuxFilter);
 
-		auto processImage = [&](const SharedImagePtr image) 
-		{
-			switch (ImageBitDepth) 
-			{
-				case RGB24_PIXEL_SIZE:
-					AltaLuxFilterPtr->ProcessRGB24(static_cast<void*>(image.get()->data()));
-					break;
-				case RGB32_PIXEL_SIZE:
-					AltaLuxFilterPtr->ProcessRGB32(static_cast<void*>(image.get()->data()));
-					break;
-				default:
-					break;
-			}
-		};
+		// rescaling is enabled, so preview is computed on the smaller resampled image
+		auto ScaledSrcImage = ScaledSrcImagePtr.lock();
+		if (ScaledSrcImage == nullptr)
+			return;
 
-		if (IsRescalingEnabled)
+		const PreviewSettings Settings = { FilterIntensity, FilterScale };
+		// keeps batch jobs from resuming between the preview variants
+		CPriorityJob PreviewJob(FILTER_PRIORITY_INTERACTIVE);
+		// same order as PreviewBufferId
+		const WeakImagePtr PreviewImagePtrs[NUM_PREVIEW_BUFFERS] =
 		{
-			// rescaling is enabled, so preview is computed on the smaller resampled image
-			auto ScaledProcImage = ScaledProcImagePtr.lock();
-			if (ScaledProcImage != nullptr)
-			{
-				CopyScaledSrcImage(ScaledProcImage.get()->data());
-				AltaLuxFilterPtr->SetStrength(FilterIntensity);
-				processImage(ScaledProcImage);
-			}
-			// preview intensity changes
-			const int STRENGTH_DELTA = 15;
-
-			// preview with lesser intensity
-			auto ScaledProcImageIntensityM = ScaledProcImageIntensityMPtr.lock();
-			if (ScaledProcImageIntensityM != nullptr)
-			{
-				CopyScaledSrcImage(ScaledProcImageIntensityM.get()->data());
-				AltaLuxFilterPtr->SetStrength(max(FilterIntensity - STRENGTH_DELTA, AL_MIN_STRENGTH));
-				processImage(ScaledProcImageIntensityM);
-			}
-
-			// preview with higher intensity
-			auto ScaledProcImageIntensityP = ScaledProcImageIntensityPPtr.lock();
-			if (ScaledProcImageIntensityP != nullptr)
-			{
-				CopyScaledSrcImage(ScaledProcImageIntensityP.get()->data());
-				AltaLuxFilterPtr->SetStrength(min(FilterIntensity + STRENGTH_DELTA, AL_MAX_STRENGTH));
-				processImage(ScaledProcImageIntensityP);
-			}
-
-			// preview with grid changes
-			const int SLICE_DELTA = 2;
-
-			// preview with coarser grid
-			auto ScaledProcImageGridM = ScaledProcImageGridMPtr.lock();
-			if (ScaledProcImageGridM != nullptr)
-			{
-				CopyScaledSrcImage(ScaledProcImageGridM.get()->data());
-				AltaLuxFilterPtr->SetSlices(
-					max(FilterScale - SLICE_DELTA, MIN_HOR_REGIONS), max(FilterScale - SLICE_DELTA, MIN_VERT_REGIONS));
-				processImage(ScaledProcImageGridM);
-			}
-
-			// preview with finer grid
-			auto ScaledProcImageGridP = ScaledProcImageGridPPtr.lock();
-			if (ScaledProcImageGridP != nullptr)
-			{
-				CopyScaledSrcImage(ScaledProcImageGridP.get()->data());
-				AltaLuxFilterPtr->SetSlices(
-					min(FilterScale + SLICE_DELTA, MAX_HOR_REGIONS), min(FilterScale + SLICE_DELTA, MAX_VERT_REGIONS));
-				processImage(ScaledProcImageGridP);
-			}
-		}
-		else
+			ScaledProcImagePtr, ScaledProcImageIntensityMPtr, ScaledProcImageIntensityPPtr,
+			ScaledProcImageGridMPtr, ScaledProcImageGridPPtr
+		};
+		for (int BufferId = PREVIEW_PROCESSED; BufferId < NUM_PREVIEW_BUFFERS; BufferId++)
 		{
-			// full-scale view only
-			auto SrcImage = SrcImagePtr.lock();
-			auto ProcImage = ProcImagePtr.lock();
-			if ((SrcImage != nullptr) && (ProcImage != nullptr))
-			{
-				memcpy(ProcImage.get()->data(), SrcImage.get()->data(), ImageWidth * ImageHeight * ImageBitDepth);
-				AltaLuxFilterPtr->SetStrength(FilterIntensity);
-				processImage(ProcImage);
-			}
+			// buffers dropped by the memory budget are skipped
+			auto PreviewImage = PreviewImagePtrs[BufferId].lock();
+			if (PreviewImage != nullptr)
+				RenderPreview(AltaLuxFilterPtr.get(), static_cast<PreviewBufferId>(BufferId), Settings,
+				              ScaledSrcImage.get()->data(), PreviewImage.get()->data(), ScaledImageWidth, ScaledImageHeight,
+				              ImageBitDepth);
 		}
 	}
 	catch (std::exception& e)
@@ -256,68 +200,6 @@ void ScaleRect(RECT& RectToScale, int ScalingFactor)
 	RectToScale.bottom = (originalHeight * ScalingFactor) / 100;
 }
 
-/// <summary>
-/// Down-samples incoming image for computing preview on smaller images
-/// </summary>
-/// <param name="SrcImage"></param>
-/// <param name="SrcImageWidth"></param>
-/// <param name="SrcImageHeight"></param>
-/// <param name="DestImage"></param>
-/// <param name="ScalingFactor">dest image width = source image width / ScalingFactor, same for height</param>
-/// <remarks>Downsampling is computed with simple averaging as it is used only for previews</remarks>
-void ScaleDownImage(void* SrcImage, const int SrcImageWidth, const int SrcImageHeight, void* DestImage, const int ScalingFactor)
-{
-	if (SrcImage == nullptr)
-		return;
-	if (DestImage == nullptr)
-		return;
-	if (ScalingFactor == 1)
-	{
-		/// no rescaling
-		memcpy(DestImage, SrcImage, SrcImageWidth * SrcImageHeight * ImageBitDepth);
-		return;
-	}
-
-	auto DestImagePtr = static_cast<unsigned char *>(DestImage);
-	auto SrcImagePtr = static_cast<unsigned char *>(SrcImage);
-	const int SrcImageStride = SrcImageWidth * ImageBitDepth;
-	const int DestImageWidth = SrcImageWidth / ScalingFactor;
-	const int DestImageHeight = SrcImageHeight / ScalingFactor;
-	unsigned char* DestPixelPtr = DestImagePtr;
-
-	for (int y = 0; y < DestImageHeight; y++)
-	{
-		unsigned char* SrcPixelPtr = &SrcImagePtr[((y * ScalingFactor) * SrcImageWidth) * ImageBitDepth];
-		for (int x = 0; x < DestImageWidth; x++)
-		{
-			unsigned int RAcc = 0;
-			unsigned int GAcc = 0;
-			unsigned int BAcc = 0;
-			for (int iy = 0; iy < ScalingFactor; iy++)
-				for (int ix = 0; ix < ScalingFactor; ix++)
-				{
-					RAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * ImageBitDepth)]);
-					GAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * ImageBitDepth) + 1]);
-					BAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * ImageBitDepth) + 2]);
-				}
-			if ((ScalingFactor == 2) || (ScalingFactor == 4))
-			{
-				DestPixelPtr[0] = static_cast<unsigned char>(RAcc >> ScalingFactor);
-				DestPixelPtr[1] = static_cast<unsigned char>(GAcc >> ScalingFactor);
-				DestPixelPtr[2] = static_cast<unsigned char>(BAcc >> ScalingFactor);
-			}
-			else
-			{
-				DestPixelPtr[0] = static_cast<unsigned char>(RAcc / (ScalingFactor * ScalingFactor));
-				DestPixelPtr[1] = static_cast<unsigned char>(GAcc / (ScalingFactor * ScalingFactor));
-				DestPixelPtr[2] = static_cast<unsigned char>(BAcc / (ScalingFactor * ScalingFactor));
-			}
-			SrcPixelPtr += ScalingFactor * ImageBitDepth;
-			DestPixelPtr += ImageBitDepth;
-		}
-	}
-}
-
 void FillImageArea(HDC hdc, const RECT& rectClient, BYTE R, BYTE G, BYTE B)
 {
 	HRGN bgRgn = CreateRectRgnIndirect(&rectClient);
@@ -594,29 +476,32 @@ BOOL CALLBACK DlgProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 			{
 				const int ThirdWidth = RectWidth(rectClient) / 3;
 				const int ThirdHeight = RectHeight(rectClient) / 3;
+				PreviewSettings Settings = { FilterIntensity, FilterScale };
 				auto ChangedSettings = false;
 				if ((MouseXPos < ThirdWidth) && (MouseYPos > ThirdHeight) && (MouseYPos < (2 * ThirdHeight)))
 				{
-					FilterScale = max(FilterScale - 2, MIN_HOR_REGIONS);
+					Settings = ApplyPreviewEvent(Settings, { PREVIEW_EVENT_CLICK_GRID_M, 0 });
 					ChangedSettings = true;
 				}
 				if ((MouseXPos > (rectClient.right - ThirdWidth)) && (MouseYPos > ThirdHeight) && (MouseYPos < (2 * ThirdHeight)))
 				{
-					FilterScale = min(FilterScale + 2, MAX_HOR_REGIONS);
+					Settings = ApplyPreviewEvent(Settings, { PREVIEW_EVENT_CLICK_GRID_P, 0 });
 					ChangedSettings = true;
 				}
 				if ((MouseYPos < ThirdHeight) && (MouseXPos > ThirdWidth) && (MouseXPos < (2 * ThirdWidth)))
 				{
-					FilterIntensity = max(FilterIntensity - 15, AL_MIN_STRENGTH);
+					Settings = ApplyPreviewEvent(Settings, { PREVIEW_EVENT_CLICK_INTENSITY_M, 0 });
 					ChangedSettings = true;
 				}
 				if ((MouseYPos > (rectClient.bottom - ThirdHeight)) && (MouseXPos > ThirdWidth) && (MouseXPos < (2 * ThirdWidth)))
 				{
-					FilterIntensity = min(FilterIntensity + 15, AL_MAX_STRENGTH);
+					Settings = ApplyPreviewEvent(Settings, { PREVIEW_EVENT_CLICK_INTENSITY_P, 0 });
 					ChangedSettings = true;
 				}
 				if (ChangedSettings)
 				{
+					FilterIntensity = Settings.Intensity;
+					FilterScale = Settings.Scale;
 					UpdateSliders(hwnd);
 					DoProcessing();
 					InvalidateRgn(hwnd, nullptr, true);
@@ -648,8 +533,9 @@ BOOL CALLBACK DlgProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 				}
 			case ID_DEFAULT:
 				{
-					FilterIntensity = AL_DEFAULT_STRENGTH;
-					FilterScale = DEFAULT_HOR_REGIONS;
+					const PreviewSettings Settings = ApplyPreviewEvent({ FilterIntensity, FilterScale }, { PREVIEW_EVENT_DEFAULT, 0 });
+					FilterIntensity = Settings.Intensity;
+					FilterScale = Settings.Scale;
 					UpdateSliders(hwnd);
 					DoProcessing();
 					InvalidateRgn(hwnd, nullptr, true);
@@ -749,47 +635,6 @@ BOOL CALLBACK DlgProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 	return TRUE;
 }
 
-int GetRGBImageSize(int ImageWidth, int ImageHeight)
-{
-	const int SECURITY_PADDING = 4096;
-	return (ImageWidth * ImageHeight * ImageBitDepth) + SECURITY_PADDING;
-}
-
-/// <summary>
-/// Computes the optimal scaling factor for images in preview
-/// </summary>
-/// <remarks>scaled image width must be a multiple of 8, if not a minor scaling factor is chosen</remarks>
-void ComputeScalingFactor()
-{
-	int HorScaling = ImageWidth / 1000;
-	int VerScaling = ImageHeight / 800;
-	ScalingFactor = min(HorScaling, VerScaling);
-	if (ScalingFactor < 1)
-		ScalingFactor = 1;
-	while (ScalingFactor > 1)
-	{
-		ScaledImageWidth = ImageWidth / ScalingFactor;
-		ScaledImageHeight = ImageHeight / ScalingFactor;
-		if ((ScaledImageWidth & 0x07) != 0)
-		{
-			// fix for non-standard, multiple of 4 rescaled images that may not be drawn correctly
-			ScalingFactor--;
-		}
-		else
-			break;
-	}
-	if (ScalingFactor > 1)
-	{
-		ScaledImageWidth = ImageWidth / ScalingFactor;
-		ScaledImageHeight = ImageHeight / ScalingFactor;
-	}
-	else
-	{
-		ScaledImageWidth = ImageWidth;
-		ScaledImageHeight = ImageHeight;
-	}
-}
-
 /// <summary>
 /// copy the image back into ImageBits
 /// </summary>
@@ -802,28 +647,16 @@ void CopyToSourceImage(BYTE* ImageBits, DWORD ImageBitsStride, unsigned char* Sr
 	if (!ImageBits || !SrcImage)
 		return;
 
-	unsigned char* SrcImagePtr = SrcImage;
 	unsigned char* ImageBitsPtr = ImageBits;
+	int NumRows = FullImageHeight;
 	if (CroppedImage)
 	{
 		ImageBitsPtr += ClipRect.left * ImageBitDepth;
 		ImageBitsPtr += ImageBitsStride * ClipRect.top;
-		for (int y = ClipRect.top; y < ClipRect.bottom; y++)
-		{
-			memcpy(ImageBitsPtr, SrcImagePtr, ImageWidth * ImageBitDepth);
-			SrcImagePtr += ImageWidth * ImageBitDepth;
-			ImageBitsPtr += ImageBitsStride;
-		}
-	}
-	else
-	{
-		for (int y = 0; y < FullImageHeight; y++)
-		{
-			memcpy(ImageBitsPtr, SrcImagePtr, ImageWidth * ImageBitDepth);
-			SrcImagePtr += ImageWidth * ImageBitDepth;
-			ImageBitsPtr += ImageBitsStride;
-		}
+		NumRows = ClipRect.bottom - ClipRect.top;
 	}
+	CopyImageRows(SrcImage, ImageWidth * ImageBitDepth, ImageBitDepth, ImageBitsPtr, ImageBitsStride, ImageBitDepth,
+	              ImageWidth, NumRows, false);
 }
 
 void NormalizeClipRect(RECT& ClipRect)
@@ -843,30 +676,17 @@ void CopyFromSourceImage(unsigned char* SrcImage, RECT ClipRect, BYTE* ImageBits
 	if (!ImageBits || !SrcImage)
 		return;
 
-	unsigned char* SrcImagePtr = SrcImage;
+	// copy whole source image, or only part of it
 	unsigned char* ImageBitsPtr = ImageBits;
+	int NumRows = FullImageHeight;
 	if (CroppedImage)
 	{
-		// copy only part of source image
 		ImageBitsPtr += ClipRect.left * ImageBitDepth;
 		ImageBitsPtr += ImageBitsStride * ClipRect.top;
-		for (int y = ClipRect.top; y < ClipRect.bottom; y++)
-		{
-			memcpy(SrcImagePtr, ImageBitsPtr, ImageWidth * ImageBitDepth);
-			SrcImagePtr += ImageWidth * ImageBitDepth;
-			ImageBitsPtr += ImageBitsStride;
-		}
-	}
-	else
-	{
-		// copy whole source image
-		for (int y = 0; y < FullImageHeight; y++)
-		{
-			memcpy(SrcImagePtr, ImageBitsPtr, ImageWidth * ImageBitDepth);
-			SrcImagePtr += ImageWidth * ImageBitDepth;
-			ImageBitsPtr += ImageBitsStride;
-		}
+		NumRows = ClipRect.bottom - ClipRect.top;
 	}
+	CopyImageRows(ImageBitsPtr, ImageBitsStride, ImageBitDepth, SrcImage, ImageWidth * ImageBitDepth, ImageBitDepth,
+	              ImageWidth, NumRows, false);
 }
 
 bool IsCroppedImage()
@@ -920,8 +740,8 @@ bool __cdecl StartEffects2(HANDLE hDib, HWND hwnd, int filter, RECT rect, int pa
 {
 #define WIDTHBYTES(bits) (((bits) + 31) / 32 * 4)
 
-	const int SECURITY_PADDING = 4096;
-	SharedImagePtr SrcImage;
+	// owns all the image buffers of this session, preview buffers are released when the session ends
+	CSessionBufferManager SessionBuffers;
 	RECT ClipRect = rect;
 	{
 		ScopedBitmapHeader pbBmHdr(hDib);
@@ -950,67 +770,49 @@ bool __cdecl StartEffects2(HANDLE hDib, HWND hwnd, int filter, RECT rect, int pa
 		BYTE* ImageBits = pbBmHdr.GetImageBits();
 		DWORD ImageBitsStride = WIDTHBYTES((DWORD)FullImageWidth * pbBmHdr->biBitCount);
 		/// SrcImage
-		SrcImage = std::make_shared<std::vector<unsigned char>>(GetRGBImageSize(ImageWidth, ImageHeight));
+		auto SrcImage = SessionBuffers.AllocateSourceImage(ImageWidth, ImageHeight, ImageBitDepth);
 		if (SrcImage == nullptr)		
 			return false;		
-		SrcImagePtr = SrcImage;
 
 		// copy from ImageBits into SrcImage
 		CopyFromSourceImage(SrcImage.get()->data(), ClipRect, ImageBits, ImageBitsStride);
 	}
 
-	/// ProcImage
-	auto ProcImage = std::make_shared<std::vector<unsigned char>>(*SrcImage.get());
-	if (ProcImage == nullptr)
-		return false;
-	ProcImagePtr = ProcImage;
-
 	/// param1 : [0..100], default 25
-	/// param2 : [2..16], default 8
+	/// param2 : [2..64], default 8
+	/// calls with both parameters specified come from batch conversions, that yield the cores to interactive previews
+	const bool IsBatchCall = (param1 != -1) && (param2 != -1);
+	AutoStrength = (GetPrivateProfileIntA("AltaLux", "AutoStrength", 0, iniFile) != 0);
+	/// budget shared by the filter instances of all the calls, batch conversions included; 0, the default, is unlimited
+	const size_t FilterMemoryBudgetMB = GetPrivateProfileIntA("AltaLux", "FilterMemoryBudgetMB", 0, iniFile);
+	CMemoryBudget::GetInstance().SetLimit(FilterMemoryBudgetMB << 20);
 	if ((param1 == -1) || (param2 == -1))
 	{
 		// show GUI
 		strcpy(SetupIniFile, iniFile);
 		FilterIntensity = GetPrivateProfileIntA("AltaLux", "Intensity", AL_DEFAULT_STRENGTH, SetupIniFile);
 		FilterScale = GetPrivateProfileIntA("AltaLux", "Scale", DEFAULT_HOR_REGIONS, SetupIniFile);
-
-		ComputeScalingFactor();
-
-		auto ScaledSrcImage = std::make_shared<std::vector<unsigned char>>(GetRGBImageSize(ScaledImageWidth, ScaledImageHeight));
-		if (ScaledSrcImage == nullptr)
-			return false;
-		ScaledSrcImagePtr = ScaledSrcImage;
-
-		ScaleDownImage(SrcImage.get()->data(), ImageWidth, ImageHeight, ScaledSrcImage.get()->data(), ScalingFactor);
-
-		auto ScaledProcImage = std::make_shared<std::vector<unsigned char>>(*ScaledSrcImage.get());
-		if (ScaledProcImage == nullptr)
+		const size_t MemoryBudgetMB = GetPrivateProfileIntA("AltaLux", "MemoryBudgetMB", DEFAULT_MEMORY_BUDGET_MB, SetupIniFile);
+		SessionBuffers.SetMemoryBudget(MemoryBudgetMB << 20);
+		ApproximatePreview = (GetPrivateProfileIntA("AltaLux", "ApproximatePreview", 0, SetupIniFile) != 0);
+		PreviewIdentityTolerance = GetPrivateProfileIntA("AltaLux", "PreviewIdentityTolerance", AL_DEFAULT_IDENTITY_TOLERANCE, SetupIniFile);
+
+		// allocate only the preview buffers that fit in the memory budget
+		PreviewPlan Plan;
+		if (!PreparePreviewSource(SessionBuffers, ImageWidth, ImageHeight, ImageBitDepth,
+		                          ComputePreviewScalingFactor(ImageWidth, ImageHeight), Plan))
 			return false;
-		ScaledProcImagePtr = ScaledProcImage;
+		ScalingFactor = Plan.ScalingFactor;
+		ScaledImageWidth = Plan.ScaledWidth;
+		ScaledImageHeight = Plan.ScaledHeight;
 
-		// allocate buffer for processed image with coarser grid
-		auto ScaledProcImageGridM = std::make_shared<std::vector<unsigned char>>(*ScaledSrcImage.get());
-		if (ScaledProcImageGridM == nullptr)
-			return false;
-		ScaledProcImageGridMPtr = ScaledProcImageGridM;
-
-		// allocate buffer for processed image with finer grid
-		auto ScaledProcImageGridP = std::make_shared<std::vector<unsigned char>>(*ScaledSrcImage.get());
-		if (ScaledProcImageGridP == nullptr)
-			return false;
-		ScaledProcImageGridPPtr = ScaledProcImageGridP;
+		ScaledSrcImagePtr = SessionBuffers.GetScaledSourceImage();
 
-		// allocate buffer for processed image with lesser intensity
-		auto ScaledProcImageIntensityM = std::make_shared<std::vector<unsigned char>>(*ScaledSrcImage.get());
-		if (ScaledProcImageIntensityM == nullptr)
-			return false;
-		ScaledProcImageIntensityMPtr = ScaledProcImageIntensityM;
-
-		// allocate buffer for processed image with higher intensity
-		auto ScaledProcImageIntensityP = std::make_shared<std::vector<unsigned char>>(*ScaledSrcImage.get());
-		if (ScaledProcImageIntensityP == nullptr)
-			return false;
-		ScaledProcImageIntensityPPtr = ScaledProcImageIntensityP;
+		ScaledProcImagePtr = SessionBuffers.GetPreviewImage(PREVIEW_PROCESSED);
+		ScaledProcImageIntensityMPtr = SessionBuffers.GetPreviewImage(PREVIEW_INTENSITY_M);
+		ScaledProcImageIntensityPPtr = SessionBuffers.GetPreviewImage(PREVIEW_INTENSITY_P);
+		ScaledProcImageGridMPtr = SessionBuffers.GetPreviewImage(PREVIEW_GRID_M);
+		ScaledProcImageGridPPtr = SessionBuffers.GetPreviewImage(PREVIEW_GRID_P);
 
 		int ret = DialogBox(hDll, MAKEINTRESOURCE(IDD_DIALOG1), hwnd, (DLGPROC)DlgProc);
 
@@ -1032,9 +834,15 @@ bool __cdecl StartEffects2(HANDLE hDib, HWND hwnd, int filter, RECT rect, int pa
 
 	try
 	{
+		// previews are no longer needed, release them before processing the full resolution image
+		auto SrcImage = SessionBuffers.GetWritableSourceImage();
+		if (SrcImage == nullptr)
+			return false;
 		std::unique_ptr<CBaseAltaLuxFilter> AltaLuxFilter(
 			CAltaLuxFilterFactory::CreateAltaLuxFilter(ImageWidth, ImageHeight, param2, param2));
 		AltaLuxFilter->SetStrength(param1);
+		AltaLuxFilter->SetAutoStrength(AutoStrength);
+		AltaLuxFilter->SetPriority(IsBatchCall ? FILTER_PRIORITY_BACKGROUND : FILTER_PRIORITY_NORMAL);
 		if (ImageBitDepth == RGB32_PIXEL_SIZE)
 			AltaLuxFilter->ProcessRGB32(static_cast<void*>(SrcImage.get()->data()));
 		else
@@ -26,13 +26,24 @@ A "contributor" is any person that distributes its contribution under this licen
 */
 
 #include "CBaseAltaLuxFilter.h"
+#include "CLatencyRegistry.h"
+#include "CPriorityScheduler.h"
+#include "../ImageScaling/ImageScaling.h"
 
-#include <windows.h>
+#include <algorithm>
 #include <cstdio>
 #include <cmath>
-#include <malloc.h>
+#include <cstring>
 #include <memory>
-#include <ppl.h>
+#include <vector>
+#include <tmmintrin.h>
+
+/// only the IrfanView plugin and the Windows tools are built with MSVC, the command line tool also builds with GCC
+#ifdef _MSC_VER
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif // _MSC_VER
 
 #ifdef ENABLE_LOGGING
 	#include "..\Log\easylogging++.h"
@@ -43,33 +54,46 @@ CBaseAltaLuxFilter::CBaseAltaLuxFilter(int Width, int Height, int HorSlices, int
 	OriginalImageWidth = Width;
 	OriginalImageHeight = Height;
 
-	/// delay allocation of ImageBuffer into SetStrength
+	/// delay allocation of ImageBuffer into SetStrength, and of MapArray into the first Run
 	ImageBuffer = nullptr;
-
-	NumHorRegions = HorSlices;
-	NumVertRegions = VerSlices;
-
-	RegionWidth = OriginalImageWidth / NumHorRegions;
-	RegionHeight = OriginalImageHeight / NumVertRegions;
-
-	ImageWidth = RegionWidth * NumHorRegions;
-	ImageHeight = RegionHeight * NumVertRegions;
+	ImageBufferSize = 0;
+	LumaBandTop = 0;
+	MapArray = nullptr;
+	MapArrayCapacity = 0;
+	IdentityMaps = nullptr;
+	Allocations = AllocationStats();
+	ApproximateInterpolation = false;
+	IdentityTolerance = AL_DEFAULT_IDENTITY_TOLERANCE;
+	AutoStrength = false;
+	TiledLayout = false;
+	LumaTiled = false;
+	SchedulingPolicy = AL_SCHEDULE_LONGEST_FIRST;
+	Priority = FILTER_PRIORITY_NORMAL;
+	AppliedDegradations = AL_DEGRADE_NONE;
+	HistogramStep = 1;
+	SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	SetThumbnailOutput(nullptr, 1);
+	NumThumbnailTiles = 0;
+
+	SetSlices(HorSlices, VerSlices);
 
 	SetStrength();
 }
 
 CBaseAltaLuxFilter::~CBaseAltaLuxFilter()
 {
-	if (ImageBuffer)
+	ReleaseImageBuffer();
+	if (MapArray)
 	{
 		try
 		{
-			delete[] ImageBuffer;
+			delete[] MapArray;
 		}
 		catch (...)
 		{
-			ImageBuffer = nullptr;
 		}
+		MapArray = nullptr;
+		IdentityMaps = nullptr;
 	}
 }
 
@@ -84,6 +108,13 @@ void CBaseAltaLuxFilter::SetSlices(int HorSlices, int VerSlices)
 		VerSlices = MIN_VERT_REGIONS;
 	if (VerSlices > MAX_VERT_REGIONS)
 		VerSlices = MAX_VERT_REGIONS;
+	// on small images, keep contextual regions at least MIN_REGION_SIZE pixels wide and high
+	const int MaxHorSlices = OriginalImageWidth / static_cast<int>(MIN_REGION_SIZE);
+	if (HorSlices > MaxHorSlices)
+		HorSlices = std::max(MaxHorSlices, static_cast<int>(MIN_HOR_REGIONS));
+	const int MaxVerSlices = OriginalImageHeight / static_cast<int>(MIN_REGION_SIZE);
+	if (VerSlices > MaxVerSlices)
+		VerSlices = std::max(MaxVerSlices, static_cast<int>(MIN_VERT_REGIONS));
 
 	NumHorRegions = HorSlices;
 	NumVertRegions = VerSlices;
@@ -103,36 +134,11 @@ void CBaseAltaLuxFilter::SetStrength(int _Strength)
 	if (Strength > AL_MAX_STRENGTH)
 		Strength = AL_MAX_STRENGTH;
 
+	/// under a memory budget ImageBuffer is allocated by each ProcessXXX call, once it has been admitted
 	if (Strength == AL_MIN_STRENGTH)
-	{
-		/// free ImageBuffer, if allocated
-		if (ImageBuffer)
-		{
-			try
-			{
-				delete[] ImageBuffer;
-			}
-			catch (...)
-			{
-			}
-			ImageBuffer = nullptr;
-		}
-	}
-	else
-	{
-		if (ImageBuffer == nullptr)
-		{
-			/// allocate ImageBuffer
-			try
-			{
-				ImageBuffer = new unsigned char[IMAGE_BUFFER_SIZE];
-			}
-			catch (...)
-			{
-				ImageBuffer = nullptr;
-			}
-		}
-	}
+		ReleaseImageBuffer();
+	else if (!CMemoryBudget::GetInstance().IsLimited())
+		AllocateImageBuffer();
 
 	ClipLimit = MIN_CLIP_LIMIT + (MAX_CLIP_LIMIT - MIN_CLIP_LIMIT) * ((float)(Strength - AL_MIN_STRENGTH)) / (
 		AL_MAX_STRENGTH - AL_MIN_STRENGTH);
@@ -147,255 +153,314 @@ bool CBaseAltaLuxFilter::IsEnabled() const
 	return Strength != AL_MIN_STRENGTH;
 }
 
-int CBaseAltaLuxFilter::ProcessUYVY(void* Image)
+/// <summary>
+/// enables the approximate interpolation, that quantises the bilinear weights to AL_APPROX_WEIGHT_BITS bits
+/// and runs on 16-bit SIMD lanes. Output may differ from the exact interpolation by up to AL_APPROX_MAX_ERROR graylevels,
+/// so it is meant for previews and not for the final image
+/// </summary>
+/// <param name="Enabled">true to use the approximate interpolation, false for the bit-exact one</param>
+void CBaseAltaLuxFilter::SetApproximateInterpolation(bool Enabled)
 {
-#ifdef _WIN64
+	ApproximateInterpolation = Enabled;
+}
 
-#else
-	if (Image == nullptr)
-		return AL_NULL_IMAGE;
+bool CBaseAltaLuxFilter::IsApproximateInterpolation() const
+{
+	return ApproximateInterpolation;
+}
 
-	if (!IsEnabled())
-		return AL_OK;
+/// <summary>
+/// sets how far from the identity a graylevel mapping may be to be treated as the identity.
+/// A sub-matrix whose four surrounding mappings are all treated as the identity is not interpolated,
+/// which saves most of the processing of low strengths and of images whose histograms are already balanced.
+/// With 0 only exact identity mappings are skipped and the result does not change, otherwise the skipped
+/// pixels may differ from the interpolated ones by up to Graylevels graylevels
+/// </summary>
+/// <param name="Graylevels">in [0..AL_MAX_IDENTITY_TOLERANCE]</param>
+void CBaseAltaLuxFilter::SetIdentityTolerance(unsigned int Graylevels)
+{
+	IdentityTolerance = std::min(Graylevels, AL_MAX_IDENTITY_TOLERANCE);
+}
 
-	if (ImageBuffer == nullptr)
-	{
-		/// if ImageBuffer allocation failed in the constructor, try again
-		/// if it still fails, return AL_OUT_OF_MEMORY
-		try
-		{
-			ImageBuffer = new unsigned char[IMAGE_BUFFER_SIZE];
-		}
-		catch (...)
-		{
-			ImageBuffer = nullptr;
-		}
-		if (ImageBuffer == nullptr)
-			return AL_OUT_OF_MEMORY;
-	}
+unsigned int CBaseAltaLuxFilter::GetIdentityTolerance() const
+{
+	return IdentityTolerance;
+}
 
-	/// copy luma from UYVY Image into ImageBuffer
-	auto ImagePtr = static_cast<unsigned char *>(Image);
-	auto ImageBufferPtr = static_cast<unsigned char *>(ImageBuffer);
+/// <summary>
+/// lets each contextual region choose its own clip limit, between the one of AL_MIN_STRENGTH and the one of the strength
+/// set by SetStrength, from the statistics of the histogram already built for its mapping, refer to EstimateRegionStrength.
+/// Regions whose graylevels are few or unevenly spread are enhanced, while flat regions and regions that already
+/// span the whole range evenly are left almost as they are, so a single strength suits images of any contrast
+/// </summary>
+/// <param name="Enabled">true to enable the automatic strength</param>
+void CBaseAltaLuxFilter::SetAutoStrength(bool Enabled)
+{
+	AutoStrength = Enabled;
+}
 
-	//	ImagePtr++;
-	//	for (int i = (ImageWidth * ImageHeight); i > 0; i--)
-	//	{
-	//		*ImageBufferPtr = *ImagePtr;
-	//		ImagePtr += 2;
-	//		ImageBufferPtr++;
-	//	}
+bool CBaseAltaLuxFilter::IsAutoStrength() const
+{
+	return AutoStrength;
+}
 
-	int ImageSize = ImageWidth * ImageHeight;
+/// <summary>
+/// stores the luminance extracted by the following ProcessRGB24/RGB32/BGR24/BGR32 calls sub-matrix by sub-matrix,
+/// each one in a contiguous block of ImageBuffer, instead of row by row. The interpolation then walks every sub-matrix
+/// linearly and the histogram of a contextual region reads the corners of four blocks, rather than one segment
+/// of each of its rows spread over the whole buffer, so large images touch far fewer pages. The result does not change.
+/// The other ProcessXXX calls keep the row by row layout, as they do not copy the luminance or copy it in assembly
+/// </summary>
+/// <param name="Enabled">true to enable the tiled layout</param>
+void CBaseAltaLuxFilter::SetTiledLayout(bool Enabled)
+{
+	TiledLayout = Enabled;
+}
 
-	__asm
-	{
-		mov EAX,ImagePtr
-		mov EDX,ImageBufferPtr
-		mov ECX,ImageSize
-		shr ECX,3
-
-		ALIGN 16
-		CopyIntoImageBufferLoop:
-		movq mm0,[EAX]
-		movq mm1,[EAX+8]
-		add EAX,16
-		psrlw mm0,8
-		psrlw mm1,8
-		packuswb mm0,mm1
-		movq [EDX],mm0
-		add EDX,8
-		sub ECX,1
-		jnz CopyIntoImageBufferLoop
-
-		emms
-	}
-	/// perform processing on ImageBuffer
-	auto RunReturn = Run();
-	if (RunReturn != AL_OK)
-		return RunReturn;
+bool CBaseAltaLuxFilter::IsTiledLayout() const
+{
+	return TiledLayout;
+}
 
-	/// copy processed luma back into UYVY Image
-	ImagePtr = static_cast<unsigned char *>(Image);
-	ImageBufferPtr = static_cast<unsigned char *>(ImageBuffer);
+/// <summary>
+/// selects the order in which the tasks are handed out to the workers; it does not change the result.
+/// Sub-matrices on the border are smaller than the others, except for the bottom row and the right column
+/// that also cover the leftover of the image, so dispatching them in index order may leave one heavy task last.
+/// Only the split loop strategy supports AL_SCHEDULE_LONGEST_FIRST, the others always use AL_SCHEDULE_ROW_MAJOR
+/// </summary>
+/// <param name="Policy">AL_SCHEDULE_ROW_MAJOR or AL_SCHEDULE_LONGEST_FIRST</param>
+void CBaseAltaLuxFilter::SetSchedulingPolicy(int Policy)
+{
+	if ((Policy != AL_SCHEDULE_ROW_MAJOR) && (Policy != AL_SCHEDULE_LONGEST_FIRST))
+		Policy = AL_SCHEDULE_LONGEST_FIRST;
+	SchedulingPolicy = Policy;
+}
 
-	// ImagePtr++;
-	// for (int j = (ImageWidth * ImageHeight); j > 0; j--)
-	// {
-	// 	*ImagePtr = *ImageBufferPtr;
-	// 	ImagePtr += 2;
-	// 	ImageBufferPtr++;
-	// }
+int CBaseAltaLuxFilter::GetSchedulingPolicy() const
+{
+	return SchedulingPolicy;
+}
 
-#define CHROMA_MASK	mm6
+/// <summary>
+/// requests a down-sampled copy of the result of the following ProcessRGB24/RGB32/BGR24/BGR32 calls, equal to
+/// the one computed by ScaleDownImage on the processed image. Each sub-matrix is down-sampled right after
+/// its interpolation, while its pixels are still in the cache, so the full-size result is not read again
+/// </summary>
+/// <param name="Image">buffer of (width / ScalingFactor) x (height / ScalingFactor) pixels of the same format
+/// as the processed image, nullptr to disable the thumbnail</param>
+/// <param name="ScalingFactor">thumbnail width = image width / ScalingFactor, same for height</param>
+void CBaseAltaLuxFilter::SetThumbnailOutput(void* Image, int ScalingFactor)
+{
+	if (ScalingFactor < 1)
+		ScalingFactor = 1;
+	Thumbnail.Image = static_cast<unsigned char *>(Image);
+	Thumbnail.ScalingFactor = ScalingFactor;
+}
 
-	__asm
-	{
-		mov EAX,ImagePtr
-		mov EDX,ImageBufferPtr
-		mov ECX,ImageSize
-		shr ECX,3
-		pcmpeqb CHROMA_MASK,CHROMA_MASK
-		psrlw CHROMA_MASK,8
-
-		ALIGN 16
-		CopyIntoImageLoop:
-		movq mm0,[EDX]
-		add EDX,8
-		movq mm3,[EAX]
-		movq mm4,[EAX+8]
-		pxor mm1,mm1
-		pxor mm2,mm2
-		punpcklbw mm1,mm0
-		punpckhbw mm2,mm0
-		pand mm3,CHROMA_MASK
-		pand mm4,CHROMA_MASK
-		por mm1,mm3
-		por mm2,mm4
-		movq [EAX],mm1
-		movq [EAX+8],mm2
-		add EAX,16
-		sub ECX,1
-		jnz CopyIntoImageLoop
-
-		emms
-	}
-
-#undef CHROMA_MASK
-
-#endif // _WIN64
+/// <summary>
+/// sets the priority class of the following ProcessXXX calls; while a call is running, the calls of lower classes
+/// made by other instances yield their cores to it at the next row of contextual regions, refer to CPriorityScheduler
+/// </summary>
+/// <param name="_Priority">FILTER_PRIORITY_INTERACTIVE for previews, FILTER_PRIORITY_BACKGROUND for batch work</param>
+void CBaseAltaLuxFilter::SetPriority(FilterPriority _Priority)
+{
+	if ((_Priority < FILTER_PRIORITY_INTERACTIVE) || (_Priority >= NUM_FILTER_PRIORITIES))
+		_Priority = FILTER_PRIORITY_NORMAL;
+	Priority = _Priority;
+}
 
-	return AL_OK;
+FilterPriority CBaseAltaLuxFilter::GetPriority() const
+{
+	return Priority;
 }
 
-int CBaseAltaLuxFilter::ProcessVYUY(void* Image)
+/// <summary>
+/// waits while a job of a higher priority class than this instance is running, refer to CPriorityScheduler
+/// </summary>
+void CBaseAltaLuxFilter::WaitForTurn()
 {
-	return ProcessUYVY(Image); //< no operations are performed on chroma
+	CPriorityScheduler& Scheduler = CPriorityScheduler::GetInstance();
+	if (Scheduler.ShouldYield(Priority))
+		Scheduler.WaitForTurn(Priority);
 }
 
-int CBaseAltaLuxFilter::ProcessYUYV(void* Image)
+/// <summary>
+/// returns the counters of the heap buffers allocated by this instance; once the first ProcessXXX call
+/// has returned, further calls on images of the same size with the same grid do not allocate
+/// </summary>
+AllocationStats CBaseAltaLuxFilter::GetAllocationStats() const
 {
-#ifdef _WIN64
+	return Allocations;
+}
 
-#else
+void CBaseAltaLuxFilter::ResetAllocationStats()
+{
+	Allocations.NumAllocations = 0;
+	Allocations.AllocatedBytes = 0;
+	Allocations.PeakBytes = Allocations.CurrentBytes;
+}
+
+/// <summary>
+/// returns the AL_DEGRADE_XXX flags applied by the last ProcessXXX call to meet its deadline,
+/// AL_DEGRADE_NONE for calls without a deadline. The approximate interpolation is not reported
+/// when it was already enabled with SetApproximateInterpolation
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetAppliedDegradations() const
+{
+	return AppliedDegradations;
+}
+
+void CBaseAltaLuxFilter::ResetDeadlineModel()
+{
+	DeadlineModel.Reset();
+}
+
+/// <summary>
+/// enables the degradations of the current call
+/// </summary>
+/// <param name="Degradations">AL_DEGRADE_XXX flags</param>
+void CBaseAltaLuxFilter::ApplyDegradations(unsigned int Degradations)
+{
+	AppliedDegradations = Degradations;
+	if (ApproximateInterpolation)
+		AppliedDegradations &= ~AL_DEGRADE_APPROXIMATE_INTERPOLATION;
+	if (Degradations & AL_DEGRADE_PROXY_MAPPINGS)
+		HistogramStep = AL_PROXY_HISTOGRAM_STEP;
+	else if (Degradations & AL_DEGRADE_HISTOGRAM_SUBSAMPLING)
+		HistogramStep = AL_SUBSAMPLED_HISTOGRAM_STEP;
+	else
+		HistogramStep = 1;
+}
+
+/// <summary>
+/// without a deadline, the call runs at full quality; otherwise the cheapest degradations expected to meet
+/// the deadline are chosen by DeadlineModel, that learns the cost of the plan from the duration of the call
+/// </summary>
+/// <param name="Filter">filter running the call</param>
+/// <param name="Format">pixel format of the call, refer to LatencyPixelFormat</param>
+/// <param name="DeadlineMicroseconds">time budget of the call, or AL_NO_DEADLINE</param>
+CBaseAltaLuxFilter::CDeadlineScope::CDeadlineScope(CBaseAltaLuxFilter* Filter, int Format, unsigned int DeadlineMicroseconds)
+	: Filter(Filter), Plan(), Level(-1)
+{
+	Filter->ApplyDegradations(AL_DEGRADE_NONE);
+	if (DeadlineMicroseconds == AL_NO_DEADLINE)
+		return;
+	Plan.Format = Format;
+	Plan.HorRegions = Filter->NumHorRegions;
+	Plan.VertRegions = Filter->NumVertRegions;
+	Plan.Approximate = Filter->ApproximateInterpolation;
+	Level = Filter->DeadlineModel.SelectLevel(Plan, DeadlineMicroseconds * 1e-6);
+	Filter->ApplyDegradations(DEADLINE_LEVEL_DEGRADATIONS[Level]);
+	StartTime = std::chrono::steady_clock::now();
+}
+
+CBaseAltaLuxFilter::CDeadlineScope::~CDeadlineScope()
+{
+	if (Level < 0)
+		return;
+	const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+	Filter->DeadlineModel.Update(Plan, Level, Elapsed.count());
+	/// the flags are kept for GetAppliedDegradations, the histograms of the next call are not subsampled
+	Filter->HistogramStep = 1;
+}
+
+int CBaseAltaLuxFilter::ProcessUYVY(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_UYVY, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_UYVY, DeadlineMicroseconds);
+
+	return ProcessPackedYUV(Image, 1);
+}
+
+int CBaseAltaLuxFilter::ProcessVYUY(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_VYUY, OriginalImageWidth, OriginalImageHeight);
+
+	return ProcessUYVY(Image, DeadlineMicroseconds); //< no operations are performed on chroma
+}
+
+int CBaseAltaLuxFilter::ProcessYUYV(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_YUYV, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_YUYV, DeadlineMicroseconds);
+
+	return ProcessPackedYUV(Image, 0);
+}
+
+/// <summary>
+/// process a packed 4:2:2 YUV image, whose chroma is left as is
+/// </summary>
+/// <param name="Image">image to be processed</param>
+/// <param name="LumaOffset">offset of the luma byte in each 2-byte pixel (0 for YUYV and YVYU, 1 for UYVY and VYUY)</param>
+/// <returns></returns>
+int CBaseAltaLuxFilter::ProcessPackedYUV(void* Image, int LumaOffset)
+{
 	if (Image == nullptr)
 		return AL_NULL_IMAGE;
 
-	if (ImageBuffer == nullptr)
+	if (!IsEnabled())
+		return AL_OK;
+
+	/// wait until the buffers of the call fit in the memory budget, then allocate them;
+	/// if the luma plane does not fit or cannot be allocated, process the image by bands
+	CMemoryReservation Reservation(IMAGE_BUFFER_SIZE + GetMapArrayBytes(), GetBandBufferSize() + GetMapArrayBytes(), Priority);
+	if (!AllocateCallBuffer(Reservation))
+		return AL_OUT_OF_MEMORY;
+
+	/// perform processing on ImageBuffer, the processed luma is written straight into the packed YUV Image
+	auto ImagePtr = static_cast<const unsigned char *>(Image);
+	WaitForTurn();
+	SetLumaOutput(Image, AL_OUTPUT_PACKED_YUV, 2, LumaOffset);
+	int RunReturn;
+	if (Reservation.IsReduced())
 	{
-		/// if ImageBuffer allocation failed in the constructor, try again
-		/// if it still fails, return AL_OUT_OF_MEMORY
-		try
+		RunReturn = RunBanded([&](int FirstRow, int LastRow)
 		{
-			ImageBuffer = new unsigned char[IMAGE_BUFFER_SIZE];
-		}
-		catch (...)
-		{
-			ImageBuffer = nullptr;
-		}
-		if (ImageBuffer == nullptr)
-			return AL_OUT_OF_MEMORY;
+			ExtractPackedLuma(ImagePtr, LumaOffset, FirstRow, LastRow);
+		});
 	}
-
-	/// copy luma from YUYV Image into ImageBuffer
-	auto ImagePtr = static_cast<unsigned char *>(Image);
-	auto ImageBufferPtr = static_cast<unsigned char *>(ImageBuffer);
-
-	//	for (int i = (ImageWidth * ImageHeight); i > 0; i--)
-	//	{
-	//		*ImageBufferPtr = *ImagePtr;
-	//		ImagePtr += 2;
-	//		ImageBufferPtr++;
-	//	}
-
-	int ImageSize = ImageWidth * ImageHeight;
-
-#define LUMA_MASK	mm6
-	__asm
+	else
 	{
-		mov EAX,ImagePtr
-		mov EDX,ImageBufferPtr
-		mov ECX,ImageSize
-		shr ECX,3
-		pcmpeqb LUMA_MASK,LUMA_MASK
-		psrlw LUMA_MASK,8
-
-		ALIGN 16
-		CopyIntoImageBufferLoop:
-		movq mm0,[EAX]
-		movq mm1,[EAX+8]
-		add EAX,16
-		pand mm0,LUMA_MASK
-		pand mm1,LUMA_MASK
-		packuswb mm0,mm1
-		movq [EDX],mm0
-		add EDX,8
-		sub ECX,1
-		jnz CopyIntoImageBufferLoop
-
-		emms
-	}
-#undef LUMA_MASK
-
-	/// perform processing on ImageBuffer
-	int RunReturn = Run();
+		/// copy luma from the packed YUV Image into ImageBuffer
+		ExtractPackedLuma(ImagePtr, LumaOffset, 0, OriginalImageHeight);
+		RunReturn = Run();
+	}
+	SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	ReleaseCallBuffer(Reservation);
 	if (RunReturn != AL_OK)
 		return RunReturn;
 
-	/// copy processed luma back into YUYV Image
-	ImagePtr = (unsigned char *)Image;
-	ImageBufferPtr = (unsigned char *)ImageBuffer;
-
-	//	for (int j = (ImageWidth * ImageHeight); j > 0; j--)
-	//	{
-	//		*ImagePtr = *ImageBufferPtr;
-	//		ImagePtr += 2;
-	//		ImageBufferPtr++;
-	//	}
-
-#define CHROMA_MASK	mm6
+	return AL_OK;
+}
 
-	__asm
+/// <summary>
+/// copies the luma bytes of some rows of a packed 4:2:2 YUV image into ImageBuffer, from its row LumaBandTop
+/// </summary>
+/// <param name="Image">source image</param>
+/// <param name="LumaOffset">offset of the luma byte in each 2-byte pixel</param>
+/// <param name="FirstRow">first row of the image copied</param>
+/// <param name="LastRow">row after the last one copied</param>
+void CBaseAltaLuxFilter::ExtractPackedLuma(const unsigned char* Image, int LumaOffset, int FirstRow, int LastRow)
+{
+	ForEachRowBand(LastRow - FirstRow, [&](int FirstBandRow, int LastBandRow)
 	{
-		mov EAX,ImagePtr
-		mov EDX,ImageBufferPtr
-		mov ECX,ImageSize
-		shr ECX,3
-		pcmpeqb CHROMA_MASK,CHROMA_MASK
-		psllw CHROMA_MASK,8
-
-		ALIGN 16
-		CopyIntoImageLoop:
-		movq mm1,[EDX]
-		pxor mm0,mm0
-		movq mm2,mm1
-		add EDX,8
-		movq mm3,[EAX]
-		movq mm4,[EAX+8]
-		punpcklbw mm1,mm0
-		punpckhbw mm2,mm0
-		pand mm3,CHROMA_MASK
-		pand mm4,CHROMA_MASK
-		por mm1,mm3
-		por mm2,mm4
-		movq [EAX],mm1
-		movq [EAX+8],mm2
-		add EAX,16
-		sub ECX,1
-		jnz CopyIntoImageLoop
-
-		emms
-	}
-
-#undef CHROMA_MASK
-
-#endif // _WIN64
-	return AL_OK;
+		for (int y = FirstRow + FirstBandRow; y < FirstRow + LastBandRow; y++)
+		{
+			const unsigned char* ImagePtr = Image + static_cast<size_t>(y) * OriginalImageWidth * 2 + LumaOffset;
+			unsigned char* ImageBufferPtr = ImageBuffer + static_cast<size_t>(y - LumaBandTop) * OriginalImageWidth;
+			for (int x = 0; x < OriginalImageWidth; x++)
+				ImageBufferPtr[x] = ImagePtr[2 * x];
+		}
+	});
 }
 
-int CBaseAltaLuxFilter::ProcessYVYU(void* Image)
+int CBaseAltaLuxFilter::ProcessYVYU(void* Image, unsigned int DeadlineMicroseconds)
 {
-	return ProcessYUYV(Image); //< no operations are performed on chroma
+	CLatencyScope LatencyScope(LATENCY_FORMAT_YVYU, OriginalImageWidth, OriginalImageHeight);
+
+	return ProcessYUYV(Image, DeadlineMicroseconds); //< no operations are performed on chroma
 }
 
 /// <summary>
@@ -403,8 +468,12 @@ int CBaseAltaLuxFilter::ProcessYVYU(void* Image)
 /// </summary>
 /// <param name="Image">image to be processed</param>
 /// <returns></returns>
-int CBaseAltaLuxFilter::ProcessGray(void* Image)
+int CBaseAltaLuxFilter::ProcessGray(void* Image, unsigned int DeadlineMicroseconds)
 {
+	CLatencyScope LatencyScope(LATENCY_FORMAT_GRAY, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_GRAY, DeadlineMicroseconds);
+
 	if (Image == nullptr)
 		return AL_NULL_IMAGE;
 
@@ -420,6 +489,31 @@ int CBaseAltaLuxFilter::ProcessGray(void* Image)
 	return AL_OK;
 }
 
+/// <summary>
+/// runs ProcessRows on consecutive bands of AL_CONVERSION_BAND_ROWS rows covering [0, NumRows), through ForEachBand
+/// </summary>
+/// <remarks>
+/// the bands do not overlap, so a conversion pass gives the same result however they are scheduled
+/// </remarks>
+void CBaseAltaLuxFilter::ForEachRowBand(int NumRows, const std::function<void(int FirstRow, int LastRow)>& ProcessRows)
+{
+	const int NumBands = (NumRows + AL_CONVERSION_BAND_ROWS - 1) / AL_CONVERSION_BAND_ROWS;
+	ForEachBand(NumBands, [&](int Band)
+	{
+		const int FirstRow = Band * AL_CONVERSION_BAND_ROWS;
+		ProcessRows(FirstRow, (FirstRow + AL_CONVERSION_BAND_ROWS < NumRows) ? FirstRow + AL_CONVERSION_BAND_ROWS : NumRows);
+	});
+}
+
+/// <summary>
+/// runs the bands [0, NumBands) of a conversion pass in order on the calling thread
+/// </summary>
+void CBaseAltaLuxFilter::ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand)
+{
+	for (int Band = 0; Band < NumBands; Band++)
+		ProcessBand(Band);
+}
+
 #include <mmintrin.h>
 
 /// Ey = 0.299*Er + 0.587*Eg + 0.114*Eb
@@ -444,134 +538,584 @@ int CBaseAltaLuxFilter::ProcessGeneric(void* Image, int FirstFactor, int SecondF
 	if (Image == nullptr)
 		return AL_NULL_IMAGE;
 
+	/// wait until the buffers of the call fit in the memory budget, then allocate them;
+	/// if the luminance plane does not fit or cannot be allocated, process the image by bands
+	CMemoryReservation Reservation(IMAGE_BUFFER_SIZE + GetMapArrayBytes(), GetBandBufferSize() + GetMapArrayBytes(), Priority);
+	if (!AllocateCallBuffer(Reservation))
+		return AL_OUT_OF_MEMORY;
+
+	/// perform processing on ImageBuffer, the interpolation shifts the channels of the generic RGB image
+	/// by the change of luminance of each pixel, as InjectLuminance would do in a separate pass
+	auto ImagePtr = static_cast<const unsigned char *>(Image);
+	WaitForTurn();
+	SetLumaOutput(Image, AL_OUTPUT_RGB, PixelOffset, 0);
+	NumThumbnailTiles = 0;
+	int RunReturn;
+	if (Reservation.IsReduced())
+	{
+		/// the bands are always in the row layout
+		RunReturn = RunBanded([&](int FirstRow, int LastRow)
+		{
+			ExtractLuminanceRows(ImagePtr, FirstFactor, SecondFactor, ThirdFactor, PixelOffset, FirstRow, LastRow);
+		});
+	}
+	else
+	{
+		/// extract Y component from generic RGB image
+		LumaTiled = TiledLayout;
+		ExtractLuminance(ImagePtr, FirstFactor, SecondFactor, ThirdFactor, PixelOffset);
+		RunReturn = Run();
+	}
+	if ((RunReturn == AL_OK) && (Thumbnail.Image != nullptr))
+		FinishThumbnail();
+	SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	LumaTiled = false;
+	ReleaseCallBuffer(Reservation);
+	if (RunReturn != AL_OK)
+		return RunReturn;
+
+	return AL_OK;
+}
+
+/// <summary>
+/// scaling factors of ExtractLuminance and InjectLuminance for the RGB and BGR byte orders
+/// </summary>
+/// <param name="IsBGR">true if the first byte of each pixel is blue</param>
+void CBaseAltaLuxFilter::GetLuminanceFactors(bool IsBGR, int& FirstFactor, int& SecondFactor, int& ThirdFactor)
+{
+	FirstFactor = IsBGR ? Y_BLUE_SCALE : Y_RED_SCALE;
+	SecondFactor = Y_GREEN_SCALE;
+	ThirdFactor = IsBGR ? Y_RED_SCALE : Y_BLUE_SCALE;
+}
+
+/// <summary>
+/// computes the luminance of a generic RGB image into ImageBuffer, in the tiled layout if LumaTiled is set
+/// </summary>
+/// <param name="Image">source image</param>
+/// <param name="FirstFactor">scaling factor for first byte of each pixel</param>
+/// <param name="SecondFactor">scaling factor for second byte of each pixel</param>
+/// <param name="ThirdFactor">scaling factor for third byte of each pixel</param>
+/// <param name="PixelOffset">distance in bytes between pixels (3 for RGB24, 4 for RGB32)</param>
+void CBaseAltaLuxFilter::ExtractLuminance(const unsigned char* Image, int FirstFactor, int SecondFactor,
+                                         int ThirdFactor, int PixelOffset)
+{
+	ExtractLuminanceRows(Image, FirstFactor, SecondFactor, ThirdFactor, PixelOffset, 0, OriginalImageHeight);
+}
+
+/// <summary>
+/// computes the luminance of some rows of a generic RGB image into ImageBuffer, from its row LumaBandTop
+/// in the row layout, or in the tiled layout if LumaTiled is set
+/// </summary>
+/// <param name="Image">source image</param>
+/// <param name="FirstFactor">scaling factor for first byte of each pixel</param>
+/// <param name="SecondFactor">scaling factor for second byte of each pixel</param>
+/// <param name="ThirdFactor">scaling factor for third byte of each pixel</param>
+/// <param name="PixelOffset">distance in bytes between pixels (3 for RGB24, 4 for RGB32)</param>
+/// <param name="FirstRow">first row of the image converted</param>
+/// <param name="LastRow">row after the last one converted</param>
+void CBaseAltaLuxFilter::ExtractLuminanceRows(const unsigned char* Image, int FirstFactor, int SecondFactor,
+                                             int ThirdFactor, int PixelOffset, int FirstRow, int LastRow)
+{
+	/// in the tiled layout each row is split among the blocks of its row of sub-matrices
+	const unsigned int NumSegments = LumaTiled ? (NumHorRegions + 1) : 1;
+
+	/// C code
+	ForEachRowBand(LastRow - FirstRow, [&](int FirstBandRow, int LastBandRow)
+	{
+		const unsigned char* ImagePtr = Image + static_cast<size_t>(FirstRow + FirstBandRow) * OriginalImageWidth * PixelOffset;
+		for (int y = FirstRow + FirstBandRow; y < FirstRow + LastBandRow; y++)
+		{
+			for (unsigned int Segment = 0; Segment < NumSegments; Segment++)
+			{
+				unsigned char* ImageBufferPtr = ImageBuffer + static_cast<size_t>(y - LumaBandTop) * OriginalImageWidth;
+				int SegmentWidth = OriginalImageWidth;
+				if (LumaTiled)
+				{
+					const unsigned int uiY = GetSubMatrixLine(y);
+					SegmentWidth = GetTileWidth(Segment);
+					ImageBufferPtr = GetTile(ImageBuffer, Segment, uiY) + static_cast<size_t>(y - GetSubMatrixTop(uiY)) * SegmentWidth;
+				}
+				for (int i = SegmentWidth; i > 0; i--)
+				{
+					int YValue = (ImagePtr[0] * FirstFactor) +
+						(ImagePtr[1] * SecondFactor) +
+						(ImagePtr[2] * ThirdFactor);
+					ImagePtr += PixelOffset;
+					YValue += 1 << (SCALING_LOG - 1);
+					YValue >>= SCALING_LOG;
+					if (YValue > 255)
+						YValue = 255;
+					*ImageBufferPtr = (unsigned char)YValue;
+					ImageBufferPtr++;
+				}
+			}
+		}
+	});
+}
+
+/// <summary>
+/// shifts the channels of each pixel of a generic RGB image by the difference between the processed luminance
+/// in ImageBuffer and its original luminance
+/// </summary>
+/// <param name="Image">image to be updated</param>
+/// <param name="FirstFactor">scaling factor for first byte of each pixel</param>
+/// <param name="SecondFactor">scaling factor for second byte of each pixel</param>
+/// <param name="ThirdFactor">scaling factor for third byte of each pixel</param>
+/// <param name="PixelOffset">distance in bytes between pixels (3 for RGB24, 4 for RGB32)</param>
+void CBaseAltaLuxFilter::InjectLuminance(unsigned char* Image, int FirstFactor, int SecondFactor,
+                                        int ThirdFactor, int PixelOffset)
+{
+	/// C code
+	ForEachRowBand(OriginalImageHeight, [&](int FirstRow, int LastRow)
+	{
+		unsigned char* ImagePtr = Image + static_cast<size_t>(FirstRow) * OriginalImageWidth * PixelOffset;
+		const unsigned char* ImageBufferPtr = ImageBuffer + static_cast<size_t>(FirstRow) * OriginalImageWidth;
+		for (int j = (LastRow - FirstRow) * OriginalImageWidth; j > 0; j--)
+		{
+			int OldYValue = (ImagePtr[0] * FirstFactor) +
+				(ImagePtr[1] * SecondFactor) +
+				(ImagePtr[2] * ThirdFactor);
+			OldYValue += 1 << (SCALING_LOG - 1);
+			OldYValue >>= SCALING_LOG;
+			if (OldYValue > 255)
+				OldYValue = 255;
+			int DiffYValue = (int)(*ImageBufferPtr) - OldYValue;
+			if (DiffYValue < 0)
+			{
+				int NewVal0 = DiffYValue;
+				NewVal0 += ImagePtr[0];
+				if (NewVal0 < 0)
+					NewVal0 = 0;
+				ImagePtr[0] = (unsigned char)NewVal0;
+
+				int NewVal1 = DiffYValue;
+				NewVal1 += ImagePtr[1];
+				if (NewVal1 < 0)
+					NewVal1 = 0;
+				ImagePtr[1] = (unsigned char)NewVal1;
+
+				int NewVal2 = DiffYValue;
+				NewVal2 += ImagePtr[2];
+				if (NewVal2 < 0)
+					NewVal2 = 0;
+				ImagePtr[2] = (unsigned char)NewVal2;
+			}
+			else
+			{
+				int NewVal0 = DiffYValue;
+				NewVal0 += ImagePtr[0];
+				if (NewVal0 > 255)
+					NewVal0 = 255;
+				ImagePtr[0] = (unsigned char)NewVal0;
+
+				int NewVal1 = DiffYValue;
+				NewVal1 += ImagePtr[1];
+				if (NewVal1 > 255)
+					NewVal1 = 255;
+				ImagePtr[1] = (unsigned char)NewVal1;
+
+				int NewVal2 = DiffYValue;
+				NewVal2 += ImagePtr[2];
+				if (NewVal2 > 255)
+					NewVal2 = 255;
+				ImagePtr[2] = (unsigned char)NewVal2;
+			}
+
+			ImagePtr += PixelOffset;
+			ImageBufferPtr++;
+		}
+	});
+}
+
+
+/// <summary>
+/// selects where the interpolation writes the processed luminance
+/// </summary>
+/// <param name="Image">image receiving the luminance, nullptr to replace the original luminance in ImageBuffer</param>
+/// <param name="Layout">AL_OUTPUT_XXX</param>
+/// <param name="PixelOffset">distance in bytes between pixels of Image</param>
+/// <param name="LumaOffset">offset of the luma byte in a packed YUV pixel</param>
+/// <remarks>
+/// ImageBuffer must hold the luminance extracted from Image, and it is left unchanged by the interpolation
+/// </remarks>
+void CBaseAltaLuxFilter::SetLumaOutput(void* Image, int Layout, int PixelOffset, int LumaOffset)
+{
+	Output.Image = static_cast<unsigned char *>(Image);
+	Output.Layout = (Image != nullptr) ? Layout : AL_OUTPUT_IN_PLACE;
+	Output.PixelOffset = PixelOffset;
+	Output.LumaOffset = LumaOffset;
+}
+
+/// <summary>
+/// writes a segment of a row of interpolated luminance into the pixels of Output.Image
+/// </summary>
+/// <param name="pOriginalLuma">original luminance of the segment in ImageBuffer</param>
+/// <param name="pNewLuma">interpolated luminance of the segment</param>
+/// <param name="Count">pixels in the segment</param>
+void CBaseAltaLuxFilter::WriteInterpolatedLuma(const PixelType* pOriginalLuma, const PixelType* pNewLuma, unsigned int Count)
+{
+	const size_t FirstPixel = GetImageOffset(pOriginalLuma);
+	unsigned char* ImagePtr = Output.Image + FirstPixel * Output.PixelOffset;
+
+	if (Output.Layout == AL_OUTPUT_PACKED_YUV)
+	{
+		ImagePtr += Output.LumaOffset;
+		for (unsigned int i = 0; i < Count; i++, ImagePtr += Output.PixelOffset)
+			*ImagePtr = pNewLuma[i];
+		return;
+	}
+
+	/// same shift as InjectLuminance, whose recomputed luminance is the one still in ImageBuffer
+	for (unsigned int i = 0; i < Count; i++, ImagePtr += Output.PixelOffset)
+	{
+		const int DiffYValue = (int)pNewLuma[i] - (int)pOriginalLuma[i];
+		if (DiffYValue == 0)
+			continue;
+		for (int Channel = 0; Channel < 3; Channel++)
+		{
+			int NewValue = ImagePtr[Channel] + DiffYValue;
+			if (NewValue < 0)
+				NewValue = 0;
+			if (NewValue > 255)
+				NewValue = 255;
+			ImagePtr[Channel] = (unsigned char)NewValue;
+		}
+	}
+}
+
+/// <summary>
+/// sub-matrix column of a column of the image, refer to InterpolateSubMatrix for the geometry
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetSubMatrixColumn(unsigned int x) const
+{
+	const unsigned int HalfWidth = RegionWidth >> 1;
+	if (x < HalfWidth)
+		return 0;
+	return std::min(1 + (x - HalfWidth) / RegionWidth, NumHorRegions);
+}
+
+/// <summary>
+/// sub-matrix row of a row of the image, refer to InterpolateSubMatrix for the geometry
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetSubMatrixLine(unsigned int y) const
+{
+	const unsigned int HalfHeight = RegionHeight >> 1;
+	if (y < HalfHeight)
+		return 0;
+	return std::min(1 + (y - HalfHeight) / RegionHeight, NumVertRegions);
+}
+
+/// <summary>
+/// first column of a sub-matrix, refer to InterpolateSubMatrix for the geometry
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetSubMatrixLeft(unsigned int uiX) const
+{
+	return (uiX == 0) ? 0 : (RegionWidth >> 1) + (uiX - 1) * RegionWidth;
+}
+
+/// <summary>
+/// first row of a sub-matrix, refer to InterpolateSubMatrix for the geometry
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetSubMatrixTop(unsigned int uiY) const
+{
+	return (uiY == 0) ? 0 : (RegionHeight >> 1) + (uiY - 1) * RegionHeight;
+}
+
+/// <summary>
+/// width of the blocks of a column of sub-matrices in the tiled layout; the blocks of the right column
+/// also hold the last column of the image, that is not interpolated when the regions have an odd width
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetTileWidth(unsigned int uiX) const
+{
+	return ((uiX == NumHorRegions) ? OriginalImageWidth : GetSubMatrixLeft(uiX + 1)) - GetSubMatrixLeft(uiX);
+}
+
+/// <summary>
+/// height of the blocks of a row of sub-matrices in the tiled layout, refer to GetTileWidth
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetTileHeight(unsigned int uiY) const
+{
+	return ((uiY == NumVertRegions) ? OriginalImageHeight : GetSubMatrixTop(uiY + 1)) - GetSubMatrixTop(uiY);
+}
+
+/// <summary>
+/// first pixel of the block of a sub-matrix in the tiled layout. The blocks of a row of sub-matrices follow each other
+/// from left to right and together take the same space as the rows of the image they cover
+/// </summary>
+PixelType* CBaseAltaLuxFilter::GetTile(PixelType* pImage, unsigned int uiX, unsigned int uiY) const
+{
+	return pImage + static_cast<size_t>(GetSubMatrixTop(uiY)) * OriginalImageWidth +
+		static_cast<size_t>(GetSubMatrixLeft(uiX)) * GetTileHeight(uiY);
+}
+
+/// <summary>
+/// position in the image of a pixel of ImageBuffer, that is its offset in ImageBuffer plus the rows above LumaBandTop
+/// unless LumaTiled is set
+/// </summary>
+size_t CBaseAltaLuxFilter::GetImageOffset(const PixelType* pLuma) const
+{
+	const size_t Offset = pLuma - ImageBuffer;
+	if (!LumaTiled)
+		return Offset + static_cast<size_t>(LumaBandTop) * OriginalImageWidth;
+
+	/// row of blocks, then block in that row, then pixel in that block
+	const size_t FirstRowSize = static_cast<size_t>(RegionHeight >> 1) * OriginalImageWidth;
+	const unsigned int uiY = (Offset < FirstRowSize) ? 0 :
+		std::min(1 + static_cast<unsigned int>((Offset - FirstRowSize) / (static_cast<size_t>(RegionHeight) * OriginalImageWidth)), NumVertRegions);
+	const unsigned int Top = GetSubMatrixTop(uiY);
+	const size_t TileHeight = GetTileHeight(uiY);
+	const size_t RowOffset = Offset - static_cast<size_t>(Top) * OriginalImageWidth;
+	const size_t FirstTileSize = (RegionWidth >> 1) * TileHeight;
+	const unsigned int uiX = (RowOffset < FirstTileSize) ? 0 :
+		std::min(1 + static_cast<unsigned int>((RowOffset - FirstTileSize) / (RegionWidth * TileHeight)), NumHorRegions);
+	const unsigned int Left = GetSubMatrixLeft(uiX);
+	const size_t TileOffset = RowOffset - Left * TileHeight;
+	const size_t TileWidth = GetTileWidth(uiX);
+	return (Top + TileOffset / TileWidth) * OriginalImageWidth + Left + TileOffset % TileWidth;
+}
+
+/// <summary>
+/// down-samples into Thumbnail the blocks of pixels lying entirely inside a sub-matrix whose result
+/// has just been written to Output.Image; the blocks across the borders of the sub-matrices are left to FinishThumbnail
+/// </summary>
+/// <param name="Left">left column of the sub-matrix</param>
+/// <param name="Top">top row of the sub-matrix</param>
+/// <param name="Width">width of the sub-matrix</param>
+/// <param name="Height">height of the sub-matrix</param>
+void CBaseAltaLuxFilter::RenderThumbnailTile(unsigned int Left, unsigned int Top, unsigned int Width, unsigned int Height)
+{
+	const unsigned int Factor = Thumbnail.ScalingFactor;
+	const unsigned int FirstX = (Left + Factor - 1) / Factor;
+	const unsigned int FirstY = (Top + Factor - 1) / Factor;
+	const unsigned int EndX = std::min((Left + Width) / Factor, OriginalImageWidth / Factor);
+	const unsigned int EndY = std::min((Top + Height) / Factor, OriginalImageHeight / Factor);
+	if ((EndX > FirstX) && (EndY > FirstY))
+		ScaleDownImageRect(Output.Image, OriginalImageWidth, Thumbnail.Image, OriginalImageWidth / Factor, Factor,
+		                   Output.PixelOffset, FirstX, FirstY, EndX - FirstX, EndY - FirstY);
+	NumThumbnailTiles++;
+}
+
+/// <summary>
+/// completes Thumbnail after Run, down-sampling the blocks of pixels across the borders of the sub-matrices.
+/// If Run did not interpolate every sub-matrix, e.g. because the strength leaves the image as is,
+/// the whole thumbnail is down-sampled from Output.Image
+/// </summary>
+void CBaseAltaLuxFilter::FinishThumbnail()
+{
+	const int Factor = Thumbnail.ScalingFactor;
+	if (NumThumbnailTiles != (NumHorRegions + 1) * (NumVertRegions + 1))
+	{
+		ScaleDownImage(Output.Image, OriginalImageWidth, OriginalImageHeight, Thumbnail.Image, Factor, Output.PixelOffset);
+		return;
+	}
+
+	const int ThumbnailWidth = OriginalImageWidth / Factor;
+	const int ThumbnailHeight = OriginalImageHeight / Factor;
+	for (int y = 0; y < ThumbnailHeight; y++)
+	{
+		if (GetSubMatrixLine(y * Factor) != GetSubMatrixLine(y * Factor + Factor - 1))
+		{
+			ScaleDownImageRect(Output.Image, OriginalImageWidth, Thumbnail.Image, ThumbnailWidth, Factor,
+			                   Output.PixelOffset, 0, y, ThumbnailWidth, 1);
+			continue;
+		}
+		/// the blocks crossed by the left border of a sub-matrix, walked from the borders so that Run stays free of allocations;
+		/// with regions narrower than Factor several borders cross the same block, that is down-sampled once
+		int LastColumn = -1;
+		for (unsigned int uiX = 1; uiX <= NumHorRegions; uiX++)
+		{
+			const unsigned int Left = GetSubMatrixLeft(uiX);
+			const int x = static_cast<int>(Left / Factor);
+			if ((Left % Factor == 0) || (x >= ThumbnailWidth) || (x == LastColumn))
+				continue;
+			ScaleDownImageRect(Output.Image, OriginalImageWidth, Thumbnail.Image, ThumbnailWidth, Factor,
+			                   Output.PixelOffset, x, y, 1, 1);
+			LastColumn = x;
+		}
+	}
+}
+
+int CBaseAltaLuxFilter::ProcessRGB24(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_RGB24, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_RGB24, DeadlineMicroseconds);
+
+	return ProcessGeneric(Image, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, 3);
+}
+
+int CBaseAltaLuxFilter::ProcessRGB32(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_RGB32, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_RGB32, DeadlineMicroseconds);
+
+	return ProcessGeneric(Image, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, 4);
+}
+
+int CBaseAltaLuxFilter::ProcessBGR24(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_BGR24, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_BGR24, DeadlineMicroseconds);
+
+	return ProcessGeneric(Image, Y_BLUE_SCALE, Y_GREEN_SCALE, Y_RED_SCALE, 3);
+}
+
+int CBaseAltaLuxFilter::ProcessBGR32(void* Image, unsigned int DeadlineMicroseconds)
+{
+	CLatencyScope LatencyScope(LATENCY_FORMAT_BGR32, OriginalImageWidth, OriginalImageHeight);
+	CPriorityJob PriorityJob(Priority);
+	CDeadlineScope DeadlineScope(this, LATENCY_FORMAT_BGR32, DeadlineMicroseconds);
+
+	return ProcessGeneric(Image, Y_BLUE_SCALE, Y_GREEN_SCALE, Y_RED_SCALE, 4);
+}
+
+/// private methods
+
+/// <summary>
+/// allocates ImageBuffer, unless it is already allocated
+/// </summary>
+/// <returns>false if there is not enough memory</returns>
+bool CBaseAltaLuxFilter::AllocateImageBuffer()
+{
+	return AllocateLumaBuffer(IMAGE_BUFFER_SIZE);
+}
+
+/// <summary>
+/// makes ImageBuffer Size bytes long, reallocating it only if it has a different size
+/// </summary>
+bool CBaseAltaLuxFilter::AllocateLumaBuffer(size_t Size)
+{
+	if ((ImageBuffer != nullptr) && (ImageBufferSize == Size))
+		return true;
+	ReleaseImageBuffer();
+	try
+	{
+		ImageBuffer = new unsigned char[Size];
+	}
+	catch (...)
+	{
+		ImageBuffer = nullptr;
+	}
+	if (ImageBuffer == nullptr)
+		return false;
+	ImageBufferSize = Size;
+	TrackAllocation(ImageBufferSize);
+	return true;
+}
+
+void CBaseAltaLuxFilter::ReleaseImageBuffer()
+{
 	if (ImageBuffer == nullptr)
+		return;
+	try
 	{
-		/// if ImageBuffer allocation failed in the constructor, try again
-		/// if it still fails, return AL_OUT_OF_MEMORY
-		try
-		{
-			ImageBuffer = new unsigned char[IMAGE_BUFFER_SIZE];
-		}
-		catch (...)
-		{
-			ImageBuffer = nullptr;
-		}
-		if (ImageBuffer == nullptr)
-			return AL_OUT_OF_MEMORY;
+		delete[] ImageBuffer;
 	}
-
-	/// extract Y component from generic RGB image
-	unsigned char* ImagePtr = (unsigned char *)Image;
-	unsigned char* ImageBufferPtr = (unsigned char *)ImageBuffer;
-
-	/// C code
-	for (int i = (OriginalImageWidth * OriginalImageHeight); i > 0; i--)
-	{
-		int YValue = (ImagePtr[0] * FirstFactor) +
-			(ImagePtr[1] * SecondFactor) +
-			(ImagePtr[2] * ThirdFactor);
-		ImagePtr += PixelOffset;
-		YValue += 1 << (SCALING_LOG - 1);
-		YValue >>= SCALING_LOG;
-		if (YValue > 255)
-			YValue = 255;
-		*ImageBufferPtr = (unsigned char)YValue;
-		ImageBufferPtr++;
-	}
-
-	/// perform processing on ImageBuffer
-	int RunReturn = Run();
-	if (RunReturn != AL_OK)
-		return RunReturn;
-
-	/// inject Y component back into generic RGB image
-	ImagePtr = (unsigned char *)Image;
-	ImageBufferPtr = (unsigned char *)ImageBuffer;
-
-	/// C code
-	for (int j = (OriginalImageWidth * OriginalImageHeight); j > 0; j--)
-	{
-		int OldYValue = (ImagePtr[0] * FirstFactor) +
-			(ImagePtr[1] * SecondFactor) +
-			(ImagePtr[2] * ThirdFactor);
-		OldYValue += 1 << (SCALING_LOG - 1);
-		OldYValue >>= SCALING_LOG;
-		if (OldYValue > 255)
-			OldYValue = 255;
-		int DiffYValue = (int)(*ImageBufferPtr) - OldYValue;
-		if (DiffYValue < 0)
-		{
-			int NewVal0 = DiffYValue;
-			NewVal0 += ImagePtr[0];
-			if (NewVal0 < 0)
-				NewVal0 = 0;
-			ImagePtr[0] = (unsigned char)NewVal0;
-
-			int NewVal1 = DiffYValue;
-			NewVal1 += ImagePtr[1];
-			if (NewVal1 < 0)
-				NewVal1 = 0;
-			ImagePtr[1] = (unsigned char)NewVal1;
-
-			int NewVal2 = DiffYValue;
-			NewVal2 += ImagePtr[2];
-			if (NewVal2 < 0)
-				NewVal2 = 0;
-			ImagePtr[2] = (unsigned char)NewVal2;
-		}
-		else
-		{
-			int NewVal0 = DiffYValue;
-			NewVal0 += ImagePtr[0];
-			if (NewVal0 > 255)
-				NewVal0 = 255;
-			ImagePtr[0] = (unsigned char)NewVal0;
-
-			int NewVal1 = DiffYValue;
-			NewVal1 += ImagePtr[1];
-			if (NewVal1 > 255)
-				NewVal1 = 255;
-			ImagePtr[1] = (unsigned char)NewVal1;
-
-			int NewVal2 = DiffYValue;
-			NewVal2 += ImagePtr[2];
-			if (NewVal2 > 255)
-				NewVal2 = 255;
-			ImagePtr[2] = (unsigned char)NewVal2;
-		}
-
-		ImagePtr += PixelOffset;
-		ImageBufferPtr++;
+	catch (...)
+	{
 	}
+	ImageBuffer = nullptr;
+	TrackRelease(ImageBufferSize);
+	ImageBufferSize = 0;
+}
 
-	return AL_OK;
+/// <summary>
+/// allocates ImageBuffer for a ProcessXXX call admitted with Reservation: the whole luminance plane,
+/// or the band of RunBanded if the reservation is reduced or the plane cannot be allocated
+/// </summary>
+/// <returns>false if not even the band can be allocated</returns>
+bool CBaseAltaLuxFilter::AllocateCallBuffer(CMemoryReservation& Reservation)
+{
+	if (!Reservation.IsReduced())
+	{
+		if (AllocateImageBuffer())
+			return true;
+		Reservation.Reduce();
+	}
+	return AllocateLumaBuffer(GetBandBufferSize());
 }
 
+/// <summary>
+/// releases ImageBuffer at the end of a ProcessXXX call if it is not kept across calls: under a memory budget,
+/// as the memory is given back with the reservation, and when it holds a band, so that the next call
+/// tries again to allocate the whole plane
+/// </summary>
+void CBaseAltaLuxFilter::ReleaseCallBuffer(const CMemoryReservation& Reservation)
+{
+	if (Reservation.IsReduced() || CMemoryBudget::GetInstance().IsLimited())
+		ReleaseImageBuffer();
+}
 
-int CBaseAltaLuxFilter::ProcessRGB24(void* Image)
+/// <summary>
+/// bytes of the band of RunBanded: the rows of a contextual region, or of the tallest row of sub-matrices,
+/// plus one row as for IMAGE_BUFFER_SIZE
+/// </summary>
+size_t CBaseAltaLuxFilter::GetBandBufferSize() const
 {
-	return ProcessGeneric(Image, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, 3);
+	const unsigned int BandRows = std::max(static_cast<unsigned int>(RegionHeight), GetTileHeight(NumVertRegions));
+	return static_cast<size_t>(BandRows + 1) * OriginalImageWidth;
 }
 
-int CBaseAltaLuxFilter::ProcessRGB32(void* Image)
+/// <summary>
+/// bytes of the allocation of GetMapArray for the current grid
+/// </summary>
+size_t CBaseAltaLuxFilter::GetMapArrayBytes() const
 {
-	return ProcessGeneric(Image, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, 4);
+	return (GetMapArraySize() + GetMapArraySize() / NUM_GRAY_LEVELS) * sizeof(MapType);
 }
 
-int CBaseAltaLuxFilter::ProcessBGR24(void* Image)
+/// <summary>
+/// returns the buffer for the graylevel mappings of the current grid, it is reallocated only when the grid grows.
+/// The same allocation holds the IdentityMaps flags after the mappings
+/// </summary>
+/// <returns>nullptr if there is not enough memory</returns>
+MapType* CBaseAltaLuxFilter::GetMapArray()
 {
-	return ProcessGeneric(Image, Y_BLUE_SCALE, Y_GREEN_SCALE, Y_RED_SCALE, 3);
+	const unsigned int MapArraySize = GetMapArraySize();
+	if (MapArraySize <= MapArrayCapacity)
+		return MapArray;
+	if (MapArray)
+	{
+		delete[] MapArray;
+		MapArray = nullptr;
+		IdentityMaps = nullptr;
+		TrackRelease((MapArrayCapacity + MapArrayCapacity / NUM_GRAY_LEVELS) * sizeof(MapType));
+		MapArrayCapacity = 0;
+	}
+	try
+	{
+		MapArray = new MapType[MapArraySize + MapArraySize / NUM_GRAY_LEVELS];
+	}
+	catch (...)
+	{
+		MapArray = nullptr;
+	}
+	if (MapArray == nullptr)
+		return nullptr;
+	MapArrayCapacity = MapArraySize;
+	IdentityMaps = MapArray + MapArrayCapacity;
+	TrackAllocation((MapArrayCapacity + MapArrayCapacity / NUM_GRAY_LEVELS) * sizeof(MapType));
+	return MapArray;
 }
 
-int CBaseAltaLuxFilter::ProcessBGR32(void* Image)
+void CBaseAltaLuxFilter::TrackAllocation(size_t Bytes)
 {
-	return ProcessGeneric(Image, Y_BLUE_SCALE, Y_GREEN_SCALE, Y_RED_SCALE, 4);
+	Allocations.NumAllocations++;
+	Allocations.AllocatedBytes += Bytes;
+	Allocations.CurrentBytes += Bytes;
+	if (Allocations.CurrentBytes > Allocations.PeakBytes)
+		Allocations.PeakBytes = Allocations.CurrentBytes;
 }
 
-/// private methods
+void CBaseAltaLuxFilter::TrackRelease(size_t Bytes)
+{
+	Allocations.CurrentBytes -= Bytes;
+}
 
 
-#ifdef _WIN64
+#ifndef _M_IX86
 	void FloatToInt(unsigned int *int_pointer, float f)
 	{
 		*int_pointer = (unsigned int)f;
@@ -587,7 +1131,7 @@ __forceinline void FloatToInt(unsigned int* int_pointer, float f)
 		fistp dword ptr[edx];
 	}
 }
-#endif  // _WIN64
+#endif  // _M_IX86
 
 void CBaseAltaLuxFilter::ClipHistogram(unsigned int* pHistogram, unsigned int ClipLimit)
 /* This function performs clipping of the histogram and redistribution of bins.
@@ -640,6 +1184,7 @@ void CBaseAltaLuxFilter::ClipHistogram(unsigned int* pHistogram, unsigned int Cl
 		/// Redistribute remaining excess
 		pulEndPointer = &pHistogram[NUM_GRAY_LEVELS];
 		pulHisto = pHistogram;
+		const unsigned int ulPrevNrExcess = ulNrExcess;
 
 		while (ulNrExcess && pulHisto < pulEndPointer)
 		{
@@ -656,6 +1201,9 @@ void CBaseAltaLuxFilter::ClipHistogram(unsigned int* pHistogram, unsigned int Cl
 			}
 			pulHisto++; //< restart redistributing on other bin location
 		}
+		/// on small regions the excess can exceed the room left below the cliplimit, when all bins are full stop
+		if (ulNrExcess == ulPrevNrExcess)
+			break;
 	}
 }
 
@@ -677,12 +1225,74 @@ void CBaseAltaLuxFilter::MakeHistogram(PixelType* pImage, unsigned int* pHistogr
 	}
 }
 
-void CBaseAltaLuxFilter::MapHistogram(unsigned int* pHistogram, unsigned int NumOfPixels)
+/// <summary>
+/// histogram of one pixel out of Step in both directions of a contextual region,
+/// holding GetHistogramSampleCount() pixels
+/// </summary>
+void CBaseAltaLuxFilter::MakeSubsampledHistogram(PixelType* pImage, unsigned int* pHistogram, unsigned int Step)
+{
+	/// clear histogram
+	memset(pHistogram, 0, sizeof(unsigned int) * NUM_GRAY_LEVELS);
+
+	for (int i = 0; i < RegionHeight; i += Step)
+	{
+		const PixelType* pRow = &pImage[i * OriginalImageWidth];
+		for (int j = 0; j < RegionWidth; j += Step)
+			pHistogram[pRow[j]]++;
+	}
+}
+
+/// <summary>
+/// histogram of a contextual region stored in the tiled layout, where it spans the corners of up to four blocks.
+/// The same pixels as MakeHistogram, or MakeSubsampledHistogram with the same Step, are counted
+/// </summary>
+/// <param name="pImage">image in the tiled layout</param>
+/// <param name="uiX">column of the contextual region, in [0..NumHorRegions-1]</param>
+/// <param name="uiY">row of the contextual region, in [0..NumVertRegions-1]</param>
+void CBaseAltaLuxFilter::MakeTiledHistogram(PixelType* pImage, unsigned int uiX, unsigned int uiY,
+                                            unsigned int* pHistogram, unsigned int Step)
+{
+	/// clear histogram
+	memset(pHistogram, 0, sizeof(unsigned int) * NUM_GRAY_LEVELS);
+
+	/// same rows as the region located by GetSubMatrixRow
+	const unsigned int RegionLeft = uiX * RegionWidth;
+	const unsigned int RegionTop = GetSubMatrixTop(uiY);
+	for (unsigned int uiTileY = GetSubMatrixLine(RegionTop); uiTileY <= GetSubMatrixLine(RegionTop + RegionHeight - 1); uiTileY++)
+	{
+		const unsigned int TileTop = GetSubMatrixTop(uiTileY);
+		/// first row of the region in the block that is sampled
+		unsigned int FirstRow = std::max(RegionTop, TileTop);
+		FirstRow += (Step - (FirstRow - RegionTop) % Step) % Step;
+		const unsigned int EndRow = std::min(RegionTop + RegionHeight, TileTop + GetTileHeight(uiTileY));
+		for (unsigned int uiTileX = GetSubMatrixColumn(RegionLeft); uiTileX <= GetSubMatrixColumn(RegionLeft + RegionWidth - 1); uiTileX++)
+		{
+			const unsigned int TileLeft = GetSubMatrixLeft(uiTileX);
+			const unsigned int TileWidth = GetTileWidth(uiTileX);
+			unsigned int FirstColumn = std::max(RegionLeft, TileLeft);
+			FirstColumn += (Step - (FirstColumn - RegionLeft) % Step) % Step;
+			const unsigned int EndColumn = std::min(RegionLeft + RegionWidth, TileLeft + TileWidth);
+
+			const PixelType* pTile = GetTile(pImage, uiTileX, uiTileY);
+			for (unsigned int y = FirstRow; y < EndRow; y += Step)
+			{
+				const PixelType* pRow = pTile + static_cast<size_t>(y - TileTop) * TileWidth;
+				for (unsigned int x = FirstColumn - TileLeft; x < EndColumn - TileLeft; x += Step)
+					pHistogram[pRow[x]]++;
+			}
+		}
+	}
+}
+
+bool CBaseAltaLuxFilter::MapHistogram(unsigned int* pHistogram, unsigned int NumOfPixels, MapType* pMap)
 /* This function calculates the equalized lookup table (mapping) by
- * cumulating the input histogram. Lookup table is rescaled in range [0..255].
+ * cumulating the input histogram. Lookup table is rescaled in range [0..255]
+ * and stored in pMap, as a mapped value always fits in a MapType.
+ * Returns true if no mapped value is farther than IdentityTolerance from its graylevel.
  */
 {
 	unsigned int HistoSum = 0;
+	unsigned int MaxDistance = 0; //< from the identity
 	const float Scale = ((float)MAX_GRAY_VALUE) / NumOfPixels;
 
 	for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
@@ -690,25 +1300,45 @@ void CBaseAltaLuxFilter::MapHistogram(unsigned int* pHistogram, unsigned int Num
 		HistoSum += pHistogram[i];
 		unsigned int TargetValue;
 		FloatToInt(&TargetValue, HistoSum * Scale);
-		pHistogram[i] = min(MAX_GRAY_VALUE, TargetValue);
+		TargetValue = std::min(MAX_GRAY_VALUE, TargetValue);
+		pMap[i] = (MapType)TargetValue;
+		MaxDistance = std::max(MaxDistance, (TargetValue > i) ? (TargetValue - i) : (i - TargetValue));
 	}
+	return MaxDistance <= IdentityTolerance;
+}
+
+/// <summary>
+/// interleaves the mappings of the four contextual regions around a sub-matrix, already scaled by 2^AL_APPROX_MAP_SHIFT,
+/// so that the approximate interpolation reads all the mappings of a pixel with a single load instead of one load from each table
+/// </summary>
+/// <param name="pQuadMap">NUM_GRAY_LEVELS entries, refer to QuadMapType</param>
+void CBaseAltaLuxFilter::MakeQuadMap(const MapType* pMapLU, const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+                                     QuadMapType* pQuadMap)
+{
+	for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
+		pQuadMap[i] = (static_cast<QuadMapType>(pMapLU[i]) |
+			(static_cast<QuadMapType>(pMapRU[i]) << 16) |
+			(static_cast<QuadMapType>(pMapLB[i]) << 32) |
+			(static_cast<QuadMapType>(pMapRB[i]) << 48)) << AL_APPROX_MAP_SHIFT;
 }
 
 void CBaseAltaLuxFilter::Interpolate(PixelType* pImage,
-                                     unsigned int* pMapLeftUp, unsigned int* pMapRightUp,
-                                     unsigned int* pMapLeftBottom, unsigned int* pMapRightBottom,
-                                     unsigned int MatrixWidth, unsigned int MatrixHeight)
+                                     const MapType* pMapLeftUp, const MapType* pMapRightUp,
+                                     const MapType* pMapLeftBottom, const MapType* pMapRightBottom,
+                                     unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride)
 /* pImage		- pointer to input/output image
  * pMap*		- mappings of greylevels from histograms
  * MatrixWidth  - MatrixWidth of image submatrix
  * MatrixHeight - MatrixHeight of image submatrix
+ * RowStride	- distance in pixels between the rows of the submatrix
  * This function calculates the new greylevel assignments of pixels within a submatrix
  * of the image with size MatrixWidth and MatrixHeight. This is done by a bilinear interpolation
  * between four different mappings in order to eliminate boundary artifacts.
  */
 {
-	const unsigned int PtrIncr = OriginalImageWidth - MatrixWidth; //< pointer increment after processing row
 	unsigned int MatrixArea = MatrixWidth * MatrixHeight; //< normalization factor
+	PixelType NewLuma[AL_OUTPUT_CHUNK]; //< interpolated pixels, when they are not written back in place
+	const bool InPlace = (Output.Layout == AL_OUTPUT_IN_PLACE);
 
 	if (MatrixArea & (MatrixArea - 1))
 	{
@@ -720,19 +1350,27 @@ void CBaseAltaLuxFilter::Interpolate(PixelType* pImage,
 		// huge images
 		for (unsigned int YCoef = 0, YInvCoef = MatrixHeight;
 		     YCoef < MatrixHeight;
-		     YCoef++, YInvCoef--, pImage += PtrIncr)
+		     YCoef++, YInvCoef--, pImage += RowStride)
 		{
-			for (unsigned int XCoef = 0, XInvCoef = MatrixWidth;
-			     XCoef < MatrixWidth;
-			     XCoef++, XInvCoef--)
+			for (unsigned int FirstColumn = 0; FirstColumn < MatrixWidth; FirstColumn += AL_OUTPUT_CHUNK)
 			{
-				PixelType GreyValue = *pImage; //< get histogram bin value
+				const unsigned int ChunkWidth = std::min(MatrixWidth - FirstColumn, AL_OUTPUT_CHUNK);
+				const PixelType* pSource = pImage + FirstColumn;
+				PixelType* pTarget = InPlace ? (pImage + FirstColumn) : NewLuma;
+				for (unsigned int i = 0, XCoef = FirstColumn, XInvCoef = MatrixWidth - FirstColumn;
+				     i < ChunkWidth;
+				     i++, XCoef++, XInvCoef--)
+				{
+					PixelType GreyValue = pSource[i]; //< get histogram bin value
 
-				*pImage++ = (PixelType)((YInvCoef * (XInvCoef * pMapLeftUp[GreyValue]
-						+ XCoef * pMapRightUp[GreyValue])
-					+ YCoef * (XInvCoef * pMapLeftBottom[GreyValue]
-						+ XCoef * pMapRightBottom[GreyValue])
-					+ (MatrixArea >> 1)) / MatrixArea);
+					pTarget[i] = (PixelType)((YInvCoef * (XInvCoef * pMapLeftUp[GreyValue]
+							+ XCoef * pMapRightUp[GreyValue])
+						+ YCoef * (XInvCoef * pMapLeftBottom[GreyValue]
+							+ XCoef * pMapRightBottom[GreyValue])
+						+ (MatrixArea >> 1)) / MatrixArea);
+				}
+				if (!InPlace)
+					WriteInterpolatedLuma(pSource, NewLuma, ChunkWidth);
 			}
 		}
 	}
@@ -744,77 +1382,394 @@ void CBaseAltaLuxFilter::Interpolate(PixelType* pImage,
 			ShiftIndex++; //< Calculate log2 of MatrixArea
 		for (unsigned int YCoef = 0, YInvCoef = MatrixHeight;
 		     YCoef < MatrixHeight;
-		     YCoef++, YInvCoef--, pImage += PtrIncr)
+		     YCoef++, YInvCoef--, pImage += RowStride)
 		{
-			for (unsigned int XCoef = 0, XInvCoef = MatrixWidth;
-			     XCoef < MatrixWidth;
-			     XCoef++, XInvCoef--)
+			for (unsigned int FirstColumn = 0; FirstColumn < MatrixWidth; FirstColumn += AL_OUTPUT_CHUNK)
 			{
-				PixelType GreyValue = *pImage; //< get histogram bin value
-				*pImage++ = (PixelType)((YInvCoef * (XInvCoef * pMapLeftUp[GreyValue]
-						+ XCoef * pMapRightUp[GreyValue])
-					+ YCoef * (XInvCoef * pMapLeftBottom[GreyValue]
-						+ XCoef * pMapRightBottom[GreyValue])) >> ShiftIndex);
+				const unsigned int ChunkWidth = std::min(MatrixWidth - FirstColumn, AL_OUTPUT_CHUNK);
+				const PixelType* pSource = pImage + FirstColumn;
+				PixelType* pTarget = InPlace ? (pImage + FirstColumn) : NewLuma;
+				for (unsigned int i = 0, XCoef = FirstColumn, XInvCoef = MatrixWidth - FirstColumn;
+				     i < ChunkWidth;
+				     i++, XCoef++, XInvCoef--)
+				{
+					PixelType GreyValue = pSource[i]; //< get histogram bin value
+					pTarget[i] = (PixelType)((YInvCoef * (XInvCoef * pMapLeftUp[GreyValue]
+							+ XCoef * pMapRightUp[GreyValue])
+						+ YCoef * (XInvCoef * pMapLeftBottom[GreyValue]
+							+ XCoef * pMapRightBottom[GreyValue])) >> ShiftIndex);
+				}
+				if (!InPlace)
+					WriteInterpolatedLuma(pSource, NewLuma, ChunkWidth);
 			}
 		}
 	}
 }
 
-void CBaseAltaLuxFilter::CalcGraylevelMappings(int uiY, unsigned int ulClipLimit, unsigned int* pulMapArray)
+/// <summary>
+/// checks once if the CPU supports SSSE3, that is required by InterpolateApproximateSSSE3
+/// </summary>
+bool CBaseAltaLuxFilter::IsSSSE3Supported()
 {
-	PixelType* pImage = (PixelType *)ImageBuffer;
-	PixelType* pImPointer = pImage; //< pointer to image
+	static const bool SSSE3Supported = []()
+	{
+#ifdef _MSC_VER
+		int CPUInfo[4];
+		__cpuid(CPUInfo, 1);
+		return (CPUInfo[2] & (1 << 9)) != 0;
+#else
+		unsigned int EAX, EBX, ECX, EDX;
+		if (!__get_cpuid(1, &EAX, &EBX, &ECX, &EDX))
+			return false;
+		return (ECX & bit_SSSE3) != 0;
+#endif // _MSC_VER
+	}();
+	return SSSE3Supported;
+}
+
+/// <summary>
+/// scalar equivalent of pmulhrsw, multiplies two Q15 values with rounding
+/// </summary>
+static inline int MulHighRoundScale(int a, int b)
+{
+	return (a * b + (1 << (AL_APPROX_WEIGHT_BITS - 1))) >> AL_APPROX_WEIGHT_BITS;
+}
+
+/// <summary>
+/// Q15 weight of the mapping on the right/bottom side for the given coefficient
+/// </summary>
+static inline int ComputeApproximateWeight(unsigned int Coef, unsigned int Size)
+{
+	return static_cast<int>(((Coef << AL_APPROX_WEIGHT_BITS) + (Size >> 1)) / Size);
+}
 
-	/// region pixel count
-	unsigned int NumPixels = (unsigned int)RegionWidth * (unsigned int)RegionHeight; //< region pixel count
+/// <summary>
+/// approximate bilinear interpolation of a single pixel, in the same order of operations as the SIMD code
+/// </summary>
+static inline PixelType InterpolateApproximatePixel(PixelType GreyValue,
+                                                    const MapType* pMapLU, const MapType* pMapRU,
+                                                    const MapType* pMapLB, const MapType* pMapRB,
+                                                    int XWeight, int YWeight)
+{
+	const int LU = pMapLU[GreyValue] << AL_APPROX_MAP_SHIFT;
+	const int RU = pMapRU[GreyValue] << AL_APPROX_MAP_SHIFT;
+	const int LB = pMapLB[GreyValue] << AL_APPROX_MAP_SHIFT;
+	const int RB = pMapRB[GreyValue] << AL_APPROX_MAP_SHIFT;
+	const int Up = LU + MulHighRoundScale(RU - LU, XWeight);
+	const int Bottom = LB + MulHighRoundScale(RB - LB, XWeight);
+	const int Value = Up + MulHighRoundScale(Bottom - Up, YWeight);
+	return static_cast<PixelType>((Value + (1 << (AL_APPROX_MAP_SHIFT - 1))) >> AL_APPROX_MAP_SHIFT);
+}
 
-	/// Interpolate greylevel mappings to get CLAHE image
-	for (int k = 0; k < uiY; k++)
+/// <summary>
+/// approximate version of Interpolate, uses the SSSE3 code when available
+/// </summary>
+/// <remarks>
+/// The mapped graylevels are scaled by 2^AL_APPROX_MAP_SHIFT and the weights quantised to Q15, so each lerp
+/// is a single pmulhrsw on 8 pixels. Rounding of the three lerps and of the weights adds less than 1/64 of a graylevel,
+/// so the result is within AL_APPROX_MAX_ERROR of the exact interpolation, that truncates on power-of-two areas
+/// </remarks>
+void CBaseAltaLuxFilter::InterpolateApproximate(PixelType* pImage,
+                                                const MapType* pMapLeftUp, const MapType* pMapRightUp,
+                                                const MapType* pMapLeftBottom, const MapType* pMapRightBottom,
+                                                unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride)
+{
+	if (IsSSSE3Supported())
+		InterpolateApproximateSSSE3(pImage, pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom, MatrixWidth, MatrixHeight, RowStride);
+	else
+		InterpolateApproximateScalar(pImage, pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom, MatrixWidth, MatrixHeight, RowStride);
+}
+
+/// <summary>
+/// plain C emulation of InterpolateApproximateSSSE3, produces exactly the same output
+/// </summary>
+void CBaseAltaLuxFilter::InterpolateApproximateScalar(PixelType* pImage,
+                                                      const MapType* pMapLeftUp, const MapType* pMapRightUp,
+                                                      const MapType* pMapLeftBottom, const MapType* pMapRightBottom,
+                                                      unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride)
+{
+	PixelType NewLuma[AL_OUTPUT_CHUNK]; //< interpolated pixels, when they are not written back in place
+	const bool InPlace = (Output.Layout == AL_OUTPUT_IN_PLACE);
+
+	for (unsigned int YCoef = 0; YCoef < MatrixHeight; YCoef++, pImage += RowStride)
 	{
-		if (k == 0)
-			pImPointer += (RegionHeight >> 1) * OriginalImageWidth;
-		else
-			pImPointer += RegionHeight * OriginalImageWidth;
+		const int YWeight = ComputeApproximateWeight(YCoef, MatrixHeight);
+		for (unsigned int FirstColumn = 0; FirstColumn < MatrixWidth; FirstColumn += AL_OUTPUT_CHUNK)
+		{
+			const unsigned int ChunkWidth = std::min(MatrixWidth - FirstColumn, AL_OUTPUT_CHUNK);
+			const PixelType* pSource = pImage + FirstColumn;
+			PixelType* pTarget = InPlace ? (pImage + FirstColumn) : NewLuma;
+			for (unsigned int i = 0; i < ChunkWidth; i++)
+			{
+				pTarget[i] = InterpolateApproximatePixel(pSource[i], pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom,
+				                                         ComputeApproximateWeight(FirstColumn + i, MatrixWidth), YWeight);
+			}
+			if (!InPlace)
+				WriteInterpolatedLuma(pSource, NewLuma, ChunkWidth);
+		}
 	}
+}
+
+/// <summary>
+/// scaled mappings of 8 pixels from the four separate tables, one vector per contextual region
+/// </summary>
+static inline void LoadApproximateMappings(const PixelType* p, const MapType* pMapLeftUp, const MapType* pMapRightUp,
+                                           const MapType* pMapLeftBottom, const MapType* pMapRightBottom,
+                                           __m128i& LU, __m128i& RU, __m128i& LB, __m128i& RB)
+{
+	LU = _mm_setr_epi16(pMapLeftUp[p[0]], pMapLeftUp[p[1]], pMapLeftUp[p[2]], pMapLeftUp[p[3]],
+	                    pMapLeftUp[p[4]], pMapLeftUp[p[5]], pMapLeftUp[p[6]], pMapLeftUp[p[7]]);
+	RU = _mm_setr_epi16(pMapRightUp[p[0]], pMapRightUp[p[1]], pMapRightUp[p[2]], pMapRightUp[p[3]],
+	                    pMapRightUp[p[4]], pMapRightUp[p[5]], pMapRightUp[p[6]], pMapRightUp[p[7]]);
+	LB = _mm_setr_epi16(pMapLeftBottom[p[0]], pMapLeftBottom[p[1]], pMapLeftBottom[p[2]], pMapLeftBottom[p[3]],
+	                    pMapLeftBottom[p[4]], pMapLeftBottom[p[5]], pMapLeftBottom[p[6]], pMapLeftBottom[p[7]]);
+	RB = _mm_setr_epi16(pMapRightBottom[p[0]], pMapRightBottom[p[1]], pMapRightBottom[p[2]], pMapRightBottom[p[3]],
+	                    pMapRightBottom[p[4]], pMapRightBottom[p[5]], pMapRightBottom[p[6]], pMapRightBottom[p[7]]);
+	LU = _mm_slli_epi16(LU, AL_APPROX_MAP_SHIFT);
+	RU = _mm_slli_epi16(RU, AL_APPROX_MAP_SHIFT);
+	LB = _mm_slli_epi16(LB, AL_APPROX_MAP_SHIFT);
+	RB = _mm_slli_epi16(RB, AL_APPROX_MAP_SHIFT);
+}
 
-	PixelType* SavedImPointer = pImPointer;
+/// <summary>
+/// same as LoadApproximateMappings from the interleaved table, with a single load per pixel:
+/// two pixels per vector, [LU RU LB RB] each, are transposed into LU0..LU7, RU0..RU7, LB0..LB7 and RB0..RB7
+/// </summary>
+static inline void LoadApproximateQuadMappings(const PixelType* p, const QuadMapType* pQuadMap,
+                                               __m128i& LU, __m128i& RU, __m128i& LB, __m128i& RB)
+{
+	const __m128i Pixels01 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[0]])),
+	                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[1]])));
+	const __m128i Pixels23 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[2]])),
+	                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[3]])));
+	const __m128i Pixels45 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[4]])),
+	                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[5]])));
+	const __m128i Pixels67 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[6]])),
+	                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&pQuadMap[p[7]])));
+	const __m128i Pairs02 = _mm_unpacklo_epi16(Pixels01, Pixels23); //< LU0 LU2 RU0 RU2 LB0 LB2 RB0 RB2
+	const __m128i Pairs13 = _mm_unpackhi_epi16(Pixels01, Pixels23);
+	const __m128i Pairs46 = _mm_unpacklo_epi16(Pixels45, Pixels67);
+	const __m128i Pairs57 = _mm_unpackhi_epi16(Pixels45, Pixels67);
+	const __m128i Up03 = _mm_unpacklo_epi16(Pairs02, Pairs13); //< LU0 LU1 LU2 LU3 RU0 RU1 RU2 RU3
+	const __m128i Bottom03 = _mm_unpackhi_epi16(Pairs02, Pairs13); //< LB0 LB1 LB2 LB3 RB0 RB1 RB2 RB3
+	const __m128i Up47 = _mm_unpacklo_epi16(Pairs46, Pairs57);
+	const __m128i Bottom47 = _mm_unpackhi_epi16(Pairs46, Pairs57);
+	LU = _mm_unpacklo_epi64(Up03, Up47);
+	RU = _mm_unpackhi_epi64(Up03, Up47);
+	LB = _mm_unpacklo_epi64(Bottom03, Bottom47);
+	RB = _mm_unpackhi_epi64(Bottom03, Bottom47);
+}
 
-	if (uiY < NumVertRegions)
+/// <summary>
+/// interpolates 8 pixels from their scaled mappings and stores them in pTarget
+/// </summary>
+static inline void StoreApproximatePixels(PixelType* pTarget, __m128i LU, __m128i RU, __m128i LB, __m128i RB,
+                                          const short* pXWeights, __m128i YWeights, __m128i RoundingTerm)
+{
+	const __m128i XWeight = _mm_load_si128(reinterpret_cast<const __m128i*>(pXWeights));
+	const __m128i Up = _mm_add_epi16(LU, _mm_mulhrs_epi16(_mm_sub_epi16(RU, LU), XWeight));
+	const __m128i Bottom = _mm_add_epi16(LB, _mm_mulhrs_epi16(_mm_sub_epi16(RB, LB), XWeight));
+	__m128i Value = _mm_add_epi16(Up, _mm_mulhrs_epi16(_mm_sub_epi16(Bottom, Up), YWeights));
+	Value = _mm_srli_epi16(_mm_add_epi16(Value, RoundingTerm), AL_APPROX_MAP_SHIFT);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(pTarget), _mm_packus_epi16(Value, Value));
+}
+
+/// <summary>
+/// approximate interpolation of 8 pixels at a time with pmulhrsw,
+/// the horizontal weights are computed once for every AL_APPROX_WEIGHT_CHUNK columns and reused on all rows.
+/// Sub-matrices of at least AL_QUAD_MAP_MIN_PIXELS pixels load the four scaled mappings of each pixel at once
+/// from an interleaved table, then transpose them into one vector per contextual region
+/// </summary>
+void CBaseAltaLuxFilter::InterpolateApproximateSSSE3(PixelType* pImage,
+                                                     const MapType* pMapLeftUp, const MapType* pMapRightUp,
+                                                     const MapType* pMapLeftBottom, const MapType* pMapRightBottom,
+                                                     unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride)
+{
+	alignas(16) short XWeights[AL_APPROX_WEIGHT_CHUNK];
+	PixelType NewLuma[AL_APPROX_WEIGHT_CHUNK]; //< interpolated pixels, when they are not written back in place
+	const bool InPlace = (Output.Layout == AL_OUTPUT_IN_PLACE);
+	const __m128i RoundingTerm = _mm_set1_epi16(1 << (AL_APPROX_MAP_SHIFT - 1));
+	alignas(16) QuadMapType QuadMap[NUM_GRAY_LEVELS];
+	const bool UseQuadMap = (MatrixWidth * MatrixHeight >= AL_QUAD_MAP_MIN_PIXELS);
+	if (UseQuadMap)
+		MakeQuadMap(pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom, QuadMap);
+
+	for (unsigned int FirstColumn = 0; FirstColumn < MatrixWidth; FirstColumn += AL_APPROX_WEIGHT_CHUNK)
 	{
-		/// calculate greylevel mappings for each contextual region
-		for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++, pImPointer += RegionWidth)
+		const unsigned int ChunkWidth = std::min(MatrixWidth - FirstColumn, AL_APPROX_WEIGHT_CHUNK);
+		for (unsigned int i = 0; i < ChunkWidth; i++)
+			XWeights[i] = static_cast<short>(ComputeApproximateWeight(FirstColumn + i, MatrixWidth));
+
+		PixelType* pRow = pImage + FirstColumn;
+		for (unsigned int YCoef = 0; YCoef < MatrixHeight; YCoef++, pRow += RowStride)
 		{
-			unsigned int* pHistogram = &pulMapArray[NUM_GRAY_LEVELS * (uiY * NumHorRegions + uiX)];
-			MakeHistogram(pImPointer, pHistogram);
-			ClipHistogram(pHistogram, ulClipLimit);
-			MapHistogram(pHistogram, NumPixels);
+			const int YWeight = ComputeApproximateWeight(YCoef, MatrixHeight);
+			const __m128i YWeights = _mm_set1_epi16(static_cast<short>(YWeight));
+			PixelType* pTarget = InPlace ? pRow : NewLuma;
+			unsigned int i = 0;
+			if (UseQuadMap)
+			{
+				for (; i + 8 <= ChunkWidth; i += 8)
+				{
+					__m128i LU, RU, LB, RB;
+					LoadApproximateQuadMappings(pRow + i, QuadMap, LU, RU, LB, RB);
+					StoreApproximatePixels(pTarget + i, LU, RU, LB, RB, &XWeights[i], YWeights, RoundingTerm);
+				}
+			}
+			else
+			{
+				for (; i + 8 <= ChunkWidth; i += 8)
+				{
+					__m128i LU, RU, LB, RB;
+					LoadApproximateMappings(pRow + i, pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom, LU, RU, LB, RB);
+					StoreApproximatePixels(pTarget + i, LU, RU, LB, RB, &XWeights[i], YWeights, RoundingTerm);
+				}
+			}
+			/// remaining pixels of the chunk
+			for (; i < ChunkWidth; i++)
+				pTarget[i] = InterpolateApproximatePixel(pRow[i], pMapLeftUp, pMapRightUp, pMapLeftBottom, pMapRightBottom,
+				                                         XWeights[i], YWeight);
+			if (!InPlace)
+				WriteInterpolatedLuma(pRow, NewLuma, ChunkWidth);
 		}
 	}
 }
 
-void CBaseAltaLuxFilter::ProcessRow(int uiY, unsigned int ulClipLimit, unsigned int* pulMapArray)
+/// <summary>
+/// share of the strength of the filter that suits a region, refer to SetAutoStrength
+/// </summary>
+/// <param name="pHistogram">histogram of the region, before clipping</param>
+/// <param name="NumOfPixels">pixels counted by the histogram</param>
+/// <returns>from 0 (leave the region as it is) to 1 (full strength)</returns>
+/// <remarks>
+/// The contrast left to be gained is 1 - range * evenness, where the range is the share of graylevels spanned
+/// by the histogram without its tails, and the evenness is the entropy of the histogram over the entropy of
+/// a flat histogram of the same range. It is scaled down as the entropy falls towards AL_AUTO_FLAT_ENTROPY,
+/// so that the noise of flat regions such as the sky is not amplified
+/// </remarks>
+float CBaseAltaLuxFilter::EstimateRegionStrength(const unsigned int* pHistogram, unsigned int NumOfPixels)
 {
-	PixelType* pImage = (PixelType *)ImageBuffer;
+	if (NumOfPixels == 0)
+		return 0.0f;
+
+	/// dynamic range, without the darkest and brightest pixels
+	const unsigned int TailPixels = NumOfPixels / AL_AUTO_TAIL_SHARE;
+	unsigned int LowGraylevel = 0, HighGraylevel = MAX_GRAY_VALUE;
+	for (unsigned int Sum = pHistogram[0]; (Sum <= TailPixels) && (LowGraylevel < MAX_GRAY_VALUE); Sum += pHistogram[LowGraylevel])
+		LowGraylevel++;
+	for (unsigned int Sum = pHistogram[MAX_GRAY_VALUE]; (Sum <= TailPixels) && (HighGraylevel > LowGraylevel); Sum += pHistogram[HighGraylevel])
+		HighGraylevel--;
+
+	/// entropy in bits, log2(N) - sum(h * log2(h)) / N
+	float WeightedLogs = 0.0f;
+	for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
+		if (pHistogram[i] > 1)
+			WeightedLogs += pHistogram[i] * std::log2(static_cast<float>(pHistogram[i]));
+	const float Entropy = std::max(0.0f, std::log2(static_cast<float>(NumOfPixels)) - WeightedLogs / NumOfPixels);
+
+	const float Detail = std::min(1.0f, std::max(0.0f, (Entropy - AL_AUTO_FLAT_ENTROPY) / (AL_AUTO_DETAIL_ENTROPY - AL_AUTO_FLAT_ENTROPY)));
+	if (Detail == 0.0f)
+		return 0.0f;
+	const float Range = static_cast<float>(HighGraylevel - LowGraylevel) / MAX_GRAY_VALUE;
+	const float Evenness = std::min(1.0f, Entropy / std::log2(static_cast<float>(HighGraylevel - LowGraylevel + 1)));
+	return (1.0f - Range * Evenness) * Detail;
+}
 
-	unsigned int uiX; //< counters
-	unsigned int uiSubX, uiSubY; //< size of subimages
-	unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
-	PixelType* pImPointer; //< pointer to image
-	unsigned int *pulLU, *pulLB, *pulRU, *pulRB; //< auxiliary pointers interpolation
+/// <summary>
+/// computes the clip limit of the histograms of contextual regions from ClipLimit
+/// </summary>
+/// <returns>the max number of pixels in a histogram bin</returns>
+unsigned int CBaseAltaLuxFilter::ComputeClipLimit() const
+{
+	unsigned int ulClipLimit; //< clip limit
+	if (ClipLimit > 0.0)
+	{
+		/// calculate actual cliplimit
+		ulClipLimit = static_cast<unsigned int>(ClipLimit * GetHistogramSampleCount() / NUM_GRAY_LEVELS);
+		ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
+	}
+	else
+		ulClipLimit = 1UL << 14; //< large value, do not clip (AHE)
+	return ulClipLimit;
+}
 
-	/// region pixel count
-	unsigned int NumPixels = (unsigned int)RegionWidth * (unsigned int)RegionHeight; //< region pixel count
+/// <summary>
+/// number of pixels in the histogram of a contextual region, that is less than its size
+/// when the histograms are subsampled to meet a deadline
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetHistogramSampleCount() const
+{
+	const unsigned int SampledWidth = (RegionWidth + HistogramStep - 1) / HistogramStep;
+	const unsigned int SampledHeight = (RegionHeight + HistogramStep - 1) / HistogramStep;
+	return SampledWidth * SampledHeight;
+}
 
-	/// Interpolate greylevel mappings to get CLAHE image
+/// <summary>
+/// number of entries in the array holding the graylevel mappings of all the contextual regions
+/// </summary>
+unsigned int CBaseAltaLuxFilter::GetMapArraySize() const
+{
+	return NumHorRegions * NumVertRegions * NUM_GRAY_LEVELS;
+}
+
+/// <summary>
+/// returns the first pixel of the given row of submatrices, that is also the first pixel of
+/// the contextual regions of that row. Rows 0 and NumVertRegions are the half-height top and bottom rows
+/// </summary>
+PixelType* CBaseAltaLuxFilter::GetSubMatrixRow(PixelType* pImage, unsigned int uiY) const
+{
+	/// while RunBanded is running, pImage starts at row LumaBandTop of the image
+	return pImage + static_cast<size_t>(GetSubMatrixTop(uiY) - LumaBandTop) * OriginalImageWidth;
+}
 
-	pImPointer = pImage;
-	for (int k = 0; k < uiY; k++)
+/// <summary>
+/// computes the graylevel mapping of a contextual region
+/// </summary>
+/// <param name="pImage">image to be processed</param>
+/// <param name="uiX">column of the contextual region, in [0..NumHorRegions-1]</param>
+/// <param name="uiY">row of the contextual region, in [0..NumVertRegions-1]</param>
+/// <param name="ulClipLimit">clip limit, as returned by ComputeClipLimit</param>
+/// <param name="pMapArray">mappings of all contextual regions</param>
+void CBaseAltaLuxFilter::CalcRegionMapping(PixelType* pImage, unsigned int uiX, unsigned int uiY,
+                                           unsigned int ulClipLimit, MapType* pMapArray)
+{
+	unsigned int Histogram[NUM_GRAY_LEVELS];
+	const unsigned int NumPixels = GetHistogramSampleCount(); //< region pixel count
+
+	PixelType* pImPointer = GetSubMatrixRow(pImage, uiY) + uiX * RegionWidth;
+	if (LumaTiled)
+		MakeTiledHistogram(pImage, uiX, uiY, Histogram, HistogramStep);
+	else if (HistogramStep == 1)
+		MakeHistogram(pImPointer, Histogram);
+	else
+		MakeSubsampledHistogram(pImPointer, Histogram, HistogramStep);
+	if (AutoStrength)
 	{
-		if (k == 0)
-			pImPointer += (RegionHeight >> 1) * OriginalImageWidth;
-		else
-			pImPointer += RegionHeight * OriginalImageWidth;
+		/// the lowest clip limit is the one of AL_MIN_STRENGTH, rounded up so that the clipped histogram still holds
+		/// all the pixels, otherwise ClipHistogram would keep looking for room for the excess
+		const unsigned int MinClipLimit = (NumPixels + NUM_GRAY_LEVELS - 1) / NUM_GRAY_LEVELS;
+		if (ulClipLimit > MinClipLimit)
+			ulClipLimit = MinClipLimit + static_cast<unsigned int>((ulClipLimit - MinClipLimit) * EstimateRegionStrength(Histogram, NumPixels));
 	}
+	ClipHistogram(Histogram, ulClipLimit);
+	const unsigned int Region = uiY * NumHorRegions + uiX;
+	const bool Identity = MapHistogram(Histogram, NumPixels, &pMapArray[NUM_GRAY_LEVELS * Region]);
+	if (pMapArray == MapArray)
+		IdentityMaps[Region] = Identity;
+}
+
+/// <summary>
+/// interpolates the graylevel mappings of the four contextual regions surrounding a submatrix
+/// </summary>
+/// <param name="pImage">image to be processed</param>
+/// <param name="uiX">column of the submatrix, in [0..NumHorRegions]</param>
+/// <param name="uiY">row of the submatrix, in [0..NumVertRegions]</param>
+/// <param name="pMapArray">mappings of all contextual regions</param>
+void CBaseAltaLuxFilter::InterpolateSubMatrix(PixelType* pImage, unsigned int uiX, unsigned int uiY,
+                                              const MapType* pMapArray)
+{
+	unsigned int uiSubX, uiSubY; //< size of subimages
+	unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
 
 	if (uiY == 0)
 	{
@@ -841,39 +1796,160 @@ void CBaseAltaLuxFilter::ProcessRow(int uiY, unsigned int ulClipLimit, unsigned
 		}
 	}
 
-	for (uiX = 0; uiX <= NumHorRegions; uiX++)
+	PixelType* pImPointer = GetSubMatrixRow(pImage, uiY);
+	if (uiX == 0)
+	{
+		/// special case: left column
+		uiSubX = RegionWidth >> 1;
+		uiXL = 0;
+		uiXR = 0;
+	}
+	else
 	{
-		if (uiX == 0)
+		pImPointer += (RegionWidth >> 1) + ((uiX - 1) * RegionWidth);
+		if (uiX == NumHorRegions)
 		{
-			/// special case: left column
-			uiSubX = RegionWidth >> 1;
-			uiXL = 0;
-			uiXR = 0;
+			/// special case: right column
+			uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
+			uiXL = NumHorRegions - 1;
+			uiXR = uiXL;
 		}
 		else
 		{
-			if (uiX == NumHorRegions)
-			{
-				/// special case: right column
-				uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
-				uiXL = NumHorRegions - 1;
-				uiXR = uiXL;
-			}
-			else
-			{
-				/// default values
-				uiSubX = RegionWidth;
-				uiXL = uiX - 1;
-				uiXR = uiX;
-			}
+			/// default values
+			uiSubX = RegionWidth;
+			uiXL = uiX - 1;
+			uiXR = uiX;
 		}
-		pulLU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
-		pulRU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
-		pulLB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
-		pulRB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
+	}
+	unsigned int RowStride = OriginalImageWidth;
+	if (LumaTiled)
+	{
+		pImPointer = GetTile(pImage, uiX, uiY);
+		RowStride = GetTileWidth(uiX);
+	}
+	/// the interpolation of four identity mappings leaves the pixels as they are
+	const bool Identity = (pMapArray == MapArray) &&
+		IdentityMaps[uiYU * NumHorRegions + uiXL] && IdentityMaps[uiYU * NumHorRegions + uiXR] &&
+		IdentityMaps[uiYB * NumHorRegions + uiXL] && IdentityMaps[uiYB * NumHorRegions + uiXR];
+	if (!Identity)
+	{
+		const MapType* pLU = &pMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
+		const MapType* pRU = &pMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
+		const MapType* pLB = &pMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
+		const MapType* pRB = &pMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
+
+		if (ApproximateInterpolation || (AppliedDegradations & AL_DEGRADE_APPROXIMATE_INTERPOLATION))
+			InterpolateApproximate(pImPointer, pLU, pRU, pLB, pRB, uiSubX, uiSubY, RowStride);
+		else
+			Interpolate(pImPointer, pLU, pRU, pLB, pRB, uiSubX, uiSubY, RowStride);
+	}
+
+	/// the pixels of the sub-matrix are final, down-sample them while they are still in the cache;
+	/// with odd regions the last column and row of the image are not covered by any sub-matrix and are left as they are,
+	/// so they are added to the sub-matrices on the border
+	if ((Thumbnail.Image != nullptr) && (Output.Layout == AL_OUTPUT_RGB))
+	{
+		const unsigned int Left = GetSubMatrixLeft(uiX);
+		const unsigned int Top = GetSubMatrixTop(uiY);
+		RenderThumbnailTile(Left, Top, (uiX == NumHorRegions) ? OriginalImageWidth - Left : uiSubX,
+		                    (uiY == NumVertRegions) ? OriginalImageHeight - Top : uiSubY);
+	}
+}
+
+/// <summary>
+/// lower-memory version of Run, for images whose luminance plane does not fit in the memory budget:
+/// ImageBuffer holds only the band of rows being processed, whose luminance is extracted when it is needed.
+/// The mappings are computed one row of contextual regions at a time, then the sub-matrices are interpolated
+/// one row at a time; as the rows of sub-matrices do not overlap, the luminance of each one is extracted before
+/// the interpolation changes its pixels, so the result is the same as Run
+/// </summary>
+/// <param name="ExtractRows">fills ImageBuffer with the luminance of the rows [FirstRow, LastRow) of the image</param>
+/// <returns>error code, refer to AL_XXX codes</returns>
+int CBaseAltaLuxFilter::RunBanded(const std::function<void(int FirstRow, int LastRow)>& ExtractRows)
+{
+	if (ClipLimit == 1.0)
+		return AL_OK; //< is OK, immediately returns original image
+
+	const int MappingReturn = RunBandedMappings(ExtractRows);
+	if (MappingReturn != AL_OK)
+		return MappingReturn;
+	RunBandedInterpolation(ExtractRows);
+
+	return AL_OK; //< return status OK
+}
+
+/// <summary>
+/// first half of RunBanded, also used by CFramePipeline: computes the mappings one row of contextual regions at a time
+/// </summary>
+/// <returns>error code, refer to AL_XXX codes</returns>
+int CBaseAltaLuxFilter::RunBandedMappings(const std::function<void(int FirstRow, int LastRow)>& ExtractRows)
+{
+	auto pImage = static_cast<PixelType *>(ImageBuffer);
+
+	/// pMapArray is pointer to mappings
+	MapType* pMapArray = GetMapArray();
+	if (pMapArray == nullptr)
+		return AL_OUT_OF_MEMORY; //< not enough memory
+
+	const unsigned int ulClipLimit = ComputeClipLimit(); //< clip limit
+
+	/// calculate greylevel mappings for each contextual region
+	for (unsigned int uiY = 0; uiY < NumVertRegions; uiY++)
+	{
+		WaitForTurn();
+		LumaBandTop = GetSubMatrixTop(uiY);
+		ExtractRows(LumaBandTop, LumaBandTop + RegionHeight);
+		ForEachBand(NumHorRegions, [&](int uiX)
+		{
+			CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
+		});
+	}
+	LumaBandTop = 0;
+
+	return AL_OK;
+}
+
+/// <summary>
+/// second half of RunBanded, needs the mappings of RunBandedMappings and the image they were computed on:
+/// interpolates the sub-matrices one row at a time
+/// </summary>
+void CBaseAltaLuxFilter::RunBandedInterpolation(const std::function<void(int FirstRow, int LastRow)>& ExtractRows)
+{
+	auto pImage = static_cast<PixelType *>(ImageBuffer);
+	const MapType* pMapArray = MapArray;
+
+	/// Interpolate greylevel mappings to get CLAHE image
+	for (unsigned int uiY = 0; uiY <= NumVertRegions; uiY++)
+	{
+		WaitForTurn();
+		LumaBandTop = GetSubMatrixTop(uiY);
+		ExtractRows(LumaBandTop, LumaBandTop + GetTileHeight(uiY));
+		ForEachBand(NumHorRegions + 1, [&](int uiX)
+		{
+			InterpolateSubMatrix(pImage, uiX, uiY, pMapArray);
+		});
+	}
+	LumaBandTop = 0;
+}
 
-		Interpolate(pImPointer, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY);
+void CBaseAltaLuxFilter::CalcGraylevelMappings(unsigned int uiY, unsigned int ulClipLimit, MapType* pMapArray)
+{
+	PixelType* pImage = (PixelType *)ImageBuffer;
 
-		pImPointer += uiSubX; //< set pointer on next matrix
+	if (uiY < NumVertRegions)
+	{
+		/// calculate greylevel mappings for each contextual region
+		for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++)
+			CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
 	}
 }
+
+void CBaseAltaLuxFilter::ProcessRow(unsigned int uiY, MapType* pMapArray)
+{
+	PixelType* pImage = (PixelType *)ImageBuffer;
+
+	/// Interpolate greylevel mappings to get CLAHE image
+	for (unsigned int uiX = 0; uiX <= NumHorRegions; uiX++)
+		InterpolateSubMatrix(pImage, uiX, uiY, pMapArray);
+}
@@ -27,6 +27,15 @@ A "contributor" is any person that distributes its contribution under this licen
 
 #pragma once
 
+#include "CDeadlineCostModel.h"
+#include "CMemoryBudget.h"
+#include "CPriorityScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
 /// CAltaLux::Process return values
 const int AL_OK = 0;
 const int AL_NULL_IMAGE = -1; //< Image pointer is null
@@ -34,6 +43,10 @@ const int AL_WIDTH_NO_MULTIPLE = -3; //< x-resolution no multiple of 8
 const int AL_HEIGHT_NO_MULTIPLE = -4; //< y-resolution no multiple of 8
 const int AL_OUT_OF_MEMORY = -11; //< no memory left to alloc internal buffers
 
+/// revision of the processed pixels, bumped by every change of the filter that alters its output for the same
+/// input and settings, so that results stored by the callers are not reused across such changes
+const int AL_FILTER_VERSION = 1;
+
 /// Parameters for CAltaLux::SetStrength
 const int AL_MIN_STRENGTH = 0;
 const int AL_DEFAULT_STRENGTH = 25;
@@ -42,9 +55,12 @@ const int AL_LIGHT_CONTRAST_STRENGTH = 5;
 const int AL_HEAVY_CONTRAST_STRENGTH = 10;
 
 typedef unsigned char PixelType; //< for 8 bpp grayscale images
+typedef unsigned char MapType; //< entry of a graylevel mapping, mapped values are in [0..255]
+typedef unsigned long long QuadMapType; //< mappings of a graylevel in the four contextual regions around a sub-matrix,
+//< as the 16-bit lanes of the approximate interpolation from the lowest: left-up, right-up, left-bottom, right-bottom
 
-const unsigned int MAX_HOR_REGIONS = 16; //< max # contextual regions in x-direction
-const unsigned int MAX_VERT_REGIONS = 16; //< max # contextual regions in y-direction
+const unsigned int MAX_HOR_REGIONS = 64; //< max # contextual regions in x-direction
+const unsigned int MAX_VERT_REGIONS = 64; //< max # contextual regions in y-direction
 
 const unsigned int DEFAULT_HOR_REGIONS = 8; //< default # contextual regions in x-direction
 const unsigned int DEFAULT_VERT_REGIONS = 8; //< default # contextual regions in y-direction
@@ -52,6 +68,8 @@ const unsigned int DEFAULT_VERT_REGIONS = 8; //< default # contextual regions in
 const unsigned int MIN_HOR_REGIONS = 2; //< min # contextual regions in x-direction
 const unsigned int MIN_VERT_REGIONS = 2; //< min # contextual regions in y-direction
 
+const unsigned int MIN_REGION_SIZE = 8; //< min width and height in pixels of a contextual region
+
 const unsigned int NUM_GRAY_LEVELS = 256;
 const unsigned int MAX_GRAY_VALUE = (NUM_GRAY_LEVELS - 1);
 const unsigned int MIN_GRAY_VALUE = 0;
@@ -60,30 +78,117 @@ const float DEFAULT_CLIP_LIMIT = 2.0f;
 const float MIN_CLIP_LIMIT = 1.0f;
 const float MAX_CLIP_LIMIT = 5.0f;
 
+/// Parameters of the approximate interpolation, refer to CBaseAltaLuxFilter::SetApproximateInterpolation
+const int AL_APPROX_WEIGHT_BITS = 15; //< bilinear weights are quantised to Q15
+const int AL_APPROX_MAP_SHIFT = 7; //< mapped graylevels are scaled by 2^7 so that they fit in signed 16-bit lanes
+const int AL_APPROX_MAX_ERROR = 1; //< max difference in graylevels from the exact interpolation
+const unsigned int AL_APPROX_WEIGHT_CHUNK = 256; //< columns whose horizontal weights are computed at once
+
+/// Parameters of the interleaved mappings, refer to CBaseAltaLuxFilter::MakeQuadMap
+const unsigned int AL_QUAD_MAP_MIN_PIXELS = NUM_GRAY_LEVELS; //< smaller sub-matrices read the four mappings separately,
+//< as interleaving them would cost more than it saves
+
+/// Parameters of the skipping of identity mappings, refer to CBaseAltaLuxFilter::SetIdentityTolerance
+const unsigned int AL_DEFAULT_IDENTITY_TOLERANCE = 0; //< only exact identity mappings are skipped, the result is unchanged
+const unsigned int AL_MAX_IDENTITY_TOLERANCE = 2; //< max distance in graylevels of a skipped mapping from the identity
+
+/// Parameters of the automatic strength, refer to CBaseAltaLuxFilter::SetAutoStrength
+const float AL_AUTO_FLAT_ENTROPY = 2.0f; //< regions whose histogram entropy in bits is up to this value are flat and left as they are
+const float AL_AUTO_DETAIL_ENTROPY = 5.0f; //< from this entropy up, regions get all the strength their contrast calls for
+const unsigned int AL_AUTO_TAIL_SHARE = 100; //< 1 / AL_AUTO_TAIL_SHARE of the pixels at each end of the histogram
+//< is ignored when measuring its dynamic range
+
+/// Parameters for CBaseAltaLuxFilter::SetSchedulingPolicy
+const int AL_SCHEDULE_ROW_MAJOR = 0; //< tiles are dispatched in index order
+const int AL_SCHEDULE_LONGEST_FIRST = 1; //< sub-matrices are dispatched by decreasing cost, estimated from their size
+
+/// Layouts of the image written by the interpolation, refer to CBaseAltaLuxFilter::SetLumaOutput
+const int AL_OUTPUT_IN_PLACE = 0; //< the processed luminance replaces the original one in ImageBuffer
+const int AL_OUTPUT_RGB = 1; //< the channels of each RGB pixel are shifted by the change of its luminance
+const int AL_OUTPUT_PACKED_YUV = 2; //< the luma byte of each packed YUV pixel is replaced
+const unsigned int AL_OUTPUT_CHUNK = 256; //< columns of a row interpolated at once before they are written to the image
+
+/// Parameters of the conversion passes, refer to CBaseAltaLuxFilter::ForEachRowBand
+const int AL_CONVERSION_BAND_ROWS = 32; //< rows of the image converted by each task of the parallel strategies
+
 #define IMAGE_BUFFER_SIZE	(OriginalImageWidth * (OriginalImageHeight + 1))
 
+/// <summary>
+/// heap buffers allocated by a filter instance, refer to CBaseAltaLuxFilter::GetAllocationStats
+/// </summary>
+struct AllocationStats
+{
+	unsigned int NumAllocations; //< buffers allocated since construction or the last ResetAllocationStats
+	size_t AllocatedBytes; //< total size of those buffers
+	size_t CurrentBytes; //< size of the buffers currently held by the instance
+	size_t PeakBytes; //< max value reached by CurrentBytes
+};
+
+/// <summary>
+/// image whose pixels receive the interpolated luminance, while ImageBuffer keeps the original one
+/// </summary>
+struct LumaOutput
+{
+	unsigned char* Image; //< nullptr for AL_OUTPUT_IN_PLACE
+	int Layout; //< AL_OUTPUT_XXX
+	int PixelOffset; //< distance in bytes between pixels
+	int LumaOffset; //< offset of the luma byte in a packed YUV pixel
+};
+
+/// <summary>
+/// down-sampled copy of the processed image, refer to CBaseAltaLuxFilter::SetThumbnailOutput
+/// </summary>
+struct ThumbnailOutput
+{
+	unsigned char* Image; //< nullptr if no thumbnail is requested
+	int ScalingFactor; //< thumbnail width = image width / ScalingFactor, same for height
+};
+
 class CBaseAltaLuxFilter
 {
 public:
 	CBaseAltaLuxFilter(int Width, int Height, int HorSlices = DEFAULT_HOR_REGIONS, int VerSlices = DEFAULT_VERT_REGIONS);
-	~CBaseAltaLuxFilter();
+	virtual ~CBaseAltaLuxFilter();
 	void SetStrength(int _Strength = AL_DEFAULT_STRENGTH); //< set processing strength,
 	void SetSlices(int HorSlices, int VerSlices);
 	//< from AL_MIN_STRENGTH (which leaves the image as is)
 	//< to AL_MAX_STRENGTH (which drastically enhances the contrast)
 	bool IsEnabled() const;
-	int ProcessUYVY(void* Image); //< UYVY Image
-	int ProcessVYUY(void* Image); //< VYUY Image
-	int ProcessYUYV(void* Image); //< YUYV Image
-	int ProcessYVYU(void* Image); //< YVYU Image
-	int ProcessGray(void* Image); //< grayscale, 8-bit per pixel Image
-	int ProcessRGB24(void* Image); //< 24 bit per pixel RGB Image
-	int ProcessRGB32(void* Image); //< 32 bit per pixel RGB Image
-	int ProcessBGR24(void* Image); //< 24 bit per pixel BGR Image
-	int ProcessBGR32(void* Image); //< 32 bit per pixel BGR Image
-
-	void ProcessRow(int uiY, unsigned int ulClipLimit, unsigned int* pulMapArray);
-	void CalcGraylevelMappings(int uiY, unsigned int ulClipLimit, unsigned int* pulMapArray);
+	void SetApproximateInterpolation(bool Enabled = true); //< opt-in 16-bit fixed point interpolation,
+	//< faster but it may differ from the exact result by up to AL_APPROX_MAX_ERROR graylevels
+	bool IsApproximateInterpolation() const;
+	void SetIdentityTolerance(unsigned int Graylevels = AL_DEFAULT_IDENTITY_TOLERANCE); //< mappings within this distance
+	//< from the identity are treated as the identity, so that the sub-matrices surrounded by them are not interpolated
+	unsigned int GetIdentityTolerance() const;
+	void SetAutoStrength(bool Enabled = true); //< opt-in choice of the strength of each contextual region from its histogram,
+	//< up to the one set by SetStrength
+	bool IsAutoStrength() const;
+	void SetTiledLayout(bool Enabled = true); //< the RGB and BGR ProcessXXX calls keep the luminance sub-matrix by sub-matrix,
+	//< each one contiguous, instead of row by row; the result does not change
+	bool IsTiledLayout() const;
+	void SetSchedulingPolicy(int Policy); //< order of the tasks of the parallel strategies, AL_SCHEDULE_XXX
+	int GetSchedulingPolicy() const;
+	void SetThumbnailOutput(void* Image, int ScalingFactor); //< the RGB and BGR ProcessXXX calls also down-sample
+	//< their result into Image as ScaleDownImage would do, while it is written; nullptr disables the thumbnail
+	void SetPriority(FilterPriority _Priority); //< priority class used to share the cores with other instances
+	FilterPriority GetPriority() const;
+	static bool IsSSSE3Supported(); //< true if InterpolateApproximate runs the SSSE3 code
+	AllocationStats GetAllocationStats() const;
+	void ResetAllocationStats(); //< clears the counters, except for the buffers still held by the instance
+	unsigned int GetAppliedDegradations() const; //< AL_DEGRADE_XXX flags applied by the last ProcessXXX call to meet its deadline
+	void ResetDeadlineModel(); //< forgets the costs learned by the previous calls with a deadline
+	int ProcessUYVY(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< UYVY Image
+	int ProcessVYUY(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< VYUY Image
+	int ProcessYUYV(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< YUYV Image
+	int ProcessYVYU(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< YVYU Image
+	int ProcessGray(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< grayscale, 8-bit per pixel Image
+	int ProcessRGB24(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< 24 bit per pixel RGB Image
+	int ProcessRGB32(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< 32 bit per pixel RGB Image
+	int ProcessBGR24(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< 24 bit per pixel BGR Image
+	int ProcessBGR32(void* Image, unsigned int DeadlineMicroseconds = AL_NO_DEADLINE); //< 32 bit per pixel BGR Image
+
+	void ProcessRow(unsigned int uiY, MapType* pMapArray);
+	void CalcGraylevelMappings(unsigned int uiY, unsigned int ulClipLimit, MapType* pMapArray);
 
 protected:
 	int ImageWidth;
@@ -91,6 +196,13 @@ protected:
 	int OriginalImageWidth;
 	int OriginalImageHeight;
 	unsigned char* ImageBuffer;
+	size_t ImageBufferSize; //< bytes allocated for ImageBuffer, less than IMAGE_BUFFER_SIZE when it holds a band of RunBanded
+	unsigned int LumaBandTop; //< row of the image held by the first row of ImageBuffer, 0 unless RunBanded is running
+	MapType* MapArray; //< graylevel mappings, kept across calls so that Run does not allocate
+	unsigned int MapArrayCapacity; //< number of entries allocated in MapArray
+	MapType* IdentityMaps; //< one flag per contextual region, set when its mapping is treated as the identity;
+	//< it is the tail of the MapArray allocation
+	AllocationStats Allocations;
 	int Strength;
 	/// internal settings
 	unsigned int NumHorRegions;
@@ -98,6 +210,39 @@ protected:
 	int RegionWidth;
 	int RegionHeight;
 	float ClipLimit;
+	bool ApproximateInterpolation;
+	unsigned int IdentityTolerance;
+	bool AutoStrength;
+	bool TiledLayout;
+	bool LumaTiled; //< ImageBuffer holds the luminance of the current call in the tiled layout, refer to SetTiledLayout
+	int SchedulingPolicy;
+	FilterPriority Priority;
+	CDeadlineCostModel DeadlineModel;
+	unsigned int AppliedDegradations; //< AL_DEGRADE_XXX flags of the current or last ProcessXXX call
+	unsigned int HistogramStep; //< 1, or the sampling step of the degraded histograms of the current call
+	LumaOutput Output; //< where the interpolation writes, refer to SetLumaOutput
+	ThumbnailOutput Thumbnail; //< refer to SetThumbnailOutput
+	std::atomic<unsigned int> NumThumbnailTiles; //< sub-matrices of the current call already down-sampled into Thumbnail
+
+	/// <summary>
+	/// picks the quality level of a ProcessXXX call with a deadline, applies its degradations
+	/// and adds the duration of the call to DeadlineModel
+	/// </summary>
+	class CDeadlineScope
+	{
+	public:
+		CDeadlineScope(CBaseAltaLuxFilter* Filter, int Format, unsigned int DeadlineMicroseconds);
+		~CDeadlineScope();
+
+	private:
+		CBaseAltaLuxFilter* Filter;
+		DeadlinePlan Plan;
+		int Level; //< -1 if the call has no deadline
+		std::chrono::steady_clock::time_point StartTime;
+
+		CDeadlineScope(const CDeadlineScope&) = delete;
+		CDeadlineScope& operator=(const CDeadlineScope&) = delete;
+	};
 
 	/// <summary>
 	/// processes incoming image
@@ -110,11 +255,75 @@ protected:
 	virtual int Run() = 0;
 	void ClipHistogram(unsigned int* pHistogram, unsigned int ClipLimit);
 	void MakeHistogram(PixelType* pImage, unsigned int* pHistogram);
-	void MapHistogram(unsigned int* pHistogram, unsigned int NumOfPixels);
-	void Interpolate(PixelType* pImage, unsigned int* pulMapLU,
-	                 unsigned int* pulMapRU, unsigned int* pulMapLB, unsigned int* pulMapRB,
-	                 unsigned int MatrixWidth, unsigned int MatrixHeight);
+	void MakeSubsampledHistogram(PixelType* pImage, unsigned int* pHistogram, unsigned int Step);
+	void MakeTiledHistogram(PixelType* pImage, unsigned int uiX, unsigned int uiY, unsigned int* pHistogram, unsigned int Step);
+	bool MapHistogram(unsigned int* pHistogram, unsigned int NumOfPixels, MapType* pMap);
+	static void MakeQuadMap(const MapType* pMapLU, const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+	                        QuadMapType* pQuadMap);
+	static float EstimateRegionStrength(const unsigned int* pHistogram, unsigned int NumOfPixels);
+	void Interpolate(PixelType* pImage, const MapType* pMapLU,
+	                 const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+	                 unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride);
+	void InterpolateApproximate(PixelType* pImage, const MapType* pMapLU,
+	                            const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+	                            unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride);
+	void InterpolateApproximateScalar(PixelType* pImage, const MapType* pMapLU,
+	                                  const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+	                                  unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride);
+	void InterpolateApproximateSSSE3(PixelType* pImage, const MapType* pMapLU,
+	                                 const MapType* pMapRU, const MapType* pMapLB, const MapType* pMapRB,
+	                                 unsigned int MatrixWidth, unsigned int MatrixHeight, unsigned int RowStride);
+
+	bool AllocateImageBuffer();
+	bool AllocateLumaBuffer(size_t Size);
+	void ReleaseImageBuffer();
+	bool AllocateCallBuffer(CMemoryReservation& Reservation);
+	void ReleaseCallBuffer(const CMemoryReservation& Reservation);
+	size_t GetBandBufferSize() const;
+	size_t GetMapArrayBytes() const;
+	MapType* GetMapArray();
+	void TrackAllocation(size_t Bytes);
+	void TrackRelease(size_t Bytes);
+	void WaitForTurn();
+
+	void SetLumaOutput(void* Image, int Layout, int PixelOffset, int LumaOffset);
+	void WriteInterpolatedLuma(const PixelType* pOriginalLuma, const PixelType* pNewLuma, unsigned int Count);
+	unsigned int GetSubMatrixColumn(unsigned int x) const;
+	unsigned int GetSubMatrixLine(unsigned int y) const;
+	unsigned int GetSubMatrixLeft(unsigned int uiX) const;
+	unsigned int GetSubMatrixTop(unsigned int uiY) const;
+	unsigned int GetTileWidth(unsigned int uiX) const;
+	unsigned int GetTileHeight(unsigned int uiY) const;
+	PixelType* GetTile(PixelType* pImage, unsigned int uiX, unsigned int uiY) const;
+	size_t GetImageOffset(const PixelType* pLuma) const;
+	void RenderThumbnailTile(unsigned int Left, unsigned int Top, unsigned int Width, unsigned int Height);
+	void FinishThumbnail();
+
+	void ForEachRowBand(int NumRows, const std::function<void(int FirstRow, int LastRow)>& ProcessRows);
+	virtual void ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand); //< runs the bands of
+	//< a conversion pass on the executor of Run, in order on the calling thread unless overridden
+
+	void ApplyDegradations(unsigned int Degradations);
+	unsigned int GetHistogramSampleCount() const;
+	unsigned int ComputeClipLimit() const;
+	unsigned int GetMapArraySize() const;
+	PixelType* GetSubMatrixRow(PixelType* pImage, unsigned int uiY) const;
+	void CalcRegionMapping(PixelType* pImage, unsigned int uiX, unsigned int uiY, unsigned int ulClipLimit,
+	                       MapType* pMapArray);
+	void InterpolateSubMatrix(PixelType* pImage, unsigned int uiX, unsigned int uiY, const MapType* pMapArray);
 
 	int ProcessGeneric(void* Image, int FirstFactor, int SecondFactor,
 	                   int ThirdFactor, int PixelOffset);
+	int ProcessPackedYUV(void* Image, int LumaOffset);
+	void ExtractPackedLuma(const unsigned char* Image, int LumaOffset, int FirstRow, int LastRow);
+	void ExtractLuminance(const unsigned char* Image, int FirstFactor, int SecondFactor,
+	                      int ThirdFactor, int PixelOffset);
+	void ExtractLuminanceRows(const unsigned char* Image, int FirstFactor, int SecondFactor,
+	                          int ThirdFactor, int PixelOffset, int FirstRow, int LastRow);
+	int RunBanded(const std::function<void(int FirstRow, int LastRow)>& ExtractRows);
+	int RunBandedMappings(const std::function<void(int FirstRow, int LastRow)>& ExtractRows);
+	void RunBandedInterpolation(const std::function<void(int FirstRow, int LastRow)>& ExtractRows);
+	void InjectLuminance(unsigned char* Image, int FirstFactor, int SecondFactor,
+	                     int ThirdFactor, int PixelOffset);
+	static void GetLuminanceFactors(bool IsBGR, int& FirstFactor, int& SecondFactor, int& ThirdFactor);
 };
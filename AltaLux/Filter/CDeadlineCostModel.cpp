@@ -0,0 +1,149 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CDeadlineCostModel.h"
+
+static bool IsSamePlan(const DeadlinePlan& Plan, const DeadlinePlan& Key)
+{
+	return (Plan.LastUse != 0) && (Plan.Format == Key.Format) && (Plan.HorRegions == Key.HorRegions) &&
+		(Plan.VertRegions == Key.VertRegions) && (Plan.Approximate == Key.Approximate);
+}
+
+CDeadlineCostModel::CDeadlineCostModel()
+{
+	Reset();
+}
+
+void CDeadlineCostModel::Reset()
+{
+	for (auto& Plan : Plans)
+		Plan = DeadlinePlan();
+	UseCounter = 0;
+}
+
+const DeadlinePlan* CDeadlineCostModel::FindPlan(const DeadlinePlan& Key) const
+{
+	for (auto& Plan : Plans)
+	{
+		if (IsSamePlan(Plan, Key))
+			return &Plan;
+	}
+	return nullptr;
+}
+
+DeadlinePlan* CDeadlineCostModel::FindOrCreatePlan(const DeadlinePlan& Key)
+{
+	DeadlinePlan* OldestPlan = &Plans[0];
+	for (auto& Plan : Plans)
+	{
+		if (IsSamePlan(Plan, Key))
+			return &Plan;
+		if (Plan.LastUse < OldestPlan->LastUse)
+			OldestPlan = &Plan;
+	}
+	*OldestPlan = DeadlinePlan();
+	OldestPlan->Format = Key.Format;
+	OldestPlan->HorRegions = Key.HorRegions;
+	OldestPlan->VertRegions = Key.VertRegions;
+	OldestPlan->Approximate = Key.Approximate;
+	return OldestPlan;
+}
+
+/// <summary>
+/// estimated cost of a level, from its own measures or from the nearest measured level
+/// </summary>
+double CDeadlineCostModel::EstimatePlanCost(const DeadlinePlan& Plan, int Level)
+{
+	if (Plan.Measured[Level])
+		return Plan.Cost[Level];
+	for (int Distance = 1; Distance < NUM_DEADLINE_LEVELS; Distance++)
+	{
+		int Neighbour = Level - Distance;
+		if ((Neighbour < 0) || !Plan.Measured[Neighbour])
+			Neighbour = Level + Distance;
+		if ((Neighbour < NUM_DEADLINE_LEVELS) && Plan.Measured[Neighbour])
+			return Plan.Cost[Neighbour] * DEADLINE_PRIOR_COST_RATIOS[Level] / DEADLINE_PRIOR_COST_RATIOS[Neighbour];
+	}
+	return -1.0;
+}
+
+double CDeadlineCostModel::EstimateCost(const DeadlinePlan& Key, int Level) const
+{
+	if ((Level < 0) || (Level >= NUM_DEADLINE_LEVELS))
+		return -1.0;
+	const DeadlinePlan* Plan = FindPlan(Key);
+	return (Plan != nullptr) ? EstimatePlanCost(*Plan, Level) : -1.0;
+}
+
+/// <summary>
+/// picks the first level whose estimated cost fits in the deadline, or the cheapest level if none does.
+/// Plans that have never been measured run at full quality
+/// </summary>
+/// <param name="Key">plan of the call, only the Format, HorRegions, VertRegions and Approximate fields are used</param>
+/// <param name="DeadlineSeconds">time budget of the call</param>
+/// <returns>index in DEADLINE_LEVEL_DEGRADATIONS</returns>
+int CDeadlineCostModel::SelectLevel(const DeadlinePlan& Key, double DeadlineSeconds)
+{
+	const DeadlinePlan* Plan = FindPlan(Key);
+	if (Plan == nullptr)
+		return 0;
+	for (int Level = 0; Level < NUM_DEADLINE_LEVELS; Level++)
+	{
+		if (EstimatePlanCost(*Plan, Level) <= DeadlineSeconds * DEADLINE_SAFETY_MARGIN)
+			return Level;
+	}
+	return NUM_DEADLINE_LEVELS - 1;
+}
+
+/// <summary>
+/// adds the measured duration of a call to the model of its plan
+/// </summary>
+/// <param name="Key">plan of the call</param>
+/// <param name="Level">level used by the call</param>
+/// <param name="Seconds">duration of the call</param>
+void CDeadlineCostModel::Update(const DeadlinePlan& Key, int Level, double Seconds)
+{
+	if ((Level < 0) || (Level >= NUM_DEADLINE_LEVELS) || (Seconds <= 0.0))
+		return;
+	DeadlinePlan* Plan = FindOrCreatePlan(Key);
+	Plan->LastUse = ++UseCounter;
+	if (!Plan->Measured[Level])
+	{
+		Plan->Measured[Level] = true;
+		Plan->Cost[Level] = Seconds;
+		return;
+	}
+	const double OldCost = Plan->Cost[Level];
+	const double NewCost = OldCost + DEADLINE_COST_SMOOTHING * (Seconds - OldCost);
+	Plan->Cost[Level] = NewCost;
+	/// the other levels keep their learned ratio to this one
+	for (int i = 0; i < NUM_DEADLINE_LEVELS; i++)
+	{
+		if ((i != Level) && Plan->Measured[i])
+			Plan->Cost[i] *= NewCost / OldCost;
+	}
+}
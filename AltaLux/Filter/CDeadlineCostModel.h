@@ -0,0 +1,97 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+/// degradations applied by a ProcessXXX call to meet its deadline, refer to CBaseAltaLuxFilter::GetAppliedDegradations
+const unsigned int AL_DEGRADE_NONE = 0;
+const unsigned int AL_DEGRADE_APPROXIMATE_INTERPOLATION = 1; //< 16-bit fixed point interpolation, as SetApproximateInterpolation
+const unsigned int AL_DEGRADE_HISTOGRAM_SUBSAMPLING = 2; //< histograms of one pixel out of AL_SUBSAMPLED_HISTOGRAM_STEP in both directions
+const unsigned int AL_DEGRADE_PROXY_MAPPINGS = 4; //< mappings computed on a proxy of each region, reduced by AL_PROXY_HISTOGRAM_STEP in both directions
+
+const unsigned int AL_NO_DEADLINE = 0; //< ProcessXXX calls without a deadline are never degraded
+
+const unsigned int AL_SUBSAMPLED_HISTOGRAM_STEP = 2;
+const unsigned int AL_PROXY_HISTOGRAM_STEP = 4;
+
+/// quality levels tried in order, each one cheaper than the previous
+const int NUM_DEADLINE_LEVELS = 4;
+const unsigned int DEADLINE_LEVEL_DEGRADATIONS[NUM_DEADLINE_LEVELS] =
+{
+	AL_DEGRADE_NONE,
+	AL_DEGRADE_APPROXIMATE_INTERPOLATION,
+	AL_DEGRADE_APPROXIMATE_INTERPOLATION | AL_DEGRADE_HISTOGRAM_SUBSAMPLING,
+	AL_DEGRADE_APPROXIMATE_INTERPOLATION | AL_DEGRADE_PROXY_MAPPINGS
+};
+/// cost of each level relative to the full quality one, used until the level has been measured on the plan
+const double DEADLINE_PRIOR_COST_RATIOS[NUM_DEADLINE_LEVELS] = { 1.0, 0.9, 0.82, 0.78 };
+
+const double DEADLINE_COST_SMOOTHING = 0.25; //< weight of the last call in the moving average of the cost
+const double DEADLINE_SAFETY_MARGIN = 0.9; //< share of the deadline that the estimated cost may use
+const int DEADLINE_MAX_PLANS = 4; //< plans remembered by a filter instance, the least recently used is replaced
+
+/// <summary>
+/// cost of the quality levels of a plan, that is a pixel format and grid processed by a filter instance
+/// </summary>
+struct DeadlinePlan
+{
+	int Format;
+	unsigned int HorRegions;
+	unsigned int VertRegions;
+	bool Approximate; //< approximate interpolation was already enabled by the caller
+	bool Measured[NUM_DEADLINE_LEVELS];
+	double Cost[NUM_DEADLINE_LEVELS]; //< moving average of the duration of the calls, in seconds
+	unsigned long long LastUse; //< 0 for unused entries
+};
+
+/// <summary>
+/// Learns the cost of the ProcessXXX calls of a filter instance at each quality level, and picks the best level
+/// that fits a deadline. A level that has not been measured yet is estimated from the nearest measured one with
+/// DEADLINE_PRIOR_COST_RATIOS; the change of cost measured on a level, due to content or machine load,
+/// is applied to the other measured levels of the plan, so their estimates follow it.
+/// </summary>
+/// <remarks>
+/// The model has a fixed size, so that choosing and learning do not allocate
+/// </remarks>
+class CDeadlineCostModel
+{
+public:
+	CDeadlineCostModel();
+
+	int SelectLevel(const DeadlinePlan& Key, double DeadlineSeconds);
+	void Update(const DeadlinePlan& Key, int Level, double Seconds);
+	double EstimateCost(const DeadlinePlan& Key, int Level) const; //< seconds, or a negative value if the plan is unknown
+	void Reset();
+
+private:
+	DeadlinePlan Plans[DEADLINE_MAX_PLANS];
+	unsigned long long UseCounter;
+
+	const DeadlinePlan* FindPlan(const DeadlinePlan& Key) const;
+	DeadlinePlan* FindOrCreatePlan(const DeadlinePlan& Key);
+	static double EstimatePlanCost(const DeadlinePlan& Plan, int Level);
+};
@@ -0,0 +1,413 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CFramePipeline.h"
+#include "CParallelSplitLoopAltaLuxFilter.h"
+#include "CMemoryBudget.h"
+
+#include <memory>
+
+/// <summary>
+/// split-loop filter whose ProcessGeneric is cut in two halves around the mappings,
+/// so that the halves of consecutive frames can run at the same time on different instances
+/// </summary>
+class CPipelineFrameFilter : public CParallelSplitLoopAltaLuxFilter
+{
+public:
+	CPipelineFrameFilter(int Width, int Height, int HorSlices, int VerSlices, FramePixelFormat _Format) :
+		CParallelSplitLoopAltaLuxFilter(Width, Height, HorSlices, VerSlices), Format(_Format),
+		FrameImage(nullptr), SavedImageBuffer(nullptr), Mapped(false), Banded(false)
+	{
+	}
+
+	int BeginFrame(void* Image); //< extracts the luminance of Image and computes its mappings
+	void EndFrame(); //< interpolates the mappings into the image of BeginFrame
+
+private:
+	FramePixelFormat Format;
+	void* FrameImage;
+	unsigned char* SavedImageBuffer; //< ImageBuffer of the instance while it points to a gray frame
+	bool Mapped; //< the mappings of FrameImage are in MapArray
+	bool Banded; //< FrameImage is processed by bands, as in RunBanded
+	std::unique_ptr<CMemoryReservation> Reservation; //< memory of FrameImage, from BeginFrame to the end of EndFrame
+
+	int GetPixelOffset() const;
+	bool IsBGR() const;
+	void ExtractFrameRows(int FirstRow, int LastRow);
+	void ReleaseFrame();
+};
+
+int CPipelineFrameFilter::GetPixelOffset() const
+{
+	return ((Format == FRAME_FORMAT_RGB24) || (Format == FRAME_FORMAT_BGR24)) ? 3 : 4;
+}
+
+bool CPipelineFrameFilter::IsBGR() const
+{
+	return (Format == FRAME_FORMAT_BGR24) || (Format == FRAME_FORMAT_BGR32);
+}
+
+/// <summary>
+/// computes the luminance of some rows of the RGB frame into the band held by ImageBuffer
+/// </summary>
+void CPipelineFrameFilter::ExtractFrameRows(int FirstRow, int LastRow)
+{
+	int FirstFactor, SecondFactor, ThirdFactor;
+	GetLuminanceFactors(IsBGR(), FirstFactor, SecondFactor, ThirdFactor);
+	ExtractLuminanceRows(static_cast<const unsigned char *>(FrameImage), FirstFactor, SecondFactor, ThirdFactor,
+	                     GetPixelOffset(), FirstRow, LastRow);
+}
+
+/// <summary>
+/// gives back the buffers of the frame and its reservation in CMemoryBudget
+/// </summary>
+void CPipelineFrameFilter::ReleaseFrame()
+{
+	if (Format == FRAME_FORMAT_GRAY)
+		ImageBuffer = SavedImageBuffer;
+	else if (Reservation)
+		ReleaseCallBuffer(*Reservation);
+	Reservation.reset();
+	Mapped = false;
+	Banded = false;
+}
+
+/// <summary>
+/// first half of ProcessGray and ProcessGeneric, the memory of the frame is reserved in CMemoryBudget
+/// until the end of EndFrame, so that the frames in flight count against the limit as the ProcessXXX calls do
+/// </summary>
+/// <returns>error code, refer to AL_XXX codes</returns>
+int CPipelineFrameFilter::BeginFrame(void* Image)
+{
+	FrameImage = Image;
+	Mapped = false;
+	Banded = false;
+	if (Image == nullptr)
+		return AL_NULL_IMAGE;
+
+	if (Format == FRAME_FORMAT_GRAY)
+	{
+		/// as in ProcessGray, the gray frame is processed in place, so only the mappings are reserved
+		/// and there is no lower-memory mode to fall back to
+		Reservation.reset(new CMemoryReservation(GetMapArrayBytes(), GetMapArrayBytes(), Priority));
+		SavedImageBuffer = ImageBuffer;
+		ImageBuffer = static_cast<unsigned char *>(Image);
+	}
+	else
+	{
+		/// as in ProcessGeneric, if the luminance plane does not fit or cannot be allocated, the frame is
+		/// processed by bands: the mapping stage extracts the rows of each contextual region and the
+		/// interpolation stage extracts them again, as the frame is not changed in between
+		Reservation.reset(new CMemoryReservation(IMAGE_BUFFER_SIZE + GetMapArrayBytes(),
+		                                         GetBandBufferSize() + GetMapArrayBytes(), Priority));
+		if (!AllocateCallBuffer(*Reservation))
+		{
+			Reservation.reset();
+			return AL_OUT_OF_MEMORY;
+		}
+		Banded = Reservation->IsReduced();
+		WaitForTurn();
+		if (!Banded)
+		{
+			int FirstFactor, SecondFactor, ThirdFactor;
+			GetLuminanceFactors(IsBGR(), FirstFactor, SecondFactor, ThirdFactor);
+			ExtractLuminance(static_cast<const unsigned char *>(Image), FirstFactor, SecondFactor, ThirdFactor,
+			                 GetPixelOffset());
+		}
+	}
+
+	if (ClipLimit == 1.0)
+		return AL_OK; //< as in Run, the luminance is left as is
+
+	const int MappingReturn = Banded ?
+		RunBandedMappings([this](int FirstRow, int LastRow) { ExtractFrameRows(FirstRow, LastRow); }) :
+		RunMappingPhase();
+	if (MappingReturn != AL_OK)
+	{
+		ReleaseFrame();
+		return MappingReturn;
+	}
+	Mapped = true;
+	return AL_OK;
+}
+
+/// <summary>
+/// second half of ProcessGray and ProcessGeneric, called only if BeginFrame succeeded
+/// </summary>
+void CPipelineFrameFilter::EndFrame()
+{
+	if (Format == FRAME_FORMAT_GRAY)
+	{
+		if (Mapped)
+			RunInterpolationPhase();
+	}
+	else if (Mapped)
+	{
+		/// as in ProcessGeneric, the interpolation writes straight into the pixels of the frame
+		SetLumaOutput(FrameImage, AL_OUTPUT_RGB, GetPixelOffset(), 0);
+		if (Banded)
+			RunBandedInterpolation([this](int FirstRow, int LastRow) { ExtractFrameRows(FirstRow, LastRow); });
+		else
+			RunInterpolationPhase();
+		SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	}
+	ReleaseFrame();
+}
+
+CFramePipeline::CFramePipeline(int Width, int Height, FramePixelFormat _Format, int HorSlices, int VerSlices,
+                               unsigned int _Depth)
+{
+	Format = _Format;
+	Depth = _Depth;
+	if (Depth < 1)
+		Depth = 1;
+	if (Depth > MAX_PIPELINE_DEPTH)
+		Depth = MAX_PIPELINE_DEPTH;
+	Strength = AL_DEFAULT_STRENGTH;
+	Priority = FILTER_PRIORITY_NORMAL;
+	IdentityTolerance = AL_DEFAULT_IDENTITY_TOLERANCE;
+	AutoStrength = false;
+
+	for (unsigned int i = 0; i < MAX_PIPELINE_DEPTH; i++)
+	{
+		FrameSlot& Slot = Slots[i];
+		Slot.Filter = nullptr;
+		Slot.Image = nullptr;
+		Slot.State = SLOT_FREE;
+		Slot.Status = AL_OK;
+		Slot.Strength = AL_DEFAULT_STRENGTH;
+		Slot.Priority = FILTER_PRIORITY_NORMAL;
+		if (i >= Depth)
+			continue;
+		/// a slot whose filter cannot be allocated fails its frames with AL_OUT_OF_MEMORY
+		try
+		{
+			Slot.Filter = new CPipelineFrameFilter(Width, Height, HorSlices, VerSlices, Format);
+		}
+		catch (...)
+		{
+			Slot.Filter = nullptr;
+		}
+	}
+
+	SubmittedFrames = 0;
+	CompletedFrames = 0;
+	NextMappedFrame = 0;
+	NextInterpolatedFrame = 0;
+	MappingBusy = false;
+	InterpolationBusy = false;
+}
+
+CFramePipeline::~CFramePipeline()
+{
+	Stages.wait();
+	for (unsigned int i = 0; i < Depth; i++)
+	{
+		try
+		{
+			delete Slots[i].Filter;
+		}
+		catch (...)
+		{
+		}
+		Slots[i].Filter = nullptr;
+	}
+}
+
+void CFramePipeline::SetStrength(int _Strength)
+{
+	std::lock_guard<std::mutex> Lock(StateLock);
+	Strength = _Strength;
+}
+
+void CFramePipeline::SetPriority(FilterPriority _Priority)
+{
+	std::lock_guard<std::mutex> Lock(StateLock);
+	Priority = _Priority;
+}
+
+void CFramePipeline::SetIdentityTolerance(unsigned int Graylevels)
+{
+	std::lock_guard<std::mutex> Lock(StateLock);
+	IdentityTolerance = Graylevels;
+}
+
+void CFramePipeline::SetAutoStrength(bool Enabled)
+{
+	std::lock_guard<std::mutex> Lock(StateLock);
+	AutoStrength = Enabled;
+}
+
+unsigned int CFramePipeline::GetDepth() const
+{
+	return Depth;
+}
+
+unsigned int CFramePipeline::GetNumFramesInFlight() const
+{
+	std::lock_guard<std::mutex> Lock(StateLock);
+	return static_cast<unsigned int>(SubmittedFrames - CompletedFrames);
+}
+
+/// <summary>
+/// queues a frame, which starts its mapping stage as soon as the previous frame has left it
+/// </summary>
+/// <param name="Image">frame to be processed in place, in the format given to the constructor</param>
+/// <returns>AL_OK if the frame was queued, AL_PIPELINE_FULL if GetDepth() frames are in flight</returns>
+/// <remarks>
+/// the errors of the processing of the frame are returned by CompleteFrame
+/// </remarks>
+int CFramePipeline::SubmitFrame(void* Image)
+{
+	std::unique_lock<std::mutex> Lock(StateLock);
+	if (SubmittedFrames - CompletedFrames >= Depth)
+		return AL_PIPELINE_FULL;
+
+	FrameSlot& Slot = Slots[SubmittedFrames % Depth];
+	/// the slot is free, so no stage is using its filter
+	if ((Slot.Filter != nullptr) && (Slot.Strength != Strength))
+	{
+		Slot.Filter->SetStrength(Strength);
+		Slot.Strength = Strength;
+	}
+	if (Slot.Filter != nullptr)
+	{
+		Slot.Filter->SetPriority(Priority);
+		Slot.Filter->SetIdentityTolerance(IdentityTolerance);
+		Slot.Filter->SetAutoStrength(AutoStrength);
+	}
+	Slot.Priority = Priority;
+	Slot.Image = Image;
+	Slot.Status = AL_OK;
+	Slot.State = SLOT_QUEUED;
+	SubmittedFrames++;
+
+	Dispatch(Lock);
+	return AL_OK;
+}
+
+/// <summary>
+/// waits for the oldest frame in flight and frees its slot
+/// </summary>
+/// <param name="Image">if not null, receives the image given to SubmitFrame</param>
+/// <returns>error code of the processing of the frame, refer to AL_XXX codes, or AL_PIPELINE_EMPTY</returns>
+int CFramePipeline::CompleteFrame(void** Image)
+{
+	std::unique_lock<std::mutex> Lock(StateLock);
+	if (CompletedFrames == SubmittedFrames)
+		return AL_PIPELINE_EMPTY;
+
+	FrameSlot& Slot = Slots[CompletedFrames % Depth];
+	FrameDone.wait(Lock, [&]() { return Slot.State == SLOT_DONE; });
+	if (Image != nullptr)
+		*Image = Slot.Image;
+	const int Status = Slot.Status;
+	Slot.Image = nullptr;
+	Slot.State = SLOT_FREE;
+	CompletedFrames++;
+	return Status;
+}
+
+int CFramePipeline::Flush()
+{
+	int FirstError = AL_OK;
+	for (;;)
+	{
+		const int Status = CompleteFrame();
+		if (Status == AL_PIPELINE_EMPTY)
+			return FirstError;
+		if ((Status != AL_OK) && (FirstError == AL_OK))
+			FirstError = Status;
+	}
+}
+
+/// <summary>
+/// starts the stages that can take their next frame
+/// </summary>
+/// <param name="Lock">holds StateLock, which is released before the stages are started</param>
+/// <remarks>
+/// a stage takes the frames one at a time and in submission order, so frame N + 1 is mapped while frame N is
+/// interpolated, and its mappings are never written while frame N still reads its own ones, as they belong to
+/// different filters
+/// </remarks>
+void CFramePipeline::Dispatch(std::unique_lock<std::mutex>& Lock)
+{
+	int MappingSlot = -1;
+	int InterpolationSlot = -1;
+	if (!MappingBusy && (NextMappedFrame < SubmittedFrames))
+	{
+		MappingBusy = true;
+		MappingSlot = static_cast<int>(NextMappedFrame % Depth);
+		Slots[MappingSlot].State = SLOT_MAPPING;
+	}
+	if (!InterpolationBusy && (NextInterpolatedFrame < NextMappedFrame) &&
+		(Slots[NextInterpolatedFrame % Depth].State == SLOT_MAPPED))
+	{
+		InterpolationBusy = true;
+		InterpolationSlot = static_cast<int>(NextInterpolatedFrame % Depth);
+		Slots[InterpolationSlot].State = SLOT_INTERPOLATING;
+	}
+	Lock.unlock();
+
+	if (MappingSlot >= 0)
+		Stages.run([this, MappingSlot]() { RunMappingStage(MappingSlot); });
+	if (InterpolationSlot >= 0)
+		Stages.run([this, InterpolationSlot]() { RunInterpolationStage(InterpolationSlot); });
+}
+
+void CFramePipeline::RunMappingStage(unsigned int Slot)
+{
+	FrameSlot& Frame = Slots[Slot];
+	{
+		CPriorityJob PriorityJob(Frame.Priority);
+		Frame.Status = (Frame.Filter != nullptr) ? Frame.Filter->BeginFrame(Frame.Image) : AL_OUT_OF_MEMORY;
+	}
+
+	std::unique_lock<std::mutex> Lock(StateLock);
+	Frame.State = SLOT_MAPPED;
+	MappingBusy = false;
+	NextMappedFrame++;
+	Dispatch(Lock);
+}
+
+void CFramePipeline::RunInterpolationStage(unsigned int Slot)
+{
+	FrameSlot& Frame = Slots[Slot];
+	/// a frame that failed its mapping stage still goes through this stage, so that frames complete in order
+	if (Frame.Status == AL_OK)
+	{
+		CPriorityJob PriorityJob(Frame.Priority);
+		Frame.Filter->EndFrame();
+	}
+
+	std::unique_lock<std::mutex> Lock(StateLock);
+	Frame.State = SLOT_DONE;
+	InterpolationBusy = false;
+	NextInterpolatedFrame++;
+	FrameDone.notify_all();
+	Dispatch(Lock);
+}
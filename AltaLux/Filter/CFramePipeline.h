@@ -0,0 +1,138 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include "CBaseAltaLuxFilter.h"
+
+#include <ppl.h>
+
+#include <condition_variable>
+#include <mutex>
+
+/// CFramePipeline return values, in addition to the AL_XXX codes of CBaseAltaLuxFilter
+const int AL_PIPELINE_FULL = -12; //< SubmitFrame called with GetDepth() frames in flight, complete the oldest one first
+const int AL_PIPELINE_EMPTY = -13; //< CompleteFrame called with no frames in flight
+
+const unsigned int DEFAULT_PIPELINE_DEPTH = 3; //< frames in flight: one being mapped, one being interpolated, one queued
+const unsigned int MAX_PIPELINE_DEPTH = 8;
+
+/// pixel formats accepted by CFramePipeline, the packed YUV ones are processed by 32-bit assembly only
+enum FramePixelFormat
+{
+	FRAME_FORMAT_GRAY = 0,
+	FRAME_FORMAT_RGB24,
+	FRAME_FORMAT_RGB32,
+	FRAME_FORMAT_BGR24,
+	FRAME_FORMAT_BGR32
+};
+
+class CPipelineFrameFilter;
+
+/// <summary>
+/// Processes a stream of same-sized frames with a bounded ring of frames in flight.
+/// Each frame goes through two stages: extraction of the luminance plus the mappings of the contextual regions,
+/// then interpolation plus write-back. The mapping stage of a frame runs while the previous frame is interpolated,
+/// so that the cores left idle by the tail of one stage are used by the other one and the sustained frame rate is
+/// bounded by the slower stage rather than by their sum.
+/// Frames enter each stage in submission order and are completed in the same order.
+/// </summary>
+/// <remarks>
+/// Every slot of the ring owns a split-loop filter, so without a limit on CMemoryBudget the buffers are allocated once.
+/// Under a limit, each frame reserves its buffers from the start of its mapping stage to the end of its interpolation
+/// stage and, as ProcessGeneric does, an RGB frame that does not fit is processed by bands; a gray frame is processed
+/// in place and reserves only its mappings.
+/// The caller must not touch a submitted image until CompleteFrame has returned it.
+/// </remarks>
+class CFramePipeline
+{
+public:
+	CFramePipeline(int Width, int Height, FramePixelFormat Format, int HorSlices = DEFAULT_HOR_REGIONS,
+	               int VerSlices = DEFAULT_VERT_REGIONS, unsigned int Depth = DEFAULT_PIPELINE_DEPTH);
+	~CFramePipeline(); //< waits for the frames still in flight
+
+	void SetStrength(int Strength = AL_DEFAULT_STRENGTH); //< applied to the frames submitted afterwards
+	void SetPriority(FilterPriority Priority); //< priority class of the frames submitted afterwards
+	void SetIdentityTolerance(unsigned int Graylevels); //< refer to CBaseAltaLuxFilter::SetIdentityTolerance
+	void SetAutoStrength(bool Enabled); //< refer to CBaseAltaLuxFilter::SetAutoStrength
+
+	int SubmitFrame(void* Image); //< starts processing Image in place, returns AL_PIPELINE_FULL if the ring is full
+	int CompleteFrame(void** Image = nullptr); //< waits for the oldest frame in flight, returns its AL_XXX status
+	int Flush(); //< completes all the frames in flight, returns the first error among them
+
+	unsigned int GetDepth() const;
+	unsigned int GetNumFramesInFlight() const;
+
+private:
+	/// stages of a slot, in the order they are visited by each frame
+	enum SlotState
+	{
+		SLOT_FREE = 0,
+		SLOT_QUEUED, //< submitted, waiting for the mapping stage
+		SLOT_MAPPING,
+		SLOT_MAPPED, //< waiting for the interpolation stage
+		SLOT_INTERPOLATING,
+		SLOT_DONE //< waiting for CompleteFrame
+	};
+
+	struct FrameSlot
+	{
+		CPipelineFrameFilter* Filter;
+		void* Image;
+		SlotState State;
+		int Status;
+		int Strength; //< last strength set on Filter
+		FilterPriority Priority;
+	};
+
+	void Dispatch(std::unique_lock<std::mutex>& Lock);
+	void RunMappingStage(unsigned int Slot);
+	void RunInterpolationStage(unsigned int Slot);
+
+	FramePixelFormat Format;
+	unsigned int Depth;
+	FrameSlot Slots[MAX_PIPELINE_DEPTH];
+	int Strength;
+	FilterPriority Priority;
+	unsigned int IdentityTolerance;
+	bool AutoStrength;
+
+	/// frames are numbered in submission order, frame N uses slot N % Depth
+	unsigned long long SubmittedFrames;
+	unsigned long long CompletedFrames; //< frames returned by CompleteFrame
+	unsigned long long NextMappedFrame; //< next frame to enter the mapping stage
+	unsigned long long NextInterpolatedFrame; //< next frame to enter the interpolation stage
+	bool MappingBusy;
+	bool InterpolationBusy;
+
+	mutable std::mutex StateLock;
+	std::condition_variable FrameDone;
+	concurrency::task_group Stages;
+
+	CFramePipeline(const CFramePipeline&) = delete;
+	CFramePipeline& operator=(const CFramePipeline&) = delete;
+};
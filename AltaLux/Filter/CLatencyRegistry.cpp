@@ -0,0 +1,296 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CLatencyRegistry.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+/// quantiles published by ExportPrometheus
+static const double EXPORTED_QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/// nesting depth of CLatencyScope on the current thread
+static thread_local int LatencyScopeDepth = 0;
+
+unsigned long long CLatencySnapshot::GetPercentile(double Percentile) const
+{
+	if (TotalCount == 0)
+		return 0;
+	if (Percentile < 0.0)
+		Percentile = 0.0;
+	if (Percentile > 100.0)
+		Percentile = 100.0;
+	/// rank of the requested sample, counting from 1
+	auto TargetCount = static_cast<unsigned long long>(std::ceil(Percentile / 100.0 * TotalCount));
+	if (TargetCount == 0)
+		TargetCount = 1;
+	unsigned long long CumulativeCount = 0;
+	for (int i = 0; i < NUM_LATENCY_BUCKETS; i++)
+	{
+		CumulativeCount += Counts[i];
+		if (CumulativeCount >= TargetCount)
+			return CLatencyHistogram::GetBucketUpperBound(i);
+	}
+	return CLatencyHistogram::GetBucketUpperBound(NUM_LATENCY_BUCKETS - 1);
+}
+
+unsigned long long CLatencySnapshot::GetMax() const
+{
+	for (int i = NUM_LATENCY_BUCKETS - 1; i >= 0; i--)
+	{
+		if (Counts[i] != 0)
+			return CLatencyHistogram::GetBucketUpperBound(i);
+	}
+	return 0;
+}
+
+CLatencyHistogram::CLatencyHistogram()
+{
+	Reset();
+}
+
+/// <summary>
+/// adds a sample to the histogram, can be called concurrently from any thread
+/// </summary>
+/// <param name="Nanoseconds">latency of the sample</param>
+void CLatencyHistogram::Record(unsigned long long Nanoseconds)
+{
+	Counts[GetBucketIndex(Nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	TotalNanoseconds.fetch_add(Nanoseconds, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// copies the histogram into Snapshot
+/// </summary>
+/// <param name="Snapshot">receives the bucket counts</param>
+/// <param name="ResetAfterSnapshot">if true, the buckets are cleared as they are read, so that no sample is lost or counted twice between two snapshots</param>
+void CLatencyHistogram::GetSnapshot(CLatencySnapshot& Snapshot, bool ResetAfterSnapshot)
+{
+	Snapshot.TotalCount = 0;
+	for (int i = 0; i < NUM_LATENCY_BUCKETS; i++)
+	{
+		Snapshot.Counts[i] = ResetAfterSnapshot ? Counts[i].exchange(0, std::memory_order_relaxed)
+		                                        : Counts[i].load(std::memory_order_relaxed);
+		Snapshot.TotalCount += Snapshot.Counts[i];
+	}
+	Snapshot.TotalNanoseconds = ResetAfterSnapshot ? TotalNanoseconds.exchange(0, std::memory_order_relaxed)
+	                                               : TotalNanoseconds.load(std::memory_order_relaxed);
+}
+
+void CLatencyHistogram::Reset()
+{
+	for (int i = 0; i < NUM_LATENCY_BUCKETS; i++)
+		Counts[i].store(0, std::memory_order_relaxed);
+	TotalNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+int CLatencyHistogram::GetBucketIndex(unsigned long long Nanoseconds)
+{
+	if (Nanoseconds < LATENCY_SUB_BUCKETS)
+		return static_cast<int>(Nanoseconds);
+	if ((Nanoseconds >> (LATENCY_MAX_EXPONENT + 1)) != 0)
+		return NUM_LATENCY_BUCKETS - 1;
+	/// position of the most significant bit
+	int Exponent = LATENCY_SUB_BUCKET_BITS;
+	while ((Nanoseconds >> (Exponent + 1)) != 0)
+		Exponent++;
+	/// the LATENCY_SUB_BUCKET_BITS bits below the most significant one select the linear sub-bucket
+	auto SubBucket = static_cast<int>(Nanoseconds >> (Exponent - LATENCY_SUB_BUCKET_BITS)) - LATENCY_SUB_BUCKETS;
+	return LATENCY_SUB_BUCKETS * (Exponent - LATENCY_SUB_BUCKET_BITS + 1) + SubBucket;
+}
+
+unsigned long long CLatencyHistogram::GetBucketUpperBound(int BucketIndex)
+{
+	if (BucketIndex < LATENCY_SUB_BUCKETS)
+		return static_cast<unsigned long long>(BucketIndex);
+	int Shift = BucketIndex / LATENCY_SUB_BUCKETS - 1;
+	int SubBucket = BucketIndex % LATENCY_SUB_BUCKETS;
+	unsigned long long LowerBound = static_cast<unsigned long long>(LATENCY_SUB_BUCKETS + SubBucket) << Shift;
+	return LowerBound + (1ULL << Shift) - 1;
+}
+
+CLatencyRegistry::CLatencyRegistry()
+{
+	Enabled.store(false);
+}
+
+CLatencyRegistry& CLatencyRegistry::GetInstance()
+{
+	static CLatencyRegistry Instance;
+	return Instance;
+}
+
+/// <summary>
+/// starts or stops recording the latency of the ProcessXXX calls; the histograms are kept when recording stops
+/// </summary>
+void CLatencyRegistry::SetEnabled(bool Enabled)
+{
+	this->Enabled.store(Enabled, std::memory_order_relaxed);
+}
+
+bool CLatencyRegistry::IsEnabled() const
+{
+	return Enabled.load(std::memory_order_relaxed);
+}
+
+void CLatencyRegistry::Record(LatencyPixelFormat Format, int Width, int Height, unsigned long long Nanoseconds)
+{
+	if ((Format < 0) || (Format >= NUM_LATENCY_FORMATS))
+		return;
+	Histograms[Format][GetSizeBucket(Width, Height)].Record(Nanoseconds);
+}
+
+void CLatencyRegistry::GetSnapshot(LatencyPixelFormat Format, LatencySizeBucket Size, CLatencySnapshot& Snapshot,
+                                   bool ResetAfterSnapshot)
+{
+	Histograms[Format][Size].GetSnapshot(Snapshot, ResetAfterSnapshot);
+}
+
+void CLatencyRegistry::Reset()
+{
+	for (int Format = 0; Format < NUM_LATENCY_FORMATS; Format++)
+	{
+		for (int Size = 0; Size < NUM_LATENCY_SIZES; Size++)
+			Histograms[Format][Size].Reset();
+	}
+}
+
+/// <summary>
+/// formats the histograms as a Prometheus summary named altalux_process_latency_seconds,
+/// labelled with format and size, and skips the histograms without samples
+/// </summary>
+/// <returns>text in Prometheus exposition format</returns>
+std::string CLatencyRegistry::ExportPrometheus()
+{
+	std::string Text;
+	Text += "# HELP altalux_process_latency_seconds Latency of the AltaLux filter Process calls.\n";
+	Text += "# TYPE altalux_process_latency_seconds summary\n";
+
+	CLatencySnapshot Snapshot;
+	char Line[256];
+	for (int Format = 0; Format < NUM_LATENCY_FORMATS; Format++)
+	{
+		for (int Size = 0; Size < NUM_LATENCY_SIZES; Size++)
+		{
+			GetSnapshot(static_cast<LatencyPixelFormat>(Format), static_cast<LatencySizeBucket>(Size), Snapshot);
+			if (Snapshot.TotalCount == 0)
+				continue;
+			auto FormatName = GetFormatName(static_cast<LatencyPixelFormat>(Format));
+			auto SizeName = GetSizeName(static_cast<LatencySizeBucket>(Size));
+			for (auto Quantile : EXPORTED_QUANTILES)
+			{
+				snprintf(Line, sizeof(Line),
+				         "altalux_process_latency_seconds{format=\"%s\",size=\"%s\",quantile=\"%g\"} %.9g\n",
+				         FormatName, SizeName, Quantile, Snapshot.GetPercentile(Quantile * 100.0) * 1e-9);
+				Text += Line;
+			}
+			snprintf(Line, sizeof(Line), "altalux_process_latency_seconds_sum{format=\"%s\",size=\"%s\"} %.9g\n",
+			         FormatName, SizeName, Snapshot.TotalNanoseconds * 1e-9);
+			Text += Line;
+			snprintf(Line, sizeof(Line), "altalux_process_latency_seconds_count{format=\"%s\",size=\"%s\"} %llu\n",
+			         FormatName, SizeName, Snapshot.TotalCount);
+			Text += Line;
+		}
+	}
+	return Text;
+}
+
+/// <summary>
+/// writes ExportPrometheus() into a file, e.g. for the textfile collector of the node exporter
+/// </summary>
+/// <param name="FileName">name of the file, overwritten if it exists</param>
+/// <returns>true if the file was written</returns>
+bool CLatencyRegistry::ExportPrometheus(const char* FileName)
+{
+	if (FileName == nullptr)
+		return false;
+	std::ofstream File(FileName, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!File)
+		return false;
+	File << ExportPrometheus();
+	File.close();
+	return !File.fail();
+}
+
+LatencySizeBucket CLatencyRegistry::GetSizeBucket(int Width, int Height)
+{
+	auto NumPixels = static_cast<long long>(Width) * Height;
+	if (NumPixels <= 640LL * 480)
+		return LATENCY_SIZE_VGA;
+	if (NumPixels <= 1280LL * 720)
+		return LATENCY_SIZE_HD;
+	if (NumPixels <= 1920LL * 1080)
+		return LATENCY_SIZE_FULL_HD;
+	if (NumPixels <= 3840LL * 2160)
+		return LATENCY_SIZE_4K;
+	if (NumPixels <= 7680LL * 4320)
+		return LATENCY_SIZE_8K;
+	return LATENCY_SIZE_HUGE;
+}
+
+const char* CLatencyRegistry::GetFormatName(LatencyPixelFormat Format)
+{
+	static const char* FORMAT_NAMES[NUM_LATENCY_FORMATS] =
+	{
+		"uyvy", "vyuy", "yuyv", "yvyu", "gray", "rgb24", "rgb32", "bgr24", "bgr32"
+	};
+	if ((Format < 0) || (Format >= NUM_LATENCY_FORMATS))
+		return "unknown";
+	return FORMAT_NAMES[Format];
+}
+
+const char* CLatencyRegistry::GetSizeName(LatencySizeBucket Size)
+{
+	static const char* SIZE_NAMES[NUM_LATENCY_SIZES] =
+	{
+		"vga", "hd", "fullhd", "4k", "8k", "huge"
+	};
+	if ((Size < 0) || (Size >= NUM_LATENCY_SIZES))
+		return "unknown";
+	return SIZE_NAMES[Size];
+}
+
+CLatencyScope::CLatencyScope(LatencyPixelFormat Format, int Width, int Height)
+	: Format(Format), Width(Width), Height(Height)
+{
+	/// only the outermost scope records, and the clock is not read at all when the registry is disabled
+	Recording = (LatencyScopeDepth++ == 0) && CLatencyRegistry::GetInstance().IsEnabled();
+	if (Recording)
+		StartTime = std::chrono::steady_clock::now();
+}
+
+CLatencyScope::~CLatencyScope()
+{
+	LatencyScopeDepth--;
+	if (Recording)
+	{
+		auto Elapsed = std::chrono::steady_clock::now() - StartTime;
+		auto Nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Elapsed).count();
+		CLatencyRegistry::GetInstance().Record(Format, Width, Height, static_cast<unsigned long long>(Nanoseconds));
+	}
+}
@@ -0,0 +1,159 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/// pixel formats accepted by the CBaseAltaLuxFilter::ProcessXXX methods, used to label latency samples
+enum LatencyPixelFormat
+{
+	LATENCY_FORMAT_UYVY = 0,
+	LATENCY_FORMAT_VYUY,
+	LATENCY_FORMAT_YUYV,
+	LATENCY_FORMAT_YVYU,
+	LATENCY_FORMAT_GRAY,
+	LATENCY_FORMAT_RGB24,
+	LATENCY_FORMAT_RGB32,
+	LATENCY_FORMAT_BGR24,
+	LATENCY_FORMAT_BGR32,
+	NUM_LATENCY_FORMATS
+};
+
+/// image sizes, each bucket holds the images with up to as many pixels as the named resolution
+enum LatencySizeBucket
+{
+	LATENCY_SIZE_VGA = 0, //< up to 640x480
+	LATENCY_SIZE_HD, //< up to 1280x720
+	LATENCY_SIZE_FULL_HD, //< up to 1920x1080
+	LATENCY_SIZE_4K, //< up to 3840x2160
+	LATENCY_SIZE_8K, //< up to 7680x4320
+	LATENCY_SIZE_HUGE, //< larger than 8K
+	NUM_LATENCY_SIZES
+};
+
+/// Layout of the HDR-style latency histogram: values below 2^LATENCY_SUB_BUCKET_BITS nanoseconds get a bucket each,
+/// every larger power of two range is split into 2^LATENCY_SUB_BUCKET_BITS linear buckets,
+/// so the relative error of a recorded value is below 1 / 2^LATENCY_SUB_BUCKET_BITS
+const int LATENCY_SUB_BUCKET_BITS = 4;
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BUCKET_BITS;
+const int LATENCY_MAX_EXPONENT = 36; //< values from 2^36 ns (about 68 seconds) on are recorded in the last bucket
+const int NUM_LATENCY_BUCKETS = LATENCY_SUB_BUCKETS * (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2);
+
+/// <summary>
+/// copy of a latency histogram, taken by CLatencyRegistry::GetSnapshot
+/// </summary>
+struct CLatencySnapshot
+{
+	unsigned long long Counts[NUM_LATENCY_BUCKETS];
+	unsigned long long TotalCount; //< sum of Counts
+	unsigned long long TotalNanoseconds;
+
+	unsigned long long GetPercentile(double Percentile) const; //< Percentile from 0.0 to 100.0, result in nanoseconds
+	unsigned long long GetMax() const;
+};
+
+/// <summary>
+/// latency histogram that can be recorded concurrently from any thread without locks
+/// </summary>
+class CLatencyHistogram
+{
+public:
+	CLatencyHistogram();
+
+	void Record(unsigned long long Nanoseconds);
+	void GetSnapshot(CLatencySnapshot& Snapshot, bool ResetAfterSnapshot = false);
+	void Reset();
+
+	static int GetBucketIndex(unsigned long long Nanoseconds);
+	static unsigned long long GetBucketUpperBound(int BucketIndex); //< highest value recorded into the bucket
+
+private:
+	std::atomic<unsigned long long> Counts[NUM_LATENCY_BUCKETS];
+	std::atomic<unsigned long long> TotalNanoseconds;
+};
+
+/// <summary>
+/// Process-wide registry of the latency of the CBaseAltaLuxFilter::ProcessXXX calls,
+/// with a histogram for each pixel format and image size bucket.
+/// Recording is disabled by default, so that the filter does not pay for the timers unless asked to.
+/// </summary>
+/// <remarks>
+/// Snapshots read each bucket atomically but not the histogram as a whole, so a snapshot taken
+/// while other threads are recording may miss the samples that are being added.
+/// </remarks>
+class CLatencyRegistry
+{
+public:
+	static CLatencyRegistry& GetInstance();
+
+	void SetEnabled(bool Enabled = true);
+	bool IsEnabled() const;
+
+	void Record(LatencyPixelFormat Format, int Width, int Height, unsigned long long Nanoseconds);
+	void GetSnapshot(LatencyPixelFormat Format, LatencySizeBucket Size, CLatencySnapshot& Snapshot,
+	                 bool ResetAfterSnapshot = false);
+	void Reset();
+
+	std::string ExportPrometheus(); //< Prometheus text exposition format, one summary series for each non-empty histogram
+	bool ExportPrometheus(const char* FileName);
+
+	static LatencySizeBucket GetSizeBucket(int Width, int Height);
+	static const char* GetFormatName(LatencyPixelFormat Format);
+	static const char* GetSizeName(LatencySizeBucket Size);
+
+private:
+	CLatencyRegistry();
+	CLatencyRegistry(const CLatencyRegistry&) = delete;
+	CLatencyRegistry& operator=(const CLatencyRegistry&) = delete;
+
+	std::atomic<bool> Enabled;
+	CLatencyHistogram Histograms[NUM_LATENCY_FORMATS][NUM_LATENCY_SIZES];
+};
+
+/// <summary>
+/// times its own lifetime and records it into CLatencyRegistry, if enabled;
+/// nested scopes on the same thread are not recorded, so a ProcessXXX method forwarding to another one is counted once
+/// </summary>
+class CLatencyScope
+{
+public:
+	CLatencyScope(LatencyPixelFormat Format, int Width, int Height);
+	~CLatencyScope();
+
+private:
+	LatencyPixelFormat Format;
+	int Width;
+	int Height;
+	bool Recording;
+	std::chrono::steady_clock::time_point StartTime;
+
+	CLatencyScope(const CLatencyScope&) = delete;
+	CLatencyScope& operator=(const CLatencyScope&) = delete;
+};
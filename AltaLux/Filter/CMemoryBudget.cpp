@@ -0,0 +1,179 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CMemoryBudget.h"
+
+CMemoryBudget::CMemoryBudget()
+{
+	Limit = 0;
+	ReservedBytes = 0;
+	NextTicket = 0;
+	ServedTicket = 0;
+	Stats = MemoryBudgetStats();
+}
+
+CMemoryBudget& CMemoryBudget::GetInstance()
+{
+	static CMemoryBudget Instance;
+	return Instance;
+}
+
+/// <summary>
+/// sets the bytes that the running jobs may reserve together; the jobs already running keep their reservations,
+/// the waiting ones are admitted as soon as they fit in the new limit
+/// </summary>
+void CMemoryBudget::SetLimit(size_t Bytes)
+{
+	{
+		std::lock_guard<std::mutex> Lock(BudgetLock);
+		Limit = Bytes;
+	}
+	BudgetChanged.notify_all();
+}
+
+size_t CMemoryBudget::GetLimit() const
+{
+	std::lock_guard<std::mutex> Lock(BudgetLock);
+	return Limit;
+}
+
+bool CMemoryBudget::IsLimited() const
+{
+	return GetLimit() != 0;
+}
+
+size_t CMemoryBudget::GetReservedBytes() const
+{
+	std::lock_guard<std::mutex> Lock(BudgetLock);
+	return ReservedBytes;
+}
+
+/// <summary>
+/// admits a job, waiting behind the jobs that are already waiting and then until its normal or lower-memory
+/// footprint fits in the budget; the lower-memory mode is preferred to waiting
+/// </summary>
+/// <param name="FullBytes">footprint of the normal mode of the job</param>
+/// <param name="ReducedBytes">footprint of the lower-memory mode of the job, not larger than FullBytes</param>
+/// <param name="Priority">priority class of the job, that is not yielded to while the job waits</param>
+/// <returns>bytes reserved for the job, to be released with Release</returns>
+size_t CMemoryBudget::Admit(size_t FullBytes, size_t ReducedBytes, FilterPriority Priority)
+{
+	std::unique_lock<std::mutex> Lock(BudgetLock);
+	Stats.NumAdmissions++;
+	auto FullFits = [&]() { return (Limit == 0) || (ReservedBytes + FullBytes <= Limit); };
+	/// a job larger than the whole budget is run when no other job holds memory, so that it is not blocked forever
+	auto ReducedFits = [&]() { return (ReservedBytes + ReducedBytes <= Limit) || (ReservedBytes == 0); };
+
+	if ((NextTicket != ServedTicket) || !(FullFits() || ReducedFits()))
+	{
+		const unsigned long long Ticket = NextTicket++;
+		Stats.NumQueued++;
+		const auto StartTime = std::chrono::steady_clock::now();
+		CPriorityScheduler::GetInstance().BeginMemoryWait(Priority);
+		BudgetChanged.wait(Lock, [&]() { return (Ticket == ServedTicket) && (FullFits() || ReducedFits()); });
+		CPriorityScheduler::GetInstance().EndMemoryWait(Priority);
+		ServedTicket++;
+		const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+		Stats.QueuedSeconds += Elapsed.count();
+		if (Elapsed.count() > Stats.MaxQueuedSeconds)
+			Stats.MaxQueuedSeconds = Elapsed.count();
+		/// the next waiting job may fit as well
+		BudgetChanged.notify_all();
+	}
+
+	const size_t Bytes = FullFits() ? FullBytes : ReducedBytes;
+	if (Bytes != FullBytes)
+		Stats.NumFallbacks++;
+	ReservedBytes += Bytes;
+	if (ReservedBytes > Stats.PeakBytes)
+		Stats.PeakBytes = ReservedBytes;
+	return Bytes;
+}
+
+/// <summary>
+/// returns the memory of a job to the budget and wakes up the waiting jobs
+/// </summary>
+void CMemoryBudget::Release(size_t Bytes)
+{
+	{
+		std::lock_guard<std::mutex> Lock(BudgetLock);
+		ReservedBytes -= Bytes;
+	}
+	BudgetChanged.notify_all();
+}
+
+void CMemoryBudget::CountFallback()
+{
+	std::lock_guard<std::mutex> Lock(BudgetLock);
+	Stats.NumFallbacks++;
+}
+
+MemoryBudgetStats CMemoryBudget::GetStats() const
+{
+	std::lock_guard<std::mutex> Lock(BudgetLock);
+	return Stats;
+}
+
+/// <summary>
+/// clears the counters, PeakBytes restarts from the bytes currently reserved
+/// </summary>
+void CMemoryBudget::ResetStats()
+{
+	std::lock_guard<std::mutex> Lock(BudgetLock);
+	Stats = MemoryBudgetStats();
+	Stats.PeakBytes = ReservedBytes;
+}
+
+CMemoryReservation::CMemoryReservation(size_t _FullBytes, size_t _ReducedBytes, FilterPriority Priority)
+	: FullBytes(_FullBytes), ReducedBytes(_ReducedBytes)
+{
+	ReservedBytes = CMemoryBudget::GetInstance().Admit(FullBytes, ReducedBytes, Priority);
+	Reduced = (ReservedBytes != FullBytes);
+}
+
+CMemoryReservation::~CMemoryReservation()
+{
+	CMemoryBudget::GetInstance().Release(ReservedBytes);
+}
+
+bool CMemoryReservation::IsReduced() const
+{
+	return Reduced;
+}
+
+/// <summary>
+/// gives back the difference between the two footprints, and counts the fallback
+/// </summary>
+void CMemoryReservation::Reduce()
+{
+	if (Reduced)
+		return;
+	CMemoryBudget::GetInstance().Release(ReservedBytes - ReducedBytes);
+	ReservedBytes = ReducedBytes;
+	Reduced = true;
+	CMemoryBudget::GetInstance().CountFallback();
+}
@@ -0,0 +1,111 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include "CPriorityScheduler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/// <summary>
+/// admission and fallback counters of CMemoryBudget, since the start of the process or the last ResetStats
+/// </summary>
+struct MemoryBudgetStats
+{
+	unsigned long long NumAdmissions; //< jobs admitted, with or without a limit
+	unsigned long long NumQueued; //< jobs that had to wait for other jobs to release their memory
+	unsigned long long NumFallbacks; //< jobs run in their lower-memory mode, because of the limit or of a failed allocation
+	double QueuedSeconds; //< total time spent waiting by the queued jobs
+	double MaxQueuedSeconds; //< longest wait of a single job
+	size_t PeakBytes; //< max value reached by the bytes reserved by the running jobs
+};
+
+/// <summary>
+/// Process-wide memory budget shared by the filter instances, so that concurrent calls on large images
+/// do not exhaust the memory together. Each job states the footprint of its normal mode and of its
+/// lower-memory mode: it is admitted in the normal mode if that fits in what is left of the budget,
+/// else in the lower-memory mode if that fits, else it waits in FIFO order for the running jobs to release
+/// their memory. A job that does not fit even in an empty budget is run alone, in its lower-memory mode.
+/// While a job waits, its priority class is not yielded to by CPriorityScheduler, so that the jobs holding
+/// the memory are not pre-empted in its favour and can complete.
+/// Without a limit, the default, every job is admitted at once in its normal mode.
+/// </summary>
+class CMemoryBudget
+{
+public:
+	static CMemoryBudget& GetInstance();
+
+	void SetLimit(size_t Bytes); //< 0 removes the limit
+	size_t GetLimit() const;
+	bool IsLimited() const;
+	size_t GetReservedBytes() const;
+
+	size_t Admit(size_t FullBytes, size_t ReducedBytes, FilterPriority Priority); //< returns the bytes reserved, FullBytes or ReducedBytes
+	void Release(size_t Bytes);
+	void CountFallback(); //< records a job moved to its lower-memory mode after it has been admitted
+
+	MemoryBudgetStats GetStats() const;
+	void ResetStats();
+
+private:
+	CMemoryBudget();
+	CMemoryBudget(const CMemoryBudget&) = delete;
+	CMemoryBudget& operator=(const CMemoryBudget&) = delete;
+
+	size_t Limit;
+	size_t ReservedBytes;
+	unsigned long long NextTicket; //< ticket of the next job that has to wait
+	unsigned long long ServedTicket; //< ticket of the waiting job that is admitted next
+	MemoryBudgetStats Stats;
+	mutable std::mutex BudgetLock;
+	std::condition_variable BudgetChanged;
+};
+
+/// <summary>
+/// reserves the memory of a job in CMemoryBudget for its own lifetime
+/// </summary>
+class CMemoryReservation
+{
+public:
+	CMemoryReservation(size_t _FullBytes, size_t _ReducedBytes, FilterPriority Priority); //< waits until the job is admitted
+	~CMemoryReservation();
+
+	bool IsReduced() const; //< true if the job has to run in its lower-memory mode
+	void Reduce(); //< moves the job to its lower-memory mode, e.g. when its normal buffers cannot be allocated
+
+private:
+	size_t FullBytes;
+	size_t ReducedBytes;
+	size_t ReservedBytes;
+	bool Reduced;
+
+	CMemoryReservation(const CMemoryReservation&) = delete;
+	CMemoryReservation& operator=(const CMemoryReservation&) = delete;
+};
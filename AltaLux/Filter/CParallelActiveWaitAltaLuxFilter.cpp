@@ -46,24 +46,12 @@ int CParallelActiveWaitAltaLuxFilter::Run()
 
 	auto pImage = static_cast<PixelType *>(ImageBuffer);
 
-	/// pulMapArray is pointer to mappings
-	auto pulMapArray = std::make_unique<unsigned int[]>(NumHorRegions * NumVertRegions * NUM_GRAY_LEVELS);
-	if (pulMapArray == nullptr)
+	/// pMapArray is pointer to mappings
+	MapType* pMapArray = GetMapArray();
+	if (pMapArray == nullptr)
 		return AL_OUT_OF_MEMORY; //< not enough memory
 
-	/// region pixel count
-	auto NumPixels = static_cast<unsigned int>(RegionWidth) * static_cast<unsigned int>(RegionHeight);
-	//< region pixel count
-
-	unsigned int ulClipLimit; //< clip limit
-	if (ClipLimit > 0.0)
-	{
-		/// calculate actual cliplimit
-		ulClipLimit = static_cast<unsigned int>(ClipLimit * (RegionWidth * RegionHeight) / NUM_GRAY_LEVELS);
-		ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
-	}
-	else
-		ulClipLimit = 1UL << 14; //< large value, do not clip (AHE)
+	const unsigned int ulClipLimit = ComputeClipLimit(); //< clip limit
 
 	/// Interpolate greylevel mappings to get CLAHE image
 	// create events for signaling that the first phase is completed
@@ -74,82 +62,20 @@ int CParallelActiveWaitAltaLuxFilter::Run()
 	concurrency::parallel_for((LONG)0, (LONG)(NumVertRegions + 1), [&](LONG uiY)
 	{
 		// first half
-		PixelType* pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
 		if (uiY < NumVertRegions)
 		{
 			/// calculate greylevel mappings for each contextual region
-			for (LONG uiX = 0; uiX < NumHorRegions; uiX++, pImPointer += RegionWidth)
+			for (LONG uiX = 0; uiX < NumHorRegions; uiX++)
 			{
-				unsigned int* pHistogram = &pulMapArray[NUM_GRAY_LEVELS * (uiY * NumHorRegions + uiX)];
-				MakeHistogram(pImPointer, pHistogram);
-				ClipHistogram(pHistogram, ulClipLimit);
-				MapHistogram(pHistogram, NumPixels);
+				CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
 				InterlockedExchange((volatile LONG*)&FirstPhaseCompleted[uiY], uiX);
 			}
 		}
 
 		// second half
-		unsigned int uiSubX, uiSubY; //< size of subimages
-		unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
-
-		pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
-		if (uiY == 0)
-		{
-			/// special case: top row
-			uiSubY = RegionHeight >> 1;
-			uiYU = 0;
-			uiYB = 0;
-		}
-		else
-		{
-			if (uiY == NumVertRegions)
-			{
-				/// special case: bottom row
-				uiSubY = (RegionHeight >> 1) + (OriginalImageHeight - ImageHeight);
-				uiYU = NumVertRegions - 1;
-				uiYB = uiYU;
-			}
-			else
-			{
-				/// default values
-				uiSubY = RegionHeight;
-				uiYU = uiY - 1;
-				uiYB = uiY;
-			}
-		}
-
 		for (LONG uiX = 0; uiX <= NumHorRegions; uiX++)
 		{
-			if (uiX == 0)
-			{
-				/// special case: left column
-				uiSubX = RegionWidth >> 1;
-				uiXL = 0;
-				uiXR = 0;
-			}
-			else
-			{
-				if (uiX == NumHorRegions)
-				{
-					/// special case: right column
-					uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
-					uiXL = NumHorRegions - 1;
-					uiXR = uiXL;
-				}
-				else
-				{
-					/// default values
-					uiSubX = RegionWidth;
-					uiXL = uiX - 1;
-					uiXR = uiX;
-				}
-			}
+			const LONG uiXR = (uiX < NumHorRegions) ? uiX : (NumHorRegions - 1); //< rightmost region needed by this submatrix
 			if (uiY > 0)
 			{
 				while (true)
@@ -162,16 +88,20 @@ int CParallelActiveWaitAltaLuxFilter::Run()
 				}
 			}
 
-			auto pulLU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
-			auto pulRU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
-			auto pulLB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
-			auto pulRB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
-
-			Interpolate(pImPointer, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY);
-
-			pImPointer += uiSubX; //< set pointer on next matrix
+			InterpolateSubMatrix(pImage, uiX, uiY, pMapArray);
 		}
 	});
 
 	return AL_OK; //< return status OK
 }
+
+/// <summary>
+/// runs the bands of a conversion pass in parallel
+/// </summary>
+void CParallelActiveWaitAltaLuxFilter::ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand)
+{
+	concurrency::parallel_for(0, NumBands, [&](int Band)
+	{
+		ProcessBand(Band);
+	});
+}
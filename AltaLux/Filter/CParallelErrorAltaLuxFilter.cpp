@@ -50,113 +50,38 @@ int CParallelErrorAltaLuxFilter::Run()
 
 	PixelType* pImage = (PixelType *)ImageBuffer;
 
-	/// pulMapArray is pointer to mappings
-	unsigned int* pulMapArray = new unsigned int[NumHorRegions * NumVertRegions * NUM_GRAY_LEVELS];
-	if (pulMapArray == nullptr)
+	/// pMapArray is pointer to mappings
+	MapType* pMapArray = GetMapArray();
+	if (pMapArray == nullptr)
 		return AL_OUT_OF_MEMORY; //< not enough memory
 
-	/// region pixel count
-	unsigned int NumPixels = (unsigned int)RegionWidth * (unsigned int)RegionHeight; //< region pixel count
-
-	unsigned int ulClipLimit; //< clip limit
-	if (ClipLimit > 0.0)
-	{
-		/// calculate actual cliplimit
-		ulClipLimit = (unsigned int)(ClipLimit * (RegionWidth * RegionHeight) / NUM_GRAY_LEVELS);
-		ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
-	}
-	else
-		ulClipLimit = 1UL << 14; //< large value, do not clip (AHE)
+	const unsigned int ulClipLimit = ComputeClipLimit(); //< clip limit
 
 	/// Interpolate greylevel mappings to get CLAHE image
 	concurrency::parallel_for((int)0, (int)(NumVertRegions + 1), [&](int uiY)
 	{
 		// first half
-		PixelType* pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
 		if (uiY < NumVertRegions)
 		{
 			/// calculate greylevel mappings for each contextual region
-			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++, pImPointer += RegionWidth)
-			{
-				unsigned int* pHistogram = &pulMapArray[NUM_GRAY_LEVELS * (uiY * NumHorRegions + uiX)];
-				MakeHistogram(pImPointer, pHistogram);
-				ClipHistogram(pHistogram, ulClipLimit);
-				MapHistogram(pHistogram, NumPixels);
-			}
+			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++)
+				CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
 		}
 		// second half
-		unsigned int uiSubX, uiSubY; //< size of subimages
-		unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
-
-		pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
-		if (uiY == 0)
-		{
-			/// special case: top row
-			uiSubY = RegionHeight >> 1;
-			uiYU = 0;
-			uiYB = 0;
-		}
-		else
-		{
-			if (uiY == NumVertRegions)
-			{
-				/// special case: bottom row
-				uiSubY = (RegionHeight >> 1) + (OriginalImageHeight - ImageHeight);
-				uiYU = NumVertRegions - 1;
-				uiYB = uiYU;
-			}
-			else
-			{
-				/// default values
-				uiSubY = RegionHeight;
-				uiYU = uiY - 1;
-				uiYB = uiY;
-			}
-		}
-
 		for (unsigned int uiX = 0; uiX <= NumHorRegions; uiX++)
-		{
-			if (uiX == 0)
-			{
-				/// special case: left column
-				uiSubX = RegionWidth >> 1;
-				uiXL = 0;
-				uiXR = 0;
-			}
-			else
-			{
-				if (uiX == NumHorRegions)
-				{
-					/// special case: right column
-					uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
-					uiXL = NumHorRegions - 1;
-					uiXR = uiXL;
-				}
-				else
-				{
-					/// default values
-					uiSubX = RegionWidth;
-					uiXL = uiX - 1;
-					uiXR = uiX;
-				}
-			}
-			unsigned int* pulLU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
-			unsigned int* pulRU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
-			unsigned int* pulLB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
-			unsigned int* pulRB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
-
-			Interpolate(pImPointer, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY);
-
-			pImPointer += uiSubX; //< set pointer on next matrix
-		}
+			InterpolateSubMatrix(pImage, uiX, uiY, pMapArray);
 	});
 
-	delete[] pulMapArray;
 	return AL_OK; //< return status OK
 }
+
+/// <summary>
+/// runs the bands of a conversion pass in parallel
+/// </summary>
+void CParallelErrorAltaLuxFilter::ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand)
+{
+	concurrency::parallel_for(0, NumBands, [&](int Band)
+	{
+		ProcessBand(Band);
+	});
+}
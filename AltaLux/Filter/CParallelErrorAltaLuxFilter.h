@@ -40,4 +40,5 @@ public:
 
 protected:
 	int Run() override;
+	void ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand) override;
 };
@@ -29,6 +29,8 @@ A "contributor" is any person that distributes its contribution under this licen
 
 #include "CBaseAltaLuxFilter.h"
 
+#include <windows.h>
+
 class CParallelEventAltaLuxFilter : public CBaseAltaLuxFilter
 {
 public:
@@ -36,8 +38,16 @@ public:
 	                            int VerSlices = DEFAULT_VERT_REGIONS) :
 		CBaseAltaLuxFilter(Width, Height, HorSlices, VerSlices)
 	{
+		NumEvents = 0;
 	}
+	~CParallelEventAltaLuxFilter() override;
 
 protected:
 	int Run() override;
+	void ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand) override;
+
+private:
+	/// events signaling that the first phase is completed, created by the first Run and reset by the next ones
+	HANDLE FirstPhaseCompleted[MAX_VERT_REGIONS];
+	unsigned int NumEvents;
 };
@@ -27,16 +27,111 @@ A "contributor" is any person that distributes its contribution under this licen
 
 #include "CParallelSplitLoopAltaLuxFilter.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <ppl.h>
 
+/// cost of the setup of each row of a sub-matrix, in pixels, refer to EstimateSubMatrixCost
+const unsigned int SUBMATRIX_ROW_OVERHEAD = 16;
+
+/// <summary>
+/// runs ProcessTile on the tiles [0, NumTiles), in the given order or in row-major order, pre-empting every TilesPerRow tiles
+/// </summary>
+/// <remarks>
+/// Workers fetch the next position from a shared cursor, and do not start a new row of positions while a job of
+/// a higher priority class is running: they return, the calling thread waits for its turn and starts a new
+/// parallel_for from the cursor, so the tiles already completed are not processed again
+/// </remarks>
+/// <param name="Order">tile at each position, nullptr for row-major order</param>
+template <typename TileFunction>
+static void ForEachTileByRows(FilterPriority Priority, int NumTiles, int TilesPerRow, const unsigned short* Order,
+                              const TileFunction& ProcessTile)
+{
+	CPriorityScheduler& Scheduler = CPriorityScheduler::GetInstance();
+	const int NumWorkers = std::min(static_cast<int>(concurrency::GetProcessorCount()), NumTiles);
+	std::atomic<int> NextPosition(0);
+	for (;;)
+	{
+		concurrency::parallel_for(0, NumWorkers, [&](int)
+		{
+			int Position = NextPosition.load();
+			while (Position < NumTiles)
+			{
+				if (((Position % TilesPerRow) == 0) && Scheduler.ShouldYield(Priority))
+					return;
+				/// on failure Position is updated to the one fetched by another worker
+				if (NextPosition.compare_exchange_weak(Position, Position + 1))
+				{
+					ProcessTile((Order != nullptr) ? (int)Order[Position] : Position);
+					Position = NextPosition.load();
+				}
+			}
+		});
+		if (NextPosition.load() >= NumTiles)
+			return;
+		Scheduler.WaitForTurn(Priority);
+	}
+}
+
+/// <summary>
+/// estimates the cost of interpolating a sub-matrix from its size, refer to InterpolateSubMatrix for the geometry:
+/// the first and last rows and columns are half as high or wide as the others, and the last ones also
+/// include the rows and columns left over by the division of the image in contextual regions
+/// </summary>
+/// <param name="uiX">column of the sub-matrix, in [0..NumHorRegions]</param>
+/// <param name="uiY">row of the sub-matrix, in [0..NumVertRegions]</param>
+/// <returns>cost in pixels</returns>
+unsigned int CParallelSplitLoopAltaLuxFilter::EstimateSubMatrixCost(unsigned int uiX, unsigned int uiY) const
+{
+	unsigned int uiSubX = RegionWidth;
+	if (uiX == 0)
+		uiSubX = RegionWidth >> 1;
+	else if (uiX == NumHorRegions)
+		uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
+	unsigned int uiSubY = RegionHeight;
+	if (uiY == 0)
+		uiSubY = RegionHeight >> 1;
+	else if (uiY == NumVertRegions)
+		uiSubY = (RegionHeight >> 1) + (OriginalImageHeight - ImageHeight);
+	return uiSubY * (uiSubX + SUBMATRIX_ROW_OVERHEAD);
+}
+
+/// <summary>
+/// returns the sub-matrices sorted by decreasing estimated cost, so that the heaviest ones are not left
+/// for the end of the interpolation phase; sub-matrices with the same cost keep their row-major order
+/// </summary>
+const unsigned short* CParallelSplitLoopAltaLuxFilter::GetSubMatrixOrder()
+{
+	if ((OrderedHorRegions == NumHorRegions) && (OrderedVertRegions == NumVertRegions))
+		return SubMatrixOrder;
+	const unsigned int NumSubMatrixCols = NumHorRegions + 1;
+	const unsigned int NumSubMatrices = NumSubMatrixCols * (NumVertRegions + 1);
+	for (unsigned int i = 0; i < NumSubMatrices; i++)
+		SubMatrixOrder[i] = (unsigned short)i;
+	std::sort(SubMatrixOrder, SubMatrixOrder + NumSubMatrices, [&](unsigned short First, unsigned short Second)
+	{
+		const unsigned int FirstCost = EstimateSubMatrixCost(First % NumSubMatrixCols, First / NumSubMatrixCols);
+		const unsigned int SecondCost = EstimateSubMatrixCost(Second % NumSubMatrixCols, Second / NumSubMatrixCols);
+		return (FirstCost != SecondCost) ? (FirstCost > SecondCost) : (First < Second);
+	});
+	OrderedHorRegions = NumHorRegions;
+	OrderedVertRegions = NumVertRegions;
+	return SubMatrixOrder;
+}
+
 /// <summary>
 /// processes incoming image
 /// </summary>
 /// <returns>error code, refer to AL_XXX codes</returns>
 /// <remarks>
 /// parallel code that divides the loop in two and puts a synchronization barrier in the middle 
-/// to ensure that all data dependencies are resolved before moving to the next steps
+/// to ensure that all data dependencies are resolved before moving to the next steps.
+/// Both halves are scheduled per tile rather than per row, so large grids expose
+/// NumHorRegions * NumVertRegions tasks instead of NumVertRegions.
+/// With AL_SCHEDULE_LONGEST_FIRST the sub-matrices are handed out by decreasing size, as the bottom row
+/// and the right column may be much larger than the others, the contextual regions have all the same size.
+/// A job of a lower priority class than a running one stops at the next row of tiles, refer to CPriorityScheduler
 /// [Filter processing of full resolution image] in [1.109 seconds]
 /// </remarks>
 int CParallelSplitLoopAltaLuxFilter::Run()
@@ -44,117 +139,61 @@ int CParallelSplitLoopAltaLuxFilter::Run()
 	if (ClipLimit == 1.0)
 		return AL_OK; //< is OK, immediately returns original image
 
-	auto pImage = static_cast<PixelType *>(ImageBuffer);
+	const int MappingReturn = RunMappingPhase();
+	if (MappingReturn != AL_OK)
+		return MappingReturn;
 
-	/// pulMapArray is pointer to mappings
-	auto pulMapArray = std::make_unique<unsigned int[]>(NumHorRegions * NumVertRegions * NUM_GRAY_LEVELS);
-	if (pulMapArray == nullptr)
-		return AL_OUT_OF_MEMORY; //< not enough memory
+	RunInterpolationPhase();
 
-	/// region pixel count
-	unsigned int NumPixels = static_cast<unsigned int>(RegionWidth) * static_cast<unsigned int>(RegionHeight);
-	//< region pixel count
+	return AL_OK; //< return status OK
+}
 
-	unsigned int ulClipLimit; //< clip limit
-	if (ClipLimit > 0.0)
-	{
-		/// calculate actual cliplimit
-		ulClipLimit = static_cast<unsigned int>(ClipLimit * (RegionWidth * RegionHeight) / NUM_GRAY_LEVELS);
-		ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
-	}
-	else
-		ulClipLimit = 1UL << 14; //< large value, do not clip (AHE)
+/// <summary>
+/// calculates the greylevel mappings of all the contextual regions of ImageBuffer into MapArray
+/// </summary>
+/// <returns>error code, refer to AL_XXX codes</returns>
+int CParallelSplitLoopAltaLuxFilter::RunMappingPhase()
+{
+	auto pImage = static_cast<PixelType *>(ImageBuffer);
 
-	/// Interpolate greylevel mappings to get CLAHE image
-	concurrency::parallel_for((int)0, (int)(NumVertRegions + 1), [&](int uiY)
-	{
-		PixelType* pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
+	/// pMapArray is pointer to mappings
+	MapType* pMapArray = GetMapArray();
+	if (pMapArray == nullptr)
+		return AL_OUT_OF_MEMORY; //< not enough memory
 
-		if (uiY < NumVertRegions)
-		{
-			/// calculate greylevel mappings for each contextual region
-			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++, pImPointer += RegionWidth)
-			{
-				unsigned int* pHistogram = &pulMapArray[NUM_GRAY_LEVELS * (uiY * NumHorRegions + uiX)];
-				MakeHistogram(pImPointer, pHistogram);
-				ClipHistogram(pHistogram, ulClipLimit);
-				MapHistogram(pHistogram, NumPixels);
-			}
-		}
-	});
+	const unsigned int ulClipLimit = ComputeClipLimit(); //< clip limit
 
-	concurrency::parallel_for((int)0, (int)(NumVertRegions + 1), [&](int uiY)
+	/// calculate greylevel mappings for each contextual region
+	ForEachTileByRows(Priority, (int)(NumHorRegions * NumVertRegions), (int)NumHorRegions, nullptr, [&](int uiTile)
 	{
-		unsigned int uiSubX, uiSubY; //< size of subimages
-		unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
-
-		PixelType* pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
-		if (uiY == 0)
-		{
-			/// special case: top row
-			uiSubY = RegionHeight >> 1;
-			uiYU = 0;
-			uiYB = 0;
-		}
-		else
-		{
-			if (uiY == NumVertRegions)
-			{
-				/// special case: bottom row
-				uiSubY = (RegionHeight >> 1) + (OriginalImageHeight - ImageHeight);
-				uiYU = NumVertRegions - 1;
-				uiYB = uiYU;
-			}
-			else
-			{
-				/// default values
-				uiSubY = RegionHeight;
-				uiYU = uiY - 1;
-				uiYB = uiY;
-			}
-		}
+		CalcRegionMapping(pImage, uiTile % NumHorRegions, uiTile / NumHorRegions, ulClipLimit, pMapArray);
+	});
 
-		for (unsigned int uiX = 0; uiX <= NumHorRegions; uiX++)
-		{
-			if (uiX == 0)
-			{
-				/// special case: left column
-				uiSubX = RegionWidth >> 1;
-				uiXL = 0;
-				uiXR = 0;
-			}
-			else
-			{
-				if (uiX == NumHorRegions)
-				{
-					/// special case: right column
-					uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
-					uiXL = NumHorRegions - 1;
-					uiXR = uiXL;
-				}
-				else
-				{
-					/// default values
-					uiSubX = RegionWidth;
-					uiXL = uiX - 1;
-					uiXR = uiX;
-				}
-			}
-			auto pulLU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
-			auto pulRU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
-			auto pulLB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
-			auto pulRB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
+	return AL_OK;
+}
 
-			Interpolate(pImPointer, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY);
+/// <summary>
+/// interpolates the mappings computed by RunMappingPhase to get the CLAHE image in ImageBuffer
+/// </summary>
+void CParallelSplitLoopAltaLuxFilter::RunInterpolationPhase()
+{
+	auto pImage = static_cast<PixelType *>(ImageBuffer);
+	const MapType* pMapArray = MapArray;
 
-			pImPointer += uiSubX; //< set pointer on next matrix
-		}
+	/// Interpolate greylevel mappings to get CLAHE image
+	const unsigned int NumSubMatrixCols = NumHorRegions + 1;
+	const unsigned short* pOrder = (SchedulingPolicy == AL_SCHEDULE_LONGEST_FIRST) ? GetSubMatrixOrder() : nullptr;
+	ForEachTileByRows(Priority, (int)(NumSubMatrixCols * (NumVertRegions + 1)), (int)NumSubMatrixCols, pOrder, [&](int uiSubMatrix)
+	{
+		InterpolateSubMatrix(pImage, uiSubMatrix % NumSubMatrixCols, uiSubMatrix / NumSubMatrixCols, pMapArray);
 	});
+}
 
-	return AL_OK; //< return status OK
+/// <summary>
+/// runs the bands of a conversion pass on the workers of the two phases of Run, which stop between bands
+/// while a job of a higher priority class is running
+/// </summary>
+void CParallelSplitLoopAltaLuxFilter::ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand)
+{
+	ForEachTileByRows(Priority, NumBands, 1, nullptr, ProcessBand);
 }
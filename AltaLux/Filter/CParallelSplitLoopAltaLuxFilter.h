@@ -34,10 +34,21 @@ class CParallelSplitLoopAltaLuxFilter : public CBaseAltaLuxFilter
 public:
 	CParallelSplitLoopAltaLuxFilter(int Width, int Height, int HorSlices = DEFAULT_HOR_REGIONS,
 	                                int VerSlices = DEFAULT_VERT_REGIONS) :
-		CBaseAltaLuxFilter(Width, Height, HorSlices, VerSlices)
+		CBaseAltaLuxFilter(Width, Height, HorSlices, VerSlices), OrderedHorRegions(0), OrderedVertRegions(0)
 	{
 	}
 
 protected:
 	int Run() override;
+	void ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand) override;
+	int RunMappingPhase(); //< first half of Run, also used by CFramePipeline
+	void RunInterpolationPhase(); //< second half of Run, needs the mappings of RunMappingPhase
+	const unsigned short* GetSubMatrixOrder();
+	unsigned int EstimateSubMatrixCost(unsigned int uiX, unsigned int uiY) const;
+
+private:
+	/// sub-matrices by decreasing estimated cost, kept across calls as the image size of an instance does not change
+	unsigned short SubMatrixOrder[(MAX_HOR_REGIONS + 1) * (MAX_VERT_REGIONS + 1)];
+	unsigned int OrderedHorRegions; //< grid SubMatrixOrder was computed for, 0 if not computed yet
+	unsigned int OrderedVertRegions;
 };
@@ -0,0 +1,141 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CPriorityScheduler.h"
+
+CPriorityScheduler::CPriorityScheduler()
+{
+	for (int i = 0; i < NUM_FILTER_PRIORITIES; i++)
+	{
+		ActiveJobs[i].store(0);
+		MemoryWaits[i].store(0);
+		Preemptions[i].store(0);
+	}
+}
+
+CPriorityScheduler& CPriorityScheduler::GetInstance()
+{
+	static CPriorityScheduler Instance;
+	return Instance;
+}
+
+/// <summary>
+/// marks a job of the given class as running, so that jobs of lower classes yield to it
+/// </summary>
+void CPriorityScheduler::BeginJob(FilterPriority Priority)
+{
+	ActiveJobs[Priority].fetch_add(1);
+}
+
+/// <summary>
+/// marks a job as completed and wakes up the jobs waiting for their turn
+/// </summary>
+void CPriorityScheduler::EndJob(FilterPriority Priority)
+{
+	/// the lock orders the update with the check in WaitForTurn, so that no wakeup is lost
+	{
+		std::lock_guard<std::mutex> Lock(TurnLock);
+		ActiveJobs[Priority].fetch_sub(1);
+	}
+	TurnChanged.notify_all();
+}
+
+/// <summary>
+/// checks if a job of the given class should release its cores, it is cheap enough to be called for every region row.
+/// The classes with a job waiting for memory are skipped: that job may wait for the memory of the caller, and
+/// a job registered from outside the filter, such as the preview one, cannot be told apart from it
+/// </summary>
+bool CPriorityScheduler::ShouldYield(FilterPriority Priority) const
+{
+	for (int i = 0; i < Priority; i++)
+	{
+		if ((ActiveJobs[i].load(std::memory_order_relaxed) != 0) && (MemoryWaits[i].load(std::memory_order_relaxed) == 0))
+			return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// waits until all the jobs of higher classes are completed, returns immediately if there are none
+/// </summary>
+void CPriorityScheduler::WaitForTurn(FilterPriority Priority)
+{
+	std::unique_lock<std::mutex> Lock(TurnLock);
+	if (!ShouldYield(Priority))
+		return;
+	Preemptions[Priority].fetch_add(1, std::memory_order_relaxed);
+	TurnChanged.wait(Lock, [this, Priority] { return !ShouldYield(Priority); });
+}
+
+/// <summary>
+/// marks a job of the given class as waiting for memory, and wakes up the jobs of lower classes waiting for their turn,
+/// that may hold the memory it waits for
+/// </summary>
+void CPriorityScheduler::BeginMemoryWait(FilterPriority Priority)
+{
+	{
+		std::lock_guard<std::mutex> Lock(TurnLock);
+		MemoryWaits[Priority].fetch_add(1);
+	}
+	TurnChanged.notify_all();
+}
+
+/// <summary>
+/// marks a job as admitted by CMemoryBudget, the jobs of lower classes yield to its class again
+/// </summary>
+void CPriorityScheduler::EndMemoryWait(FilterPriority Priority)
+{
+	std::lock_guard<std::mutex> Lock(TurnLock);
+	MemoryWaits[Priority].fetch_sub(1);
+}
+
+unsigned int CPriorityScheduler::GetNumActiveJobs(FilterPriority Priority) const
+{
+	return ActiveJobs[Priority].load();
+}
+
+unsigned long long CPriorityScheduler::GetNumPreemptions(FilterPriority Priority) const
+{
+	return Preemptions[Priority].load();
+}
+
+void CPriorityScheduler::ResetStats()
+{
+	for (int i = 0; i < NUM_FILTER_PRIORITIES; i++)
+		Preemptions[i].store(0);
+}
+
+CPriorityJob::CPriorityJob(FilterPriority Priority)
+	: Priority(Priority)
+{
+	CPriorityScheduler::GetInstance().BeginJob(Priority);
+}
+
+CPriorityJob::~CPriorityJob()
+{
+	CPriorityScheduler::GetInstance().EndJob(Priority);
+}
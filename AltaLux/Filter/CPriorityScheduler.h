@@ -0,0 +1,95 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/// priority classes of the filter jobs, a job is pre-empted by any running job of a lower-numbered class
+enum FilterPriority
+{
+	FILTER_PRIORITY_INTERACTIVE = 0, //< previews the user is waiting for, never pre-empted
+	FILTER_PRIORITY_NORMAL, //< default class
+	FILTER_PRIORITY_BACKGROUND, //< batch work, pre-empted by interactive and normal jobs
+	NUM_FILTER_PRIORITIES
+};
+
+/// <summary>
+/// Process-wide arbiter between the filter instances that share the cores.
+/// A job registers its priority class while it runs; the parallel strategies check ShouldYield before starting
+/// a new row of contextual regions and, if a job of a higher class is running, release their workers and
+/// wait in WaitForTurn. The work done so far is kept, so a pre-empted job resumes from the next row.
+/// A class with a job waiting for memory in CMemoryBudget is not yielded to, as the memory it waits for may be
+/// held by the very jobs that would yield.
+/// </summary>
+class CPriorityScheduler
+{
+public:
+	static CPriorityScheduler& GetInstance();
+
+	void BeginJob(FilterPriority Priority);
+	void EndJob(FilterPriority Priority);
+
+	bool ShouldYield(FilterPriority Priority) const; //< true if a job of a higher class is running
+	void WaitForTurn(FilterPriority Priority); //< blocks until no job of a higher class is running
+
+	void BeginMemoryWait(FilterPriority Priority); //< a job of the class waits to be admitted by CMemoryBudget
+	void EndMemoryWait(FilterPriority Priority);
+
+	unsigned int GetNumActiveJobs(FilterPriority Priority) const;
+	unsigned long long GetNumPreemptions(FilterPriority Priority) const; //< times WaitForTurn had to wait
+	void ResetStats();
+
+private:
+	CPriorityScheduler();
+	CPriorityScheduler(const CPriorityScheduler&) = delete;
+	CPriorityScheduler& operator=(const CPriorityScheduler&) = delete;
+
+	std::atomic<unsigned int> ActiveJobs[NUM_FILTER_PRIORITIES];
+	std::atomic<unsigned int> MemoryWaits[NUM_FILTER_PRIORITIES]; //< jobs of each class waiting in CMemoryBudget::Admit
+	std::atomic<unsigned long long> Preemptions[NUM_FILTER_PRIORITIES];
+	std::mutex TurnLock;
+	std::condition_variable TurnChanged;
+};
+
+/// <summary>
+/// registers a job with CPriorityScheduler for its own lifetime
+/// </summary>
+class CPriorityJob
+{
+public:
+	explicit CPriorityJob(FilterPriority Priority);
+	~CPriorityJob();
+
+private:
+	FilterPriority Priority;
+
+	CPriorityJob(const CPriorityJob&) = delete;
+	CPriorityJob& operator=(const CPriorityJob&) = delete;
+};
@@ -34,7 +34,8 @@ A "contributor" is any person that distributes its contribution under this licen
 /// </summary>
 /// <returns>error code, refer to AL_XXX codes</returns>
 /// <remarks>
-/// serial code, used as reference for parallel implementations
+/// serial code, used as reference for parallel implementations.
+/// A job of a lower priority class than a running one waits before each row of contextual regions
 /// [Filter processing of full resolution image] in [1.245 seconds]
 /// </remarks>
 int CSerialAltaLuxFilter::Run()
@@ -44,111 +45,27 @@ int CSerialAltaLuxFilter::Run()
 
 	auto pImage = static_cast<PixelType *>(ImageBuffer);
 
-	/// pulMapArray is pointer to mappings
-	auto pulMapArray = std::make_unique<unsigned int[]>(NumHorRegions * NumVertRegions * NUM_GRAY_LEVELS);
-	if (pulMapArray == nullptr)
+	/// pMapArray is pointer to mappings
+	MapType* pMapArray = GetMapArray();
+	if (pMapArray == nullptr)
 		return AL_OUT_OF_MEMORY; //< not enough memory
 
-	/// region pixel count
-	const unsigned int NumPixels = static_cast<unsigned int>(RegionWidth) * static_cast<unsigned int>(RegionHeight); //< region pixel count
-
-	unsigned int ulClipLimit; //< clip limit
-	if (ClipLimit > 0.0)
-	{
-		/// calculate actual cliplimit
-		ulClipLimit = static_cast<unsigned int>(ClipLimit * (RegionWidth * RegionHeight) / NUM_GRAY_LEVELS);
-		ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
-	}
-	else
-		ulClipLimit = 1UL << 14; //< large value, do not clip (AHE)
+	const unsigned int ulClipLimit = ComputeClipLimit(); //< clip limit
 
 	/// Interpolate greylevel mappings to get CLAHE image
 	for (unsigned int uiY = 0; uiY <= NumVertRegions; uiY++)
 	{
+		WaitForTurn();
 		// first half
-		auto pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
 		if (uiY < NumVertRegions)
 		{
 			/// calculate greylevel mappings for each contextual region
-			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++, pImPointer += RegionWidth)
-			{
-				unsigned int* pHistogram = &pulMapArray[NUM_GRAY_LEVELS * (uiY * NumHorRegions + uiX)];
-				MakeHistogram(pImPointer, pHistogram);
-				ClipHistogram(pHistogram, ulClipLimit);
-				MapHistogram(pHistogram, NumPixels);
-			}
+			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++)
+				CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
 		}
 		// second half
-		unsigned int uiSubX, uiSubY; //< size of subimages
-		unsigned int uiXL, uiXR, uiYU, uiYB; //< auxiliary variables interpolation routine
-
-		pImPointer = pImage;
-		if (uiY > 0)
-			pImPointer += ((RegionHeight >> 1) + ((uiY - 1) * RegionHeight)) * OriginalImageWidth;
-
-		if (uiY == 0)
-		{
-			/// special case: top row
-			uiSubY = RegionHeight >> 1;
-			uiYU = 0;
-			uiYB = 0;
-		}
-		else
-		{
-			if (uiY == NumVertRegions)
-			{
-				/// special case: bottom row
-				uiSubY = (RegionHeight >> 1) + (OriginalImageHeight - ImageHeight);
-				uiYU = NumVertRegions - 1;
-				uiYB = uiYU;
-			}
-			else
-			{
-				/// default values
-				uiSubY = RegionHeight;
-				uiYU = uiY - 1;
-				uiYB = uiY;
-			}
-		}
-
 		for (unsigned int uiX = 0; uiX <= NumHorRegions; uiX++)
-		{
-			if (uiX == 0)
-			{
-				/// special case: left column
-				uiSubX = RegionWidth >> 1;
-				uiXL = 0;
-				uiXR = 0;
-			}
-			else
-			{
-				if (uiX == NumHorRegions)
-				{
-					/// special case: right column
-					uiSubX = (RegionWidth >> 1) + (OriginalImageWidth - ImageWidth);
-					uiXL = NumHorRegions - 1;
-					uiXR = uiXL;
-				}
-				else
-				{
-					/// default values
-					uiSubX = RegionWidth;
-					uiXL = uiX - 1;
-					uiXR = uiX;
-				}
-			}
-			auto pulLU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXL)];
-			auto pulRU = &pulMapArray[NUM_GRAY_LEVELS * (uiYU * NumHorRegions + uiXR)];
-			auto pulLB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXL)];
-			auto pulRB = &pulMapArray[NUM_GRAY_LEVELS * (uiYB * NumHorRegions + uiXR)];
-
-			Interpolate(pImPointer, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY);
-
-			pImPointer += uiSubX; //< set pointer on next matrix
-		}
+			InterpolateSubMatrix(pImage, uiX, uiY, pMapArray);
 	}
 	return AL_OK; //< return status OK
 }
@@ -0,0 +1,141 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "ImageCopy.h"
+#include "../Filter/CBaseAltaLuxFilter.h"
+
+#include <cstring>
+#include <ppl.h>
+#include <tmmintrin.h>
+
+/// <summary>
+/// widens a row of RGB24 pixels to RGB32, the fourth byte of each pixel is set to 0
+/// </summary>
+static void WidenRow(const unsigned char* SrcRow, unsigned char* DestRow, int Width, bool UseSSSE3)
+{
+	int x = 0;
+	if (UseSSSE3)
+	{
+		/// 4 pixels at a time, the 16 bytes loaded cover 4 more bytes than the pixels in use
+		/// so the last pixels are left to the scalar code
+		const __m128i WidenMask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		for (; x + 6 <= Width; x += 4)
+		{
+			const __m128i Pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(SrcRow + x * 3));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(DestRow + x * 4), _mm_shuffle_epi8(Pixels, WidenMask));
+		}
+	}
+	for (; x < Width; x++)
+	{
+		DestRow[x * 4] = SrcRow[x * 3];
+		DestRow[x * 4 + 1] = SrcRow[x * 3 + 1];
+		DestRow[x * 4 + 2] = SrcRow[x * 3 + 2];
+		DestRow[x * 4 + 3] = 0;
+	}
+}
+
+/// <summary>
+/// narrows a row of RGB32 pixels to RGB24, dropping the fourth byte of each pixel
+/// </summary>
+static void NarrowRow(const unsigned char* SrcRow, unsigned char* DestRow, int Width, bool UseSSSE3)
+{
+	int x = 0;
+	if (UseSSSE3)
+	{
+		/// 4 pixels at a time, the 16 bytes stored overwrite 4 bytes after the pixels in use
+		/// that are rewritten by the next pixels, so the last pixels are left to the scalar code
+		const __m128i NarrowMask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		for (; x + 6 <= Width; x += 4)
+		{
+			const __m128i Pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(SrcRow + x * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(DestRow + x * 3), _mm_shuffle_epi8(Pixels, NarrowMask));
+		}
+	}
+	for (; x < Width; x++)
+	{
+		DestRow[x * 3] = SrcRow[x * 4];
+		DestRow[x * 3 + 1] = SrcRow[x * 4 + 1];
+		DestRow[x * 3 + 2] = SrcRow[x * 4 + 2];
+	}
+}
+
+/// <summary>
+/// Copies the rows of an image into another one, e.g. between a DIB and the buffer processed by the filter,
+/// converting the pixels between RGB24 and RGB32 if their sizes differ.
+/// Large images are copied in bands of rows by parallel tasks
+/// </summary>
+/// <param name="SrcImage">first pixel of the top row to be copied</param>
+/// <param name="SrcImageStride">distance in bytes between rows of SrcImage</param>
+/// <param name="SrcBytesPerPixel">3 for RGB24 images, 4 for RGB32 images</param>
+/// <param name="DestImage">first pixel of the top row to be written</param>
+/// <param name="DestImageStride">distance in bytes between rows of DestImage</param>
+/// <param name="DestBytesPerPixel">3 for RGB24 images, 4 for RGB32 images; the fourth byte of widened pixels is set to 0</param>
+/// <param name="Width">pixels copied from each row</param>
+/// <param name="Height">rows copied</param>
+/// <param name="FlipRows">if true, the top row of SrcImage becomes the bottom row of DestImage,
+/// e.g. to turn a bottom-up DIB into a top-down image</param>
+void CopyImageRows(const void* SrcImage, const int SrcImageStride, const int SrcBytesPerPixel,
+                   void* DestImage, const int DestImageStride, const int DestBytesPerPixel,
+                   const int Width, const int Height, const bool FlipRows)
+{
+	if (SrcImage == nullptr)
+		return;
+	if (DestImage == nullptr)
+		return;
+	if ((Width <= 0) || (Height <= 0))
+		return;
+
+	auto SrcImagePtr = static_cast<const unsigned char *>(SrcImage);
+	auto DestImagePtr = static_cast<unsigned char *>(DestImage);
+	const bool UseSSSE3 = CBaseAltaLuxFilter::IsSSSE3Supported();
+	auto CopyBand = [&](int FirstRow, int LastRow)
+	{
+		for (int y = FirstRow; y < LastRow; y++)
+		{
+			const unsigned char* SrcRow = SrcImagePtr + static_cast<size_t>(y) * SrcImageStride;
+			unsigned char* DestRow = DestImagePtr + static_cast<size_t>(FlipRows ? (Height - 1 - y) : y) * DestImageStride;
+			if (SrcBytesPerPixel == DestBytesPerPixel)
+				memcpy(DestRow, SrcRow, static_cast<size_t>(Width) * SrcBytesPerPixel);
+			else if (SrcBytesPerPixel < DestBytesPerPixel)
+				WidenRow(SrcRow, DestRow, Width, UseSSSE3);
+			else
+				NarrowRow(SrcRow, DestRow, Width, UseSSSE3);
+		}
+	};
+
+	if (static_cast<long long>(Width) * Height * DestBytesPerPixel < IMAGE_COPY_MIN_PARALLEL_BYTES)
+	{
+		CopyBand(0, Height);
+		return;
+	}
+	const int NumBands = (Height + IMAGE_COPY_BAND_ROWS - 1) / IMAGE_COPY_BAND_ROWS;
+	concurrency::parallel_for(0, NumBands, [&](int Band)
+	{
+		const int FirstRow = Band * IMAGE_COPY_BAND_ROWS;
+		CopyBand(FirstRow, (FirstRow + IMAGE_COPY_BAND_ROWS < Height) ? FirstRow + IMAGE_COPY_BAND_ROWS : Height);
+	});
+}
@@ -0,0 +1,121 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "ImageScaling.h"
+
+#include <cstring>
+
+/// <summary>
+/// Down-samples incoming image for computing preview on smaller images
+/// </summary>
+/// <param name="SrcImage"></param>
+/// <param name="SrcImageWidth"></param>
+/// <param name="SrcImageHeight"></param>
+/// <param name="DestImage"></param>
+/// <param name="ScalingFactor">dest image width = source image width / ScalingFactor, same for height</param>
+/// <param name="BytesPerPixel">3 for RGB24 images, 4 for RGB32 images</param>
+/// <remarks>Downsampling is computed with simple averaging as it is used only for previews</remarks>
+void ScaleDownImage(const void* SrcImage, const int SrcImageWidth, const int SrcImageHeight, void* DestImage, const int ScalingFactor,
+                    const int BytesPerPixel)
+{
+	if (SrcImage == nullptr)
+		return;
+	if (DestImage == nullptr)
+		return;
+	if (ScalingFactor == 1)
+	{
+		/// no rescaling
+		memcpy(DestImage, SrcImage, SrcImageWidth * SrcImageHeight * BytesPerPixel);
+		return;
+	}
+
+	ScaleDownImageRect(SrcImage, SrcImageWidth, DestImage, SrcImageWidth / ScalingFactor, ScalingFactor, BytesPerPixel,
+	                   0, 0, SrcImageWidth / ScalingFactor, SrcImageHeight / ScalingFactor);
+}
+
+/// <summary>
+/// Down-samples a rectangle of the dest image, i.e. the blocks of ScalingFactor x ScalingFactor source pixels
+/// that it covers
+/// </summary>
+/// <param name="SrcImage"></param>
+/// <param name="SrcImageWidth"></param>
+/// <param name="DestImage"></param>
+/// <param name="DestImageWidth">width of the whole dest image, usually source image width / ScalingFactor</param>
+/// <param name="ScalingFactor"></param>
+/// <param name="BytesPerPixel">3 for RGB24 images, 4 for RGB32 images</param>
+/// <param name="FirstDestX">left column of the rectangle in the dest image</param>
+/// <param name="FirstDestY">top row of the rectangle in the dest image</param>
+/// <param name="NumDestX">width of the rectangle</param>
+/// <param name="NumDestY">height of the rectangle</param>
+/// <remarks>Same averaging as ScaleDownImage, so that an image can be down-sampled in pieces</remarks>
+void ScaleDownImageRect(const void* SrcImage, const int SrcImageWidth, void* DestImage, const int DestImageWidth,
+                        const int ScalingFactor, const int BytesPerPixel,
+                        const int FirstDestX, const int FirstDestY, const int NumDestX, const int NumDestY)
+{
+	auto DestImagePtr = static_cast<unsigned char *>(DestImage);
+	auto SrcImagePtr = static_cast<const unsigned char *>(SrcImage);
+	const int SrcImageStride = SrcImageWidth * BytesPerPixel;
+
+	for (int y = FirstDestY; y < FirstDestY + NumDestY; y++)
+	{
+		const unsigned char* SrcPixelPtr = &SrcImagePtr[(((y * ScalingFactor) * SrcImageWidth) + (FirstDestX * ScalingFactor)) * BytesPerPixel];
+		unsigned char* DestPixelPtr = &DestImagePtr[((y * DestImageWidth) + FirstDestX) * BytesPerPixel];
+		if (ScalingFactor == 1)
+		{
+			/// no rescaling
+			memcpy(DestPixelPtr, SrcPixelPtr, NumDestX * BytesPerPixel);
+			continue;
+		}
+		for (int x = 0; x < NumDestX; x++)
+		{
+			unsigned int RAcc = 0;
+			unsigned int GAcc = 0;
+			unsigned int BAcc = 0;
+			for (int iy = 0; iy < ScalingFactor; iy++)
+				for (int ix = 0; ix < ScalingFactor; ix++)
+				{
+					RAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * BytesPerPixel)]);
+					GAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * BytesPerPixel) + 1]);
+					BAcc += static_cast<unsigned int>(SrcPixelPtr[(iy * SrcImageStride) + (ix * BytesPerPixel) + 2]);
+				}
+			if ((ScalingFactor == 2) || (ScalingFactor == 4))
+			{
+				DestPixelPtr[0] = static_cast<unsigned char>(RAcc >> ScalingFactor);
+				DestPixelPtr[1] = static_cast<unsigned char>(GAcc >> ScalingFactor);
+				DestPixelPtr[2] = static_cast<unsigned char>(BAcc >> ScalingFactor);
+			}
+			else
+			{
+				DestPixelPtr[0] = static_cast<unsigned char>(RAcc / (ScalingFactor * ScalingFactor));
+				DestPixelPtr[1] = static_cast<unsigned char>(GAcc / (ScalingFactor * ScalingFactor));
+				DestPixelPtr[2] = static_cast<unsigned char>(BAcc / (ScalingFactor * ScalingFactor));
+			}
+			SrcPixelPtr += ScalingFactor * BytesPerPixel;
+			DestPixelPtr += BytesPerPixel;
+		}
+	}
+}
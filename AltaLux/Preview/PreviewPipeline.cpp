@@ -0,0 +1,165 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "PreviewPipeline.h"
+#include "../ImageScaling/ImageScaling.h"
+
+#include <cstring>
+
+const int RGB24_PIXEL_SIZE = 3;
+const int RGB32_PIXEL_SIZE = 4;
+
+static int ClampIntensity(int Intensity)
+{
+	if (Intensity < AL_MIN_STRENGTH)
+		return AL_MIN_STRENGTH;
+	if (Intensity > AL_MAX_STRENGTH)
+		return AL_MAX_STRENGTH;
+	return Intensity;
+}
+
+static int ClampScale(int Scale)
+{
+	if (Scale < static_cast<int>(MIN_HOR_REGIONS))
+		return MIN_HOR_REGIONS;
+	if (Scale > static_cast<int>(MAX_HOR_REGIONS))
+		return MAX_HOR_REGIONS;
+	return Scale;
+}
+
+/// <summary>
+/// Computes the optimal scaling factor for images in preview
+/// </summary>
+/// <remarks>scaled image width must be a multiple of 8, if not a minor scaling factor is chosen</remarks>
+int ComputePreviewScalingFactor(int Width, int Height)
+{
+	const int HorScaling = Width / PREVIEW_TARGET_WIDTH;
+	const int VerScaling = Height / PREVIEW_TARGET_HEIGHT;
+	int ScalingFactor = (HorScaling < VerScaling) ? HorScaling : VerScaling;
+	if (ScalingFactor < 1)
+		ScalingFactor = 1;
+	// fix for non-standard, multiple of 4 rescaled images that may not be drawn correctly
+	while ((ScalingFactor > 1) && (((Width / ScalingFactor) & 0x07) != 0))
+		ScalingFactor--;
+	return ScalingFactor;
+}
+
+/// <summary>
+/// allocates the preview buffers of a session, within its memory budget, and scales the source image down into the scaled source
+/// </summary>
+/// <param name="SessionBuffers">session holding the source image</param>
+/// <param name="PreferredScalingFactor">scaling factor returned by ComputePreviewScalingFactor, the plan may choose a larger one</param>
+/// <param name="Plan">receives the layout of the preview buffers</param>
+/// <returns>false if the preview buffers could not be allocated</returns>
+bool PreparePreviewSource(CSessionBufferManager& SessionBuffers, int Width, int Height, int BytesPerPixel,
+                          int PreferredScalingFactor, PreviewPlan& Plan)
+{
+	Plan = SessionBuffers.PlanPreview(PreferredScalingFactor);
+	if (!SessionBuffers.AllocatePreviewImages(Plan))
+		return false;
+	if (!Plan.SharesSource)
+		ScaleDownImage(SessionBuffers.GetSourceImage().get()->data(), Width, Height,
+		               SessionBuffers.GetScaledSourceImage().get()->data(), Plan.ScalingFactor, BytesPerPixel);
+	return true;
+}
+
+/// <summary>
+/// returns the filter settings after a user interaction, as done by the GUI
+/// </summary>
+PreviewSettings ApplyPreviewEvent(const PreviewSettings& Settings, const PreviewEvent& Event)
+{
+	PreviewSettings NewSettings = Settings;
+	switch (Event.Type)
+	{
+	case PREVIEW_EVENT_INTENSITY_SLIDER: NewSettings.Intensity = ClampIntensity(Event.Value);
+		break;
+	case PREVIEW_EVENT_SCALE_SLIDER: NewSettings.Scale = ClampScale(Event.Value);
+		break;
+	case PREVIEW_EVENT_CLICK_INTENSITY_M:
+	case PREVIEW_EVENT_CLICK_INTENSITY_P:
+	case PREVIEW_EVENT_CLICK_GRID_M:
+	case PREVIEW_EVENT_CLICK_GRID_P:
+		// clicking on a thumbnail selects its settings
+		NewSettings = GetPreviewVariantSettings(
+			static_cast<PreviewBufferId>(PREVIEW_INTENSITY_M + (Event.Type - PREVIEW_EVENT_CLICK_INTENSITY_M)), Settings);
+		break;
+	case PREVIEW_EVENT_DEFAULT: NewSettings.Intensity = AL_DEFAULT_STRENGTH;
+		NewSettings.Scale = DEFAULT_HOR_REGIONS;
+		break;
+	default:
+		break;
+	}
+	return NewSettings;
+}
+
+/// <summary>
+/// returns the filter settings shown by a preview buffer, the variants differ from the current settings
+/// by PREVIEW_STRENGTH_DELTA or PREVIEW_SLICE_DELTA
+/// </summary>
+PreviewSettings GetPreviewVariantSettings(PreviewBufferId BufferId, const PreviewSettings& Settings)
+{
+	PreviewSettings VariantSettings = Settings;
+	switch (BufferId)
+	{
+	case PREVIEW_INTENSITY_M: VariantSettings.Intensity = ClampIntensity(Settings.Intensity - PREVIEW_STRENGTH_DELTA);
+		break;
+	case PREVIEW_INTENSITY_P: VariantSettings.Intensity = ClampIntensity(Settings.Intensity + PREVIEW_STRENGTH_DELTA);
+		break;
+	case PREVIEW_GRID_M: VariantSettings.Scale = ClampScale(Settings.Scale - PREVIEW_SLICE_DELTA);
+		break;
+	case PREVIEW_GRID_P: VariantSettings.Scale = ClampScale(Settings.Scale + PREVIEW_SLICE_DELTA);
+		break;
+	default:
+		break;
+	}
+	return VariantSettings;
+}
+
+/// <summary>
+/// computes one of the preview buffers: copies the scaled source into it and processes it with the settings of the variant
+/// </summary>
+/// <param name="Filter">filter sized for the scaled source, its strength and grid are changed</param>
+/// <param name="BufferId">preview variant</param>
+/// <param name="Settings">current filter settings</param>
+/// <returns>error code, refer to AL_XXX codes</returns>
+int RenderPreview(CBaseAltaLuxFilter* Filter, PreviewBufferId BufferId, const PreviewSettings& Settings,
+                  const unsigned char* ScaledSrcImage, unsigned char* PreviewImage, int Width, int Height, int BytesPerPixel)
+{
+	if ((ScaledSrcImage == nullptr) || (PreviewImage == nullptr))
+		return AL_NULL_IMAGE;
+	memcpy(PreviewImage, ScaledSrcImage, static_cast<size_t>(Width) * Height * BytesPerPixel);
+
+	const PreviewSettings VariantSettings = GetPreviewVariantSettings(BufferId, Settings);
+	Filter->SetSlices(VariantSettings.Scale, VariantSettings.Scale);
+	Filter->SetStrength(VariantSettings.Intensity);
+	switch (BytesPerPixel)
+	{
+	case RGB24_PIXEL_SIZE: return Filter->ProcessRGB24(PreviewImage);
+	case RGB32_PIXEL_SIZE: return Filter->ProcessRGB32(PreviewImage);
+	default: return AL_OK;
+	}
+}
@@ -0,0 +1,240 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "CSessionBufferManager.h"
+
+#include <exception>
+
+CSessionBufferManager::CSessionBufferManager(size_t MemoryBudget)
+	: MemoryBudget(MemoryBudget), SourceWidth(0), SourceHeight(0), SourceBitDepth(0)
+{
+}
+
+void CSessionBufferManager::SetMemoryBudget(size_t MemoryBudget)
+{
+	this->MemoryBudget = MemoryBudget;
+}
+
+size_t CSessionBufferManager::GetMemoryBudget() const
+{
+	return MemoryBudget;
+}
+
+/// <summary>
+/// size in bytes of an image buffer, including the security padding
+/// </summary>
+size_t CSessionBufferManager::GetImageBufferSize(int Width, int Height, int BitDepth)
+{
+	return (static_cast<size_t>(Width) * Height * BitDepth) + BUFFER_SECURITY_PADDING;
+}
+
+/// <summary>
+/// allocates the full resolution source image, releasing all the buffers of a previous image
+/// </summary>
+/// <returns>the source image, or nullptr if out of memory</returns>
+SharedImagePtr CSessionBufferManager::AllocateSourceImage(int Width, int Height, int BitDepth)
+{
+	ReleasePreviewImages();
+	SourceImage.reset();
+	try
+	{
+		SourceImage = std::make_shared<std::vector<unsigned char>>(GetImageBufferSize(Width, Height, BitDepth));
+	}
+	catch (std::exception&)
+	{
+		SourceImage.reset();
+		return nullptr;
+	}
+	SourceWidth = Width;
+	SourceHeight = Height;
+	SourceBitDepth = BitDepth;
+	return SourceImage;
+}
+
+SharedImagePtr CSessionBufferManager::GetSourceImage() const
+{
+	return SourceImage;
+}
+
+/// <summary>
+/// returns the source image for in-place processing. Preview buffers are released, and if the source
+/// is still referenced elsewhere, it is detached with a private copy (copy-on-write)
+/// </summary>
+SharedImagePtr CSessionBufferManager::GetWritableSourceImage()
+{
+	ReleasePreviewImages();
+	if ((SourceImage != nullptr) && (SourceImage.use_count() > 1))
+	{
+		try
+		{
+			SourceImage = std::make_shared<std::vector<unsigned char>>(*SourceImage);
+		}
+		catch (std::exception&)
+		{
+			return nullptr;
+		}
+	}
+	return SourceImage;
+}
+
+/// <summary>
+/// computes the scaled size of the source image
+/// </summary>
+/// <returns>false if the scaled width is not a multiple of 8, as these images may not be drawn correctly</returns>
+bool CSessionBufferManager::GetScaledSize(int ScalingFactor, int& ScaledWidth, int& ScaledHeight) const
+{
+	ScaledWidth = SourceWidth / ScalingFactor;
+	ScaledHeight = SourceHeight / ScalingFactor;
+	if (ScalingFactor == 1)
+		return true;
+	return (ScaledWidth & 0x07) == 0;
+}
+
+size_t CSessionBufferManager::ComputeFootprint(int ScaledWidth, int ScaledHeight, bool SharesSource,
+                                               int NumPreviewBuffers) const
+{
+	const size_t ScaledImageSize = GetImageBufferSize(ScaledWidth, ScaledHeight, SourceBitDepth);
+	size_t Footprint = GetImageBufferSize(SourceWidth, SourceHeight, SourceBitDepth);
+	if (!SharesSource)
+		Footprint += ScaledImageSize;
+	Footprint += NumPreviewBuffers * ScaledImageSize;
+	return Footprint;
+}
+
+/// <summary>
+/// chooses the preview layout that fits in the memory budget, starting from the preferred scaling factor
+/// with all the preview variants. When the budget is exceeded, the least important variants are dropped first,
+/// then the preview is scaled down further, but not below MIN_PREVIEW_WIDTH. If no width from MIN_PREVIEW_WIDTH up
+/// is accepted by GetScaledSize, the largest width that is accepted is used
+/// </summary>
+/// <param name="PreferredScalingFactor">scaling factor chosen for the size of the preview window</param>
+/// <returns>the plan to pass to AllocatePreviewImages</returns>
+PreviewPlan CSessionBufferManager::PlanPreview(int PreferredScalingFactor) const
+{
+	PreviewPlan Plan = {};
+	if (PreferredScalingFactor < 1)
+		PreferredScalingFactor = 1;
+
+	/// smallest preview tried so far, with the processed image only, returned if the budget cannot be met
+	PreviewPlan SmallestPlan = {};
+	bool HasSmallestPlan = false;
+	for (int ScalingFactor = PreferredScalingFactor; ; ScalingFactor++)
+	{
+		/// the factors that GetScaledSize rejects are skipped, but they still tell when the minimum width is crossed
+		if (HasSmallestPlan && ((SourceWidth / ScalingFactor) < MIN_PREVIEW_WIDTH))
+			return SmallestPlan;
+		int ScaledWidth, ScaledHeight;
+		if (!GetScaledSize(ScalingFactor, ScaledWidth, ScaledHeight))
+			continue;
+		const bool SharesSource = (ScalingFactor == 1);
+
+		Plan.ScalingFactor = ScalingFactor;
+		Plan.ScaledWidth = ScaledWidth;
+		Plan.ScaledHeight = ScaledHeight;
+		Plan.SharesSource = SharesSource;
+		for (int NumPreviewBuffers = NUM_PREVIEW_BUFFERS; NumPreviewBuffers > 0; NumPreviewBuffers--)
+		{
+			Plan.NumPreviewBuffers = NumPreviewBuffers;
+			Plan.Footprint = ComputeFootprint(ScaledWidth, ScaledHeight, SharesSource, NumPreviewBuffers);
+			if (Plan.Footprint <= MemoryBudget)
+				return Plan;
+		}
+		SmallestPlan = Plan;
+		HasSmallestPlan = true;
+	}
+}
+
+/// <summary>
+/// allocates the scaled source and the preview buffers requested by the plan.
+/// The caller fills the scaled source, unless it is shared with the source image
+/// </summary>
+/// <returns>false if out of memory, in this case no preview buffer is allocated</returns>
+bool CSessionBufferManager::AllocatePreviewImages(const PreviewPlan& Plan)
+{
+	ReleasePreviewImages();
+	if (SourceImage == nullptr)
+		return false;
+
+	try
+	{
+		if (Plan.SharesSource)
+		{
+			/// same size as the source, share it read-only instead of copying it
+			ScaledSourceImage = SourceImage;
+		}
+		else
+		{
+			ScaledSourceImage = std::make_shared<std::vector<unsigned char>>(
+				GetImageBufferSize(Plan.ScaledWidth, Plan.ScaledHeight, SourceBitDepth));
+		}
+		for (int i = 0; i < Plan.NumPreviewBuffers; i++)
+			PreviewImages[i] = std::make_shared<std::vector<unsigned char>>(
+				GetImageBufferSize(Plan.ScaledWidth, Plan.ScaledHeight, SourceBitDepth));
+	}
+	catch (std::exception&)
+	{
+		ReleasePreviewImages();
+		return false;
+	}
+	return true;
+}
+
+void CSessionBufferManager::ReleasePreviewImages()
+{
+	ScaledSourceImage.reset();
+	for (auto& PreviewImage : PreviewImages)
+		PreviewImage.reset();
+}
+
+SharedImagePtr CSessionBufferManager::GetScaledSourceImage() const
+{
+	return ScaledSourceImage;
+}
+
+/// <returns>the requested preview buffer, or nullptr if it was dropped to fit in the memory budget</returns>
+SharedImagePtr CSessionBufferManager::GetPreviewImage(PreviewBufferId BufferId) const
+{
+	if ((BufferId < 0) || (BufferId >= NUM_PREVIEW_BUFFERS))
+		return nullptr;
+	return PreviewImages[BufferId];
+}
+
+/// <summary>
+/// total size in bytes of the buffers currently allocated, counting shared buffers once
+/// </summary>
+size_t CSessionBufferManager::GetFootprint() const
+{
+	size_t Footprint = 0;
+	if (SourceImage != nullptr)
+		Footprint += SourceImage->size();
+	if ((ScaledSourceImage != nullptr) && (ScaledSourceImage != SourceImage))
+		Footprint += ScaledSourceImage->size();
+	for (const auto& PreviewImage : PreviewImages)
+		if (PreviewImage != nullptr)
+			Footprint += PreviewImage->size();
+	return Footprint;
+}
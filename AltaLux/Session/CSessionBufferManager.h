@@ -0,0 +1,108 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+using WeakImagePtr = std::weak_ptr<std::vector<unsigned char>>;
+using SharedImagePtr = std::shared_ptr<std::vector<unsigned char>>;
+
+/// preview buffers, listed in order of importance: when the memory budget is tight,
+/// the buffers at the end of the list are the first ones to be dropped
+enum PreviewBufferId
+{
+	PREVIEW_PROCESSED = 0, //< processed image with current settings
+	PREVIEW_INTENSITY_M, //< processed image with lesser intensity
+	PREVIEW_INTENSITY_P, //< processed image with higher intensity
+	PREVIEW_GRID_M, //< processed image with coarser grid
+	PREVIEW_GRID_P, //< processed image with finer grid
+	NUM_PREVIEW_BUFFERS
+};
+
+const size_t DEFAULT_MEMORY_BUDGET_MB = 1024; //< default budget for all the buffers of a session
+const size_t BUFFER_SECURITY_PADDING = 4096; //< extra bytes at the end of each image buffer
+const int MIN_PREVIEW_WIDTH = 128; //< the preview is never scaled down below this width, unless none of the widths above it can be drawn
+
+/// <summary>
+/// layout of the preview buffers chosen by CSessionBufferManager::PlanPreview
+/// </summary>
+struct PreviewPlan
+{
+	int ScalingFactor; //< scaled image width = source image width / ScalingFactor, same for height
+	int ScaledWidth;
+	int ScaledHeight;
+	int NumPreviewBuffers; //< number of preview buffers, starting from PREVIEW_PROCESSED
+	bool SharesSource; //< true if the scaled source is the source image itself (ScalingFactor == 1)
+	size_t Footprint; //< total bytes allocated by the session once the plan is applied
+};
+
+/// <summary>
+/// Owns all the image buffers of a plugin session (source image, scaled source and preview variants),
+/// allocates only the buffers needed by the chosen preview mode and keeps the total footprint
+/// under a configurable memory budget by dropping preview variants and scaling the preview down further.
+/// </summary>
+/// <remarks>
+/// The source image is shared read-only with the scaled source when no scaling is needed;
+/// GetWritableSourceImage() releases the previews, and copies the source only if it is still shared.
+/// </remarks>
+class CSessionBufferManager
+{
+public:
+	explicit CSessionBufferManager(size_t MemoryBudget = DEFAULT_MEMORY_BUDGET_MB << 20);
+
+	void SetMemoryBudget(size_t MemoryBudget);
+	size_t GetMemoryBudget() const;
+
+	SharedImagePtr AllocateSourceImage(int Width, int Height, int BitDepth);
+	SharedImagePtr GetSourceImage() const;
+	SharedImagePtr GetWritableSourceImage();
+
+	PreviewPlan PlanPreview(int PreferredScalingFactor) const;
+	bool AllocatePreviewImages(const PreviewPlan& Plan);
+	void ReleasePreviewImages();
+	SharedImagePtr GetScaledSourceImage() const;
+	SharedImagePtr GetPreviewImage(PreviewBufferId BufferId) const;
+
+	size_t GetFootprint() const;
+
+	static size_t GetImageBufferSize(int Width, int Height, int BitDepth);
+
+private:
+	size_t MemoryBudget;
+	int SourceWidth;
+	int SourceHeight;
+	int SourceBitDepth;
+	SharedImagePtr SourceImage;
+	SharedImagePtr ScaledSourceImage;
+	SharedImagePtr PreviewImages[NUM_PREVIEW_BUFFERS];
+
+	size_t ComputeFootprint(int ScaledWidth, int ScaledHeight, bool SharesSource, int NumPreviewBuffers) const;
+	bool GetScaledSize(int ScalingFactor, int& ScaledWidth, int& ScaledHeight) const;
+};
@@ -14,13 +14,26 @@
 #include "stdafx.h"
 
 #include <iostream>
+#include <iomanip>
+#include <string>
 #include <vector>
 #include <algorithm>
 #include <ctime>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <thread>
 
 #include <Windows.h>
+#include <ppl.h>
 
 #include <CAltaLuxFilterFactory.h>
+#include <CParallelSplitLoopAltaLuxFilter.h>
+#include <CFramePipeline.h>
+#include <CMemoryBudget.h>
+#include <ImageScaling.h>
+#include <ImageCopy.h>
+#include "PreviewReplay.h"
 
 using namespace std;
 // using 4K resolution for testing
@@ -28,6 +41,58 @@ const int SAMPLE_WIDTH = 3840;
 const int SAMPLE_HEIGHT = 2160;
 const int SAMPLE_SIZE = SAMPLE_WIDTH * SAMPLE_HEIGHT;
 const int BENCHMARK_SAMPLES = 10;
+// using a ~100 MP image for testing how the grid size scales
+const int LARGE_SAMPLE_WIDTH = 12288;
+const int LARGE_SAMPLE_HEIGHT = 8192;
+const int LARGE_SAMPLE_SIZE = LARGE_SAMPLE_WIDTH * LARGE_SAMPLE_HEIGHT;
+const int LARGE_BENCHMARK_SAMPLES = 3;
+const int BENCHMARK_GRID_SIZES[] = { 8, 16, 32, 64 };
+// thread scaling mode
+const int SCALING_SAMPLES = 3;
+const int SCALING_RESOLUTIONS[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+const int SCALING_GRID_SIZES[] = { 8, 16, 64 };
+const int WEAK_SCALING_WIDTH = 3840;
+const int WEAK_SCALING_ROWS_PER_THREAD = 544; //< image height grows by this amount for each added thread
+const double SYNC_OVERHEAD_WARNING = 0.25; //< flags strategies that spend more than this share of time synchronizing
+// roofline mode
+const int ROOFLINE_SAMPLES = 5;
+const int RGB32_PIXEL_SIZE = 4;
+const double MEMORY_BOUND_THRESHOLD = 0.6; //< phases above this share of the peak bandwidth are reported as memory-bound
+
+const int ORDERING_SAMPLES = 5;
+const int ORDERING_REPETITIONS = 3; //< each sub-matrix is timed this many times, and the fastest time is kept
+const int ORDERING_WORKERS[] = { 4, 8, 16, 32 };
+const int ORDERING_POLICIES[] = { AL_SCHEDULE_ROW_MAJOR, AL_SCHEDULE_LONGEST_FIRST };
+/// grids that leave many rows and columns to the bottom and right sub-matrices, and an even one for reference
+const int PIPELINE_STREAM_FRAMES = 60;
+const int PIPELINE_SOURCE_FRAMES = 4; //< distinct contents cycled through the stream, so the histograms change at each frame
+const int PIPELINE_RESOLUTIONS[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+const unsigned int PIPELINE_DEPTHS[] = { 1, 2, 3, 4 };
+const int THUMBNAIL_SAMPLES = 10;
+const int THUMBNAIL_SCALING_FACTORS[] = { 2, 4, 8 };
+const int COPY_SAMPLES = 5;
+const int COPY_WIDTH = 7680;
+const int COPY_HEIGHT = 4320;
+const int TILED_SAMPLES = 3;
+const int TILED_RESOLUTIONS[][2] = { { 3840, 2160 }, { 7680, 4320 }, { LARGE_SAMPLE_WIDTH, LARGE_SAMPLE_HEIGHT } };
+const int MEMORY_SAMPLES = 3;
+const int MEMORY_RESOLUTIONS[][2] = { { 3840, 2160 }, { 7680, 4320 }, { LARGE_SAMPLE_WIDTH, LARGE_SAMPLE_HEIGHT } };
+const int MEMORY_CONCURRENT_JOBS = 4;
+const int ORDERING_CASES[][3] = { { 1000, 1000, 64 }, { 1920, 1080, 64 }, { 4000, 3000, 64 }, { 1023, 767, 32 }, { 3840, 2160, 16 } };
+
+struct BenchmarkStrategy
+{
+	int FilterType;
+	const char *Name;
+};
+/// strategies measured in scaling mode, the serial code does not depend on the number of threads and is only used as reference
+const BenchmarkStrategy SCALING_STRATEGIES[] =
+{
+	{ ALTALUX_FILTER_PARALLEL_ERROR, "Parallel Error (no sync)" },
+	{ ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, "Parallel Split Loop" },
+	{ ALTALUX_FILTER_PARALLEL_EVENT, "Parallel Event" },
+	{ ALTALUX_FILTER_ACTIVE_WAIT, "Parallel Active Wait" }
+};
 
 unsigned char *ReferenceBuffer = nullptr;
 unsigned char *InputBuffer = nullptr;
@@ -79,9 +144,913 @@ void BenchmarkFilter(CBaseAltaLuxFilter *Filter, char *FilterName)
 	PrintBenchmarkResults(BenchmarkSamples);
 }
 
+/// <summary>
+/// filter that only runs the mapping phase, used to measure its cost in isolation from the interpolation
+/// </summary>
+class CMappingOnlyAltaLuxFilter : public CBaseAltaLuxFilter
+{
+public:
+	CMappingOnlyAltaLuxFilter(int Width, int Height, int HorSlices, int VerSlices) :
+		CBaseAltaLuxFilter(Width, Height, HorSlices, VerSlices) {}
+
+protected:
+	int Run() override
+	{
+		auto pImage = static_cast<PixelType *>(ImageBuffer);
+		MapType* pMapArray = GetMapArray();
+		if (pMapArray == nullptr)
+			return AL_OUT_OF_MEMORY;
+		const unsigned int ulClipLimit = ComputeClipLimit();
+		concurrency::parallel_for((int)0, (int)(NumHorRegions * NumVertRegions), [&](int uiTile)
+		{
+			CalcRegionMapping(pImage, uiTile % NumHorRegions, uiTile / NumHorRegions, ulClipLimit, pMapArray);
+		});
+		return AL_OK;
+	}
+};
+
+void BenchmarkLargeImage(CBaseAltaLuxFilter *Filter, unsigned char *LargeReferenceBuffer, unsigned char *LargeInputBuffer)
+{
+	vector<int> BenchmarkSamples;
+
+	for (int iteration = 0; iteration < LARGE_BENCHMARK_SAMPLES; iteration++)
+	{
+		memcpy(LargeInputBuffer, LargeReferenceBuffer, LARGE_SAMPLE_SIZE);
+		LARGE_INTEGER StartTime, StopTime;
+		QueryPerformanceCounter(&StartTime);
+		Filter->ProcessGray(LargeInputBuffer);
+		QueryPerformanceCounter(&StopTime);
+		BenchmarkSamples.push_back((int)(StopTime.QuadPart - StartTime.QuadPart));
+	}
+	PrintBenchmarkResults(BenchmarkSamples);
+}
+
+/// <summary>
+/// times the whole filter and the mapping phase alone for increasingly fine grids on a large image,
+/// the mapping phase reads every pixel once whatever the grid size, so its cost should stay flat
+/// </summary>
+void BenchmarkGridSizes()
+{
+	unsigned char *LargeReferenceBuffer = new unsigned char[LARGE_SAMPLE_SIZE];
+	FillRandomBuffer(LargeReferenceBuffer, LARGE_SAMPLE_SIZE);
+	unsigned char *LargeInputBuffer = new unsigned char[LARGE_SAMPLE_SIZE];
+
+	for (int GridSize : BENCHMARK_GRID_SIZES)
+	{
+		CMappingOnlyAltaLuxFilter *MappingFilter = new CMappingOnlyAltaLuxFilter(LARGE_SAMPLE_WIDTH, LARGE_SAMPLE_HEIGHT, GridSize, GridSize);
+		CBaseAltaLuxFilter *FullFilter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			LARGE_SAMPLE_WIDTH, LARGE_SAMPLE_HEIGHT, GridSize, GridSize);
+
+		cout << "Grid " << GridSize << "x" << GridSize << " mapping only" << endl;
+		BenchmarkLargeImage(MappingFilter, LargeReferenceBuffer, LargeInputBuffer);
+		cout << "Grid " << GridSize << "x" << GridSize << " full filter" << endl;
+		BenchmarkLargeImage(FullFilter, LargeReferenceBuffer, LargeInputBuffer);
+
+		delete MappingFilter;
+		delete FullFilter;
+	}
+
+	delete[] LargeReferenceBuffer;
+	delete[] LargeInputBuffer;
+}
+
+/// <summary>
+/// thread counts used in scaling mode: powers of two up to the number of processors, and the number of processors
+/// </summary>
+vector<unsigned int> GetScalingThreadCounts()
+{
+	const unsigned int NumProcessors = concurrency::GetProcessorCount();
+	vector<unsigned int> ThreadCounts;
+	for (unsigned int NumThreads = 1; NumThreads < NumProcessors; NumThreads <<= 1)
+		ThreadCounts.push_back(NumThreads);
+	ThreadCounts.push_back(NumProcessors);
+	return ThreadCounts;
+}
+
+/// <summary>
+/// median time in milliseconds of ProcessGray, with the PPL scheduler limited to the given number of threads
+/// </summary>
+double MeasureProcessGray(int FilterType, int Width, int Height, int GridSize, unsigned int NumThreads,
+                          unsigned char *ScalingReferenceBuffer, unsigned char *ScalingInputBuffer)
+{
+	concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(2,
+		concurrency::MinConcurrency, NumThreads, concurrency::MaxConcurrency, NumThreads));
+	CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, Width, Height, GridSize, GridSize);
+
+	LARGE_INTEGER TimerFrequency;
+	QueryPerformanceFrequency(&TimerFrequency);
+	vector<double> BenchmarkSamples;
+	for (int iteration = 0; iteration < SCALING_SAMPLES; iteration++)
+	{
+		memcpy(ScalingInputBuffer, ScalingReferenceBuffer, Width * Height);
+		LARGE_INTEGER StartTime, StopTime;
+		QueryPerformanceCounter(&StartTime);
+		Filter->ProcessGray(ScalingInputBuffer);
+		QueryPerformanceCounter(&StopTime);
+		BenchmarkSamples.push_back(1000.0 * (StopTime.QuadPart - StartTime.QuadPart) / TimerFrequency.QuadPart);
+	}
+
+	delete Filter;
+	concurrency::CurrentScheduler::Detach();
+	sort(BenchmarkSamples.begin(), BenchmarkSamples.end());
+	return BenchmarkSamples[BenchmarkSamples.size() >> 1];
+}
+
+/// <summary>
+/// strong scaling: fixed image size and grid, increasing number of threads.
+/// Parallel Error does the same work as the other strategies without synchronizing, so the extra time of a strategy
+/// over Parallel Error at the same thread count is the cost of its events, active waits or barriers
+/// </summary>
+void BenchmarkStrongScaling(const vector<unsigned int>& ThreadCounts, unsigned char *ScalingReferenceBuffer, unsigned char *ScalingInputBuffer)
+{
+	for (auto& Resolution : SCALING_RESOLUTIONS)
+		for (int GridSize : SCALING_GRID_SIZES)
+		{
+			const int Width = Resolution[0];
+			const int Height = Resolution[1];
+			cout << endl << "Strong scaling " << Width << "x" << Height << ", grid " << GridSize << "x" << GridSize << endl;
+			const double SerialTime = MeasureProcessGray(ALTALUX_FILTER_SERIAL, Width, Height, GridSize, 1, ScalingReferenceBuffer, ScalingInputBuffer);
+			cout << "Serial " << fixed << setprecision(1) << SerialTime << " ms" << endl;
+			cout << left << setw(28) << "Strategy" << right << setw(8) << "threads" << setw(12) << "time ms" << setw(10) << "speedup"
+				<< setw(12) << "efficiency" << setw(8) << "sync" << endl;
+
+			vector<double> NoSyncTimes;
+			for (auto& Strategy : SCALING_STRATEGIES)
+			{
+				double SingleThreadTime = 0.0;
+				for (size_t ThreadIndex = 0; ThreadIndex < ThreadCounts.size(); ThreadIndex++)
+				{
+					const unsigned int NumThreads = ThreadCounts[ThreadIndex];
+					const double Time = MeasureProcessGray(Strategy.FilterType, Width, Height, GridSize, NumThreads, ScalingReferenceBuffer, ScalingInputBuffer);
+					if (ThreadIndex == 0)
+						SingleThreadTime = Time;
+					if (Strategy.FilterType == ALTALUX_FILTER_PARALLEL_ERROR)
+						NoSyncTimes.push_back(Time);
+					const double Speedup = SingleThreadTime / Time;
+					const double SyncOverhead = max(0.0, (Time - NoSyncTimes[ThreadIndex]) / Time);
+
+					cout << left << setw(28) << Strategy.Name << right << setw(8) << NumThreads
+						<< fixed << setprecision(1) << setw(12) << Time
+						<< setprecision(2) << setw(10) << Speedup << setw(11) << (100.0 * Speedup / NumThreads) << "%"
+						<< setprecision(0) << setw(7) << (100.0 * SyncOverhead) << "%";
+					if (SyncOverhead > SYNC_OVERHEAD_WARNING)
+						cout << "  <- synchronization dominates";
+					cout << endl;
+				}
+			}
+		}
+}
+
+/// <summary>
+/// weak scaling: fixed number of rows per thread, so the image grows with the number of threads
+/// </summary>
+void BenchmarkWeakScaling(const vector<unsigned int>& ThreadCounts, unsigned char *ScalingReferenceBuffer, unsigned char *ScalingInputBuffer)
+{
+	for (int GridSize : SCALING_GRID_SIZES)
+	{
+		cout << endl << "Weak scaling " << WEAK_SCALING_WIDTH << "x" << WEAK_SCALING_ROWS_PER_THREAD << " per thread, grid "
+			<< GridSize << "x" << GridSize << endl;
+		cout << left << setw(28) << "Strategy" << right << setw(8) << "threads" << setw(12) << "time ms" << setw(12) << "MPixel/s"
+			<< setw(12) << "efficiency" << endl;
+		for (auto& Strategy : SCALING_STRATEGIES)
+		{
+			double SingleThreadTime = 0.0;
+			for (size_t ThreadIndex = 0; ThreadIndex < ThreadCounts.size(); ThreadIndex++)
+			{
+				const unsigned int NumThreads = ThreadCounts[ThreadIndex];
+				const int Height = WEAK_SCALING_ROWS_PER_THREAD * NumThreads;
+				const double Time = MeasureProcessGray(Strategy.FilterType, WEAK_SCALING_WIDTH, Height, GridSize, NumThreads,
+					ScalingReferenceBuffer, ScalingInputBuffer);
+				if (ThreadIndex == 0)
+					SingleThreadTime = Time;
+				const double Throughput = ((double)WEAK_SCALING_WIDTH * Height) / (Time * 1000.0);
+
+				cout << left << setw(28) << Strategy.Name << right << setw(8) << NumThreads
+					<< fixed << setprecision(1) << setw(12) << Time << setw(12) << Throughput
+					<< setw(11) << (100.0 * SingleThreadTime / Time) << "%" << endl;
+			}
+		}
+	}
+}
+
+/// <summary>
+/// runs every strategy with 1..N threads, for strong and weak scaling
+/// </summary>
+void BenchmarkThreadScaling()
+{
+	const vector<unsigned int> ThreadCounts = GetScalingThreadCounts();
+	size_t ScalingBufferSize = (size_t)WEAK_SCALING_WIDTH * WEAK_SCALING_ROWS_PER_THREAD * ThreadCounts.back();
+	for (auto& Resolution : SCALING_RESOLUTIONS)
+		ScalingBufferSize = max(ScalingBufferSize, (size_t)Resolution[0] * Resolution[1]);
+
+	unsigned char *ScalingReferenceBuffer = new unsigned char[ScalingBufferSize];
+	FillRandomBuffer(ScalingReferenceBuffer, (int)ScalingBufferSize);
+	unsigned char *ScalingInputBuffer = new unsigned char[ScalingBufferSize];
+
+	cout << "Thread scaling on " << ThreadCounts.back() << " processors" << endl;
+	BenchmarkStrongScaling(ThreadCounts, ScalingReferenceBuffer, ScalingInputBuffer);
+	BenchmarkWeakScaling(ThreadCounts, ScalingReferenceBuffer, ScalingInputBuffer);
+
+	delete[] ScalingReferenceBuffer;
+	delete[] ScalingInputBuffer;
+}
+
+/// <summary>
+/// returns the time in seconds elapsed running the given code
+/// </summary>
+template <typename Function>
+double MeasureSeconds(Function CodeToMeasure)
+{
+	LARGE_INTEGER TimerFrequency, StartTime, StopTime;
+	QueryPerformanceFrequency(&TimerFrequency);
+	QueryPerformanceCounter(&StartTime);
+	CodeToMeasure();
+	QueryPerformanceCounter(&StopTime);
+	return (double)(StopTime.QuadPart - StartTime.QuadPart) / TimerFrequency.QuadPart;
+}
+
+/// <summary>
+/// runs the same phases as ProcessRGB32 with the split loop strategy, and times each of them
+/// </summary>
+class CPhaseTimedAltaLuxFilter : public CBaseAltaLuxFilter
+{
+public:
+	CPhaseTimedAltaLuxFilter(int Width, int Height) : CBaseAltaLuxFilter(Width, Height) {}
+
+	double ConversionSeconds = 0.0;
+	double HistogramSeconds = 0.0;
+	double InterpolationSeconds = 0.0; //< includes the write-back into the RGB32 image
+
+	void ProcessTimedRGB32(unsigned char *Image)
+	{
+		ConversionSeconds = MeasureSeconds([&]() { ExtractLuminance(Image, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, RGB32_PIXEL_SIZE); });
+		SetLumaOutput(Image, AL_OUTPUT_RGB, RGB32_PIXEL_SIZE, 0);
+		Run();
+		SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	}
+
+protected:
+	/// Ey = 0.299*Er + 0.587*Eg + 0.114*Eb, same Q15 factors as ProcessRGB32
+	static const int Y_RED_SCALE = static_cast<int>(0.299 * (1 << 15));
+	static const int Y_GREEN_SCALE = static_cast<int>(0.587 * (1 << 15));
+	static const int Y_BLUE_SCALE = static_cast<int>(0.114 * (1 << 15));
+
+	int Run() override
+	{
+		auto pImage = static_cast<PixelType *>(ImageBuffer);
+		MapType* pMapArray = GetMapArray();
+		if (pMapArray == nullptr)
+			return AL_OUT_OF_MEMORY;
+		const unsigned int ulClipLimit = ComputeClipLimit();
+		HistogramSeconds = MeasureSeconds([&]()
+		{
+			concurrency::parallel_for((int)0, (int)(NumHorRegions * NumVertRegions), [&](int uiTile)
+			{
+				CalcRegionMapping(pImage, uiTile % NumHorRegions, uiTile / NumHorRegions, ulClipLimit, pMapArray);
+			});
+		});
+		const unsigned int NumSubMatrixCols = NumHorRegions + 1;
+		InterpolationSeconds = MeasureSeconds([&]()
+		{
+			concurrency::parallel_for((int)0, (int)(NumSubMatrixCols * (NumVertRegions + 1)), [&](int uiSubMatrix)
+			{
+				InterpolateSubMatrix(pImage, uiSubMatrix % NumSubMatrixCols, uiSubMatrix / NumSubMatrixCols, pMapArray);
+			});
+		});
+		return AL_OK;
+	}
+
+	void ForEachBand(int NumBands, const std::function<void(int Band)>& ProcessBand) override
+	{
+		concurrency::parallel_for(0, NumBands, [&](int Band) { ProcessBand(Band); });
+	}
+};
+
+/// bandwidth in bytes/s of the STREAM-like kernels, single threaded and on all processors
+struct HostBandwidth
+{
+	double Read[2];
+	double Write[2];
+	double Copy[2];
+};
+const int SINGLE_THREAD = 0;
+const int ALL_THREADS = 1;
+
+/// <summary>
+/// median bandwidth of a kernel run over the buffer split in NumChunks chunks, processed in parallel
+/// </summary>
+template <typename ChunkFunction>
+double MeasureBandwidth(size_t BytesMoved, int NumChunks, ChunkFunction ProcessChunk)
+{
+	vector<double> BenchmarkSamples;
+	for (int iteration = 0; iteration < ROOFLINE_SAMPLES; iteration++)
+	{
+		const double Seconds = MeasureSeconds([&]()
+		{
+			concurrency::parallel_for(0, NumChunks, [&](int Chunk) { ProcessChunk(Chunk, NumChunks); });
+		});
+		BenchmarkSamples.push_back(BytesMoved / Seconds);
+	}
+	sort(BenchmarkSamples.begin(), BenchmarkSamples.end());
+	return BenchmarkSamples[BenchmarkSamples.size() >> 1];
+}
+
+/// <summary>
+/// measures read, write and copy bandwidth on buffers of the given size, counting bytes as STREAM does
+/// (copy moves twice the buffer size)
+/// </summary>
+HostBandwidth MeasureHostBandwidth(size_t BufferSize)
+{
+	const size_t NumWords = BufferSize / sizeof(unsigned long long);
+	vector<unsigned long long> Source(NumWords, 1);
+	vector<unsigned long long> Destination(NumWords, 0);
+	volatile unsigned long long Sink = 0;
+	const size_t WordsSize = NumWords * sizeof(unsigned long long);
+
+	HostBandwidth Bandwidth;
+	const int ChunkCounts[2] = { 1, (int)concurrency::GetProcessorCount() };
+	for (int Threads = SINGLE_THREAD; Threads <= ALL_THREADS; Threads++)
+	{
+		const int NumChunks = ChunkCounts[Threads];
+		Bandwidth.Read[Threads] = MeasureBandwidth(WordsSize, NumChunks, [&](int Chunk, int Chunks)
+		{
+			unsigned long long Sum = 0;
+			for (size_t i = NumWords * Chunk / Chunks; i < NumWords * (Chunk + 1) / Chunks; i++)
+				Sum += Source[i];
+			Sink += Sum;
+		});
+		Bandwidth.Write[Threads] = MeasureBandwidth(WordsSize, NumChunks, [&](int Chunk, int Chunks)
+		{
+			const size_t First = NumWords * Chunk / Chunks;
+			memset(&Destination[First], Chunk, (NumWords * (Chunk + 1) / Chunks - First) * sizeof(unsigned long long));
+		});
+		Bandwidth.Copy[Threads] = MeasureBandwidth(2 * WordsSize, NumChunks, [&](int Chunk, int Chunks)
+		{
+			const size_t First = NumWords * Chunk / Chunks;
+			memcpy(&Destination[First], &Source[First], (NumWords * (Chunk + 1) / Chunks - First) * sizeof(unsigned long long));
+		});
+	}
+	return Bandwidth;
+}
+
+void PrintRooflinePhase(const char *PhaseName, double BytesMoved, double Seconds, double PeakBandwidth, const char *PeakName)
+{
+	const double Bandwidth = BytesMoved / Seconds;
+	const double ShareOfPeak = Bandwidth / PeakBandwidth;
+	cout << left << setw(16) << PhaseName << right << fixed << setprecision(2) << setw(10) << (Seconds * 1000.0)
+		<< setw(10) << (BytesMoved / 1e6) << setw(10) << (Bandwidth / 1e9)
+		<< setprecision(0) << setw(8) << (100.0 * ShareOfPeak) << "% of " << left << setw(24) << PeakName
+		<< ((ShareOfPeak >= MEMORY_BOUND_THRESHOLD) ? "memory-bound" : "compute-bound") << endl;
+}
+
+/// <summary>
+/// compares the bandwidth achieved by each phase of ProcessRGB32 with the bandwidth of the host.
+/// Conversion runs on a single thread, mapping and interpolation, that also writes back into the RGB32 image, on all processors,
+/// so each phase is compared to the peak with the same number of threads
+/// </summary>
+void BenchmarkRoofline()
+{
+	const size_t NumPixels = SAMPLE_SIZE;
+	const size_t ColorImageSize = NumPixels * RGB32_PIXEL_SIZE;
+
+	cout << "Host bandwidth, GB/s" << endl;
+	cout << left << setw(16) << "buffer MB" << right << setw(10) << "threads" << setw(10) << "read" << setw(10) << "write" << setw(10) << "copy" << endl;
+	const size_t BufferSizes[2] = { NumPixels, ColorImageSize };
+	HostBandwidth Bandwidth[2];
+	for (int SizeIndex = 0; SizeIndex < 2; SizeIndex++)
+	{
+		Bandwidth[SizeIndex] = MeasureHostBandwidth(BufferSizes[SizeIndex]);
+		for (int Threads = SINGLE_THREAD; Threads <= ALL_THREADS; Threads++)
+			cout << left << setw(16) << (BufferSizes[SizeIndex] >> 20) << right << setw(10)
+				<< ((Threads == SINGLE_THREAD) ? 1 : concurrency::GetProcessorCount())
+				<< fixed << setprecision(2) << setw(10) << (Bandwidth[SizeIndex].Read[Threads] / 1e9)
+				<< setw(10) << (Bandwidth[SizeIndex].Write[Threads] / 1e9)
+				<< setw(10) << (Bandwidth[SizeIndex].Copy[Threads] / 1e9) << endl;
+	}
+	const HostBandwidth& GrayBandwidth = Bandwidth[0];
+	const HostBandwidth& ColorBandwidth = Bandwidth[1];
+
+	vector<unsigned char> ReferenceImage(ColorImageSize);
+	FillRandomBuffer(ReferenceImage.data(), (int)ColorImageSize);
+	vector<unsigned char> Image(ColorImageSize);
+	CPhaseTimedAltaLuxFilter Filter(SAMPLE_WIDTH, SAMPLE_HEIGHT);
+
+	vector<double> ConversionSamples, HistogramSamples, InterpolationSamples;
+	for (int iteration = 0; iteration < ROOFLINE_SAMPLES; iteration++)
+	{
+		memcpy(Image.data(), ReferenceImage.data(), ColorImageSize);
+		Filter.ProcessTimedRGB32(Image.data());
+		ConversionSamples.push_back(Filter.ConversionSeconds);
+		HistogramSamples.push_back(Filter.HistogramSeconds);
+		InterpolationSamples.push_back(Filter.InterpolationSeconds);
+	}
+	auto Median = [](vector<double>& Samples)
+	{
+		sort(Samples.begin(), Samples.end());
+		return Samples[Samples.size() >> 1];
+	};
+
+	/// bytes moved by each phase, the mappings are small enough to stay in cache and are not counted
+	const double ConversionBytes = (double)NumPixels * (RGB32_PIXEL_SIZE + 1); //< read RGB32, write luma
+	const double HistogramBytes = (double)NumPixels; //< read luma
+	const double InterpolationBytes = (double)NumPixels * (2 * RGB32_PIXEL_SIZE + 1); //< read luma and RGB32, write RGB32
+
+	cout << endl << "ProcessRGB32 " << SAMPLE_WIDTH << "x" << SAMPLE_HEIGHT << " phases" << endl;
+	cout << left << setw(16) << "phase" << right << setw(10) << "ms" << setw(10) << "MB" << setw(10) << "GB/s" << endl;
+	PrintRooflinePhase("conversion", ConversionBytes, Median(ConversionSamples), ColorBandwidth.Copy[ALL_THREADS], "copy, all threads");
+	PrintRooflinePhase("histogram", HistogramBytes, Median(HistogramSamples), GrayBandwidth.Read[ALL_THREADS], "read, all threads");
+	PrintRooflinePhase("interpolation", InterpolationBytes, Median(InterpolationSamples), ColorBandwidth.Copy[ALL_THREADS], "copy, all threads");
+}
+
+/// <summary>
+/// split loop filter that times the interpolation of each sub-matrix on its own
+/// </summary>
+class CTileTimedAltaLuxFilter : public CParallelSplitLoopAltaLuxFilter
+{
+public:
+	CTileTimedAltaLuxFilter(int Width, int Height, int Slices) : CParallelSplitLoopAltaLuxFilter(Width, Height, Slices, Slices) {}
+
+	/// <summary>
+	/// computes the mappings of a grayscale image, then interpolates the sub-matrices one at a time
+	/// </summary>
+	/// <returns>seconds taken by each sub-matrix, in row-major order</returns>
+	vector<double> MeasureSubMatrixSeconds(const unsigned char *Image)
+	{
+		vector<double> SubMatrixSeconds;
+		MapType* pMapArray = GetMapArray();
+		if ((ImageBuffer == nullptr) || (pMapArray == nullptr))
+			return SubMatrixSeconds;
+		memcpy(ImageBuffer, Image, OriginalImageWidth * OriginalImageHeight);
+		auto pImage = static_cast<PixelType *>(ImageBuffer);
+		const unsigned int ulClipLimit = ComputeClipLimit();
+		for (unsigned int uiY = 0; uiY < NumVertRegions; uiY++)
+			for (unsigned int uiX = 0; uiX < NumHorRegions; uiX++)
+				CalcRegionMapping(pImage, uiX, uiY, ulClipLimit, pMapArray);
+		for (unsigned int uiY = 0; uiY <= NumVertRegions; uiY++)
+			for (unsigned int uiX = 0; uiX <= NumHorRegions; uiX++)
+			{
+				double FastestTime = 0.0;
+				for (int Repetition = 0; Repetition < ORDERING_REPETITIONS; Repetition++)
+				{
+					const double Time = MeasureSeconds([&]() { InterpolateSubMatrix(pImage, uiX, uiY, pMapArray); });
+					if ((Repetition == 0) || (Time < FastestTime))
+						FastestTime = Time;
+				}
+				SubMatrixSeconds.push_back(FastestTime);
+			}
+		return SubMatrixSeconds;
+	}
+
+	const unsigned short* GetLongestFirstOrder()
+	{
+		return GetSubMatrixOrder();
+	}
+};
+
+/// <summary>
+/// completion time of tasks handed out in the given order to the first free worker, as the split loop strategy does
+/// </summary>
+/// <param name="Order">task at each position, nullptr for the index order</param>
+double SimulateMakespan(const vector<double>& TaskSeconds, const unsigned short *Order, int NumWorkers)
+{
+	priority_queue<double, vector<double>, greater<double>> WorkerFreeTimes;
+	for (int i = 0; i < NumWorkers; i++)
+		WorkerFreeTimes.push(0.0);
+	double Makespan = 0.0;
+	for (size_t Position = 0; Position < TaskSeconds.size(); Position++)
+	{
+		const double EndTime = WorkerFreeTimes.top() + TaskSeconds[(Order != nullptr) ? Order[Position] : Position];
+		WorkerFreeTimes.pop();
+		WorkerFreeTimes.push(EndTime);
+		Makespan = max(Makespan, EndTime);
+	}
+	return Makespan;
+}
+
+/// <summary>
+/// compares the row-major and the longest-first dispatch of the interpolation phase on grids with uneven sub-matrices.
+/// The makespan for a given number of workers is simulated from the measured time of each sub-matrix, so it does not
+/// depend on the cores of this machine; the lower bound is the larger of the average load and the longest task.
+/// The whole filter is then timed with both policies on this machine
+/// </summary>
+void BenchmarkTaskOrdering()
+{
+	cout << "Interpolation phase makespan in ms, row-major / longest-first / lower bound" << endl;
+	for (auto& Case : ORDERING_CASES)
+	{
+		const int Width = Case[0], Height = Case[1], GridSize = Case[2];
+		vector<unsigned char> Image(Width * Height);
+		FillRandomBuffer(Image.data(), (int)Image.size());
+
+		CTileTimedAltaLuxFilter TimedFilter(Width, Height, GridSize);
+		const vector<double> SubMatrixSeconds = TimedFilter.MeasureSubMatrixSeconds(Image.data());
+		if (SubMatrixSeconds.empty())
+			continue;
+		const unsigned short *LongestFirstOrder = TimedFilter.GetLongestFirstOrder();
+		double TotalSeconds = 0.0, LongestSeconds = 0.0;
+		for (double Seconds : SubMatrixSeconds)
+		{
+			TotalSeconds += Seconds;
+			LongestSeconds = max(LongestSeconds, Seconds);
+		}
+		cout << endl << Width << "x" << Height << " grid " << GridSize << "x" << GridSize << ", " << SubMatrixSeconds.size()
+			<< " sub-matrices, " << fixed << setprecision(3) << (TotalSeconds * 1000.0) << " ms in total, longest "
+			<< (LongestSeconds * 1000.0) << " ms" << endl;
+		for (int NumWorkers : ORDERING_WORKERS)
+		{
+			const double RowMajor = SimulateMakespan(SubMatrixSeconds, nullptr, NumWorkers);
+			const double LongestFirst = SimulateMakespan(SubMatrixSeconds, LongestFirstOrder, NumWorkers);
+			const double LowerBound = max(TotalSeconds / NumWorkers, LongestSeconds);
+			cout << setw(4) << NumWorkers << " workers " << setw(10) << (RowMajor * 1000.0) << setw(10) << (LongestFirst * 1000.0)
+				<< setw(10) << (LowerBound * 1000.0) << setw(8) << setprecision(1) << (100.0 * (RowMajor - LongestFirst) / RowMajor)
+				<< "% shorter" << setprecision(3) << endl;
+		}
+
+		for (int Policy : ORDERING_POLICIES)
+		{
+			unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+				Width, Height, GridSize, GridSize));
+			Filter->SetSchedulingPolicy(Policy);
+			vector<double> Samples;
+			vector<unsigned char> Input(Image.size());
+			for (int Sample = 0; Sample < ORDERING_SAMPLES; Sample++)
+			{
+				Input = Image;
+				Samples.push_back(MeasureSeconds([&]() { Filter->ProcessGray(Input.data()); }));
+			}
+			sort(Samples.begin(), Samples.end());
+			cout << "  whole filter, " << concurrency::GetProcessorCount() << " processors, "
+				<< ((Policy == AL_SCHEDULE_ROW_MAJOR) ? "row-major    " : "longest-first") << " median "
+				<< (Samples[Samples.size() / 2] * 1000.0) << " ms" << endl;
+		}
+	}
+}
+
+/// <summary>
+/// sustained frames per second of a stream of same-sized RGB32 frames, processed one at a time by ProcessRGB32
+/// and by CFramePipeline with a growing number of frames in flight.
+/// Each frame is copied from its source before it is submitted, as a decoder would write it
+/// </summary>
+void BenchmarkFramePipeline()
+{
+	cout << "Frame pipeline, " << PIPELINE_STREAM_FRAMES << " RGB32 frames, " << concurrency::GetProcessorCount() << " processors" << endl;
+	for (auto& Resolution : PIPELINE_RESOLUTIONS)
+	{
+		const int Width = Resolution[0], Height = Resolution[1];
+		const int FrameSize = Width * Height * RGB32_PIXEL_SIZE;
+		vector<vector<unsigned char>> Sources(PIPELINE_SOURCE_FRAMES, vector<unsigned char>(FrameSize));
+		for (auto& Source : Sources)
+			FillRandomBuffer(Source.data(), FrameSize);
+		vector<vector<unsigned char>> Frames(MAX_PIPELINE_DEPTH, vector<unsigned char>(FrameSize));
+
+		unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			Width, Height));
+		const double SequentialSeconds = MeasureSeconds([&]()
+		{
+			for (int Frame = 0; Frame < PIPELINE_STREAM_FRAMES; Frame++)
+			{
+				Frames[0] = Sources[Frame % PIPELINE_SOURCE_FRAMES];
+				Filter->ProcessRGB32(Frames[0].data());
+			}
+		});
+		const double SequentialFPS = PIPELINE_STREAM_FRAMES / SequentialSeconds;
+		cout << endl << Width << "x" << Height << fixed << setprecision(1) << endl;
+		cout << "  ProcessRGB32      " << setw(8) << SequentialFPS << " frames/s" << endl;
+
+		for (unsigned int Depth : PIPELINE_DEPTHS)
+		{
+			CFramePipeline Pipeline(Width, Height, FRAME_FORMAT_RGB32, DEFAULT_HOR_REGIONS, DEFAULT_VERT_REGIONS, Depth);
+			int FirstError = AL_OK;
+			const double PipelineSeconds = MeasureSeconds([&]()
+			{
+				for (int Frame = 0; Frame < PIPELINE_STREAM_FRAMES; Frame++)
+				{
+					/// frame N reuses the buffer of frame N - Depth, which is the oldest one in flight
+					if (Pipeline.GetNumFramesInFlight() == Pipeline.GetDepth())
+					{
+						const int Status = Pipeline.CompleteFrame();
+						if (FirstError == AL_OK)
+							FirstError = Status;
+					}
+					vector<unsigned char>& Buffer = Frames[Frame % Depth];
+					Buffer = Sources[Frame % PIPELINE_SOURCE_FRAMES];
+					Pipeline.SubmitFrame(Buffer.data());
+				}
+				const int Status = Pipeline.Flush();
+				if (FirstError == AL_OK)
+					FirstError = Status;
+			});
+			if (FirstError != AL_OK)
+			{
+				cout << "  pipeline depth " << Depth << " failed with error " << FirstError << endl;
+				continue;
+			}
+			const double PipelineFPS = PIPELINE_STREAM_FRAMES / PipelineSeconds;
+			cout << "  pipeline depth " << Depth << "  " << setw(8) << PipelineFPS << " frames/s, "
+				<< setprecision(2) << (PipelineFPS / SequentialFPS) << "x" << setprecision(1) << endl;
+		}
+	}
+}
+
+/// <summary>
+/// time of ProcessRGB32 followed by ScaleDownImage of its result, against ProcessRGB32 down-sampling
+/// the result into the thumbnail while it is written, refer to CBaseAltaLuxFilter::SetThumbnailOutput
+/// </summary>
+void BenchmarkThumbnail()
+{
+	cout << "Thumbnail, " << THUMBNAIL_SAMPLES << " RGB32 frames per measure" << endl;
+	for (auto& Resolution : PIPELINE_RESOLUTIONS)
+	{
+		const int Width = Resolution[0], Height = Resolution[1];
+		const int FrameSize = Width * Height * RGB32_PIXEL_SIZE;
+		vector<unsigned char> Source(FrameSize);
+		FillRandomBuffer(Source.data(), FrameSize);
+		vector<unsigned char> Frame(FrameSize);
+		unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			Width, Height));
+		cout << endl << Width << "x" << Height << fixed << setprecision(2) << endl;
+
+		for (int ScalingFactor : THUMBNAIL_SCALING_FACTORS)
+		{
+			vector<unsigned char> Thumbnail((Width / ScalingFactor) * (Height / ScalingFactor) * RGB32_PIXEL_SIZE);
+			/// the copy of the source is done in both measures, as a decoder would write the frame
+			Filter->SetThumbnailOutput(nullptr, ScalingFactor);
+			const double SeparateSeconds = MeasureSeconds([&]()
+			{
+				for (int Sample = 0; Sample < THUMBNAIL_SAMPLES; Sample++)
+				{
+					Frame = Source;
+					Filter->ProcessRGB32(Frame.data());
+					ScaleDownImage(Frame.data(), Width, Height, Thumbnail.data(), ScalingFactor, RGB32_PIXEL_SIZE);
+				}
+			});
+			vector<unsigned char> SeparateThumbnail(Thumbnail);
+
+			Filter->SetThumbnailOutput(Thumbnail.data(), ScalingFactor);
+			const double SamePassSeconds = MeasureSeconds([&]()
+			{
+				for (int Sample = 0; Sample < THUMBNAIL_SAMPLES; Sample++)
+				{
+					Frame = Source;
+					Filter->ProcessRGB32(Frame.data());
+				}
+			});
+			Filter->SetThumbnailOutput(nullptr, ScalingFactor);
+
+			cout << "  1/" << ScalingFactor << "  separate pass " << setw(8) << (SeparateSeconds * 1000.0 / THUMBNAIL_SAMPLES)
+				<< " ms, same pass " << setw(8) << (SamePassSeconds * 1000.0 / THUMBNAIL_SAMPLES) << " ms, "
+				<< (SeparateSeconds / SamePassSeconds) << "x" << ((Thumbnail == SeparateThumbnail) ? "" : "  MISMATCH") << endl;
+		}
+	}
+}
+
+/// <summary>
+/// time of importing a bottom-up DIB into the buffer processed by the filter, row by row with memcpy
+/// as the plugin used to do, and with CopyImageRows with and without converting the pixels
+/// </summary>
+void BenchmarkImageCopy()
+{
+	const int DIBBytesPerPixel[] = { 3, 4 };
+	cout << "Image copy, " << COPY_WIDTH << "x" << COPY_HEIGHT << fixed << setprecision(1) << endl;
+	for (int SrcBytesPerPixel : DIBBytesPerPixel)
+	{
+		/// DIB rows are aligned to 4 bytes
+		const int DIBStride = ((COPY_WIDTH * SrcBytesPerPixel) + 3) & ~3;
+		vector<unsigned char> DIB(static_cast<size_t>(DIBStride) * COPY_HEIGHT);
+		FillRandomBuffer(DIB.data(), static_cast<int>(DIB.size()));
+		vector<unsigned char> Image(static_cast<size_t>(COPY_WIDTH) * COPY_HEIGHT * RGB32_PIXEL_SIZE);
+		const double GigaBytes = (double)COPY_WIDTH * COPY_HEIGHT * SrcBytesPerPixel / 1e9;
+
+		const double MemcpySeconds = MeasureSeconds([&]()
+		{
+			for (int Sample = 0; Sample < COPY_SAMPLES; Sample++)
+				for (int y = 0; y < COPY_HEIGHT; y++)
+					memcpy(&Image[static_cast<size_t>(y) * COPY_WIDTH * SrcBytesPerPixel], &DIB[static_cast<size_t>(y) * DIBStride],
+						COPY_WIDTH * SrcBytesPerPixel);
+		}) / COPY_SAMPLES;
+		cout << "  RGB" << (SrcBytesPerPixel * 8) << " row memcpy          " << setw(8) << (MemcpySeconds * 1000.0) << " ms, "
+			<< (GigaBytes / MemcpySeconds) << " GB/s" << endl;
+
+		for (int DestBytesPerPixel : DIBBytesPerPixel)
+		{
+			const double CopySeconds = MeasureSeconds([&]()
+			{
+				for (int Sample = 0; Sample < COPY_SAMPLES; Sample++)
+					CopyImageRows(DIB.data(), DIBStride, SrcBytesPerPixel, Image.data(), COPY_WIDTH * DestBytesPerPixel, DestBytesPerPixel,
+						COPY_WIDTH, COPY_HEIGHT, true);
+			}) / COPY_SAMPLES;
+			cout << "  RGB" << (SrcBytesPerPixel * 8) << " to RGB" << (DestBytesPerPixel * 8) << ", flipped  " << setw(8) << (CopySeconds * 1000.0)
+				<< " ms, " << (GigaBytes / CopySeconds) << " GB/s, " << setprecision(2) << (MemcpySeconds / CopySeconds) << "x"
+				<< setprecision(1) << endl;
+		}
+	}
+}
+
+/// <summary>
+/// time of ProcessRGB32 with the luminance stored row by row and sub-matrix by sub-matrix, refer to
+/// CBaseAltaLuxFilter::SetTiledLayout, on a single core and on all of them
+/// </summary>
+void BenchmarkTiledLayout()
+{
+	const int FilterTypes[] = { ALTALUX_FILTER_SERIAL, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP };
+	cout << "Tiled layout, " << TILED_SAMPLES << " RGB32 frames per measure" << fixed << setprecision(2) << endl;
+	for (auto& Resolution : TILED_RESOLUTIONS)
+	{
+		const int Width = Resolution[0], Height = Resolution[1];
+		const size_t FrameSize = static_cast<size_t>(Width) * Height * RGB32_PIXEL_SIZE;
+		vector<unsigned char> Source(FrameSize);
+		FillRandomBuffer(Source.data(), static_cast<int>(FrameSize));
+		vector<unsigned char> Frame(FrameSize);
+		cout << endl << Width << "x" << Height << endl;
+
+		for (int FilterType : FilterTypes)
+			for (int GridSize : BENCHMARK_GRID_SIZES)
+			{
+				unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType,
+					Width, Height, GridSize, GridSize));
+				double Seconds[2];
+				vector<unsigned char> Results[2];
+				for (int Tiled = 0; Tiled < 2; Tiled++)
+				{
+					Filter->SetTiledLayout(Tiled != 0);
+					/// the copy of the source is done in both measures, it is not timed
+					Seconds[Tiled] = 0.0;
+					for (int Sample = 0; Sample < TILED_SAMPLES; Sample++)
+					{
+						Frame = Source;
+						Seconds[Tiled] += MeasureSeconds([&]() { Filter->ProcessRGB32(Frame.data()); });
+					}
+					Results[Tiled] = Frame;
+				}
+				cout << "  " << ((FilterType == ALTALUX_FILTER_SERIAL) ? "serial    " : "split loop") << " grid " << setw(2) << GridSize
+					<< "  rows " << setw(8) << (Seconds[0] * 1000.0 / TILED_SAMPLES) << " ms, tiles " << setw(8)
+					<< (Seconds[1] * 1000.0 / TILED_SAMPLES) << " ms, " << (Seconds[0] / Seconds[1]) << "x"
+					<< ((Results[0] == Results[1]) ? "" : "  MISMATCH") << endl;
+			}
+	}
+}
+
+/// <summary>
+/// prints the counters of CMemoryBudget since the last ResetStats
+/// </summary>
+void PrintMemoryBudgetStats()
+{
+	const MemoryBudgetStats Stats = CMemoryBudget::GetInstance().GetStats();
+	cout << Stats.NumAdmissions << " admitted, " << Stats.NumQueued << " queued for " << (Stats.QueuedSeconds * 1000.0)
+		<< " ms (max " << (Stats.MaxQueuedSeconds * 1000.0) << " ms), " << Stats.NumFallbacks << " fallbacks, peak "
+		<< (Stats.PeakBytes >> 20) << " MB" << endl;
+}
+
+/// <summary>
+/// time of ProcessRGB32 with the whole luminance plane and with the bands it falls back to under a memory budget,
+/// then makespan of concurrent jobs under budgets that make them queue or fall back, refer to CMemoryBudget
+/// </summary>
+void BenchmarkMemoryBudget()
+{
+	CMemoryBudget& Budget = CMemoryBudget::GetInstance();
+	cout << "Memory budget, " << MEMORY_SAMPLES << " RGB32 frames per measure" << fixed << setprecision(2) << endl;
+	for (auto& Resolution : MEMORY_RESOLUTIONS)
+	{
+		const int Width = Resolution[0], Height = Resolution[1];
+		const size_t FrameSize = static_cast<size_t>(Width) * Height * RGB32_PIXEL_SIZE;
+		vector<unsigned char> Source(FrameSize);
+		FillRandomBuffer(Source.data(), static_cast<int>(FrameSize));
+		vector<unsigned char> Frame(FrameSize);
+		cout << endl << Width << "x" << Height << endl;
+
+		/// a limit of one byte is smaller than any job, that then runs alone on bands
+		unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			Width, Height));
+		Filter->SetStrength(AL_DEFAULT_STRENGTH);
+		const size_t Limits[2] = { 0, 1 };
+		double Seconds[2];
+		size_t PeakBytes[2];
+		vector<unsigned char> Results[2];
+		for (int Banded = 0; Banded < 2; Banded++)
+		{
+			Budget.SetLimit(Limits[Banded]);
+			Budget.ResetStats();
+			Seconds[Banded] = 0.0;
+			for (int Sample = 0; Sample < MEMORY_SAMPLES; Sample++)
+			{
+				Frame = Source;
+				Seconds[Banded] += MeasureSeconds([&]() { Filter->ProcessRGB32(Frame.data()); });
+			}
+			PeakBytes[Banded] = Budget.GetStats().PeakBytes;
+			Results[Banded] = Frame;
+		}
+		cout << "  plane " << setw(8) << (Seconds[0] * 1000.0 / MEMORY_SAMPLES) << " ms, " << setw(6) << (PeakBytes[0] >> 10)
+			<< " KB;  bands " << setw(8) << (Seconds[1] * 1000.0 / MEMORY_SAMPLES) << " ms, " << setw(6) << (PeakBytes[1] >> 10)
+			<< " KB" << ((Results[0] == Results[1]) ? "" : "  MISMATCH") << endl;
+
+		/// concurrent jobs on their own filters, with a budget that holds one plane, so that the others wait,
+		/// and one that also holds a band, so that they fall back instead
+		const size_t PlaneBytes = PeakBytes[0];
+		const size_t JobLimits[2] = { PlaneBytes, PlaneBytes + PeakBytes[1] };
+		const char *JobLimitNames[2] = { "one plane        ", "one plane + band " };
+		vector<unique_ptr<CBaseAltaLuxFilter>> JobFilters;
+		vector<vector<unsigned char>> JobFrames(MEMORY_CONCURRENT_JOBS);
+		for (int Job = 0; Job < MEMORY_CONCURRENT_JOBS; Job++)
+		{
+			JobFilters.emplace_back(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, Width, Height));
+			JobFilters.back()->SetStrength(AL_DEFAULT_STRENGTH);
+		}
+		for (int LimitIndex = 0; LimitIndex < 2; LimitIndex++)
+		{
+			for (auto& JobFrame : JobFrames)
+				JobFrame = Source;
+			Budget.SetLimit(JobLimits[LimitIndex]);
+			Budget.ResetStats();
+			const double JobSeconds = MeasureSeconds([&]()
+			{
+				vector<thread> Jobs;
+				for (int Job = 0; Job < MEMORY_CONCURRENT_JOBS; Job++)
+					Jobs.emplace_back([&, Job]() { JobFilters[Job]->ProcessRGB32(JobFrames[Job].data()); });
+				for (auto& Job : Jobs)
+					Job.join();
+			});
+			cout << "  " << MEMORY_CONCURRENT_JOBS << " jobs, budget of " << JobLimitNames[LimitIndex] << setw(8)
+				<< (JobSeconds * 1000.0) << " ms: ";
+			PrintMemoryBudgetStats();
+		}
+	}
+	Budget.SetLimit(0);
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
 	cout << "AltaLux Benchmark by Stefano Tommesani www.tommesani.com" << endl;	
+	if ((argc > 1) && (_tcscmp(argv[1], _T("scaling")) == 0))
+	{
+		// AltaLuxBench scaling
+		BenchmarkThreadScaling();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("roofline")) == 0))
+	{
+		// AltaLuxBench roofline
+		BenchmarkRoofline();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("replay")) == 0))
+	{
+		// AltaLuxBench replay [trace file]
+		BenchmarkPreviewReplay((argc > 2) ? argv[2] : nullptr);
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("ordering")) == 0))
+	{
+		// AltaLuxBench ordering
+		BenchmarkTaskOrdering();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("pipeline")) == 0))
+	{
+		// AltaLuxBench pipeline
+		BenchmarkFramePipeline();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("thumbnail")) == 0))
+	{
+		// AltaLuxBench thumbnail
+		BenchmarkThumbnail();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("copy")) == 0))
+	{
+		// AltaLuxBench copy
+		BenchmarkImageCopy();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("tiled")) == 0))
+	{
+		// AltaLuxBench tiled
+		BenchmarkTiledLayout();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("memory")) == 0))
+	{
+		// AltaLuxBench memory
+		BenchmarkMemoryBudget();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+	if ((argc > 1) && (_tcscmp(argv[1], _T("preempt")) == 0))
+	{
+		// AltaLuxBench preempt
+		BenchmarkPreviewUnderLoad();
+		cout << "Testing completed" << endl;
+		return 0;
+	}
+
 	// create image buffers
 	ReferenceBuffer = new unsigned char[SAMPLE_SIZE];
 	FillRandomBuffer(ReferenceBuffer, SAMPLE_SIZE);
@@ -93,18 +1062,24 @@ int _tmain(int argc, _TCHAR* argv[])
 	CBaseAltaLuxFilter *ParallelSplitLoopFilter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, SAMPLE_WIDTH, SAMPLE_HEIGHT);
 	CBaseAltaLuxFilter *ParallelEventFilter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_EVENT, SAMPLE_WIDTH, SAMPLE_HEIGHT);
 	CBaseAltaLuxFilter *ParallelActiveWaitFilter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_ACTIVE_WAIT, SAMPLE_WIDTH, SAMPLE_HEIGHT);
+	CBaseAltaLuxFilter *ApproximateFilter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, SAMPLE_WIDTH, SAMPLE_HEIGHT);
+	ApproximateFilter->SetApproximateInterpolation();
 
 	BenchmarkFilter(SerialFilter, "Serial");
 	BenchmarkFilter(ParallelErrorFilter, "Parallel Error");
 	BenchmarkFilter(ParallelSplitLoopFilter, "Parallel Split Loop");
 	BenchmarkFilter(ParallelEventFilter, "Parallel Event");
 	BenchmarkFilter(ParallelActiveWaitFilter, "Parallel Active Wait");
+	BenchmarkFilter(ApproximateFilter, "Parallel Split Loop, approximate interpolation");
 
 	delete SerialFilter;
 	delete ParallelErrorFilter;
 	delete ParallelSplitLoopFilter;
 	delete ParallelEventFilter;
 	delete ParallelActiveWaitFilter;
+	delete ApproximateFilter;
+
+	BenchmarkGridSizes();
 
 	delete[] ReferenceBuffer;
 	delete[] InputBuffer;
@@ -0,0 +1,366 @@
+// AltaLux Filter
+// by Stefano Tommesani (www.tommesani.com) 2016
+// this code is release under the Code Project Open License (CPOL) http://www.codeproject.com/info/cpol10.aspx
+// The main points subject to the terms of the License are:
+// -   Source Code and Executable Files can be used in commercial applications;
+// -   Source Code and Executable Files can be redistributed; and
+// -   Source Code can be modified to create derivative works.
+// -   No claim of suitability, guarantee, or any warranty whatsoever is provided. The software is provided "as-is".
+// -   The Article(s) accompanying the Work may not be distributed or republished without the Author's consent
+
+// PreviewReplay.cpp : replays recorded GUI interactions against the preview pipeline
+//
+
+#include "stdafx.h"
+#include "PreviewReplay.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <Windows.h>
+
+#include <CAltaLuxFilterFactory.h>
+#include <PreviewPipeline.h>
+
+using namespace std;
+
+const int REPLAY_ROUNDS = 3; //< each trace is replayed this many times after a warm-up round
+const double REPLAY_PERCENTILES[] = { 0.5, 0.9, 0.99, 1.0 };
+const int LOAD_ROUNDS = 2; //< rounds of the trace replayed while the full resolution image is processed
+
+struct ReplayImage
+{
+	int Width;
+	int Height;
+	int BytesPerPixel;
+	const char *Name;
+};
+/// sizes of typical camera images, the preview is scaled down from them as in the plugin
+const ReplayImage REPLAY_IMAGES[] =
+{
+	{ 6000, 4000, 3, "24 MP RGB24" },
+	{ 8192, 5464, 4, "45 MP RGB32" }
+};
+
+struct PreviewTrace
+{
+	string Name;
+	vector<PreviewEvent> Events;
+};
+
+/// names of the events in trace files, in the order of PreviewEventType
+const char *PREVIEW_EVENT_NAMES[NUM_PREVIEW_EVENTS] =
+{
+	"open", "intensity", "scale", "intensity-", "intensity+", "grid-", "grid+", "default"
+};
+
+/// <summary>
+/// traces used when no trace file is given: dragging the sliders, clicking on the thumbnails and resetting to the defaults
+/// </summary>
+vector<PreviewTrace> GetBuiltinTraces()
+{
+	vector<PreviewTrace> Traces(3);
+	Traces[0].Name = "slider drags";
+	Traces[0].Events.push_back({ PREVIEW_EVENT_OPEN, 0 });
+	for (int Intensity : { 30, 35, 45, 60, 75, 90, 100, 80, 50, 25 })
+		Traces[0].Events.push_back({ PREVIEW_EVENT_INTENSITY_SLIDER, Intensity });
+	for (int Scale : { 6, 10, 14, 20, 32, 64, 16, 8 })
+		Traces[0].Events.push_back({ PREVIEW_EVENT_SCALE_SLIDER, Scale });
+
+	Traces[1].Name = "thumbnail clicks";
+	Traces[1].Events.push_back({ PREVIEW_EVENT_OPEN, 0 });
+	const PreviewEventType Clicks[] =
+	{
+		PREVIEW_EVENT_CLICK_INTENSITY_P, PREVIEW_EVENT_CLICK_INTENSITY_P, PREVIEW_EVENT_CLICK_INTENSITY_P,
+		PREVIEW_EVENT_CLICK_GRID_P, PREVIEW_EVENT_CLICK_GRID_P, PREVIEW_EVENT_CLICK_GRID_P, PREVIEW_EVENT_CLICK_GRID_P,
+		PREVIEW_EVENT_CLICK_INTENSITY_M, PREVIEW_EVENT_CLICK_INTENSITY_M,
+		PREVIEW_EVENT_CLICK_GRID_M, PREVIEW_EVENT_CLICK_GRID_M, PREVIEW_EVENT_CLICK_GRID_M
+	};
+	for (auto Click : Clicks)
+		Traces[1].Events.push_back({ Click, 0 });
+
+	Traces[2].Name = "default resets";
+	Traces[2].Events =
+	{
+		{ PREVIEW_EVENT_OPEN, 0 },
+		{ PREVIEW_EVENT_INTENSITY_SLIDER, 90 }, { PREVIEW_EVENT_DEFAULT, 0 },
+		{ PREVIEW_EVENT_SCALE_SLIDER, 32 }, { PREVIEW_EVENT_DEFAULT, 0 },
+		{ PREVIEW_EVENT_INTENSITY_SLIDER, 5 }, { PREVIEW_EVENT_SCALE_SLIDER, 3 }, { PREVIEW_EVENT_DEFAULT, 0 }
+	};
+	return Traces;
+}
+
+/// <summary>
+/// loads a trace file, with one event per line: the event name, from PREVIEW_EVENT_NAMES, followed by the slider position
+/// for the intensity and scale events. Empty lines and lines starting with # are skipped
+/// </summary>
+/// <returns>false if the file cannot be read or contains an unknown event</returns>
+bool LoadTrace(const _TCHAR* TraceFileName, PreviewTrace& Trace)
+{
+	ifstream TraceFile(TraceFileName);
+	if (!TraceFile)
+		return false;
+	Trace.Name = "trace file";
+	Trace.Events.clear();
+	string Line;
+	while (getline(TraceFile, Line))
+	{
+		istringstream LineStream(Line);
+		string EventName;
+		if (!(LineStream >> EventName) || (EventName[0] == '#'))
+			continue;
+		auto EventType = find(begin(PREVIEW_EVENT_NAMES), end(PREVIEW_EVENT_NAMES), EventName);
+		if (EventType == end(PREVIEW_EVENT_NAMES))
+		{
+			cout << "Unknown event " << EventName << endl;
+			return false;
+		}
+		PreviewEvent Event = { static_cast<PreviewEventType>(EventType - begin(PREVIEW_EVENT_NAMES)), 0 };
+		LineStream >> Event.Value;
+		Trace.Events.push_back(Event);
+	}
+	return !Trace.Events.empty();
+}
+
+double GetSeconds()
+{
+	LARGE_INTEGER TimerFrequency, Time;
+	QueryPerformanceFrequency(&TimerFrequency);
+	QueryPerformanceCounter(&Time);
+	return (double)Time.QuadPart / TimerFrequency.QuadPart;
+}
+
+struct ReplayTimes
+{
+	vector<double> FirstPreview; //< from the event to the main preview, in seconds
+	vector<double> FinalPreview; //< from the event to the last preview variant, in seconds
+};
+
+/// <summary>
+/// replays the trace on a prepared session, as the GUI does: every event creates a filter for the scaled image
+/// and renders the preview variants, starting from the main one
+/// </summary>
+void ReplayTrace(const PreviewTrace& Trace, CSessionBufferManager& SessionBuffers, const PreviewPlan& Plan,
+                 int BytesPerPixel, bool Approximate, ReplayTimes* Times)
+{
+	auto ScaledSrcImage = SessionBuffers.GetScaledSourceImage();
+	PreviewSettings Settings = { AL_DEFAULT_STRENGTH, DEFAULT_HOR_REGIONS };
+	for (auto& Event : Trace.Events)
+	{
+		Settings = ApplyPreviewEvent(Settings, Event);
+		const double StartTime = GetSeconds();
+		CPriorityJob PreviewJob(FILTER_PRIORITY_INTERACTIVE);
+		unique_ptr<CBaseAltaLuxFilter> Filter(
+			CAltaLuxFilterFactory::CreateAltaLuxFilter(Plan.ScaledWidth, Plan.ScaledHeight, Settings.Scale, Settings.Scale));
+		if (Filter == nullptr)
+			return;
+		Filter->SetApproximateInterpolation(Approximate);
+		Filter->SetPriority(FILTER_PRIORITY_INTERACTIVE);
+		double FirstPreviewTime = 0.0;
+		for (int BufferId = PREVIEW_PROCESSED; BufferId < NUM_PREVIEW_BUFFERS; BufferId++)
+		{
+			auto PreviewImage = SessionBuffers.GetPreviewImage(static_cast<PreviewBufferId>(BufferId));
+			if (PreviewImage == nullptr)
+				continue;
+			RenderPreview(Filter.get(), static_cast<PreviewBufferId>(BufferId), Settings, ScaledSrcImage.get()->data(),
+			              PreviewImage.get()->data(), Plan.ScaledWidth, Plan.ScaledHeight, BytesPerPixel);
+			if (BufferId == PREVIEW_PROCESSED)
+				FirstPreviewTime = GetSeconds() - StartTime;
+		}
+		const double FinalPreviewTime = GetSeconds() - StartTime;
+		if (Times != nullptr)
+		{
+			Times->FirstPreview.push_back(FirstPreviewTime);
+			Times->FinalPreview.push_back(FinalPreviewTime);
+		}
+	}
+}
+
+void PrintDistribution(vector<double>& Samples)
+{
+	sort(Samples.begin(), Samples.end());
+	for (double Percentile : REPLAY_PERCENTILES)
+	{
+		size_t Index = (size_t)(Percentile * Samples.size() + 0.999999);
+		Index = (Index > 0) ? (Index - 1) : 0;
+		cout << setw(8) << (Samples[min(Index, Samples.size() - 1)] * 1000.0);
+	}
+}
+
+/// <summary>
+/// replays the traces on large images and prints the distributions of the time to first preview
+/// (main preview updated) and to final preview (all thumbnails updated), with the exact and the approximate interpolation
+/// </summary>
+/// <param name="TraceFileName">trace file to replay instead of the built-in traces, may be nullptr</param>
+void BenchmarkPreviewReplay(const _TCHAR* TraceFileName)
+{
+	vector<PreviewTrace> Traces;
+	if (TraceFileName != nullptr)
+	{
+		PreviewTrace Trace;
+		if (!LoadTrace(TraceFileName, Trace))
+		{
+			cout << "Cannot load the trace file" << endl;
+			return;
+		}
+		Traces.push_back(Trace);
+	}
+	else
+		Traces = GetBuiltinTraces();
+
+	cout << "Preview replay, times in ms (p50 p90 p99 max)" << endl;
+	for (auto& Image : REPLAY_IMAGES)
+	{
+		CSessionBufferManager SessionBuffers;
+		auto SrcImage = SessionBuffers.AllocateSourceImage(Image.Width, Image.Height, Image.BytesPerPixel);
+		if (SrcImage == nullptr)
+		{
+			cout << Image.Name << ": not enough memory" << endl;
+			continue;
+		}
+		srand(0x5555);
+		for (auto& Value : *SrcImage)
+			Value = rand() & 0xFF;
+
+		PreviewPlan Plan;
+		const double StartTime = GetSeconds();
+		if (!PreparePreviewSource(SessionBuffers, Image.Width, Image.Height, Image.BytesPerPixel,
+		                          ComputePreviewScalingFactor(Image.Width, Image.Height), Plan))
+		{
+			cout << Image.Name << ": not enough memory for the previews" << endl;
+			continue;
+		}
+		const double PrepareTime = GetSeconds() - StartTime;
+		cout << endl << Image.Name << " " << Image.Width << "x" << Image.Height << ", preview " << Plan.ScaledWidth << "x"
+			<< Plan.ScaledHeight << " with " << Plan.NumPreviewBuffers << " buffers, scaled down in "
+			<< fixed << setprecision(1) << (PrepareTime * 1000.0) << " ms" << endl;
+		cout << left << setw(20) << "trace" << setw(14) << "interpolation" << right << setw(32) << "first preview"
+			<< setw(32) << "final preview" << endl;
+
+		for (auto& Trace : Traces)
+			for (int Approximate = 0; Approximate <= 1; Approximate++)
+			{
+				ReplayTrace(Trace, SessionBuffers, Plan, Image.BytesPerPixel, Approximate != 0, nullptr);
+				ReplayTimes Times;
+				for (int Round = 0; Round < REPLAY_ROUNDS; Round++)
+					ReplayTrace(Trace, SessionBuffers, Plan, Image.BytesPerPixel, Approximate != 0, &Times);
+				if (Times.FirstPreview.empty())
+					continue;
+				cout << left << setw(20) << Trace.Name << setw(14) << (Approximate ? "approximate" : "exact") << right;
+				PrintDistribution(Times.FirstPreview);
+				PrintDistribution(Times.FinalPreview);
+				cout << endl;
+			}
+	}
+}
+
+/// <summary>
+/// replays the slider drags on the first image while the second image is processed at full resolution
+/// in a loop on another thread, as a batch conversion sharing the cores with the dialog would do.
+/// The full resolution job runs first in the same priority class as the previews, so that it is never pre-empted,
+/// and then in the background class
+/// </summary>
+void BenchmarkPreviewUnderLoad()
+{
+	const ReplayImage& PreviewSource = REPLAY_IMAGES[0];
+	const ReplayImage& LoadSource = REPLAY_IMAGES[1];
+	const PreviewTrace Trace = GetBuiltinTraces()[0];
+
+	CSessionBufferManager SessionBuffers;
+	auto SrcImage = SessionBuffers.AllocateSourceImage(PreviewSource.Width, PreviewSource.Height, PreviewSource.BytesPerPixel);
+	vector<unsigned char> LoadImage;
+	try
+	{
+		LoadImage.resize((size_t)LoadSource.Width * LoadSource.Height * LoadSource.BytesPerPixel);
+	}
+	catch (...)
+	{
+	}
+	if ((SrcImage == nullptr) || LoadImage.empty())
+	{
+		cout << "Not enough memory" << endl;
+		return;
+	}
+	srand(0x5555);
+	for (auto& Value : *SrcImage)
+		Value = rand() & 0xFF;
+	for (auto& Value : LoadImage)
+		Value = rand() & 0xFF;
+	PreviewPlan Plan;
+	if (!PreparePreviewSource(SessionBuffers, PreviewSource.Width, PreviewSource.Height, PreviewSource.BytesPerPixel,
+	                          ComputePreviewScalingFactor(PreviewSource.Width, PreviewSource.Height), Plan))
+	{
+		cout << "Not enough memory for the previews" << endl;
+		return;
+	}
+
+	struct LoadConfiguration
+	{
+		const char *Name;
+		bool Enabled;
+		FilterPriority Priority;
+	};
+	const LoadConfiguration Configurations[] =
+	{
+		{ "idle", false, FILTER_PRIORITY_INTERACTIVE },
+		{ "interactive", true, FILTER_PRIORITY_INTERACTIVE },
+		{ "background", true, FILTER_PRIORITY_BACKGROUND }
+	};
+
+	cout << "Preview under load: " << Trace.Name << " on " << PreviewSource.Name << " while " << LoadSource.Name
+		<< " is processed, times in ms (p50 p90 p99 max)" << endl;
+	cout << left << setw(14) << "load class" << right << setw(32) << "first preview" << setw(32) << "final preview"
+		<< setw(16) << "load images/s" << setw(14) << "preemptions" << endl;
+	for (auto& Configuration : Configurations)
+	{
+		CPriorityScheduler::GetInstance().ResetStats();
+		atomic<bool> StopLoad(false);
+		atomic<int> LoadImagesDone(0);
+		thread LoadThread;
+		if (Configuration.Enabled)
+		{
+			LoadThread = thread([&]()
+			{
+				unique_ptr<CBaseAltaLuxFilter> LoadFilter(
+					CAltaLuxFilterFactory::CreateAltaLuxFilter(LoadSource.Width, LoadSource.Height));
+				if (LoadFilter == nullptr)
+					return;
+				LoadFilter->SetPriority(Configuration.Priority);
+				while (!StopLoad.load())
+				{
+					LoadFilter->ProcessRGB32(LoadImage.data());
+					LoadImagesDone++;
+				}
+			});
+		}
+
+		const double StartTime = GetSeconds();
+		ReplayTrace(Trace, SessionBuffers, Plan, PreviewSource.BytesPerPixel, false, nullptr);
+		ReplayTimes Times;
+		for (int Round = 0; Round < LOAD_ROUNDS; Round++)
+			ReplayTrace(Trace, SessionBuffers, Plan, PreviewSource.BytesPerPixel, false, &Times);
+		/// the load thread keeps running alone for as long as the replay took, then its throughput is measured over both
+		if (Configuration.Enabled)
+			this_thread::sleep_for(chrono::duration<double>(GetSeconds() - StartTime));
+		const double ElapsedTime = GetSeconds() - StartTime;
+		StopLoad = true;
+		if (LoadThread.joinable())
+			LoadThread.join();
+
+		cout << left << setw(14) << Configuration.Name << right << fixed << setprecision(1);
+		PrintDistribution(Times.FirstPreview);
+		PrintDistribution(Times.FinalPreview);
+		cout << setw(16) << setprecision(2) << (LoadImagesDone / ElapsedTime)
+			<< setw(14) << CPriorityScheduler::GetInstance().GetNumPreemptions(FILTER_PRIORITY_BACKGROUND) << endl;
+	}
+}
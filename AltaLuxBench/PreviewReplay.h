@@ -0,0 +1,19 @@
+// AltaLux Filter
+// by Stefano Tommesani (www.tommesani.com) 2016
+// this code is release under the Code Project Open License (CPOL) http://www.codeproject.com/info/cpol10.aspx
+// The main points subject to the terms of the License are:
+// -   Source Code and Executable Files can be used in commercial applications;
+// -   Source Code and Executable Files can be redistributed; and
+// -   Source Code can be modified to create derivative works.
+// -   No claim of suitability, guarantee, or any warranty whatsoever is provided. The software is provided "as-is".
+// -   The Article(s) accompanying the Work may not be distributed or republished without the Author's consent
+
+// PreviewReplay.h : replays recorded GUI interactions against the preview pipeline
+//
+
+#pragma once
+
+#include <tchar.h>
+
+void BenchmarkPreviewReplay(const _TCHAR* TraceFileName = nullptr);
+void BenchmarkPreviewUnderLoad();
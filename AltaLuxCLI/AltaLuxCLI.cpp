@@ -0,0 +1,438 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+/// AltaLux command line tool, filters the luma plane of a Y4M stream:
+///   ffmpeg -i in.mp4 -f yuv4mpegpipe - | altalux -strength 30 | ffmpeg -f yuv4mpegpipe -i - out.mp4
+/// Frames are read, filtered and written by three threads, so decoding, filtering and encoding overlap;
+/// filtering itself overlaps the mappings of a frame with the interpolation of the previous one, see CFramePipeline.
+/// With -cache, the filtered luma planes are kept in a directory and the frames already filtered with the same
+/// settings by a previous run are read from there instead of being filtered again.
+/// With -uring, the input and output files go through io_uring, with several blocks in flight, see UringStream.h
+
+#include "ResultCache.h"
+#include "UringStream.h"
+#include "Y4MStream.h"
+
+#include <CFramePipeline.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+	#include <fcntl.h>
+	#include <io.h>
+#endif // _WIN32
+
+const int QUEUED_FRAMES = 2; //< frames buffered between the reader and the filter, and between the filter and the writer
+
+/// <summary>
+/// blocking FIFO between the stages of the tool; Pop returns false once the queue is closed and empty
+/// </summary>
+template <typename T>
+class CFrameQueue
+{
+public:
+	CFrameQueue() : Closed(false) {}
+
+	void Push(T Item)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(QueueLock);
+			Items.push_back(Item);
+		}
+		ItemAvailable.notify_one();
+	}
+
+	bool Pop(T& Item)
+	{
+		std::unique_lock<std::mutex> Lock(QueueLock);
+		ItemAvailable.wait(Lock, [&]() { return Closed || !Items.empty(); });
+		if (Items.empty())
+			return false;
+		Item = Items.front();
+		Items.pop_front();
+		return true;
+	}
+
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> Lock(QueueLock);
+			Closed = true;
+		}
+		ItemAvailable.notify_all();
+	}
+
+private:
+	std::mutex QueueLock;
+	std::condition_variable ItemAvailable;
+	std::deque<T> Items;
+	bool Closed;
+};
+
+/// <summary>
+/// frame buffer shared by the stages, with the key of its result when the result cache is enabled
+/// </summary>
+struct StreamFrame
+{
+	std::vector<unsigned char> Data;
+	ResultKey Key;
+	bool Cached; //< the luma plane has been filled from the result cache, so the frame is not filtered
+	bool ToStore; //< the filtered luma plane is added to the result cache once written
+};
+
+struct CommandLineOptions
+{
+	int Strength;
+	int HorRegions;
+	int VertRegions;
+	unsigned int Depth;
+	unsigned int Tolerance; //< refer to CBaseAltaLuxFilter::SetIdentityTolerance
+	bool AutoStrength; //< refer to CBaseAltaLuxFilter::SetAutoStrength
+	bool UseUring; //< refer to OpenUringStream
+	const char* CacheDirectory; //< nullptr if the result cache is disabled
+	unsigned long long CacheSizeMB;
+	const char* InputPath; //< nullptr for stdin
+	const char* OutputPath; //< nullptr for stdout
+};
+
+void PrintUsage()
+{
+	fprintf(stderr, "usage: altalux [-strength %d..%d] [-regions horizontal vertical] [-depth 1..%u] [-tolerance 0..%u] [-auto] [-uring]"
+	        " [-cache directory] [-cachesize megabytes] [input.y4m|-] [output.y4m|-]\n",
+	        AL_MIN_STRENGTH, AL_MAX_STRENGTH, MAX_PIPELINE_DEPTH, AL_MAX_IDENTITY_TOLERANCE);
+	fprintf(stderr, "filters the luma plane of an 8-bit Y4M stream, from stdin to stdout by default\n");
+	fprintf(stderr, "-tolerance leaves as they are the areas whose mappings are that close to the identity, faster on low strengths\n");
+	fprintf(stderr, "-auto lowers the strength of the regions with little detail, -strength becomes the highest one\n");
+	fprintf(stderr, "-uring reads and writes the file arguments through io_uring, with O_DIRECT where the file system allows it,"
+	        " and reports their throughput\n");
+	fprintf(stderr, "-cache reuses the frames filtered with the same settings by previous runs, keeping up to -cachesize"
+	        " (default %llu) megabytes of the least recently used ones\n", DEFAULT_CACHE_SIZE_MB);
+}
+
+bool ParseCommandLine(int argc, char* argv[], CommandLineOptions& Options)
+{
+	Options.Strength = AL_DEFAULT_STRENGTH;
+	Options.HorRegions = DEFAULT_HOR_REGIONS;
+	Options.VertRegions = DEFAULT_VERT_REGIONS;
+	Options.Depth = DEFAULT_PIPELINE_DEPTH;
+	Options.Tolerance = AL_DEFAULT_IDENTITY_TOLERANCE;
+	Options.AutoStrength = false;
+	Options.UseUring = false;
+	Options.CacheDirectory = nullptr;
+	Options.CacheSizeMB = DEFAULT_CACHE_SIZE_MB;
+	Options.InputPath = nullptr;
+	Options.OutputPath = nullptr;
+
+	int NumPaths = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-strength") == 0) && (i + 1 < argc))
+			Options.Strength = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-regions") == 0) && (i + 2 < argc))
+		{
+			Options.HorRegions = atoi(argv[++i]);
+			Options.VertRegions = atoi(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "-depth") == 0) && (i + 1 < argc))
+			Options.Depth = static_cast<unsigned int>(atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-tolerance") == 0) && (i + 1 < argc))
+			Options.Tolerance = static_cast<unsigned int>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "-auto") == 0)
+			Options.AutoStrength = true;
+		else if (strcmp(argv[i], "-uring") == 0)
+			Options.UseUring = true;
+		else if ((strcmp(argv[i], "-cache") == 0) && (i + 1 < argc))
+			Options.CacheDirectory = argv[++i];
+		else if ((strcmp(argv[i], "-cachesize") == 0) && (i + 1 < argc))
+			Options.CacheSizeMB = strtoull(argv[++i], nullptr, 10);
+		else if ((argv[i][0] == '-') && (argv[i][1] != '\0'))
+			return false;
+		else
+		{
+			const char* Path = (strcmp(argv[i], "-") == 0) ? nullptr : argv[i];
+			if (NumPaths == 0)
+				Options.InputPath = Path;
+			else if (NumPaths == 1)
+				Options.OutputPath = Path;
+			else
+				return false;
+			NumPaths++;
+		}
+	}
+	return (Options.Strength >= AL_MIN_STRENGTH) && (Options.Strength <= AL_MAX_STRENGTH) &&
+		(Options.Depth >= 1) && (Options.Depth <= MAX_PIPELINE_DEPTH) && (Options.Tolerance <= AL_MAX_IDENTITY_TOLERANCE) &&
+		(Options.CacheSizeMB > 0);
+}
+
+/// <summary>
+/// filters all the frames of the input stream into the output stream
+/// </summary>
+/// <returns>process exit code</returns>
+int ProcessY4MStream(FILE* Input, FILE* Output, const CommandLineOptions& Options)
+{
+	CY4MReader Reader(Input);
+	CY4MWriter Writer(Output);
+	Y4MHeader Header;
+	const int HeaderReturn = Reader.ReadHeader(Header);
+	if (HeaderReturn != Y4M_OK)
+	{
+		fprintf(stderr, "altalux: invalid Y4M stream header (error %d)\n", HeaderReturn);
+		return EXIT_FAILURE;
+	}
+	if (Writer.WriteHeader(Header) != Y4M_OK)
+	{
+		fprintf(stderr, "altalux: cannot write the output stream\n");
+		return EXIT_FAILURE;
+	}
+
+	/// the luma plane comes first in each frame, and it is filtered in place as a gray image
+	CFramePipeline Pipeline(Header.Width, Header.Height, FRAME_FORMAT_GRAY, Options.HorRegions, Options.VertRegions, Options.Depth);
+	Pipeline.SetStrength(Options.Strength);
+	Pipeline.SetIdentityTolerance(Options.Tolerance);
+	Pipeline.SetAutoStrength(Options.AutoStrength);
+
+	CResultCache Cache;
+	if ((Options.CacheDirectory != nullptr) && (Cache.Open(Options.CacheDirectory, Options.CacheSizeMB << 20) != CACHE_OK))
+	{
+		fprintf(stderr, "altalux: cannot use %s as result cache\n", Options.CacheDirectory);
+		return EXIT_FAILURE;
+	}
+	const bool IsCacheEnabled = Cache.IsOpen();
+	ResultSettings Settings;
+	Settings.Width = Header.Width;
+	Settings.Height = Header.Height;
+	Settings.Format = FRAME_FORMAT_GRAY;
+	Settings.Strength = Options.Strength;
+	Settings.HorRegions = Options.HorRegions;
+	Settings.VertRegions = Options.VertRegions;
+	Settings.IdentityTolerance = Options.Tolerance;
+	Settings.AutoStrength = Options.AutoStrength;
+	const size_t LumaSize = Reader.GetLumaSize();
+
+	/// every buffer is owned by one stage at a time: free, read, in the pipeline, or being written;
+	/// they are allocated here, so that the reader does not run out of memory in the middle of the stream
+	std::vector<StreamFrame> Buffers;
+	try
+	{
+		Buffers.resize(Pipeline.GetDepth() + 2 * QUEUED_FRAMES);
+		for (auto& Buffer : Buffers)
+			Buffer.Data.reserve(Reader.GetFrameSize());
+	}
+	catch (const std::bad_alloc&)
+	{
+		fprintf(stderr, "altalux: not enough memory for the frames of %dx%d\n", Header.Width, Header.Height);
+		return EXIT_FAILURE;
+	}
+	CFrameQueue<StreamFrame*> FreeFrames, ReadFrames, FilteredFrames;
+	for (auto& Buffer : Buffers)
+		FreeFrames.Push(&Buffer);
+
+	/// the reader also looks up the results, so the filter thread only routes the frames
+	int ReadStatus = Y4M_OK;
+	int CacheStatus = CACHE_OK;
+	std::thread ReaderThread([&]()
+	{
+		StreamFrame* Frame;
+		while (FreeFrames.Pop(Frame))
+		{
+			ReadStatus = Reader.ReadFrame(Frame->Data);
+			if (ReadStatus != Y4M_OK)
+				break;
+			Frame->Cached = false;
+			Frame->ToStore = false;
+			if (IsCacheEnabled)
+			{
+				Frame->Key = CResultCache::MakeKey(Frame->Data.data(), LumaSize, Settings);
+				CacheStatus = Cache.Load(Frame->Key, Frame->Data.data(), LumaSize);
+				if (CacheStatus == CACHE_READ_FAILED)
+					break;
+				Frame->Cached = (CacheStatus == CACHE_OK);
+			}
+			ReadFrames.Push(Frame);
+		}
+		ReadFrames.Close();
+	});
+
+	/// the writer also stores the results, so the files are written while the next frames are being filtered
+	int WriteStatus = Y4M_OK;
+	std::thread WriterThread([&]()
+	{
+		StreamFrame* Frame;
+		while (FilteredFrames.Pop(Frame))
+		{
+			if (WriteStatus != Y4M_OK)
+				continue; //< drains the queue, the reader has been stopped
+			WriteStatus = Writer.WriteFrame(Frame->Data.data(), Frame->Data.size());
+			if (WriteStatus != Y4M_OK)
+			{
+				FreeFrames.Close();
+				continue;
+			}
+			if (Frame->ToStore)
+				Cache.Store(Frame->Key, Frame->Data.data(), LumaSize);
+			FreeFrames.Push(Frame);
+		}
+		fflush(Output);
+	});
+
+	const auto StartTime = std::chrono::steady_clock::now();
+	unsigned long long NumFrames = 0;
+	int FilterStatus = AL_OK;
+	/// frames leave in their input order, so a cached frame waits for the filtered frames submitted before it;
+	/// at most GetDepth() frames are held, cached ones included, so the reader always has buffers left
+	std::deque<StreamFrame*> FramesInFlight;
+	auto CompleteOldestFrame = [&]()
+	{
+		StreamFrame* Oldest = FramesInFlight.front();
+		if (!Oldest->Cached)
+		{
+			const int Status = Pipeline.CompleteFrame();
+			if ((Status != AL_OK) && (FilterStatus == AL_OK))
+				FilterStatus = Status;
+			Oldest->ToStore = IsCacheEnabled && (Status == AL_OK);
+		}
+		FilteredFrames.Push(Oldest);
+		FramesInFlight.pop_front();
+		NumFrames++;
+	};
+	StreamFrame* Frame;
+	while (ReadFrames.Pop(Frame))
+	{
+		if (FramesInFlight.size() == Pipeline.GetDepth())
+			CompleteOldestFrame();
+		if (!Frame->Cached)
+			Pipeline.SubmitFrame(Frame->Data.data());
+		FramesInFlight.push_back(Frame);
+		while (!FramesInFlight.empty() && FramesInFlight.front()->Cached)
+			CompleteOldestFrame();
+	}
+	while (!FramesInFlight.empty())
+		CompleteOldestFrame();
+	const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+	FilteredFrames.Close();
+
+	ReaderThread.join();
+	WriterThread.join();
+
+	if (CacheStatus == CACHE_READ_FAILED)
+		fprintf(stderr, "altalux: cannot read the result of frame %llu from the cache\n", NumFrames + 1);
+	if ((ReadStatus != Y4M_OK) && (ReadStatus != Y4M_END_OF_STREAM))
+		fprintf(stderr, "altalux: invalid input frame %llu (error %d)\n", NumFrames + 1, ReadStatus);
+	if (WriteStatus != Y4M_OK)
+		fprintf(stderr, "altalux: cannot write the output stream\n");
+	if (FilterStatus != AL_OK)
+		fprintf(stderr, "altalux: filter failed with error %d\n", FilterStatus);
+	fprintf(stderr, "altalux: %llu frames %dx%d in %.2f s, %.1f frames/s\n", NumFrames, Header.Width, Header.Height,
+	        Elapsed.count(), (Elapsed.count() > 0.0) ? (NumFrames / Elapsed.count()) : 0.0);
+	if (IsCacheEnabled)
+		fprintf(stderr, "altalux: result cache %llu hits, %llu misses, %llu evictions\n",
+		        Cache.GetHits(), Cache.GetMisses(), Cache.GetEvictions());
+
+	const bool Failed = ((ReadStatus != Y4M_OK) && (ReadStatus != Y4M_END_OF_STREAM)) ||
+		(CacheStatus == CACHE_READ_FAILED) || (WriteStatus != Y4M_OK) || (FilterStatus != AL_OK);
+	return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/// <summary>
+/// opens a file argument through io_uring if requested, or with fopen if it is not requested or not available
+/// </summary>
+FILE* OpenFile(const char* Path, bool ForWriting, bool UseUring, UringStreamStats& Stats)
+{
+	if (UseUring)
+	{
+		FILE* Stream = OpenUringStream(Path, ForWriting, &Stats);
+		if (Stream != nullptr)
+			return Stream;
+	}
+	FILE* File = fopen(Path, ForWriting ? "wb" : "rb");
+	if (UseUring && (File != nullptr))
+		fprintf(stderr, "altalux: io_uring is not available for %s, using blocking %s\n", Path, ForWriting ? "writes" : "reads");
+	return File;
+}
+
+/// <summary>
+/// prints the throughput of an io_uring stream, after it has been closed
+/// </summary>
+void PrintUringStats(const char* Operation, const UringStreamStats& Stats)
+{
+	if (Stats.Seconds <= 0.0)
+		return; //< the stream has not been opened through io_uring
+	fprintf(stderr, "altalux: io_uring %s %.1f MB in %.2f s, %.1f MB/s%s%s\n", Operation, Stats.Bytes / 1048576.0,
+	        Stats.Seconds, Stats.Bytes / 1048576.0 / Stats.Seconds, Stats.Direct ? ", O_DIRECT" : "",
+	        Stats.Failed ? ", failed" : "");
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineOptions Options;
+	if (!ParseCommandLine(argc, argv, Options))
+	{
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	FILE* Input = stdin;
+	FILE* Output = stdout;
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif // _WIN32
+	UringStreamStats InputStats = {};
+	UringStreamStats OutputStats = {};
+	if ((Options.InputPath != nullptr) && ((Input = OpenFile(Options.InputPath, false, Options.UseUring, InputStats)) == nullptr))
+	{
+		fprintf(stderr, "altalux: cannot open %s\n", Options.InputPath);
+		return EXIT_FAILURE;
+	}
+	if ((Options.OutputPath != nullptr) && ((Output = OpenFile(Options.OutputPath, true, Options.UseUring, OutputStats)) == nullptr))
+	{
+		fprintf(stderr, "altalux: cannot create %s\n", Options.OutputPath);
+		if (Input != stdin)
+			fclose(Input);
+		return EXIT_FAILURE;
+	}
+
+	const int ExitCode = ProcessY4MStream(Input, Output, Options);
+
+	if (Input != stdin)
+		fclose(Input);
+	const bool OutputClosed = (Output == stdout) || (fclose(Output) == 0);
+	PrintUringStats("read", InputStats);
+	PrintUringStats("wrote", OutputStats);
+	if (!OutputClosed)
+		return EXIT_FAILURE;
+	return ExitCode;
+}
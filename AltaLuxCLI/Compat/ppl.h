@@ -0,0 +1,126 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+/// <summary>
+/// Subset of the Parallel Patterns Library used by the filters, on top of std::thread,
+/// so that the command line tool builds where ConcRT is not available.
+/// Only found through the include path of the Makefile, the Windows projects use the real ppl.h
+/// </summary>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace concurrency
+{
+	inline unsigned int GetProcessorCount()
+	{
+		const unsigned int NumProcessors = std::thread::hardware_concurrency();
+		return (NumProcessors > 0) ? NumProcessors : 1;
+	}
+
+	/// <summary>
+	/// runs Body on [First, Last), the calling thread takes part in the loop
+	/// </summary>
+	template <typename Index, typename Function>
+	void parallel_for(Index First, Index Last, const Function& Body)
+	{
+		if (First >= Last)
+			return;
+		const long long NumIterations = static_cast<long long>(Last) - static_cast<long long>(First);
+		const unsigned int NumThreads = static_cast<unsigned int>(std::min<long long>(GetProcessorCount(), NumIterations));
+		std::atomic<long long> NextIteration(0);
+		auto Worker = [&]()
+		{
+			for (;;)
+			{
+				const long long Iteration = NextIteration.fetch_add(1);
+				if (Iteration >= NumIterations)
+					return;
+				Body(static_cast<Index>(First + Iteration));
+			}
+		};
+		std::vector<std::thread> Threads;
+		Threads.reserve(NumThreads - 1);
+		for (unsigned int i = 1; i < NumThreads; i++)
+			Threads.emplace_back(Worker);
+		Worker();
+		for (auto& Thread : Threads)
+			Thread.join();
+	}
+
+	/// <summary>
+	/// runs each task on its own thread; the tasks that completed are released by the next run
+	/// </summary>
+	class task_group
+	{
+	public:
+		task_group() {}
+		~task_group() { wait(); }
+
+		template <typename Function>
+		void run(const Function& Task)
+		{
+			std::lock_guard<std::mutex> Lock(TasksLock);
+			Tasks.erase(std::remove_if(Tasks.begin(), Tasks.end(), [](const std::future<void>& Pending)
+			{
+				return Pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			}), Tasks.end());
+			Tasks.push_back(std::async(std::launch::async, Task));
+		}
+
+		/// waits for all the tasks, including the ones started by the tasks themselves
+		void wait()
+		{
+			for (;;)
+			{
+				std::vector<std::future<void>> Pending;
+				{
+					std::lock_guard<std::mutex> Lock(TasksLock);
+					Pending.swap(Tasks);
+				}
+				if (Pending.empty())
+					return;
+				for (auto& Task : Pending)
+					Task.wait();
+			}
+		}
+
+	private:
+		std::mutex TasksLock;
+		std::vector<std::future<void>> Tasks;
+
+		task_group(const task_group&) = delete;
+		task_group& operator=(const task_group&) = delete;
+	};
+}
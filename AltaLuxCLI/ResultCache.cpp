@@ -0,0 +1,347 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "ResultCache.h"
+
+#include <CBaseAltaLuxFilter.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char RESULT_FILE_MAGIC[4] = { 'A', 'L', 'R', 'C' };
+static const unsigned int RESULT_FILE_VERSION = 1; //< layout of the files, bumped when ResultFileHeader changes
+static const char RESULT_FILE_EXTENSION[] = ".alr";
+static const size_t RESULT_FILE_NAME_LENGTH = 32 + sizeof(RESULT_FILE_EXTENSION) - 1; //< 128-bit key in hex
+
+/// multipliers of the two lanes of the content hash, taken from xxHash64
+static const unsigned long long HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+
+/// <summary>
+/// first bytes of every result file, followed by the cached pixels
+/// </summary>
+struct ResultFileHeader
+{
+	char Magic[4];
+	unsigned int Version;
+	ResultKey Key; //< checked on load, so that a renamed or corrupted file is never returned
+	unsigned long long Size; //< bytes of pixels after the header
+};
+
+static inline unsigned long long RotateLeft(unsigned long long Value, int Bits)
+{
+	return (Value << Bits) | (Value >> (64 - Bits));
+}
+
+/// <summary>
+/// final avalanche of MurmurHash3, so that every input bit affects every output bit
+/// </summary>
+static inline unsigned long long Avalanche(unsigned long long Value)
+{
+	Value ^= Value >> 33;
+	Value *= 0xFF51AFD7ED558CCDULL;
+	Value ^= Value >> 33;
+	Value *= 0xC4CEB9FE1A85EC53ULL;
+	Value ^= Value >> 33;
+	return Value;
+}
+
+/// <summary>
+/// hashes the words of a buffer into two independent 64-bit lanes;
+/// the lanes are not dependent on each other, so they run in parallel and the hash reads several GB/s
+/// </summary>
+static void HashWords(const unsigned char* Data, size_t Size, unsigned long long& Lane1, unsigned long long& Lane2)
+{
+	const size_t NumWords = Size / sizeof(unsigned long long);
+	for (size_t i = 0; i < NumWords; i++)
+	{
+		unsigned long long Word;
+		memcpy(&Word, Data + i * sizeof(unsigned long long), sizeof(Word));
+		Lane1 = RotateLeft(Lane1 ^ (Word * HASH_PRIME_2), 31) * HASH_PRIME_1;
+		Lane2 = RotateLeft(Lane2 + (Word * HASH_PRIME_1), 27) * HASH_PRIME_2;
+	}
+	const size_t TailSize = Size % sizeof(unsigned long long);
+	if (TailSize > 0)
+	{
+		unsigned long long Word = 0;
+		memcpy(&Word, Data + NumWords * sizeof(unsigned long long), TailSize);
+		Lane1 = RotateLeft(Lane1 ^ (Word * HASH_PRIME_2), 31) * HASH_PRIME_1;
+		Lane2 = RotateLeft(Lane2 + (Word * HASH_PRIME_1), 27) * HASH_PRIME_2;
+	}
+}
+
+CResultCache::CResultCache()
+{
+	MaxBytes = 0;
+	TotalBytes = 0;
+	Hits = 0;
+	Misses = 0;
+	Evictions = 0;
+	TempFileCounter = 0;
+}
+
+/// <summary>
+/// computes the key of the result of processing Pixels with Settings.
+/// AL_FILTER_VERSION is part of the key, so the results of older versions of the filter are never reused
+/// and they are eventually evicted
+/// </summary>
+ResultKey CResultCache::MakeKey(const void* Pixels, size_t Size, const ResultSettings& Settings)
+{
+	const long long SettingsWords[] = { AL_FILTER_VERSION, Settings.Width, Settings.Height, Settings.Format,
+		Settings.Strength, Settings.HorRegions, Settings.VertRegions, Settings.IdentityTolerance,
+		Settings.AutoStrength, static_cast<long long>(Size) };
+	unsigned long long Lane1 = HASH_PRIME_1;
+	unsigned long long Lane2 = HASH_PRIME_2;
+	HashWords(reinterpret_cast<const unsigned char*>(SettingsWords), sizeof(SettingsWords), Lane1, Lane2);
+	HashWords(static_cast<const unsigned char*>(Pixels), Size, Lane1, Lane2);
+
+	ResultKey Key;
+	Key.Hash[0] = Avalanche(Lane1 ^ RotateLeft(Lane2, 17));
+	Key.Hash[1] = Avalanche(Lane2 + Lane1);
+	return Key;
+}
+
+/// <summary>
+/// uses Directory for the results, creating it if needed, and indexes the results already there
+/// from the least to the most recently used; if they exceed _MaxBytes the oldest ones are evicted
+/// </summary>
+/// <returns>CACHE_OK, or CACHE_BAD_DIRECTORY</returns>
+int CResultCache::Open(const char* _Directory, unsigned long long _MaxBytes)
+{
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	Directory = _Directory;
+	MaxBytes = _MaxBytes;
+	TotalBytes = 0;
+	Entries.clear();
+	LeastRecentlyUsed.clear();
+
+	if ((mkdir(Directory.c_str(), 0777) != 0) && (errno != EEXIST))
+		return CACHE_BAD_DIRECTORY;
+	DIR* Listing = opendir(Directory.c_str());
+	if (Listing == nullptr)
+		return CACHE_BAD_DIRECTORY;
+
+	struct IndexedFile
+	{
+		std::string Name;
+		unsigned long long Bytes;
+		struct timespec LastUse;
+	};
+	std::vector<IndexedFile> Files;
+	while (struct dirent* Item = readdir(Listing))
+	{
+		const std::string Name = Item->d_name;
+		/// temporary files of the stores in progress, possibly by another job, are not indexed
+		if ((Name.size() != RESULT_FILE_NAME_LENGTH) ||
+			(Name.compare(Name.size() - strlen(RESULT_FILE_EXTENSION), std::string::npos, RESULT_FILE_EXTENSION) != 0))
+			continue;
+		struct stat Status;
+		if ((stat(GetPath(Name).c_str(), &Status) != 0) || !S_ISREG(Status.st_mode))
+			continue;
+		Files.push_back({ Name, static_cast<unsigned long long>(Status.st_size), Status.st_mtim });
+	}
+	closedir(Listing);
+
+	std::sort(Files.begin(), Files.end(), [](const IndexedFile& First, const IndexedFile& Second)
+	{
+		if (First.LastUse.tv_sec != Second.LastUse.tv_sec)
+			return First.LastUse.tv_sec < Second.LastUse.tv_sec;
+		return First.LastUse.tv_nsec < Second.LastUse.tv_nsec;
+	});
+	for (const IndexedFile& File : Files)
+	{
+		LeastRecentlyUsed.push_back(File.Name);
+		Entries[File.Name] = { File.Bytes, std::prev(LeastRecentlyUsed.end()) };
+		TotalBytes += File.Bytes;
+	}
+	EvictFor(0);
+	return CACHE_OK;
+}
+
+bool CResultCache::IsOpen() const
+{
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	return !Directory.empty();
+}
+
+/// <summary>
+/// looks for the result of Key, that must be Size bytes long.
+/// Result is written only after the header and the size of the file have been checked
+/// </summary>
+/// <returns>CACHE_OK if Result has been filled with the cached result, CACHE_MISS, or CACHE_READ_FAILED</returns>
+int CResultCache::Load(const ResultKey& Key, void* Result, size_t Size)
+{
+	const std::string FileName = GetFileName(Key);
+	{
+		std::lock_guard<std::mutex> Lock(CacheLock);
+		auto Entry = Entries.find(FileName);
+		if (Entry == Entries.end())
+		{
+			Misses++;
+			return CACHE_MISS;
+		}
+		LeastRecentlyUsed.splice(LeastRecentlyUsed.end(), LeastRecentlyUsed, Entry->second.Recency);
+	}
+
+	/// the file is read without holding the lock, a concurrent eviction makes fopen fail
+	const std::string Path = GetPath(FileName);
+	int Status = CACHE_MISS;
+	if (FILE* File = fopen(Path.c_str(), "rb"))
+	{
+		ResultFileHeader Header;
+		struct stat FileStatus;
+		const bool Valid = (fread(&Header, sizeof(Header), 1, File) == 1) &&
+			(memcmp(Header.Magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC)) == 0) &&
+			(Header.Version == RESULT_FILE_VERSION) &&
+			(Header.Key.Hash[0] == Key.Hash[0]) && (Header.Key.Hash[1] == Key.Hash[1]) &&
+			(Header.Size == Size) &&
+			(fstat(fileno(File), &FileStatus) == 0) &&
+			(static_cast<unsigned long long>(FileStatus.st_size) == sizeof(Header) + Size);
+		if (Valid)
+			Status = (fread(Result, 1, Size, File) == Size) ? CACHE_OK : CACHE_READ_FAILED;
+		fclose(File);
+	}
+
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	if (Status != CACHE_OK)
+	{
+		/// truncated or foreign file, it is dropped so that the result is stored again
+		if (Entries.find(FileName) != Entries.end())
+			Remove(FileName);
+		Misses++;
+		return Status;
+	}
+	/// the modification time records the use for the next runs
+	utimensat(AT_FDCWD, Path.c_str(), nullptr, 0);
+	Hits++;
+	return CACHE_OK;
+}
+
+/// <summary>
+/// adds the result of Key, evicting the least recently used results to stay within the size limit.
+/// The file is written under a temporary name and renamed, so that other jobs never see a partial result;
+/// a failed write only loses the result
+/// </summary>
+void CResultCache::Store(const ResultKey& Key, const void* Result, size_t Size)
+{
+	const std::string FileName = GetFileName(Key);
+	const unsigned long long FileBytes = sizeof(ResultFileHeader) + Size;
+	std::string TempPath;
+	{
+		std::lock_guard<std::mutex> Lock(CacheLock);
+		if (Directory.empty() || (FileBytes > MaxBytes) || (Entries.find(FileName) != Entries.end()))
+			return;
+		TempPath = GetPath(FileName) + "." + std::to_string(getpid()) + "." + std::to_string(TempFileCounter++) + ".tmp";
+	}
+
+	FILE* File = fopen(TempPath.c_str(), "wb");
+	if (File == nullptr)
+		return;
+	ResultFileHeader Header;
+	memcpy(Header.Magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC));
+	Header.Version = RESULT_FILE_VERSION;
+	Header.Key = Key;
+	Header.Size = Size;
+	bool Written = (fwrite(&Header, sizeof(Header), 1, File) == 1) && (fwrite(Result, 1, Size, File) == Size);
+	Written = (fclose(File) == 0) && Written;
+
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	if (!Written || (rename(TempPath.c_str(), GetPath(FileName).c_str()) != 0))
+	{
+		unlink(TempPath.c_str());
+		return;
+	}
+	if (Entries.find(FileName) != Entries.end())
+		return; //< stored meanwhile by another thread, the rename replaced it with the same content
+	EvictFor(FileBytes);
+	LeastRecentlyUsed.push_back(FileName);
+	Entries[FileName] = { FileBytes, std::prev(LeastRecentlyUsed.end()) };
+	TotalBytes += FileBytes;
+}
+
+unsigned long long CResultCache::GetHits() const
+{
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	return Hits;
+}
+
+unsigned long long CResultCache::GetMisses() const
+{
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	return Misses;
+}
+
+unsigned long long CResultCache::GetEvictions() const
+{
+	std::lock_guard<std::mutex> Lock(CacheLock);
+	return Evictions;
+}
+
+std::string CResultCache::GetFileName(const ResultKey& Key)
+{
+	char Name[RESULT_FILE_NAME_LENGTH + 1];
+	snprintf(Name, sizeof(Name), "%016llx%016llx%s", Key.Hash[0], Key.Hash[1], RESULT_FILE_EXTENSION);
+	return Name;
+}
+
+std::string CResultCache::GetPath(const std::string& FileName) const
+{
+	return Directory + "/" + FileName;
+}
+
+/// <summary>
+/// deletes a result and drops it from the index, CacheLock must be held
+/// </summary>
+void CResultCache::Remove(const std::string& FileName)
+{
+	auto Entry = Entries.find(FileName);
+	unlink(GetPath(FileName).c_str());
+	TotalBytes -= Entry->second.Bytes;
+	LeastRecentlyUsed.erase(Entry->second.Recency);
+	Entries.erase(Entry);
+}
+
+/// <summary>
+/// evicts the least recently used results until Bytes more fit in MaxBytes, CacheLock must be held
+/// </summary>
+void CResultCache::EvictFor(unsigned long long Bytes)
+{
+	while (!LeastRecentlyUsed.empty() && (TotalBytes + Bytes > MaxBytes))
+	{
+		const std::string Oldest = LeastRecentlyUsed.front(); //< Remove erases the list node
+		Remove(Oldest);
+		Evictions++;
+	}
+}
@@ -0,0 +1,114 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// result cache errors
+const int CACHE_OK = 0;
+const int CACHE_MISS = 1; //< the result is not in the cache, not an error
+const int CACHE_BAD_DIRECTORY = -1; //< the directory does not exist and cannot be created, or cannot be listed
+const int CACHE_READ_FAILED = -2; //< I/O error while reading a valid result, the buffer has been partially overwritten
+
+const unsigned long long DEFAULT_CACHE_SIZE_MB = 1024; //< max size of the cached results on disk
+
+/// <summary>
+/// identifies a result: hash of the input pixels and of all the settings that change the output
+/// </summary>
+struct ResultKey
+{
+	unsigned long long Hash[2];
+};
+
+/// <summary>
+/// settings that, together with the input pixels, determine a result
+/// </summary>
+struct ResultSettings
+{
+	int Width;
+	int Height;
+	int Format; //< layout of the cached pixels, e.g. FRAME_FORMAT_GRAY for the luma plane of a Y4M frame
+	int Strength;
+	int HorRegions;
+	int VertRegions;
+	unsigned int IdentityTolerance;
+	bool AutoStrength;
+};
+
+/// <summary>
+/// content-addressed store of processed images in a directory, one file per result,
+/// that evicts the least recently used results when it grows beyond its size limit.
+/// The recency of use is kept in the modification time of the files, so it survives across runs
+/// and the directory may be shared by consecutive jobs; all the methods are thread safe
+/// </summary>
+class CResultCache
+{
+public:
+	CResultCache();
+
+	int Open(const char* _Directory, unsigned long long _MaxBytes); //< indexes the results already in the directory
+	bool IsOpen() const;
+
+	static ResultKey MakeKey(const void* Pixels, size_t Size, const ResultSettings& Settings);
+	int Load(const ResultKey& Key, void* Result, size_t Size); //< CACHE_OK on a hit, that fills Result
+	void Store(const ResultKey& Key, const void* Result, size_t Size);
+
+	unsigned long long GetHits() const;
+	unsigned long long GetMisses() const;
+	unsigned long long GetEvictions() const;
+
+private:
+	struct CacheEntry
+	{
+		unsigned long long Bytes; //< size of the file
+		std::list<std::string>::iterator Recency; //< position in LeastRecentlyUsed
+	};
+
+	std::string Directory;
+	unsigned long long MaxBytes;
+	unsigned long long TotalBytes; //< sum of the sizes of the indexed files
+	std::unordered_map<std::string, CacheEntry> Entries; //< by file name
+	std::list<std::string> LeastRecentlyUsed; //< file names, least recently used first
+	unsigned long long Hits;
+	unsigned long long Misses;
+	unsigned long long Evictions;
+	unsigned long long TempFileCounter;
+	mutable std::mutex CacheLock;
+
+	static std::string GetFileName(const ResultKey& Key);
+	std::string GetPath(const std::string& FileName) const;
+	void Remove(const std::string& FileName);
+	void EvictFor(unsigned long long Bytes);
+
+	CResultCache(const CResultCache&) = delete;
+	CResultCache& operator=(const CResultCache&) = delete;
+};
@@ -0,0 +1,559 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "UringStream.h"
+
+#ifndef __linux__
+
+FILE* OpenUringStream(const char* Path, bool ForWriting, UringStreamStats* Stats)
+{
+	return nullptr; //< io_uring is a Linux interface, the callers fall back to fopen
+}
+
+#else
+
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/// <summary>
+/// io_uring instance driven through the system calls, so that the tool does not depend on liburing;
+/// it is used by a single thread at a time
+/// </summary>
+class CUring
+{
+public:
+	CUring();
+	~CUring();
+
+	bool Setup(unsigned int Entries);
+	bool RegisterBuffers(const iovec* Buffers, unsigned int Count);
+	io_uring_sqe* GetSqe(); //< cleared entry of the submission queue, nullptr if it is full
+	bool Submit(unsigned int MinCompletions); //< submits the entries got so far, and waits for MinCompletions completions
+	bool PopCompletion(unsigned long long& UserData, int& Result); //< false if no completion is available
+
+private:
+	int RingFd;
+	void* SqRing;
+	size_t SqRingSize;
+	void* CqRing;
+	size_t CqRingSize;
+	io_uring_sqe* Sqes;
+	size_t SqesSize;
+	unsigned int* SqHead;
+	unsigned int* SqTail;
+	unsigned int* SqMask;
+	unsigned int* SqEntries;
+	unsigned int* SqArray;
+	unsigned int* CqHead;
+	unsigned int* CqTail;
+	unsigned int* CqMask;
+	io_uring_cqe* Cqes;
+	unsigned int Unsubmitted; //< entries got by GetSqe and not yet consumed by the kernel
+
+	CUring(const CUring&) = delete;
+	CUring& operator=(const CUring&) = delete;
+};
+
+CUring::CUring()
+{
+	RingFd = -1;
+	SqRing = MAP_FAILED;
+	SqRingSize = 0;
+	CqRing = MAP_FAILED;
+	CqRingSize = 0;
+	Sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	SqesSize = 0;
+	Unsubmitted = 0;
+}
+
+CUring::~CUring()
+{
+	if (Sqes != MAP_FAILED)
+		munmap(Sqes, SqesSize);
+	if ((CqRing != MAP_FAILED) && (CqRing != SqRing))
+		munmap(CqRing, CqRingSize);
+	if (SqRing != MAP_FAILED)
+		munmap(SqRing, SqRingSize);
+	if (RingFd >= 0)
+		close(RingFd);
+}
+
+/// <summary>
+/// creates the instance and maps its queues; fails where the kernel does not have io_uring or forbids it,
+/// e.g. in containers whose seccomp profile blocks the system call
+/// </summary>
+bool CUring::Setup(unsigned int Entries)
+{
+	io_uring_params Params;
+	memset(&Params, 0, sizeof(Params));
+	RingFd = static_cast<int>(syscall(__NR_io_uring_setup, Entries, &Params));
+	if (RingFd < 0)
+		return false;
+
+	SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned int);
+	CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+	/// with IORING_FEAT_SINGLE_MMAP both rings share the mapping of the submission ring
+	const bool SingleMapping = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (SingleMapping && (CqRingSize > SqRingSize))
+		SqRingSize = CqRingSize;
+	SqRing = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_SQ_RING);
+	if (SqRing == MAP_FAILED)
+		return false;
+	if (SingleMapping)
+		CqRing = SqRing;
+	else
+	{
+		CqRing = mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd, IORING_OFF_CQ_RING);
+		if (CqRing == MAP_FAILED)
+			return false;
+	}
+	SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+	Sqes = static_cast<io_uring_sqe*>(mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                                       RingFd, IORING_OFF_SQES));
+	if (Sqes == MAP_FAILED)
+		return false;
+
+	auto SqBase = static_cast<unsigned char*>(SqRing);
+	SqHead = reinterpret_cast<unsigned int*>(SqBase + Params.sq_off.head);
+	SqTail = reinterpret_cast<unsigned int*>(SqBase + Params.sq_off.tail);
+	SqMask = reinterpret_cast<unsigned int*>(SqBase + Params.sq_off.ring_mask);
+	SqEntries = reinterpret_cast<unsigned int*>(SqBase + Params.sq_off.ring_entries);
+	SqArray = reinterpret_cast<unsigned int*>(SqBase + Params.sq_off.array);
+	auto CqBase = static_cast<unsigned char*>(CqRing);
+	CqHead = reinterpret_cast<unsigned int*>(CqBase + Params.cq_off.head);
+	CqTail = reinterpret_cast<unsigned int*>(CqBase + Params.cq_off.tail);
+	CqMask = reinterpret_cast<unsigned int*>(CqBase + Params.cq_off.ring_mask);
+	Cqes = reinterpret_cast<io_uring_cqe*>(CqBase + Params.cq_off.cqes);
+	return true;
+}
+
+/// <summary>
+/// pins the buffers, so that IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED do not map them on every transfer;
+/// fails if they exceed RLIMIT_MEMLOCK
+/// </summary>
+bool CUring::RegisterBuffers(const iovec* Buffers, unsigned int Count)
+{
+	return syscall(__NR_io_uring_register, RingFd, IORING_REGISTER_BUFFERS, Buffers, Count) == 0;
+}
+
+io_uring_sqe* CUring::GetSqe()
+{
+	const unsigned int Tail = *SqTail;
+	if (Tail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) >= *SqEntries)
+		return nullptr;
+	const unsigned int Index = Tail & *SqMask;
+	io_uring_sqe* Sqe = &Sqes[Index];
+	memset(Sqe, 0, sizeof(*Sqe));
+	SqArray[Index] = Index;
+	/// the kernel reads the entry once the new tail is visible
+	__atomic_store_n(SqTail, Tail + 1, __ATOMIC_RELEASE);
+	Unsubmitted++;
+	return Sqe;
+}
+
+bool CUring::Submit(unsigned int MinCompletions)
+{
+	while ((Unsubmitted > 0) || (MinCompletions > 0))
+	{
+		const long Consumed = syscall(__NR_io_uring_enter, RingFd, Unsubmitted, MinCompletions,
+		                              (MinCompletions > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (Consumed < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		Unsubmitted -= static_cast<unsigned int>(Consumed);
+		MinCompletions = 0;
+	}
+	return true;
+}
+
+bool CUring::PopCompletion(unsigned long long& UserData, int& Result)
+{
+	const unsigned int Head = *CqHead;
+	if (Head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE))
+		return false;
+	const io_uring_cqe& Cqe = Cqes[Head & *CqMask];
+	UserData = Cqe.user_data;
+	Result = Cqe.res;
+	__atomic_store_n(CqHead, Head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/// <summary>
+/// sequential reader or writer of a file through a CUring, behind a stdio stream made by fopencookie.
+/// The file is split in blocks of URING_BLOCK_SIZE bytes, cycled through URING_QUEUE_DEPTH buffers:
+/// the reader keeps the blocks after the one it is copying from in flight, the writer submits each block
+/// as soon as it is full and only waits when it comes back to a buffer still being written
+/// </summary>
+class CUringStream
+{
+public:
+	explicit CUringStream(UringStreamStats* _Stats);
+	~CUringStream();
+
+	bool Open(const char* Path, bool _ForWriting);
+	ssize_t Read(char* Data, size_t Size);
+	ssize_t Write(const char* Data, size_t Size);
+	int Close();
+
+private:
+	struct Block
+	{
+		unsigned char* Data;
+		size_t Length; //< bytes read into the block, or bytes to be written from it
+		size_t Consumed; //< bytes of a read block already copied to the caller
+		bool InFlight;
+	};
+
+	CUring Ring;
+	int FileFd;
+	bool ForWriting;
+	bool Direct;
+	bool FixedBuffers;
+	bool EndOfFile; //< a read came back short, so no block after it is submitted
+	bool Failed;
+	void* Buffers; //< URING_QUEUE_DEPTH blocks, aligned to URING_ALIGNMENT
+	Block Blocks[URING_QUEUE_DEPTH];
+	unsigned int Current; //< block being copied from or into
+	unsigned long long NextOffset; //< file offset of the next block submitted
+	unsigned long long Bytes; //< bytes moved by the completed transfers
+	std::chrono::steady_clock::time_point StartTime;
+	UringStreamStats* Stats;
+
+	void SubmitBlock(unsigned int Index, size_t Length);
+	bool WaitForBlock(unsigned int Index);
+
+	CUringStream(const CUringStream&) = delete;
+	CUringStream& operator=(const CUringStream&) = delete;
+};
+
+CUringStream::CUringStream(UringStreamStats* _Stats)
+{
+	FileFd = -1;
+	ForWriting = false;
+	Direct = false;
+	FixedBuffers = false;
+	EndOfFile = false;
+	Failed = false;
+	Buffers = nullptr;
+	Current = 0;
+	NextOffset = 0;
+	Bytes = 0;
+	Stats = _Stats;
+}
+
+CUringStream::~CUringStream()
+{
+	if (FileFd >= 0)
+		close(FileFd);
+	free(Buffers);
+}
+
+/// <summary>
+/// sets up the ring and its buffers before opening the file, so that an output file is not truncated
+/// when io_uring turns out to be unavailable; a reader submits its first URING_QUEUE_DEPTH blocks right away
+/// </summary>
+bool CUringStream::Open(const char* Path, bool _ForWriting)
+{
+	ForWriting = _ForWriting;
+	if (!Ring.Setup(URING_QUEUE_DEPTH))
+		return false;
+	if (posix_memalign(&Buffers, URING_ALIGNMENT, URING_QUEUE_DEPTH * URING_BLOCK_SIZE) != 0)
+	{
+		Buffers = nullptr;
+		return false;
+	}
+	iovec BufferVectors[URING_QUEUE_DEPTH];
+	for (unsigned int i = 0; i < URING_QUEUE_DEPTH; i++)
+	{
+		Blocks[i].Data = static_cast<unsigned char*>(Buffers) + i * URING_BLOCK_SIZE;
+		Blocks[i].Length = 0;
+		Blocks[i].Consumed = 0;
+		Blocks[i].InFlight = false;
+		BufferVectors[i].iov_base = Blocks[i].Data;
+		BufferVectors[i].iov_len = URING_BLOCK_SIZE;
+	}
+	/// without registered buffers the transfers still go through the ring, each one mapping its buffer
+	FixedBuffers = Ring.RegisterBuffers(BufferVectors, URING_QUEUE_DEPTH);
+
+	const int Flags = ForWriting ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+	FileFd = open(Path, Flags | O_DIRECT, 0666);
+	Direct = (FileFd >= 0);
+	/// tmpfs and some network file systems reject O_DIRECT with EINVAL
+	if (!Direct && (errno == EINVAL))
+		FileFd = open(Path, Flags, 0666);
+	if (FileFd < 0)
+		return false;
+	struct stat FileStatus;
+	if ((fstat(FileFd, &FileStatus) != 0) || !S_ISREG(FileStatus.st_mode))
+		return false; //< pipes and devices are left to stdio
+
+	StartTime = std::chrono::steady_clock::now();
+	if (!ForWriting)
+	{
+		for (unsigned int i = 0; i < URING_QUEUE_DEPTH; i++)
+			SubmitBlock(i, URING_BLOCK_SIZE);
+		if (!Ring.Submit(0))
+			return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// queues the transfer of Blocks[Index] at NextOffset, Ring.Submit hands it to the kernel
+/// </summary>
+void CUringStream::SubmitBlock(unsigned int Index, size_t Length)
+{
+	/// the ring has as many entries as blocks, and an entry is free once its block has been submitted
+	io_uring_sqe* Sqe = Ring.GetSqe();
+	if (FixedBuffers)
+	{
+		Sqe->opcode = ForWriting ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		Sqe->buf_index = static_cast<unsigned short>(Index);
+	}
+	else
+		Sqe->opcode = ForWriting ? IORING_OP_WRITE : IORING_OP_READ;
+	Sqe->fd = FileFd;
+	Sqe->addr = reinterpret_cast<unsigned long long>(Blocks[Index].Data);
+	Sqe->len = static_cast<unsigned int>(Length);
+	Sqe->off = NextOffset;
+	Sqe->user_data = Index;
+	Blocks[Index].Length = Length;
+	Blocks[Index].Consumed = 0;
+	Blocks[Index].InFlight = true;
+	NextOffset += Length;
+}
+
+/// <summary>
+/// reaps completions until the transfer of Blocks[Index] is over
+/// </summary>
+/// <returns>false if the ring failed; a failed or short transfer sets Failed, except for the short read at the end of the file</returns>
+bool CUringStream::WaitForBlock(unsigned int Index)
+{
+	while (Blocks[Index].InFlight)
+	{
+		unsigned long long UserData;
+		int Result;
+		if (!Ring.PopCompletion(UserData, Result))
+		{
+			if (!Ring.Submit(1))
+			{
+				Failed = true;
+				return false;
+			}
+			continue;
+		}
+		Block& Completed = Blocks[UserData];
+		Completed.InFlight = false;
+		if (Result < 0)
+		{
+			Failed = true;
+			Completed.Length = 0;
+			continue;
+		}
+		Bytes += static_cast<unsigned int>(Result);
+		if (ForWriting)
+		{
+			if (static_cast<size_t>(Result) != Completed.Length)
+				Failed = true;
+			Completed.Length = 0;
+		}
+		else
+		{
+			if (static_cast<size_t>(Result) < Completed.Length)
+				EndOfFile = true;
+			Completed.Length = static_cast<size_t>(Result);
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// copies up to Size bytes from the blocks read ahead, in file order
+/// </summary>
+/// <returns>bytes copied, 0 at the end of the file, -1 on errors</returns>
+ssize_t CUringStream::Read(char* Data, size_t Size)
+{
+	size_t Copied = 0;
+	while (Copied < Size)
+	{
+		Block& Source = Blocks[Current];
+		if (!WaitForBlock(Current) || Failed)
+			return -1;
+		if (Source.Consumed == Source.Length)
+		{
+			if (Source.Length < URING_BLOCK_SIZE)
+				break; //< the file ends in this block
+			/// the buffer is reused for the block after the ones already in flight
+			if (!EndOfFile)
+			{
+				SubmitBlock(Current, URING_BLOCK_SIZE);
+				if (!Ring.Submit(0))
+					return -1;
+			}
+			else
+				Source.Length = 0;
+			Current = (Current + 1) % URING_QUEUE_DEPTH;
+			continue;
+		}
+		size_t Count = Source.Length - Source.Consumed;
+		if (Count > Size - Copied)
+			Count = Size - Copied;
+		memcpy(Data + Copied, Source.Data + Source.Consumed, Count);
+		Source.Consumed += Count;
+		Copied += Count;
+	}
+	return static_cast<ssize_t>(Copied);
+}
+
+/// <summary>
+/// copies Data into the current block, submitting each block as soon as it is full
+/// </summary>
+/// <returns>Size, or -1 if a previous write failed</returns>
+ssize_t CUringStream::Write(const char* Data, size_t Size)
+{
+	size_t Copied = 0;
+	while (Copied < Size)
+	{
+		Block& Destination = Blocks[Current];
+		if (!WaitForBlock(Current) || Failed)
+			return -1;
+		size_t Count = URING_BLOCK_SIZE - Destination.Length;
+		if (Count > Size - Copied)
+			Count = Size - Copied;
+		memcpy(Destination.Data + Destination.Length, Data + Copied, Count);
+		Destination.Length += Count;
+		Copied += Count;
+		if (Destination.Length == URING_BLOCK_SIZE)
+		{
+			SubmitBlock(Current, URING_BLOCK_SIZE);
+			if (!Ring.Submit(0))
+				return -1;
+			Current = (Current + 1) % URING_QUEUE_DEPTH;
+		}
+	}
+	return static_cast<ssize_t>(Size);
+}
+
+/// <summary>
+/// writes the last partial block and waits for all the transfers in flight.
+/// With O_DIRECT the last block is padded to URING_ALIGNMENT, and the file is then truncated to its size
+/// </summary>
+/// <returns>0, or -1 on errors</returns>
+int CUringStream::Close()
+{
+	if (ForWriting && !Failed && !Blocks[Current].InFlight && (Blocks[Current].Length > 0))
+	{
+		const unsigned long long FileSize = NextOffset + Blocks[Current].Length;
+		size_t Length = Blocks[Current].Length;
+		if (Direct)
+		{
+			const size_t PaddedLength = (Length + URING_ALIGNMENT - 1) & ~(URING_ALIGNMENT - 1);
+			memset(Blocks[Current].Data + Length, 0, PaddedLength - Length);
+			Length = PaddedLength;
+		}
+		SubmitBlock(Current, Length);
+		if (!Ring.Submit(0) || !WaitForBlock(Current))
+			Failed = true;
+		if (!Failed)
+			Bytes -= NextOffset - FileSize; //< the padding is not part of the file
+		if (Direct && (ftruncate(FileFd, static_cast<off_t>(FileSize)) != 0))
+			Failed = true;
+	}
+	/// the kernel may still be writing into the buffers, even when the stream is closed after an error
+	for (unsigned int i = 0; i < URING_QUEUE_DEPTH; i++)
+		if (!WaitForBlock(i))
+			break;
+	const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+	if (Stats != nullptr)
+	{
+		Stats->Bytes = Bytes;
+		Stats->Seconds = Elapsed.count();
+		Stats->Direct = Direct;
+		Stats->Failed = Failed;
+	}
+	if (close(FileFd) != 0)
+		Failed = true;
+	FileFd = -1;
+	return Failed ? -1 : 0;
+}
+
+static ssize_t ReadUringStream(void* Cookie, char* Data, size_t Size)
+{
+	return static_cast<CUringStream*>(Cookie)->Read(Data, Size);
+}
+
+static ssize_t WriteUringStream(void* Cookie, const char* Data, size_t Size)
+{
+	return static_cast<CUringStream*>(Cookie)->Write(Data, Size);
+}
+
+static int CloseUringStream(void* Cookie)
+{
+	auto Stream = static_cast<CUringStream*>(Cookie);
+	const int Result = Stream->Close();
+	delete Stream;
+	return Result;
+}
+
+FILE* OpenUringStream(const char* Path, bool ForWriting, UringStreamStats* Stats)
+{
+	auto Stream = new CUringStream(Stats);
+	if (!Stream->Open(Path, ForWriting))
+	{
+		delete Stream;
+		return nullptr;
+	}
+	cookie_io_functions_t Functions;
+	memset(&Functions, 0, sizeof(Functions));
+	if (ForWriting)
+		Functions.write = WriteUringStream;
+	else
+		Functions.read = ReadUringStream;
+	Functions.close = CloseUringStream;
+	FILE* File = fopencookie(Stream, ForWriting ? "wb" : "rb", Functions);
+	if (File == nullptr)
+	{
+		Stream->Close();
+		delete Stream;
+	}
+	return File;
+}
+
+#endif // __linux__
@@ -0,0 +1,215 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "Y4MStream.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+static const char Y4M_SIGNATURE[] = "YUV4MPEG2";
+static const char Y4M_FRAME_TAG[] = "FRAME";
+
+/// <summary>
+/// parses the value of the W or H parameter of the stream header
+/// </summary>
+/// <returns>false if the value is not a number in [1..Y4M_MAX_DIMENSION]</returns>
+static bool ParseDimension(const std::string& Value, int& Dimension)
+{
+	if (Value.empty())
+		return false;
+	char* End;
+	errno = 0;
+	const long Parsed = strtol(Value.c_str(), &End, 10);
+	if ((errno != 0) || (*End != '\0') || (Parsed <= 0) || (Parsed > Y4M_MAX_DIMENSION))
+		return false;
+	Dimension = static_cast<int>(Parsed);
+	return true;
+}
+
+/// <summary>
+/// computes the size of the luma plane and of all the other planes of a frame
+/// </summary>
+/// <returns>Y4M_OK, or Y4M_UNSUPPORTED_COLORSPACE for high bit depth and unknown colorspaces</returns>
+int GetY4MPlaneSizes(const Y4MHeader& Header, size_t& LumaSize, size_t& ChromaSize)
+{
+	const size_t Width = static_cast<size_t>(Header.Width);
+	const size_t Height = static_cast<size_t>(Header.Height);
+	const size_t HalfWidth = (Width + 1) / 2;
+	const size_t HalfHeight = (Height + 1) / 2;
+	const std::string& C = Header.Colorspace;
+
+	LumaSize = Width * Height;
+	if (C == "mono")
+		ChromaSize = 0;
+	else if ((C == "420") || (C == "420jpeg") || (C == "420paldv") || (C == "420mpeg2"))
+		ChromaSize = 2 * HalfWidth * HalfHeight;
+	else if (C == "422")
+		ChromaSize = 2 * HalfWidth * Height;
+	else if (C == "444")
+		ChromaSize = 2 * Width * Height;
+	else if (C == "444alpha")
+		ChromaSize = 3 * Width * Height; //< the alpha plane is passed through with the chroma ones
+	else
+		return Y4M_UNSUPPORTED_COLORSPACE;
+	return Y4M_OK;
+}
+
+CY4MReader::CY4MReader(FILE* _Stream)
+{
+	Stream = _Stream;
+	FrameSize = 0;
+	LumaSize = 0;
+}
+
+/// <summary>
+/// reads a header line, without the terminating newline
+/// </summary>
+/// <returns>false at the end of the stream, or if the line is longer than Y4M_MAX_HEADER_LENGTH</returns>
+bool CY4MReader::ReadLine(std::string& Line)
+{
+	Line.clear();
+	for (;;)
+	{
+		const int Char = fgetc(Stream);
+		if (Char == EOF)
+			return false;
+		if (Char == '\n')
+			return true;
+		if (Line.size() >= Y4M_MAX_HEADER_LENGTH)
+			return false;
+		Line.push_back(static_cast<char>(Char));
+	}
+}
+
+/// <summary>
+/// parses the stream header, that must be read before the frames
+/// </summary>
+/// <returns>Y4M_OK or one of the Y4M_XXX errors</returns>
+int CY4MReader::ReadHeader(Y4MHeader& Header)
+{
+	std::string Line;
+	if (!ReadLine(Line) || (Line.compare(0, strlen(Y4M_SIGNATURE), Y4M_SIGNATURE) != 0))
+		return Y4M_BAD_SIGNATURE;
+
+	Header.Width = 0;
+	Header.Height = 0;
+	Header.Colorspace = "420jpeg"; //< default of the format
+	Header.Parameters.clear();
+
+	/// parameters are separated by single spaces, each one is a tag letter followed by its value
+	size_t Start = strlen(Y4M_SIGNATURE);
+	while (Start < Line.size())
+	{
+		if (Line[Start] == ' ')
+		{
+			Start++;
+			continue;
+		}
+		size_t End = Line.find(' ', Start);
+		if (End == std::string::npos)
+			End = Line.size();
+		const std::string Parameter = Line.substr(Start, End - Start);
+		const std::string Value = Parameter.substr(1);
+		switch (Parameter[0])
+		{
+		case 'W':
+			if (!ParseDimension(Value, Header.Width))
+				return Y4M_BAD_HEADER;
+			break;
+		case 'H':
+			if (!ParseDimension(Value, Header.Height))
+				return Y4M_BAD_HEADER;
+			break;
+		case 'C':
+			Header.Colorspace = Value;
+			break;
+		default:
+			Header.Parameters += " " + Parameter;
+			break;
+		}
+		Start = End;
+	}
+
+	if ((Header.Width <= 0) || (Header.Height <= 0))
+		return Y4M_BAD_HEADER;
+	size_t ChromaSize;
+	const int SizeReturn = GetY4MPlaneSizes(Header, LumaSize, ChromaSize);
+	if (SizeReturn != Y4M_OK)
+		return SizeReturn;
+	FrameSize = LumaSize + ChromaSize;
+	return Y4M_OK;
+}
+
+/// <summary>
+/// reads the next frame, its FRAME parameters are ignored
+/// </summary>
+/// <returns>Y4M_OK, Y4M_END_OF_STREAM or one of the Y4M_XXX errors</returns>
+int CY4MReader::ReadFrame(std::vector<unsigned char>& Frame)
+{
+	std::string Line;
+	if (!ReadLine(Line))
+		return Line.empty() && feof(Stream) ? Y4M_END_OF_STREAM : Y4M_BAD_HEADER;
+	if (Line.compare(0, strlen(Y4M_FRAME_TAG), Y4M_FRAME_TAG) != 0)
+		return Y4M_BAD_HEADER;
+
+	Frame.resize(FrameSize);
+	if (fread(Frame.data(), 1, FrameSize, Stream) != FrameSize)
+		return Y4M_TRUNCATED_FRAME;
+	return Y4M_OK;
+}
+
+size_t CY4MReader::GetFrameSize() const
+{
+	return FrameSize;
+}
+
+size_t CY4MReader::GetLumaSize() const
+{
+	return LumaSize;
+}
+
+CY4MWriter::CY4MWriter(FILE* _Stream)
+{
+	Stream = _Stream;
+}
+
+int CY4MWriter::WriteHeader(const Y4MHeader& Header)
+{
+	const int Written = fprintf(Stream, "%s W%d H%d C%s%s\n", Y4M_SIGNATURE, Header.Width, Header.Height,
+	                            Header.Colorspace.c_str(), Header.Parameters.c_str());
+	return (Written < 0) ? Y4M_WRITE_FAILED : Y4M_OK;
+}
+
+int CY4MWriter::WriteFrame(const unsigned char* Frame, size_t FrameSize)
+{
+	if (fprintf(Stream, "%s\n", Y4M_FRAME_TAG) < 0)
+		return Y4M_WRITE_FAILED;
+	if (fwrite(Frame, 1, FrameSize, Stream) != FrameSize)
+		return Y4M_WRITE_FAILED;
+	return Y4M_OK;
+}
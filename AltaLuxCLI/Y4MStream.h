@@ -0,0 +1,94 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/// Y4M stream errors
+const int Y4M_OK = 0;
+const int Y4M_END_OF_STREAM = 1; //< no more frames, not an error
+const int Y4M_BAD_SIGNATURE = -1; //< the stream does not start with YUV4MPEG2
+const int Y4M_BAD_HEADER = -2; //< missing or invalid frame size, or malformed FRAME line
+const int Y4M_UNSUPPORTED_COLORSPACE = -3; //< only 8-bit mono, 420, 422 and 444 streams are supported
+const int Y4M_TRUNCATED_FRAME = -4; //< the stream ended in the middle of a frame
+const int Y4M_WRITE_FAILED = -5;
+
+const size_t Y4M_MAX_HEADER_LENGTH = 1024; //< longer stream or frame header lines are rejected
+const int Y4M_MAX_DIMENSION = 32768; //< larger frames are rejected, so that their pixel count fits the int sizes of the filter
+
+/// <summary>
+/// stream header of a YUV4MPEG2 file, as written by ffmpeg -f yuv4mpegpipe
+/// </summary>
+struct Y4MHeader
+{
+	int Width;
+	int Height;
+	std::string Colorspace; //< value of the C parameter, "420jpeg" if it is missing
+	std::string Parameters; //< the other parameters (frame rate, interlacing, aspect ratio...), written back as they are
+};
+
+/// <summary>
+/// reads the frames of a Y4M stream; each frame is read as a whole, the luma plane comes first
+/// and is GetLumaSize() bytes long
+/// </summary>
+class CY4MReader
+{
+public:
+	explicit CY4MReader(FILE* _Stream);
+
+	int ReadHeader(Y4MHeader& Header);
+	int ReadFrame(std::vector<unsigned char>& Frame); //< resizes Frame to GetFrameSize()
+	size_t GetFrameSize() const;
+	size_t GetLumaSize() const;
+
+private:
+	FILE* Stream;
+	size_t FrameSize;
+	size_t LumaSize;
+
+	bool ReadLine(std::string& Line);
+};
+
+/// <summary>
+/// writes the frames of a Y4M stream with the header of the input stream
+/// </summary>
+class CY4MWriter
+{
+public:
+	explicit CY4MWriter(FILE* _Stream);
+
+	int WriteHeader(const Y4MHeader& Header);
+	int WriteFrame(const unsigned char* Frame, size_t FrameSize);
+
+private:
+	FILE* Stream;
+};
+
+int GetY4MPlaneSizes(const Y4MHeader& Header, size_t& LumaSize, size_t& ChromaSize);
@@ -0,0 +1,321 @@
+// AltaLux Filter
+// by Stefano Tommesani (www.tommesani.com) 2016
+// this code is release under the Code Project Open License (CPOL) http://www.codeproject.com/info/cpol10.aspx
+// The main points subject to the terms of the License are:
+// -   Source Code and Executable Files can be used in commercial applications;
+// -   Source Code and Executable Files can be redistributed; and
+// -   Source Code can be modified to create derivative works.
+// -   No claim of suitability, guarantee, or any warranty whatsoever is provided. The software is provided "as-is".
+// -   The Article(s) accompanying the Work may not be distributed or republished without the Author's consent
+
+// AltaLuxMicroBench.cpp : times each kernel of the AltaLux filter in isolation, on controlled inputs
+//
+
+#include "stdafx.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <Windows.h>
+#include <intrin.h>
+
+#include <CBaseAltaLuxFilter.h>
+#include <ImageScaling.h>
+
+using namespace std;
+// using 4K resolution for testing, as in AltaLuxBench
+const int SAMPLE_WIDTH = 3840;
+const int SAMPLE_HEIGHT = 2160;
+const int SAMPLE_SIZE = SAMPLE_WIDTH * SAMPLE_HEIGHT;
+const int RGB24_PIXEL_SIZE = 3;
+const int RGB32_PIXEL_SIZE = 4;
+const int BENCHMARK_SAMPLES = 10; //< samples per kernel, the median is reported
+const double MIN_SAMPLE_SECONDS = 0.01; //< short kernels are called repeatedly until a sample lasts at least this long
+const int MAX_CALLS_PER_SAMPLE = 1 << 20;
+const int BENCHMARK_GRID_SIZES[] = { 8, 16, 64 }; //< region and submatrix sizes from 480x270 down to 60x33 pixels
+const int BENCHMARK_SCALING_FACTORS[] = { 2, 3, 4 };
+/// Ey = 0.299*Er + 0.587*Eg + 0.114*Eb, with the same Q15 factors used by ProcessRGB24 and ProcessRGB32
+const int Y_RED_SCALE = static_cast<int>(0.299 * (1 << 15));
+const int Y_GREEN_SCALE = static_cast<int>(0.587 * (1 << 15));
+const int Y_BLUE_SCALE = static_cast<int>(0.114 * (1 << 15));
+
+/// patterns of the image data, that drive the work done by ClipHistogram
+enum HistogramPattern
+{
+	HISTOGRAM_FLAT, //< all graylevels equally frequent, nothing to clip
+	HISTOGRAM_NOISY, //< random graylevels, little to clip
+	HISTOGRAM_PEAKY, //< a few graylevels, most pixels are redistributed
+	NUM_HISTOGRAM_PATTERNS
+};
+const char* HISTOGRAM_PATTERN_NAMES[NUM_HISTOGRAM_PATTERNS] = { "flat", "noisy", "peaky" };
+
+/// <summary>
+/// gives access to the protected kernels of the filter, Run is never used
+/// </summary>
+class CKernelAltaLuxFilter : public CBaseAltaLuxFilter
+{
+public:
+	CKernelAltaLuxFilter(int Width, int Height, int HorSlices, int VerSlices) :
+		CBaseAltaLuxFilter(Width, Height, HorSlices, VerSlices) {}
+
+	using CBaseAltaLuxFilter::MakeHistogram;
+	using CBaseAltaLuxFilter::ClipHistogram;
+	using CBaseAltaLuxFilter::MapHistogram;
+	using CBaseAltaLuxFilter::Interpolate;
+	using CBaseAltaLuxFilter::InterpolateApproximateScalar;
+	using CBaseAltaLuxFilter::InterpolateApproximateSSSE3;
+	using CBaseAltaLuxFilter::ComputeClipLimit;
+	using CBaseAltaLuxFilter::ExtractLuminance;
+	using CBaseAltaLuxFilter::InjectLuminance;
+	using CBaseAltaLuxFilter::SetLumaOutput;
+
+	unsigned int GetRegionWidth() const { return RegionWidth; }
+	unsigned int GetRegionHeight() const { return RegionHeight; }
+	PixelType* GetImageBuffer() { return ImageBuffer; }
+
+protected:
+	int Run() override { return AL_OK; }
+};
+
+/// <summary>
+/// times a kernel and prints the median time per call, and the cycles and time per unit of work
+/// </summary>
+/// <param name="KernelName">description of the kernel and of its input</param>
+/// <param name="UnitName">unit of work, e.g. pixel or histogram</param>
+/// <param name="UnitsPerCall">units of work done by each call of Kernel</param>
+/// <param name="Kernel">code under test</param>
+/// <remarks>cycles are read with rdtsc, so they are reference cycles and not core cycles when the CPU is boosting</remarks>
+template <typename KernelFunction>
+void BenchmarkKernel(const string& KernelName, const char* UnitName, double UnitsPerCall, KernelFunction Kernel)
+{
+	LARGE_INTEGER TimerFrequency;
+	QueryPerformanceFrequency(&TimerFrequency);
+
+	/// find how many calls make a sample long enough to be measured, this also warms up caches
+	int CallsPerSample = 1;
+	for (;;)
+	{
+		LARGE_INTEGER StartTime, StopTime;
+		QueryPerformanceCounter(&StartTime);
+		for (int Call = 0; Call < CallsPerSample; Call++)
+			Kernel();
+		QueryPerformanceCounter(&StopTime);
+		const double ElapsedSeconds = (double)(StopTime.QuadPart - StartTime.QuadPart) / TimerFrequency.QuadPart;
+		if ((ElapsedSeconds >= MIN_SAMPLE_SECONDS) || (CallsPerSample >= MAX_CALLS_PER_SAMPLE))
+			break;
+		CallsPerSample <<= 1;
+	}
+
+	vector<double> NsPerCall;
+	vector<double> CyclesPerCall;
+	for (int Sample = 0; Sample < BENCHMARK_SAMPLES; Sample++)
+	{
+		LARGE_INTEGER StartTime, StopTime;
+		QueryPerformanceCounter(&StartTime);
+		const unsigned __int64 StartCycles = __rdtsc();
+		for (int Call = 0; Call < CallsPerSample; Call++)
+			Kernel();
+		const unsigned __int64 StopCycles = __rdtsc();
+		QueryPerformanceCounter(&StopTime);
+		NsPerCall.push_back(1e9 * (StopTime.QuadPart - StartTime.QuadPart) / TimerFrequency.QuadPart / CallsPerSample);
+		CyclesPerCall.push_back((double)(StopCycles - StartCycles) / CallsPerSample);
+	}
+	sort(NsPerCall.begin(), NsPerCall.end());
+	sort(CyclesPerCall.begin(), CyclesPerCall.end());
+	const double MedianNs = NsPerCall[NsPerCall.size() >> 1];
+	const double MedianCycles = CyclesPerCall[CyclesPerCall.size() >> 1];
+
+	cout << left << setw(52) << KernelName << right << fixed
+		<< setprecision(0) << setw(12) << MedianNs << " ns/call"
+		<< setprecision(2) << setw(10) << (MedianCycles / UnitsPerCall) << " cycles/" << UnitName
+		<< setprecision(2) << setw(10) << (MedianNs / UnitsPerCall) << " ns/" << UnitName << endl;
+}
+
+/// <summary>
+/// fills a grayscale image so that the histograms of its regions follow the given pattern
+/// </summary>
+void FillPatternBuffer(unsigned char *Buffer, int Width, int Height, HistogramPattern Pattern)
+{
+	srand(0x5555);
+	for (int y = 0; y < Height; y++)
+		for (int x = 0; x < Width; x++)
+		{
+			unsigned char Value;
+			switch (Pattern)
+			{
+			case HISTOGRAM_FLAT:
+				Value = (unsigned char)(x + y);
+				break;
+			case HISTOGRAM_PEAKY:
+				Value = (unsigned char)(128 + (rand() % 5) - 2);
+				break;
+			case HISTOGRAM_NOISY:
+			default:
+				Value = (unsigned char)(rand() & 0xFF);
+				break;
+			}
+			Buffer[y * Width + x] = Value;
+		}
+}
+
+void FillRandomBuffer(unsigned char *Buffer, int BufferSize)
+{
+	srand(0x5555);
+	for (int j = 0; j < BufferSize; j++)
+		Buffer[j] = rand() & 0xFF;
+}
+
+/// <summary>
+/// MakeHistogram, ClipHistogram and MapHistogram on a single contextual region, for each pattern and grid size
+/// </summary>
+void BenchmarkHistogramKernels(unsigned char *GrayBuffer)
+{
+	for (int Pattern = 0; Pattern < NUM_HISTOGRAM_PATTERNS; Pattern++)
+	{
+		FillPatternBuffer(GrayBuffer, SAMPLE_WIDTH, SAMPLE_HEIGHT, (HistogramPattern)Pattern);
+		for (int GridSize : BENCHMARK_GRID_SIZES)
+		{
+			CKernelAltaLuxFilter Filter(SAMPLE_WIDTH, SAMPLE_HEIGHT, GridSize, GridSize);
+			const unsigned int NumPixels = Filter.GetRegionWidth() * Filter.GetRegionHeight();
+			const unsigned int ClipLimit = Filter.ComputeClipLimit();
+			const string InputName = string(" ") + HISTOGRAM_PATTERN_NAMES[Pattern] + " " +
+				to_string(Filter.GetRegionWidth()) + "x" + to_string(Filter.GetRegionHeight());
+
+			unsigned int Histogram[NUM_GRAY_LEVELS];
+			unsigned int ClippedHistogram[NUM_GRAY_LEVELS];
+			MapType Map[NUM_GRAY_LEVELS];
+
+			BenchmarkKernel("MakeHistogram" + InputName, "pixel", NumPixels, [&]()
+			{
+				Filter.MakeHistogram(GrayBuffer, Histogram);
+			});
+			/// clipping works in place, so each call restarts from the unclipped histogram
+			BenchmarkKernel("ClipHistogram" + InputName, "histogram", 1, [&]()
+			{
+				memcpy(ClippedHistogram, Histogram, sizeof(Histogram));
+				Filter.ClipHistogram(ClippedHistogram, ClipLimit);
+			});
+			BenchmarkKernel("MapHistogram" + InputName, "histogram", 1, [&]()
+			{
+				Filter.MapHistogram(ClippedHistogram, NumPixels, Map);
+			});
+		}
+	}
+}
+
+/// <summary>
+/// exact and approximate interpolation of a submatrix as large as a contextual region, for each grid size
+/// and each code path of the approximate interpolation, then the exact one writing into an RGB32 image
+/// as ProcessRGB32 does
+/// </summary>
+void BenchmarkInterpolationKernels(unsigned char *GrayBuffer, unsigned char *ColorBuffer)
+{
+	FillRandomBuffer(GrayBuffer, SAMPLE_SIZE);
+	/// increasing mappings, as produced by MapHistogram
+	MapType Maps[4][NUM_GRAY_LEVELS];
+	for (int MapIndex = 0; MapIndex < 4; MapIndex++)
+		for (unsigned int GrayLevel = 0; GrayLevel < NUM_GRAY_LEVELS; GrayLevel++)
+			Maps[MapIndex][GrayLevel] = (MapType)((GrayLevel * (MapIndex + 4)) / 7);
+
+	for (int GridSize : BENCHMARK_GRID_SIZES)
+	{
+		CKernelAltaLuxFilter Filter(SAMPLE_WIDTH, SAMPLE_HEIGHT, GridSize, GridSize);
+		const unsigned int MatrixWidth = Filter.GetRegionWidth();
+		const unsigned int MatrixHeight = Filter.GetRegionHeight();
+		const unsigned int NumPixels = MatrixWidth * MatrixHeight;
+		const string InputName = " " + to_string(MatrixWidth) + "x" + to_string(MatrixHeight);
+
+		BenchmarkKernel("Interpolate" + InputName, "pixel", NumPixels, [&]()
+		{
+			Filter.Interpolate(GrayBuffer, Maps[0], Maps[1], Maps[2], Maps[3], MatrixWidth, MatrixHeight, SAMPLE_WIDTH);
+		});
+		BenchmarkKernel("InterpolateApproximate C" + InputName, "pixel", NumPixels, [&]()
+		{
+			Filter.InterpolateApproximateScalar(GrayBuffer, Maps[0], Maps[1], Maps[2], Maps[3], MatrixWidth, MatrixHeight, SAMPLE_WIDTH);
+		});
+		if (CBaseAltaLuxFilter::IsSSSE3Supported())
+		{
+			BenchmarkKernel("InterpolateApproximate SSSE3" + InputName, "pixel", NumPixels, [&]()
+			{
+				Filter.InterpolateApproximateSSSE3(GrayBuffer, Maps[0], Maps[1], Maps[2], Maps[3], MatrixWidth, MatrixHeight, SAMPLE_WIDTH);
+			});
+		}
+		/// the pixels of ColorBuffer are located from their offset in ImageBuffer, whose luma is left unchanged
+		PixelType* LumaBuffer = Filter.GetImageBuffer();
+		memcpy(LumaBuffer, GrayBuffer, SAMPLE_SIZE);
+		Filter.SetLumaOutput(ColorBuffer, AL_OUTPUT_RGB, RGB32_PIXEL_SIZE, 0);
+		BenchmarkKernel("Interpolate RGB32 output" + InputName, "pixel", NumPixels, [&]()
+		{
+			Filter.Interpolate(LumaBuffer, Maps[0], Maps[1], Maps[2], Maps[3], MatrixWidth, MatrixHeight, SAMPLE_WIDTH);
+		});
+		Filter.SetLumaOutput(nullptr, AL_OUTPUT_IN_PLACE, 0, 0);
+	}
+}
+
+/// <summary>
+/// luminance extraction and injection of a full RGB24 and RGB32 image
+/// </summary>
+void BenchmarkColorConversions(unsigned char *ColorBuffer)
+{
+	CKernelAltaLuxFilter Filter(SAMPLE_WIDTH, SAMPLE_HEIGHT, DEFAULT_HOR_REGIONS, DEFAULT_VERT_REGIONS);
+	const int PixelSizes[] = { RGB24_PIXEL_SIZE, RGB32_PIXEL_SIZE };
+	for (int PixelSize : PixelSizes)
+	{
+		const string FormatName = (PixelSize == RGB24_PIXEL_SIZE) ? " RGB24" : " RGB32";
+		BenchmarkKernel("ExtractLuminance" + FormatName, "pixel", SAMPLE_SIZE, [&]()
+		{
+			Filter.ExtractLuminance(ColorBuffer, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, PixelSize);
+		});
+		BenchmarkKernel("InjectLuminance" + FormatName, "pixel", SAMPLE_SIZE, [&]()
+		{
+			Filter.InjectLuminance(ColorBuffer, Y_RED_SCALE, Y_GREEN_SCALE, Y_BLUE_SCALE, PixelSize);
+		});
+	}
+}
+
+/// <summary>
+/// down-sampling of a full RGB24 and RGB32 image for previews
+/// </summary>
+void BenchmarkScaleDownImage(unsigned char *ColorBuffer, unsigned char *ScaledBuffer)
+{
+	const int PixelSizes[] = { RGB24_PIXEL_SIZE, RGB32_PIXEL_SIZE };
+	for (int PixelSize : PixelSizes)
+		for (int ScalingFactor : BENCHMARK_SCALING_FACTORS)
+		{
+			const string KernelName = string("ScaleDownImage") + ((PixelSize == RGB24_PIXEL_SIZE) ? " RGB24" : " RGB32") +
+				" 1/" + to_string(ScalingFactor);
+			BenchmarkKernel(KernelName, "src pixel", SAMPLE_SIZE, [&]()
+			{
+				ScaleDownImage(ColorBuffer, SAMPLE_WIDTH, SAMPLE_HEIGHT, ScaledBuffer, ScalingFactor, PixelSize);
+			});
+		}
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	cout << "AltaLux Kernel Benchmark by Stefano Tommesani www.tommesani.com" << endl;
+	cout << "SSSE3 " << (CBaseAltaLuxFilter::IsSSSE3Supported() ? "supported" : "not supported") << endl;
+
+	unsigned char *GrayBuffer = new unsigned char[SAMPLE_SIZE];
+	unsigned char *ColorBuffer = new unsigned char[SAMPLE_SIZE * RGB32_PIXEL_SIZE];
+	unsigned char *ScaledBuffer = new unsigned char[SAMPLE_SIZE * RGB32_PIXEL_SIZE];
+	FillRandomBuffer(ColorBuffer, SAMPLE_SIZE * RGB32_PIXEL_SIZE);
+
+	BenchmarkHistogramKernels(GrayBuffer);
+	BenchmarkInterpolationKernels(GrayBuffer, ColorBuffer);
+	BenchmarkColorConversions(ColorBuffer);
+	BenchmarkScaleDownImage(ColorBuffer, ScaledBuffer);
+
+	delete[] GrayBuffer;
+	delete[] ColorBuffer;
+	delete[] ScaledBuffer;
+	cout << "Testing completed" << endl;
+	char WaitForUser;
+	cin >> WaitForUser;
+	return 0;
+}
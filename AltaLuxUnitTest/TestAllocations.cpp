@@ -0,0 +1,140 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test that the filters do not allocate memory once the first image of a stream has been processed
+	/// </summary>
+	TEST_CLASS(TestAllocations)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int RGBA_PIXEL_SIZE = 4;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT * RGBA_PIXEL_SIZE);
+		const int NUM_FRAMES = 8;
+
+		/// <summary>
+		/// processes a stream of frames with the given strategy, and checks that only the first frame allocates
+		/// </summary>
+		void CheckSteadyState(int FilterType, int Slices)
+		{
+			std::vector<unsigned char> Frame(IMAGE_SIZE);
+			srand(0x5555);
+			for (auto& Value : Frame)
+				Value = rand() % 256;
+
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, IMAGE_WIDTH, IMAGE_HEIGHT, Slices, Slices);
+			Assert::IsNotNull(Filter);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Frame.data()));
+			const AllocationStats FirstFrame = Filter->GetAllocationStats();
+			// ImageBuffer and the graylevel mappings
+			Assert::AreEqual(2u, FirstFrame.NumAllocations);
+			Assert::IsTrue(FirstFrame.PeakBytes == FirstFrame.CurrentBytes);
+
+			Filter->ResetAllocationStats();
+			for (int i = 0; i < NUM_FRAMES; i++)
+			{
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Frame.data()));
+				Assert::AreEqual(AL_OK, Filter->ProcessGray(Frame.data()));
+			}
+			const AllocationStats SteadyState = Filter->GetAllocationStats();
+			Assert::AreEqual(0u, SteadyState.NumAllocations);
+			Assert::IsTrue(SteadyState.AllocatedBytes == 0);
+			Assert::IsTrue(SteadyState.CurrentBytes == FirstFrame.CurrentBytes);
+			Assert::IsTrue(SteadyState.PeakBytes == FirstFrame.CurrentBytes);
+			delete Filter;
+		}
+
+		TEST_METHOD(SerialTest)
+		{
+			CheckSteadyState(ALTALUX_FILTER_SERIAL, DEFAULT_HOR_REGIONS);
+			CheckSteadyState(ALTALUX_FILTER_SERIAL, MAX_HOR_REGIONS);
+		}
+
+		TEST_METHOD(ParallelSplitLoopTest)
+		{
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, DEFAULT_HOR_REGIONS);
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, MAX_HOR_REGIONS);
+		}
+
+		TEST_METHOD(ParallelErrorTest)
+		{
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_ERROR, DEFAULT_HOR_REGIONS);
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_ERROR, MAX_HOR_REGIONS);
+		}
+
+		TEST_METHOD(ParallelEventTest)
+		{
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_EVENT, DEFAULT_HOR_REGIONS);
+			CheckSteadyState(ALTALUX_FILTER_PARALLEL_EVENT, MAX_HOR_REGIONS);
+		}
+
+		TEST_METHOD(ParallelActiveWaitTest)
+		{
+			CheckSteadyState(ALTALUX_FILTER_ACTIVE_WAIT, DEFAULT_HOR_REGIONS);
+			CheckSteadyState(ALTALUX_FILTER_ACTIVE_WAIT, MAX_HOR_REGIONS);
+		}
+
+		TEST_METHOD(StrengthAndGridChangesTest)
+		{
+			std::vector<unsigned char> Frame(IMAGE_SIZE, 64);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, IMAGE_WIDTH, IMAGE_HEIGHT);
+			Filter->ProcessRGB32(Frame.data());
+			const AllocationStats FirstFrame = Filter->GetAllocationStats();
+
+			// disabling the filter releases ImageBuffer, enabling it again allocates it once more
+			Filter->SetStrength(AL_MIN_STRENGTH - 4);
+			Assert::IsTrue(Filter->GetAllocationStats().CurrentBytes < FirstFrame.CurrentBytes);
+			Filter->SetStrength();
+			Assert::AreEqual(FirstFrame.NumAllocations + 1, Filter->GetAllocationStats().NumAllocations);
+			Assert::IsTrue(Filter->GetAllocationStats().CurrentBytes == FirstFrame.CurrentBytes);
+
+			// a coarser grid reuses the graylevel mappings, a finer one reallocates them
+			Filter->ResetAllocationStats();
+			Filter->SetSlices(MIN_HOR_REGIONS, MIN_VERT_REGIONS);
+			Filter->ProcessRGB32(Frame.data());
+			Assert::AreEqual(0u, Filter->GetAllocationStats().NumAllocations);
+			Filter->SetSlices(MAX_HOR_REGIONS, MAX_VERT_REGIONS);
+			Filter->ProcessRGB32(Frame.data());
+			Assert::AreEqual(1u, Filter->GetAllocationStats().NumAllocations);
+			delete Filter;
+		}
+	};
+}
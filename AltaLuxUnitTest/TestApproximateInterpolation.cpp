@@ -0,0 +1,151 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CSerialAltaLuxFilter.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// gives access to the approximate interpolation kernels
+	/// </summary>
+	class CApproximateKernelsFilter : public CSerialAltaLuxFilter
+	{
+	public:
+		CApproximateKernelsFilter(int Width, int Height) : CSerialAltaLuxFilter(Width, Height) {}
+
+		using CBaseAltaLuxFilter::InterpolateApproximateScalar;
+		using CBaseAltaLuxFilter::InterpolateApproximateSSSE3;
+		using CBaseAltaLuxFilter::MakeQuadMap;
+	};
+
+	/// <summary>
+	/// test that the approximate interpolation stays within AL_APPROX_MAX_ERROR of the exact one
+	/// </summary>
+	TEST_CLASS(TestApproximateInterpolation)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int RGBA_PIXEL_SIZE = 4;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT * RGBA_PIXEL_SIZE);
+
+		/// <summary>
+		/// processes the same image with the exact and the approximate interpolation, and returns the max difference
+		/// </summary>
+		int ComputeMaxError(int Width, int Height, int Slices, int Strength)
+		{
+			const int ImageSize = Width * Height * RGBA_PIXEL_SIZE;
+			std::vector<unsigned char> ExactImage(ImageSize);
+			// smoothed random data, so that the histograms are not flat
+			srand(0x5555);
+			ExactImage[0] = rand() % 256;
+			for (int j = 1; j < ImageSize; j++)
+				ExactImage[j] = (rand() % 256 + ExactImage[j - 1] * 3) / 4;
+			std::vector<unsigned char> ApproximateImage(ExactImage);
+
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, Width, Height, Slices, Slices);
+			Filter->SetStrength(Strength);
+			Filter->ProcessRGB32(ExactImage.data());
+			Filter->SetApproximateInterpolation();
+			Filter->ProcessRGB32(ApproximateImage.data());
+			delete Filter;
+
+			int MaxError = 0;
+			for (int j = 0; j < ImageSize; j++)
+			{
+				const int Error = abs(ExactImage[j] - ApproximateImage[j]);
+				if (Error > MaxError)
+					MaxError = Error;
+			}
+			return MaxError;
+		}
+
+		TEST_METHOD(MaxErrorTest)
+		{
+			const int Slices[] = { MIN_HOR_REGIONS, 3, DEFAULT_HOR_REGIONS, 11, 16, MAX_HOR_REGIONS };
+			const int Strengths[] = { AL_MIN_STRENGTH, AL_DEFAULT_STRENGTH, AL_MAX_STRENGTH };
+			for (int SliceCount : Slices)
+				for (int Strength : Strengths)
+				{
+					Assert::IsTrue(ComputeMaxError(IMAGE_WIDTH, IMAGE_HEIGHT, SliceCount, Strength) <= AL_APPROX_MAX_ERROR);
+					// image size not a multiple of the grid, so that the last submatrices are wider and higher
+					Assert::IsTrue(ComputeMaxError(1000, 750, SliceCount, Strength) <= AL_APPROX_MAX_ERROR);
+				}
+		}
+
+		TEST_METHOD(ScalarMatchesSSSE3Test)
+		{
+			CApproximateKernelsFilter Filter(IMAGE_WIDTH, IMAGE_HEIGHT);
+			MapType Maps[4 * NUM_GRAY_LEVELS];
+			srand(0x1234);
+			for (int j = 0; j < 4 * NUM_GRAY_LEVELS; j++)
+				Maps[j] = rand() % 256;
+
+			// sizes below and above the SIMD width, the weight chunk and AL_QUAD_MAP_MIN_PIXELS
+			const unsigned int Widths[] = { 1, 7, 8, 9, 63, AL_APPROX_WEIGHT_CHUNK, AL_APPROX_WEIGHT_CHUNK + 9, 1000 };
+			const unsigned int Heights[] = { 1, 5, 64, 100 };
+			for (unsigned int Width : Widths)
+				for (unsigned int Height : Heights)
+				{
+					std::vector<PixelType> ScalarImage(IMAGE_WIDTH * IMAGE_HEIGHT);
+					for (auto& Pixel : ScalarImage)
+						Pixel = rand() % 256;
+					std::vector<PixelType> SSSE3Image(ScalarImage);
+					Filter.InterpolateApproximateScalar(ScalarImage.data() + 3, &Maps[0], &Maps[NUM_GRAY_LEVELS],
+						&Maps[2 * NUM_GRAY_LEVELS], &Maps[3 * NUM_GRAY_LEVELS], Width, Height, IMAGE_WIDTH);
+					Filter.InterpolateApproximateSSSE3(SSSE3Image.data() + 3, &Maps[0], &Maps[NUM_GRAY_LEVELS],
+						&Maps[2 * NUM_GRAY_LEVELS], &Maps[3 * NUM_GRAY_LEVELS], Width, Height, IMAGE_WIDTH);
+					Assert::IsTrue(ScalarImage == SSSE3Image);
+				}
+		}
+
+		TEST_METHOD(QuadMapTest)
+		{
+			MapType Maps[4 * NUM_GRAY_LEVELS];
+			for (unsigned int j = 0; j < 4 * NUM_GRAY_LEVELS; j++)
+				Maps[j] = static_cast<MapType>(j * 7);
+			QuadMapType QuadMap[NUM_GRAY_LEVELS];
+			CApproximateKernelsFilter::MakeQuadMap(&Maps[0], &Maps[NUM_GRAY_LEVELS], &Maps[2 * NUM_GRAY_LEVELS],
+				&Maps[3 * NUM_GRAY_LEVELS], QuadMap);
+			// lanes from the lowest: left-up, right-up, left-bottom, right-bottom, scaled as the SIMD code expects
+			for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
+				for (unsigned int Lane = 0; Lane < 4; Lane++)
+					Assert::AreEqual(static_cast<unsigned int>(Maps[Lane * NUM_GRAY_LEVELS + i]) << AL_APPROX_MAP_SHIFT,
+					                 static_cast<unsigned int>((QuadMap[i] >> (16 * Lane)) & 0xFFFF));
+		}
+	};
+}
@@ -0,0 +1,156 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/Filter/CBaseAltaLuxFilter.h"
+#include "../AltaLux/Filter/CAltaLuxFilterFactory.h"
+#include "../AltaLux/Filter/CSerialAltaLuxFilter.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// gives access to the estimate of the strength of a region
+	/// </summary>
+	class CAutoStrengthFilter : public CSerialAltaLuxFilter
+	{
+	public:
+		CAutoStrengthFilter(int Width, int Height) : CSerialAltaLuxFilter(Width, Height) {}
+
+		using CBaseAltaLuxFilter::EstimateRegionStrength;
+	};
+
+	/// <summary>
+	/// test the automatic choice of the strength of each contextual region
+	/// </summary>
+	TEST_CLASS(TestAutoStrength)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT);
+
+		/// <summary>
+		/// grayscale image with random graylevels in [FirstGraylevel..FirstGraylevel + NumGraylevels - 1]
+		/// </summary>
+		std::vector<unsigned char> MakeImage(int FirstGraylevel, int NumGraylevels)
+		{
+			std::vector<unsigned char> Image(IMAGE_SIZE);
+			srand(0x1234);
+			for (auto& Value : Image)
+				Value = static_cast<unsigned char>(FirstGraylevel + rand() % NumGraylevels);
+			return Image;
+		}
+
+		/// <summary>
+		/// processes Image with the given strategy and strength, and returns the result
+		/// </summary>
+		std::vector<unsigned char> Process(const std::vector<unsigned char>& Image, int FilterType, int Strength, bool AutoStrength)
+		{
+			std::vector<unsigned char> Result(Image);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, IMAGE_WIDTH, IMAGE_HEIGHT);
+			Assert::IsNotNull(Filter);
+			Filter->SetStrength(Strength);
+			Filter->SetAutoStrength(AutoStrength);
+			Assert::AreEqual(AutoStrength, Filter->IsAutoStrength());
+			Assert::AreEqual(AL_OK, Filter->ProcessGray(Result.data()));
+			delete Filter;
+			return Result;
+		}
+
+		static int MaxDifference(const std::vector<unsigned char>& First, const std::vector<unsigned char>& Second)
+		{
+			int MaxDiff = 0;
+			for (size_t j = 0; j < First.size(); j++)
+			{
+				const int Diff = abs(First[j] - Second[j]);
+				if (Diff > MaxDiff)
+					MaxDiff = Diff;
+			}
+			return MaxDiff;
+		}
+
+		TEST_METHOD(EstimateTest)
+		{
+			unsigned int Histogram[NUM_GRAY_LEVELS];
+
+			// all graylevels equally populated, nothing to gain
+			for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
+				Histogram[i] = 16;
+			Assert::IsTrue(CAutoStrengthFilter::EstimateRegionStrength(Histogram, 16 * NUM_GRAY_LEVELS) < 0.05f);
+
+			// a single graylevel is flat
+			memset(Histogram, 0, sizeof(Histogram));
+			Histogram[100] = 4096;
+			Assert::AreEqual(0.0f, CAutoStrengthFilter::EstimateRegionStrength(Histogram, 4096));
+
+			// 32 graylevels equally populated, 5 bits of entropy in a narrow range
+			for (unsigned int i = 100; i < 132; i++)
+				Histogram[i] = 128;
+			Assert::IsTrue(CAutoStrengthFilter::EstimateRegionStrength(Histogram, 32 * 128) > 0.8f);
+
+			// 4 graylevels, 2 bits of entropy, flat
+			memset(Histogram, 0, sizeof(Histogram));
+			for (unsigned int i = 10; i < 250; i += 60)
+				Histogram[i] = 1024;
+			Assert::AreEqual(0.0f, CAutoStrengthFilter::EstimateRegionStrength(Histogram, 4096));
+
+			Assert::AreEqual(0.0f, CAutoStrengthFilter::EstimateRegionStrength(Histogram, 0));
+		}
+
+		TEST_METHOD(ContrastTest)
+		{
+			// the noise of a flat image is not amplified, while an image of low contrast is enhanced
+			const std::vector<unsigned char> Flat = MakeImage(126, 4);
+			Assert::IsTrue(Process(Flat, ALTALUX_FILTER_SERIAL, AL_MAX_STRENGTH, true) == Flat);
+			Assert::IsTrue(MaxDifference(Flat, Process(Flat, ALTALUX_FILTER_SERIAL, AL_MAX_STRENGTH, false)) > 4);
+
+			const std::vector<unsigned char> LowContrast = MakeImage(96, 48);
+			const std::vector<unsigned char> Auto = Process(LowContrast, ALTALUX_FILTER_SERIAL, AL_MAX_STRENGTH, true);
+			Assert::IsTrue(MaxDifference(LowContrast, Auto) > 32);
+
+			// all strategies pick the same strengths
+			Assert::IsTrue(Process(LowContrast, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, AL_MAX_STRENGTH, true) == Auto);
+			Assert::IsTrue(Process(LowContrast, ALTALUX_FILTER_PARALLEL_EVENT, AL_MAX_STRENGTH, true) == Auto);
+			Assert::IsTrue(Process(LowContrast, ALTALUX_FILTER_ACTIVE_WAIT, AL_MAX_STRENGTH, true) == Auto);
+		}
+
+		TEST_METHOD(MinStrengthTest)
+		{
+			// the strength set by SetStrength bounds the automatic one
+			const std::vector<unsigned char> LowContrast = MakeImage(96, 48);
+			Assert::IsTrue(Process(LowContrast, ALTALUX_FILTER_SERIAL, AL_MIN_STRENGTH - 4, true) == LowContrast);
+		}
+	};
+}
@@ -0,0 +1,138 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CDeadlineCostModel.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the choice of the degradations applied to meet the deadline of a ProcessXXX call
+	/// </summary>
+	TEST_CLASS(TestDeadline)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int RGBA_PIXEL_SIZE = 4;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT * RGBA_PIXEL_SIZE);
+		const unsigned int SHORT_DEADLINE = 1; //< microseconds, no level can meet it
+		const unsigned int LONG_DEADLINE = 60000000; //< microseconds, all levels meet it
+
+		static bool IsClose(double Value, double Expected)
+		{
+			return std::fabs(Value - Expected) < Expected * 1e-9;
+		}
+
+		TEST_METHOD(CostModelTest)
+		{
+			CDeadlineCostModel Model;
+			DeadlinePlan Plan = DeadlinePlan();
+			Plan.Format = 0;
+			Plan.HorRegions = DEFAULT_HOR_REGIONS;
+			Plan.VertRegions = DEFAULT_VERT_REGIONS;
+
+			// unknown plans run at full quality
+			Assert::AreEqual(0, Model.SelectLevel(Plan, 1e-6));
+			Assert::IsTrue(Model.EstimateCost(Plan, 0) < 0.0);
+
+			// unmeasured levels are estimated with the prior ratios
+			Model.Update(Plan, 0, 0.010);
+			Assert::IsTrue(IsClose(Model.EstimateCost(Plan, 2), 0.010 * DEADLINE_PRIOR_COST_RATIOS[2]));
+			Assert::AreEqual(0, Model.SelectLevel(Plan, 0.020));
+			Assert::AreEqual(2, Model.SelectLevel(Plan, 0.0095));
+			Assert::AreEqual(NUM_DEADLINE_LEVELS - 1, Model.SelectLevel(Plan, 0.001));
+
+			// a slowdown measured on one level is applied to the other measured levels
+			Model.Update(Plan, 2, 0.004);
+			Model.Update(Plan, 2, 0.008);
+			Assert::IsTrue(IsClose(Model.EstimateCost(Plan, 2), 0.005));
+			Assert::IsTrue(IsClose(Model.EstimateCost(Plan, 0), 0.0125));
+
+			// plans with a different grid are learned separately
+			DeadlinePlan OtherPlan = Plan;
+			OtherPlan.HorRegions = MAX_HOR_REGIONS;
+			Assert::IsTrue(Model.EstimateCost(OtherPlan, 0) < 0.0);
+			Model.Reset();
+			Assert::IsTrue(Model.EstimateCost(Plan, 0) < 0.0);
+		}
+
+		TEST_METHOD(DegradationsTest)
+		{
+			std::vector<unsigned char> SourceImage(IMAGE_SIZE);
+			srand(0x5555);
+			for (auto& Value : SourceImage)
+				Value = rand() % 256;
+			std::unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateAltaLuxFilter(IMAGE_WIDTH, IMAGE_HEIGHT));
+
+			std::vector<unsigned char> ReferenceImage(SourceImage);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(ReferenceImage.data()));
+			Assert::AreEqual(AL_DEGRADE_NONE, Filter->GetAppliedDegradations());
+
+			// the first call of a plan runs at full quality, a long deadline keeps it there
+			for (int i = 0; i < 2; i++)
+			{
+				std::vector<unsigned char> Image(SourceImage);
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Image.data(), LONG_DEADLINE));
+				Assert::AreEqual(AL_DEGRADE_NONE, Filter->GetAppliedDegradations());
+				Assert::IsTrue(Image == ReferenceImage);
+			}
+
+			// once the cost is known, a deadline that cannot be met selects the cheapest level
+			std::vector<unsigned char> DegradedImage(SourceImage);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(DegradedImage.data(), SHORT_DEADLINE));
+			Assert::AreEqual(DEADLINE_LEVEL_DEGRADATIONS[NUM_DEADLINE_LEVELS - 1], Filter->GetAppliedDegradations());
+			Assert::IsFalse(DegradedImage == ReferenceImage);
+
+			// the next call without a deadline is not degraded
+			std::vector<unsigned char> Image(SourceImage);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Image.data()));
+			Assert::AreEqual(AL_DEGRADE_NONE, Filter->GetAppliedDegradations());
+			Assert::IsTrue(Image == ReferenceImage);
+
+			// the approximate interpolation chosen by the caller is not reported as a degradation
+			Filter->SetApproximateInterpolation();
+			for (int i = 0; i < 2; i++)
+			{
+				std::vector<unsigned char> ApproximateImage(SourceImage);
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB32(ApproximateImage.data(), SHORT_DEADLINE));
+			}
+			Assert::AreEqual(AL_DEGRADE_PROXY_MAPPINGS, Filter->GetAppliedDegradations());
+		}
+	};
+}
@@ -0,0 +1,141 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CFramePipeline.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test that the frames processed by CFramePipeline are the same as the ones processed one at a time by
+	/// ProcessXXX, and that they are completed in submission order
+	/// </summary>
+	TEST_CLASS(TestFramePipeline)
+	{
+	public:
+		const int IMAGE_WIDTH = 640;
+		const int IMAGE_HEIGHT = 480;
+		const int NUM_FRAMES = 7;
+
+		/// frames of the same size and different content, as a video stream
+		std::vector<std::vector<unsigned char>> MakeFrames(int PixelSize)
+		{
+			std::vector<std::vector<unsigned char>> Frames(NUM_FRAMES);
+			srand(0x5555);
+			for (int i = 0; i < NUM_FRAMES; i++)
+			{
+				Frames[i].resize(IMAGE_WIDTH * IMAGE_HEIGHT * PixelSize);
+				const int Range = 64 + i * 32; //< a different histogram for each frame
+				for (size_t j = 0; j < Frames[i].size(); j++)
+					Frames[i][j] = static_cast<unsigned char>(rand() % Range);
+			}
+			return Frames;
+		}
+
+		void CompareWithProcess(FramePixelFormat Format, int PixelSize, unsigned int Depth)
+		{
+			std::vector<std::vector<unsigned char>> Expected = MakeFrames(PixelSize);
+			std::vector<std::vector<unsigned char>> Actual = Expected;
+
+			std::unique_ptr<CBaseAltaLuxFilter> Filter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(
+				ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, IMAGE_WIDTH, IMAGE_HEIGHT));
+			for (int i = 0; i < NUM_FRAMES; i++)
+			{
+				void* Image = Expected[i].data();
+				switch (Format)
+				{
+				case FRAME_FORMAT_GRAY: Filter->ProcessGray(Image); break;
+				case FRAME_FORMAT_RGB24: Filter->ProcessRGB24(Image); break;
+				case FRAME_FORMAT_RGB32: Filter->ProcessRGB32(Image); break;
+				case FRAME_FORMAT_BGR24: Filter->ProcessBGR24(Image); break;
+				case FRAME_FORMAT_BGR32: Filter->ProcessBGR32(Image); break;
+				}
+			}
+
+			CFramePipeline Pipeline(IMAGE_WIDTH, IMAGE_HEIGHT, Format, DEFAULT_HOR_REGIONS, DEFAULT_VERT_REGIONS, Depth);
+			int NextCompleted = 0;
+			for (int i = 0; i < NUM_FRAMES; i++)
+			{
+				if (Pipeline.GetNumFramesInFlight() == Pipeline.GetDepth())
+				{
+					void* Completed = nullptr;
+					Assert::AreEqual(AL_OK, Pipeline.CompleteFrame(&Completed));
+					Assert::IsTrue(Completed == Actual[NextCompleted++].data());
+				}
+				Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(Actual[i].data()));
+			}
+			while (NextCompleted < NUM_FRAMES)
+			{
+				void* Completed = nullptr;
+				Assert::AreEqual(AL_OK, Pipeline.CompleteFrame(&Completed));
+				Assert::IsTrue(Completed == Actual[NextCompleted++].data());
+			}
+
+			for (int i = 0; i < NUM_FRAMES; i++)
+				Assert::IsTrue(Expected[i] == Actual[i]);
+		}
+
+		TEST_METHOD(SameAsProcessTest)
+		{
+			CompareWithProcess(FRAME_FORMAT_RGB32, 4, DEFAULT_PIPELINE_DEPTH);
+			CompareWithProcess(FRAME_FORMAT_BGR24, 3, DEFAULT_PIPELINE_DEPTH);
+			CompareWithProcess(FRAME_FORMAT_GRAY, 1, DEFAULT_PIPELINE_DEPTH);
+			CompareWithProcess(FRAME_FORMAT_RGB24, 3, 1);
+			CompareWithProcess(FRAME_FORMAT_BGR32, 4, MAX_PIPELINE_DEPTH);
+		}
+
+		TEST_METHOD(RingTest)
+		{
+			std::vector<unsigned char> First(IMAGE_WIDTH * IMAGE_HEIGHT), Second(IMAGE_WIDTH * IMAGE_HEIGHT);
+			CFramePipeline Pipeline(IMAGE_WIDTH, IMAGE_HEIGHT, FRAME_FORMAT_GRAY, DEFAULT_HOR_REGIONS, DEFAULT_VERT_REGIONS, 2);
+			Assert::AreEqual(AL_PIPELINE_EMPTY, Pipeline.CompleteFrame());
+
+			Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(First.data()));
+			Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(nullptr));
+			Assert::AreEqual(AL_PIPELINE_FULL, Pipeline.SubmitFrame(Second.data()));
+			Assert::AreEqual(2u, Pipeline.GetNumFramesInFlight());
+
+			// a failed frame does not stop the ones behind it
+			Assert::AreEqual(AL_OK, Pipeline.CompleteFrame());
+			Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(Second.data()));
+			Assert::AreEqual(AL_NULL_IMAGE, Pipeline.Flush());
+			Assert::AreEqual(0u, Pipeline.GetNumFramesInFlight());
+			Assert::AreEqual(AL_PIPELINE_EMPTY, Pipeline.CompleteFrame());
+		}
+	};
+}
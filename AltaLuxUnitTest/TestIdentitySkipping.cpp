@@ -0,0 +1,170 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CSerialAltaLuxFilter.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// gives access to the computation of the graylevel mappings
+	/// </summary>
+	class CMappingFilter : public CSerialAltaLuxFilter
+	{
+	public:
+		CMappingFilter(int Width, int Height) : CSerialAltaLuxFilter(Width, Height) {}
+
+		using CBaseAltaLuxFilter::MapHistogram;
+	};
+
+	/// <summary>
+	/// test the skipping of the sub-matrices surrounded by identity mappings
+	/// </summary>
+	TEST_CLASS(TestIdentitySkipping)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int RGBA_PIXEL_SIZE = 4;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT * RGBA_PIXEL_SIZE);
+
+		/// <summary>
+		/// gray pixels with uniformly distributed random luminance, whose histograms are already balanced
+		/// </summary>
+		std::vector<unsigned char> MakeBalancedImage()
+		{
+			std::vector<unsigned char> Image(IMAGE_SIZE);
+			srand(0x5555);
+			for (int j = 0; j < IMAGE_SIZE; j += RGBA_PIXEL_SIZE)
+			{
+				const unsigned char Luminance = rand() % 256;
+				Image[j] = Luminance;
+				Image[j + 1] = Luminance;
+				Image[j + 2] = Luminance;
+				Image[j + 3] = 0;
+			}
+			return Image;
+		}
+
+		/// <summary>
+		/// processes Image with the given strategy and tolerance, and returns the result
+		/// </summary>
+		std::vector<unsigned char> Process(const std::vector<unsigned char>& Image, int FilterType, int Strength,
+		                                   unsigned int Tolerance)
+		{
+			std::vector<unsigned char> Result(Image);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, IMAGE_WIDTH, IMAGE_HEIGHT);
+			Assert::IsNotNull(Filter);
+			Filter->SetStrength(Strength);
+			Filter->SetIdentityTolerance(Tolerance);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Result.data()));
+			delete Filter;
+			return Result;
+		}
+
+		static int MaxDifference(const std::vector<unsigned char>& First, const std::vector<unsigned char>& Second)
+		{
+			int MaxDiff = 0;
+			for (size_t j = 0; j < First.size(); j++)
+			{
+				const int Diff = abs(First[j] - Second[j]);
+				if (Diff > MaxDiff)
+					MaxDiff = Diff;
+			}
+			return MaxDiff;
+		}
+
+		TEST_METHOD(MapHistogramTest)
+		{
+			CMappingFilter Filter(IMAGE_WIDTH, IMAGE_HEIGHT);
+			MapType Map[NUM_GRAY_LEVELS];
+			unsigned int Histogram[NUM_GRAY_LEVELS];
+
+			// graylevels 1..255 equally populated map to themselves
+			Histogram[0] = 0;
+			for (unsigned int i = 1; i < NUM_GRAY_LEVELS; i++)
+				Histogram[i] = 4;
+			Assert::IsTrue(Filter.MapHistogram(Histogram, 4 * MAX_GRAY_VALUE, Map));
+			for (unsigned int i = 0; i < NUM_GRAY_LEVELS; i++)
+				Assert::AreEqual((unsigned int)Map[i], i);
+
+			// graylevels 0..254 equally populated map one graylevel up
+			for (unsigned int i = 0; i < MAX_GRAY_VALUE; i++)
+				Histogram[i] = 4;
+			Histogram[MAX_GRAY_VALUE] = 0;
+			Assert::IsFalse(Filter.MapHistogram(Histogram, 4 * MAX_GRAY_VALUE, Map));
+			Filter.SetIdentityTolerance(1);
+			Assert::IsTrue(Filter.MapHistogram(Histogram, 4 * MAX_GRAY_VALUE, Map));
+
+			// a dark image is stretched, far from the identity
+			memset(Histogram, 0, sizeof(Histogram));
+			Histogram[10] = 1000;
+			Filter.SetIdentityTolerance(AL_MAX_IDENTITY_TOLERANCE);
+			Assert::IsFalse(Filter.MapHistogram(Histogram, 1000, Map));
+
+			Filter.SetIdentityTolerance(AL_MAX_IDENTITY_TOLERANCE + 10);
+			Assert::AreEqual(AL_MAX_IDENTITY_TOLERANCE, Filter.GetIdentityTolerance());
+		}
+
+		TEST_METHOD(ToleranceTest)
+		{
+			const std::vector<unsigned char> Image = MakeBalancedImage();
+			const int Strengths[] = { AL_MIN_STRENGTH, AL_DEFAULT_STRENGTH, AL_MAX_STRENGTH };
+			for (int Strength : Strengths)
+			{
+				const std::vector<unsigned char> Exact = Process(Image, ALTALUX_FILTER_SERIAL, Strength, 0);
+				for (unsigned int Tolerance = 1; Tolerance <= AL_MAX_IDENTITY_TOLERANCE; Tolerance++)
+				{
+					const std::vector<unsigned char> Skipped = Process(Image, ALTALUX_FILTER_SERIAL, Strength, Tolerance);
+					Assert::IsTrue(MaxDifference(Exact, Skipped) <= static_cast<int>(Tolerance));
+					// all strategies skip the same sub-matrices
+					Assert::IsTrue(Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, Strength, Tolerance) == Skipped);
+					Assert::IsTrue(Process(Image, ALTALUX_FILTER_PARALLEL_EVENT, Strength, Tolerance) == Skipped);
+					Assert::IsTrue(Process(Image, ALTALUX_FILTER_ACTIVE_WAIT, Strength, Tolerance) == Skipped);
+				}
+			}
+		}
+
+		TEST_METHOD(BalancedImageTest)
+		{
+			// at the lowest strength the histograms of a balanced image are clipped almost flat, so their mappings
+			// are close to the identity and nothing is interpolated
+			const std::vector<unsigned char> Image = MakeBalancedImage();
+			Assert::IsTrue(Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, AL_MIN_STRENGTH - 3, AL_MAX_IDENTITY_TOLERANCE) == Image);
+		}
+	};
+}
@@ -0,0 +1,104 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/ImageCopy/ImageCopy.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the copies of image rows between strides and pixel sizes
+	/// </summary>
+	TEST_CLASS(TestImageCopy)
+	{
+	public:
+		/// <summary>
+		/// copies a random image with padded rows, and checks each pixel against the source
+		/// </summary>
+		void CheckCopy(int Width, int Height, int SrcBytesPerPixel, int DestBytesPerPixel, bool FlipRows)
+		{
+			const int SrcStride = Width * SrcBytesPerPixel + 5;
+			const int DestStride = Width * DestBytesPerPixel + 7;
+			std::vector<unsigned char> Src(SrcStride * Height);
+			srand(Width + Height);
+			for (auto& Value : Src)
+				Value = rand() & 0xFF;
+			// the padding of the destination rows must be left as is
+			std::vector<unsigned char> Dest(DestStride * Height, 0x55);
+
+			CopyImageRows(Src.data(), SrcStride, SrcBytesPerPixel, Dest.data(), DestStride, DestBytesPerPixel, Width, Height, FlipRows);
+
+			for (int y = 0; y < Height; y++)
+			{
+				const unsigned char* SrcRow = &Src[y * SrcStride];
+				const unsigned char* DestRow = &Dest[(FlipRows ? (Height - 1 - y) : y) * DestStride];
+				for (int x = 0; x < Width; x++)
+				{
+					for (int Channel = 0; Channel < 3; Channel++)
+						Assert::AreEqual((int)SrcRow[x * SrcBytesPerPixel + Channel], (int)DestRow[x * DestBytesPerPixel + Channel]);
+					if (DestBytesPerPixel == 4)
+						Assert::AreEqual((SrcBytesPerPixel == 4) ? (int)SrcRow[x * 4 + 3] : 0, (int)DestRow[x * 4 + 3]);
+				}
+				for (int x = Width * DestBytesPerPixel; x < DestStride; x++)
+					Assert::AreEqual(0x55, (int)DestRow[x]);
+			}
+		}
+
+		TEST_METHOD(SamePixelSizeTest)
+		{
+			CheckCopy(37, 11, 3, 3, false);
+			CheckCopy(37, 11, 4, 4, true);
+		}
+
+		TEST_METHOD(ConversionTest)
+		{
+			// widths around the 4 pixel steps of the SIMD code
+			for (int Width = 1; Width <= 13; Width++)
+			{
+				CheckCopy(Width, 3, 3, 4, false);
+				CheckCopy(Width, 3, 4, 3, false);
+			}
+			CheckCopy(1021, 9, 3, 4, true);
+			CheckCopy(1021, 9, 4, 3, true);
+		}
+
+		TEST_METHOD(ParallelCopyTest)
+		{
+			// above IMAGE_COPY_MIN_PARALLEL_BYTES, with a last band shorter than IMAGE_COPY_BAND_ROWS
+			CheckCopy(1283, 723, 3, 3, true);
+			CheckCopy(1283, 723, 3, 4, false);
+			CheckCopy(1283, 723, 4, 3, true);
+		}
+	};
+}
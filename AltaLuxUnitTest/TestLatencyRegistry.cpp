@@ -0,0 +1,132 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CLatencyRegistry.h"
+
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the latency histograms and their registry
+	/// </summary>
+	TEST_CLASS(TestLatencyRegistry)
+	{
+	public:
+		TEST_METHOD(BucketBoundsTest)
+		{
+			int PreviousIndex = 0;
+			for (unsigned long long Value = 0; Value < (1ULL << LATENCY_MAX_EXPONENT); Value = Value * 9 / 8 + 1)
+			{
+				const int Index = CLatencyHistogram::GetBucketIndex(Value);
+				Assert::IsTrue(Index >= PreviousIndex);
+				Assert::IsTrue(Index < NUM_LATENCY_BUCKETS);
+				const unsigned long long UpperBound = CLatencyHistogram::GetBucketUpperBound(Index);
+				Assert::IsTrue(UpperBound >= Value);
+				// relative error below 1 / LATENCY_SUB_BUCKETS
+				Assert::IsTrue((UpperBound - Value) * LATENCY_SUB_BUCKETS <= Value);
+				PreviousIndex = Index;
+			}
+			Assert::AreEqual(NUM_LATENCY_BUCKETS - 1, CLatencyHistogram::GetBucketIndex(~0ULL));
+		}
+
+		TEST_METHOD(PercentileTest)
+		{
+			CLatencyHistogram Histogram;
+			// 1 to 10000 microseconds
+			for (unsigned long long Sample = 1; Sample <= 10000; Sample++)
+				Histogram.Record(Sample * 1000);
+			CLatencySnapshot Snapshot;
+			Histogram.GetSnapshot(Snapshot);
+			Assert::AreEqual(10000ULL, Snapshot.TotalCount);
+			const double Percentiles[] = { 50.0, 99.0, 99.9, 100.0 };
+			for (double Percentile : Percentiles)
+			{
+				const double Expected = Percentile * 100.0 * 1000.0;
+				const double Measured = static_cast<double>(Snapshot.GetPercentile(Percentile));
+				Assert::IsTrue(Measured >= Expected);
+				Assert::IsTrue(Measured <= Expected * (1.0 + 1.0 / LATENCY_SUB_BUCKETS));
+			}
+			Assert::IsTrue(Snapshot.GetMax() >= 10000000ULL);
+
+			Histogram.GetSnapshot(Snapshot, true);
+			Assert::AreEqual(10000ULL, Snapshot.TotalCount);
+			Histogram.GetSnapshot(Snapshot);
+			Assert::AreEqual(0ULL, Snapshot.TotalCount);
+			Assert::AreEqual(0ULL, Snapshot.GetPercentile(99.0));
+		}
+
+		TEST_METHOD(RecordProcessCallsTest)
+		{
+			const int Width = 1024;
+			const int Height = 768;
+			const int NumCalls = 5;
+			std::vector<unsigned char> Image(Width * Height * 4, 128);
+
+			CLatencyRegistry& Registry = CLatencyRegistry::GetInstance();
+			Registry.Reset();
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, Width, Height);
+			// nothing is recorded while the registry is disabled
+			Filter->ProcessRGB32(Image.data());
+			Registry.SetEnabled();
+			for (int i = 0; i < NumCalls; i++)
+				Filter->ProcessRGB32(Image.data());
+			Filter->ProcessGray(Image.data());
+			Registry.SetEnabled(false);
+			delete Filter;
+
+			const LatencySizeBucket Size = CLatencyRegistry::GetSizeBucket(Width, Height);
+			Assert::AreEqual(static_cast<int>(LATENCY_SIZE_HD), static_cast<int>(Size));
+			CLatencySnapshot Snapshot;
+			Registry.GetSnapshot(LATENCY_FORMAT_RGB32, Size, Snapshot);
+			Assert::AreEqual(static_cast<unsigned long long>(NumCalls), Snapshot.TotalCount);
+			Assert::IsTrue(Snapshot.GetPercentile(50.0) > 0);
+			Registry.GetSnapshot(LATENCY_FORMAT_GRAY, Size, Snapshot);
+			Assert::AreEqual(1ULL, Snapshot.TotalCount);
+			Registry.GetSnapshot(LATENCY_FORMAT_BGR32, Size, Snapshot);
+			Assert::AreEqual(0ULL, Snapshot.TotalCount);
+
+			const std::string Text = Registry.ExportPrometheus();
+			Assert::IsTrue(Text.find("# TYPE altalux_process_latency_seconds summary") != std::string::npos);
+			Assert::IsTrue(Text.find("altalux_process_latency_seconds{format=\"rgb32\",size=\"hd\",quantile=\"0.99\"}") != std::string::npos);
+			Assert::IsTrue(Text.find("altalux_process_latency_seconds_count{format=\"rgb32\",size=\"hd\"} 5") != std::string::npos);
+			Assert::IsTrue(Text.find("format=\"bgr32\"") == std::string::npos);
+
+			Registry.Reset();
+			Registry.GetSnapshot(LATENCY_FORMAT_RGB32, Size, Snapshot);
+			Assert::AreEqual(0ULL, Snapshot.TotalCount);
+		}
+	};
+}
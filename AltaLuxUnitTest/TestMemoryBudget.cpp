@@ -0,0 +1,322 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/Filter/CBaseAltaLuxFilter.h"
+#include "../AltaLux/Filter/CAltaLuxFilterFactory.h"
+#include "../AltaLux/Filter/CFramePipeline.h"
+#include "../AltaLux/Filter/CMemoryBudget.h"
+#include "../AltaLux/Filter/CPriorityScheduler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the admission control of CMemoryBudget and the banded processing the filters fall back to under it
+	/// </summary>
+	TEST_CLASS(TestMemoryBudget)
+	{
+	public:
+		TEST_METHOD_CLEANUP(RemoveLimit)
+		{
+			CMemoryBudget::GetInstance().SetLimit(0);
+		}
+
+		/// <summary>
+		/// horizontal gradient with noise, so that the mappings of the regions differ from each other and from the identity
+		/// </summary>
+		static std::vector<unsigned char> MakeImage(int Width, int Height, int BytesPerPixel)
+		{
+			std::vector<unsigned char> Image(Width * Height * BytesPerPixel);
+			srand(Width * Height);
+			for (int y = 0; y < Height; y++)
+				for (int x = 0; x < Width; x++)
+					for (int Channel = 0; Channel < BytesPerPixel; Channel++)
+						Image[(y * Width + x) * BytesPerPixel + Channel] = static_cast<unsigned char>((x * 160) / Width + (rand() % 64));
+			return Image;
+		}
+
+		/// <summary>
+		/// processes Image with the given strategy under the given memory limit, and returns the result
+		/// </summary>
+		static std::vector<unsigned char> Process(const std::vector<unsigned char>& Image, int FilterType, int Width, int Height,
+		                                          int Slices, int BytesPerPixel, size_t Limit)
+		{
+			CMemoryBudget::GetInstance().SetLimit(Limit);
+			std::vector<unsigned char> Result(Image);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, Width, Height, Slices, Slices);
+			Assert::IsNotNull(Filter);
+			Filter->SetStrength(AL_MAX_STRENGTH);
+			if (BytesPerPixel == 2)
+				Assert::AreEqual(AL_OK, Filter->ProcessYUYV(Result.data()));
+			else if (BytesPerPixel == 3)
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB24(Result.data()));
+			else
+				Assert::AreEqual(AL_OK, Filter->ProcessBGR32(Result.data()));
+			delete Filter;
+			CMemoryBudget::GetInstance().SetLimit(0);
+			return Result;
+		}
+
+		/// <summary>
+		/// processes Frames with a CFramePipeline under the given memory limit, and returns the results
+		/// </summary>
+		static std::vector<std::vector<unsigned char>> ProcessFrames(const std::vector<std::vector<unsigned char>>& Frames,
+		                                                             FramePixelFormat Format, size_t Limit)
+		{
+			CMemoryBudget::GetInstance().SetLimit(Limit);
+			std::vector<std::vector<unsigned char>> Results(Frames);
+			{
+				CFramePipeline Pipeline(640, 480, Format);
+				Pipeline.SetStrength(AL_MAX_STRENGTH);
+				for (auto& Result : Results)
+				{
+					if (Pipeline.GetNumFramesInFlight() == Pipeline.GetDepth())
+						Assert::AreEqual(AL_OK, Pipeline.CompleteFrame());
+					Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(Result.data()));
+				}
+				Assert::AreEqual(AL_OK, Pipeline.Flush());
+			}
+			CMemoryBudget::GetInstance().SetLimit(0);
+			return Results;
+		}
+
+		TEST_METHOD(BandedResultTest)
+		{
+			// a limit of one byte is smaller than any job, that is then run alone in its lower-memory mode
+			const int FilterTypes[] = { ALTALUX_FILTER_SERIAL, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, ALTALUX_FILTER_PARALLEL_ERROR,
+			                            ALTALUX_FILTER_PARALLEL_EVENT, ALTALUX_FILTER_ACTIVE_WAIT };
+			for (int FilterType : FilterTypes)
+			{
+				const std::vector<unsigned char> Image = MakeImage(640, 480, 4);
+				CMemoryBudget::GetInstance().ResetStats();
+				Assert::IsTrue(Process(Image, FilterType, 640, 480, DEFAULT_HOR_REGIONS, 4, 1) ==
+				               Process(Image, FilterType, 640, 480, DEFAULT_HOR_REGIONS, 4, 0));
+				Assert::AreEqual(1ULL, CMemoryBudget::GetInstance().GetStats().NumFallbacks);
+			}
+			// regions of odd sizes and images that are not multiples of the grid, whose bottom band is taller
+			const int Slices[] = { 2, 7, 13, 64 };
+			for (int SliceCount : Slices)
+			{
+				const std::vector<unsigned char> Image = MakeImage(1023, 765, 3);
+				Assert::IsTrue(Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 1023, 765, SliceCount, 3, 1) ==
+				               Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 1023, 765, SliceCount, 3, 0));
+			}
+			// the luma of a packed YUV image
+			const std::vector<unsigned char> Image = MakeImage(640, 480, 2);
+			Assert::IsTrue(Process(Image, ALTALUX_FILTER_SERIAL, 640, 480, DEFAULT_HOR_REGIONS, 2, 1) ==
+			               Process(Image, ALTALUX_FILTER_SERIAL, 640, 480, DEFAULT_HOR_REGIONS, 2, 0));
+		}
+
+		TEST_METHOD(LimitTest)
+		{
+			// a limit that holds the luminance plane lets the job run in its normal mode, one that only holds a band does not
+			const std::vector<unsigned char> Image = MakeImage(640, 480, 3);
+			CMemoryBudget::GetInstance().ResetStats();
+			Process(Image, ALTALUX_FILTER_SERIAL, 640, 480, DEFAULT_HOR_REGIONS, 3, 4 << 20);
+			Assert::AreEqual(0ULL, CMemoryBudget::GetInstance().GetStats().NumFallbacks);
+			CMemoryBudget::GetInstance().ResetStats();
+			Process(Image, ALTALUX_FILTER_SERIAL, 640, 480, DEFAULT_HOR_REGIONS, 3, 256 << 10);
+			const MemoryBudgetStats Stats = CMemoryBudget::GetInstance().GetStats();
+			Assert::AreEqual(1ULL, Stats.NumAdmissions);
+			Assert::AreEqual(1ULL, Stats.NumFallbacks);
+			Assert::AreEqual(0ULL, Stats.NumQueued);
+			Assert::IsTrue(Stats.PeakBytes < (256 << 10));
+			Assert::AreEqual(static_cast<size_t>(0), CMemoryBudget::GetInstance().GetReservedBytes());
+		}
+
+		TEST_METHOD(PipelineTest)
+		{
+			CMemoryBudget& Budget = CMemoryBudget::GetInstance();
+			const unsigned long long NumFrames = 5;
+			const size_t PlaneBytes = 640 * 481;
+			std::vector<std::vector<unsigned char>> Frames;
+			for (unsigned long long i = 0; i < NumFrames; i++)
+			{
+				Frames.push_back(MakeImage(640, 480, 4));
+				for (auto& Pixel : Frames.back())
+					Pixel = static_cast<unsigned char>((Pixel * (i + 3)) / 8); //< a different histogram for each frame
+			}
+			const std::vector<std::vector<unsigned char>> Expected = ProcessFrames(Frames, FRAME_FORMAT_BGR32, 0);
+
+			// every frame is admitted, and under a limit smaller than any frame each one runs alone by bands
+			Budget.ResetStats();
+			Assert::IsTrue(ProcessFrames(Frames, FRAME_FORMAT_BGR32, 1) == Expected);
+			MemoryBudgetStats Stats = Budget.GetStats();
+			Assert::AreEqual(NumFrames, Stats.NumAdmissions);
+			Assert::AreEqual(NumFrames, Stats.NumFallbacks);
+			Assert::IsTrue((Stats.PeakBytes > 0) && (Stats.PeakBytes < PlaneBytes));
+			Assert::AreEqual(static_cast<size_t>(0), Budget.GetReservedBytes());
+
+			// a limit that holds the luminance plane of the frames lets them run in their normal mode
+			Budget.ResetStats();
+			Assert::IsTrue(ProcessFrames(Frames, FRAME_FORMAT_BGR32, 4 << 20) == Expected);
+			Stats = Budget.GetStats();
+			Assert::AreEqual(NumFrames, Stats.NumAdmissions);
+			Assert::AreEqual(0ULL, Stats.NumFallbacks);
+			Assert::IsTrue((Stats.PeakBytes >= PlaneBytes) && (Stats.PeakBytes <= (4 << 20)));
+			Assert::AreEqual(static_cast<size_t>(0), Budget.GetReservedBytes());
+
+			// the reservation of a frame is held while it is in flight: an interactive job stops the frame at its
+			// first turn, after it has been admitted
+			Budget.SetLimit(4 << 20);
+			{
+				std::vector<unsigned char> Result(Frames[0]);
+				CFramePipeline Pipeline(640, 480, FRAME_FORMAT_BGR32);
+				{
+					CPriorityJob InteractiveJob(FILTER_PRIORITY_INTERACTIVE);
+					Assert::AreEqual(AL_OK, Pipeline.SubmitFrame(Result.data()));
+					while (Budget.GetReservedBytes() == 0)
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					Assert::IsTrue(Budget.GetReservedBytes() >= PlaneBytes);
+				}
+				Assert::AreEqual(AL_OK, Pipeline.Flush());
+			}
+			Assert::AreEqual(static_cast<size_t>(0), Budget.GetReservedBytes());
+
+			// a gray frame is processed in place and reserves only its mappings
+			std::vector<std::vector<unsigned char>> GrayFrames;
+			for (const auto& Frame : Frames)
+				GrayFrames.emplace_back(Frame.begin(), Frame.begin() + 640 * 480);
+			const std::vector<std::vector<unsigned char>> GrayExpected = ProcessFrames(GrayFrames, FRAME_FORMAT_GRAY, 0);
+			Budget.ResetStats();
+			Assert::IsTrue(ProcessFrames(GrayFrames, FRAME_FORMAT_GRAY, 4 << 20) == GrayExpected);
+			Stats = Budget.GetStats();
+			Assert::AreEqual(NumFrames, Stats.NumAdmissions);
+			Assert::IsTrue((Stats.PeakBytes > 0) && (Stats.PeakBytes < PlaneBytes));
+			Assert::AreEqual(static_cast<size_t>(0), Budget.GetReservedBytes());
+			Budget.SetLimit(0);
+		}
+
+		TEST_METHOD(AdmissionTest)
+		{
+			CMemoryBudget& Budget = CMemoryBudget::GetInstance();
+			Budget.SetLimit(1000);
+			Budget.ResetStats();
+			bool SecondReduced = true;
+			std::thread Second;
+			{
+				CMemoryReservation First(800, 600, FILTER_PRIORITY_NORMAL);
+				Assert::IsFalse(First.IsReduced());
+				// neither mode of the second job fits next to the first one, so it waits for it to finish
+				Second = std::thread([&SecondReduced]()
+				{
+					CMemoryReservation Reservation(800, 600, FILTER_PRIORITY_NORMAL);
+					SecondReduced = Reservation.IsReduced();
+				});
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				Assert::AreEqual(static_cast<size_t>(800), Budget.GetReservedBytes());
+			}
+			Second.join();
+			Assert::IsFalse(SecondReduced);
+			const MemoryBudgetStats Stats = Budget.GetStats();
+			Assert::AreEqual(2ULL, Stats.NumAdmissions);
+			Assert::AreEqual(1ULL, Stats.NumQueued);
+			Assert::AreEqual(0ULL, Stats.NumFallbacks);
+			Assert::IsTrue(Stats.MaxQueuedSeconds > 0.0);
+			Assert::AreEqual(static_cast<size_t>(0), Budget.GetReservedBytes());
+
+			// a job that does not fit in a free budget falls back to its lower-memory mode instead of waiting
+			{
+				CMemoryReservation First(300, 200, FILTER_PRIORITY_NORMAL);
+				CMemoryReservation Reduced(800, 600, FILTER_PRIORITY_NORMAL);
+				Assert::IsTrue(Reduced.IsReduced());
+			}
+			Assert::AreEqual(1ULL, Budget.GetStats().NumFallbacks);
+			Budget.SetLimit(0);
+		}
+
+		TEST_METHOD(PriorityTest)
+		{
+			CMemoryBudget& Budget = CMemoryBudget::GetInstance();
+			CPriorityScheduler& Scheduler = CPriorityScheduler::GetInstance();
+			const std::vector<unsigned char> Image = MakeImage(640, 480, 3);
+			Budget.SetLimit(1000);
+			Budget.ResetStats();
+
+			// a background job holds the whole budget when an interactive one, registered as the previews are,
+			// starts and waits for that memory: the background job must not yield to it at its next row
+			int InteractiveReturn = AL_OUT_OF_MEMORY;
+			std::thread Interactive;
+			{
+				CPriorityJob BackgroundJob(FILTER_PRIORITY_BACKGROUND);
+				CMemoryReservation Held(1000, 1000, FILTER_PRIORITY_BACKGROUND);
+				Interactive = std::thread([&Image, &InteractiveReturn]()
+				{
+					CPriorityJob PreviewJob(FILTER_PRIORITY_INTERACTIVE);
+					std::vector<unsigned char> Result(Image);
+					CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 640, 480);
+					Filter->SetPriority(FILTER_PRIORITY_INTERACTIVE);
+					Filter->SetStrength(AL_MAX_STRENGTH);
+					InteractiveReturn = Filter->ProcessRGB24(Result.data());
+					delete Filter;
+				});
+				while (Budget.GetStats().NumQueued == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_BACKGROUND));
+				Scheduler.WaitForTurn(FILTER_PRIORITY_BACKGROUND);
+			}
+			Interactive.join();
+			Assert::AreEqual(AL_OK, InteractiveReturn);
+
+			// background and interactive filters sharing a budget that lets only one of them run at a time
+			Budget.SetLimit(1);
+			int Returns[2] = { AL_OUT_OF_MEMORY, AL_OUT_OF_MEMORY };
+			const FilterPriority Priorities[2] = { FILTER_PRIORITY_BACKGROUND, FILTER_PRIORITY_INTERACTIVE };
+			std::thread Jobs[2];
+			for (int Job = 0; Job < 2; Job++)
+			{
+				Jobs[Job] = std::thread([&, Job]()
+				{
+					CPriorityJob OuterJob(Priorities[Job]);
+					CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 640, 480);
+					Filter->SetPriority(Priorities[Job]);
+					Filter->SetStrength(AL_MAX_STRENGTH);
+					std::vector<unsigned char> Result(Image);
+					Returns[Job] = AL_OK;
+					for (int Call = 0; (Call < 10) && (Returns[Job] == AL_OK); Call++)
+						Returns[Job] = Filter->ProcessRGB24(Result.data());
+					delete Filter;
+				});
+			}
+			for (auto& Job : Jobs)
+				Job.join();
+			Assert::AreEqual(AL_OK, Returns[0]);
+			Assert::AreEqual(AL_OK, Returns[1]);
+			Assert::AreEqual(0u, Scheduler.GetNumActiveJobs(FILTER_PRIORITY_INTERACTIVE));
+			Budget.SetLimit(0);
+		}
+	};
+}
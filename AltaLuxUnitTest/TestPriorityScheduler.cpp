@@ -0,0 +1,138 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "..\AltaLux\Filter\CBaseAltaLuxFilter.h"
+#include "..\AltaLux\Filter\CAltaLuxFilterFactory.h"
+#include "..\AltaLux\Filter\CPriorityScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test that jobs of lower priority classes yield to the running jobs of higher classes, and complete afterwards
+	/// with the same result they would have without pre-emption
+	/// </summary>
+	TEST_CLASS(TestPriorityScheduler)
+	{
+	public:
+		const int IMAGE_WIDTH = 1024;
+		const int IMAGE_HEIGHT = 768;
+		const int RGBA_PIXEL_SIZE = 4;
+		const int IMAGE_SIZE = (IMAGE_WIDTH * IMAGE_HEIGHT * RGBA_PIXEL_SIZE);
+		const int PREEMPTION_TIMEOUT_MS = 10000;
+
+		TEST_METHOD(ShouldYieldTest)
+		{
+			CPriorityScheduler& Scheduler = CPriorityScheduler::GetInstance();
+			Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_BACKGROUND));
+			{
+				CPriorityJob NormalJob(FILTER_PRIORITY_NORMAL);
+				Assert::AreEqual(1u, Scheduler.GetNumActiveJobs(FILTER_PRIORITY_NORMAL));
+				Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_INTERACTIVE));
+				Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_NORMAL));
+				Assert::IsTrue(Scheduler.ShouldYield(FILTER_PRIORITY_BACKGROUND));
+				{
+					CPriorityJob InteractiveJob(FILTER_PRIORITY_INTERACTIVE);
+					Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_INTERACTIVE));
+					Assert::IsTrue(Scheduler.ShouldYield(FILTER_PRIORITY_NORMAL));
+				}
+				Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_NORMAL));
+			}
+			Assert::AreEqual(0u, Scheduler.GetNumActiveJobs(FILTER_PRIORITY_NORMAL));
+			Assert::IsFalse(Scheduler.ShouldYield(FILTER_PRIORITY_BACKGROUND));
+
+			// with no job of a higher class running, the caller does not wait
+			Scheduler.ResetStats();
+			Scheduler.WaitForTurn(FILTER_PRIORITY_BACKGROUND);
+			Assert::IsTrue(Scheduler.GetNumPreemptions(FILTER_PRIORITY_BACKGROUND) == 0);
+		}
+
+		/// <summary>
+		/// starts a background job while an interactive one is running, checks that it waits,
+		/// and that once resumed it produces the same image as an undisturbed run
+		/// </summary>
+		void CheckPreemptedJob(int FilterType)
+		{
+			std::vector<unsigned char> SourceImage(IMAGE_SIZE);
+			srand(0x5555);
+			for (auto& Value : SourceImage)
+				Value = rand() % 256;
+
+			std::vector<unsigned char> ReferenceImage(SourceImage);
+			std::unique_ptr<CBaseAltaLuxFilter> ReferenceFilter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, IMAGE_WIDTH, IMAGE_HEIGHT));
+			Assert::AreEqual(AL_OK, ReferenceFilter->ProcessRGB32(ReferenceImage.data()));
+
+			std::vector<unsigned char> BackgroundImage(SourceImage);
+			std::unique_ptr<CBaseAltaLuxFilter> BackgroundFilter(CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, IMAGE_WIDTH, IMAGE_HEIGHT));
+			BackgroundFilter->SetPriority(FILTER_PRIORITY_BACKGROUND);
+			Assert::IsTrue(BackgroundFilter->GetPriority() == FILTER_PRIORITY_BACKGROUND);
+
+			CPriorityScheduler& Scheduler = CPriorityScheduler::GetInstance();
+			Scheduler.ResetStats();
+			std::unique_ptr<CPriorityJob> InteractiveJob(new CPriorityJob(FILTER_PRIORITY_INTERACTIVE));
+			std::atomic<bool> BackgroundCompleted(false);
+			int BackgroundResult = AL_NULL_IMAGE;
+			std::thread BackgroundThread([&]()
+			{
+				BackgroundResult = BackgroundFilter->ProcessRGB32(BackgroundImage.data());
+				BackgroundCompleted = true;
+			});
+
+			auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PREEMPTION_TIMEOUT_MS);
+			while ((Scheduler.GetNumPreemptions(FILTER_PRIORITY_BACKGROUND) == 0) && (std::chrono::steady_clock::now() < Deadline))
+				std::this_thread::yield();
+			Assert::IsTrue(Scheduler.GetNumPreemptions(FILTER_PRIORITY_BACKGROUND) > 0);
+			Assert::IsFalse(BackgroundCompleted.load());
+
+			InteractiveJob.reset();
+			BackgroundThread.join();
+			Assert::AreEqual(AL_OK, BackgroundResult);
+			Assert::IsTrue(BackgroundImage == ReferenceImage);
+		}
+
+		TEST_METHOD(SerialPreemptionTest)
+		{
+			CheckPreemptedJob(ALTALUX_FILTER_SERIAL);
+		}
+
+		TEST_METHOD(ParallelSplitLoopPreemptionTest)
+		{
+			CheckPreemptedJob(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP);
+		}
+	};
+}
@@ -0,0 +1,92 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/Session/CSessionBufferManager.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the preview plans chosen by CSessionBufferManager under its memory budget
+	/// </summary>
+	TEST_CLASS(TestSessionBuffers)
+	{
+	public:
+		TEST_METHOD(AllVariantsTest)
+		{
+			// the preferred factor gives a width that is a multiple of 8, and the budget holds all the variants
+			CSessionBufferManager SessionBuffers;
+			Assert::IsNotNull(SessionBuffers.AllocateSourceImage(1024, 768, 3).get());
+			const PreviewPlan Plan = SessionBuffers.PlanPreview(2);
+			Assert::AreEqual(2, Plan.ScalingFactor);
+			Assert::AreEqual(512, Plan.ScaledWidth);
+			Assert::AreEqual(static_cast<int>(NUM_PREVIEW_BUFFERS), Plan.NumPreviewBuffers);
+			Assert::IsTrue(Plan.Footprint <= SessionBuffers.GetMemoryBudget());
+		}
+
+		TEST_METHOD(TightBudgetTest)
+		{
+			// widths whose valid factors are far apart, so that the factors skipped by GetScaledSize
+			// would cross MIN_PREVIEW_WIDTH unnoticed
+			const int Widths[] = { 1000, 1366, 2592, 4000 };
+			for (int Width : Widths)
+			{
+				CSessionBufferManager SessionBuffers(1);
+				Assert::IsNotNull(SessionBuffers.AllocateSourceImage(Width, 480, 3).get());
+				const PreviewPlan Plan = SessionBuffers.PlanPreview(2);
+				Assert::AreEqual(1, Plan.NumPreviewBuffers);
+				Assert::AreEqual(Width / Plan.ScalingFactor, Plan.ScaledWidth);
+				Assert::AreEqual(0, Plan.ScaledWidth % 8);
+				Assert::IsTrue(Plan.ScaledWidth >= MIN_PREVIEW_WIDTH);
+				// it is the smallest of those preview sizes
+				for (int ScalingFactor = Plan.ScalingFactor + 1; Width / ScalingFactor >= MIN_PREVIEW_WIDTH; ScalingFactor++)
+					Assert::AreNotEqual(0, (Width / ScalingFactor) % 8);
+			}
+		}
+
+		TEST_METHOD(SmallSourceTest)
+		{
+			// a source narrower than twice MIN_PREVIEW_WIDTH keeps the largest preview that can be drawn
+			CSessionBufferManager SessionBuffers(1);
+			Assert::IsNotNull(SessionBuffers.AllocateSourceImage(240, 180, 3).get());
+			PreviewPlan Plan = SessionBuffers.PlanPreview(2);
+			Assert::AreEqual(2, Plan.ScalingFactor);
+			Assert::AreEqual(120, Plan.ScaledWidth);
+			Assert::AreEqual(1, Plan.NumPreviewBuffers);
+
+			// so does a source none of whose widths from MIN_PREVIEW_WIDTH up is a multiple of 8
+			Assert::IsNotNull(SessionBuffers.AllocateSourceImage(1023, 767, 3).get());
+			Plan = SessionBuffers.PlanPreview(2);
+			Assert::AreEqual(18, Plan.ScalingFactor);
+			Assert::AreEqual(56, Plan.ScaledWidth);
+		}
+	};
+}
@@ -99,5 +99,83 @@ namespace AltaLuxUnitTest
 			Assert::IsTrue(memcmp(SerialImage, ParallelImage, IMAGE_SIZE) == 0);
 			Assert::IsFalse(memcmp(InputImage, ParallelImage, IMAGE_SIZE) == 0);
 		}
+
+		TEST_METHOD(LargeGridTest)
+		{
+			unsigned char *LargeGridSerialImage = new unsigned char[IMAGE_SIZE];
+			memcpy(LargeGridSerialImage, InputImage, IMAGE_SIZE);
+			CBaseAltaLuxFilter *SerialCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, IMAGE_WIDTH, IMAGE_HEIGHT,
+				MAX_HOR_REGIONS, MAX_VERT_REGIONS);
+			SerialCode->ProcessRGB32(LargeGridSerialImage);
+			CBaseAltaLuxFilter *ParallelCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, IMAGE_WIDTH, IMAGE_HEIGHT,
+				MAX_HOR_REGIONS, MAX_VERT_REGIONS);
+			ParallelCode->ProcessRGB32(ParallelImage);
+			Assert::IsTrue(memcmp(LargeGridSerialImage, ParallelImage, IMAGE_SIZE) == 0);
+			Assert::IsFalse(memcmp(SerialImage, ParallelImage, IMAGE_SIZE) == 0);
+			delete[] LargeGridSerialImage;
+		}
+
+		TEST_METHOD(SchedulingPolicyTest)
+		{
+			// 768 / 60 leaves 48 rows to the bottom sub-matrices
+			const int UNEVEN_GRID_SIZE = 60;
+			CBaseAltaLuxFilter *SerialCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, IMAGE_WIDTH, IMAGE_HEIGHT);
+			CBaseAltaLuxFilter *ParallelCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, IMAGE_WIDTH, IMAGE_HEIGHT);
+			Assert::AreEqual(AL_SCHEDULE_LONGEST_FIRST, ParallelCode->GetSchedulingPolicy());
+			unsigned char *UnevenSerialImage = new unsigned char[IMAGE_SIZE];
+			for (int GridSize : { UNEVEN_GRID_SIZE, (int)DEFAULT_HOR_REGIONS })
+			{
+				SerialCode->SetSlices(GridSize, GridSize);
+				memcpy(UnevenSerialImage, InputImage, IMAGE_SIZE);
+				SerialCode->ProcessRGB32(UnevenSerialImage);
+				for (int Policy : { AL_SCHEDULE_ROW_MAJOR, AL_SCHEDULE_LONGEST_FIRST })
+				{
+					ParallelCode->SetSchedulingPolicy(Policy);
+					ParallelCode->SetSlices(GridSize, GridSize);
+					memcpy(ParallelImage, InputImage, IMAGE_SIZE);
+					ParallelCode->ProcessRGB32(ParallelImage);
+					Assert::IsTrue(memcmp(UnevenSerialImage, ParallelImage, IMAGE_SIZE) == 0);
+				}
+			}
+			delete[] UnevenSerialImage;
+			delete SerialCode;
+			delete ParallelCode;
+		}
+
+		TEST_METHOD(PackedYUVTest)
+		{
+			// the RGBA input is reinterpreted as a packed YUV image of the same width and half the rows
+			const int YUV_IMAGE_HEIGHT = IMAGE_SIZE / (IMAGE_WIDTH * 2);
+			const int YUV_IMAGE_SIZE = IMAGE_WIDTH * YUV_IMAGE_HEIGHT * 2;
+			CBaseAltaLuxFilter *SerialCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, IMAGE_WIDTH, YUV_IMAGE_HEIGHT);
+			CBaseAltaLuxFilter *ParallelCode = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, IMAGE_WIDTH, YUV_IMAGE_HEIGHT);
+			for (int LumaOffset = 0; LumaOffset < 2; LumaOffset++)
+			{
+				memcpy(SerialImage, InputImage, YUV_IMAGE_SIZE);
+				memcpy(ParallelImage, InputImage, YUV_IMAGE_SIZE);
+				if (LumaOffset == 0)
+				{
+					Assert::AreEqual(AL_OK, SerialCode->ProcessYUYV(SerialImage));
+					Assert::AreEqual(AL_OK, ParallelCode->ProcessYUYV(ParallelImage));
+				}
+				else
+				{
+					Assert::AreEqual(AL_OK, SerialCode->ProcessUYVY(SerialImage));
+					Assert::AreEqual(AL_OK, ParallelCode->ProcessUYVY(ParallelImage));
+				}
+				Assert::IsTrue(memcmp(SerialImage, ParallelImage, YUV_IMAGE_SIZE) == 0);
+				// only the luma bytes are changed
+				bool LumaChanged = false;
+				for (int j = 0; j < YUV_IMAGE_SIZE; j += 2)
+				{
+					Assert::AreEqual(InputImage[j + 1 - LumaOffset], ParallelImage[j + 1 - LumaOffset]);
+					if (InputImage[j + LumaOffset] != ParallelImage[j + LumaOffset])
+						LumaChanged = true;
+				}
+				Assert::IsTrue(LumaChanged);
+			}
+			delete SerialCode;
+			delete ParallelCode;
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/Filter/CBaseAltaLuxFilter.h"
+#include "../AltaLux/Filter/CAltaLuxFilterFactory.h"
+#include "../AltaLux/ImageScaling/ImageScaling.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// test the thumbnail computed while the result is written, against ScaleDownImage of the result
+	/// </summary>
+	TEST_CLASS(TestThumbnail)
+	{
+	public:
+		/// <summary>
+		/// processes a random image with the given strategy, and checks that the thumbnail is the same as ScaleDownImage
+		/// of the processed image
+		/// </summary>
+		void CheckThumbnail(int FilterType, int Width, int Height, int BytesPerPixel, int ScalingFactor, int Strength)
+		{
+			std::vector<unsigned char> Image(Width * Height * BytesPerPixel);
+			srand(Width + Height + ScalingFactor);
+			for (auto& Value : Image)
+				Value = rand() & 0xFF;
+			const int ThumbnailSize = (Width / ScalingFactor) * (Height / ScalingFactor) * BytesPerPixel;
+			std::vector<unsigned char> Thumbnail(ThumbnailSize, 0);
+			std::vector<unsigned char> Expected(ThumbnailSize, 0);
+
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, Width, Height);
+			Assert::IsNotNull(Filter);
+			Filter->SetStrength(Strength);
+			Filter->SetThumbnailOutput(Thumbnail.data(), ScalingFactor);
+			if (BytesPerPixel == 3)
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB24(Image.data()));
+			else
+				Assert::AreEqual(AL_OK, Filter->ProcessBGR32(Image.data()));
+			delete Filter;
+
+			ScaleDownImage(Image.data(), Width, Height, Expected.data(), ScalingFactor, BytesPerPixel);
+			Assert::IsTrue(Thumbnail == Expected);
+		}
+
+		TEST_METHOD(StrategiesTest)
+		{
+			const int FilterTypes[] = { ALTALUX_FILTER_SERIAL, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			                            ALTALUX_FILTER_PARALLEL_EVENT, ALTALUX_FILTER_ACTIVE_WAIT };
+			for (int FilterType : FilterTypes)
+				CheckThumbnail(FilterType, 640, 480, 4, 4, AL_DEFAULT_STRENGTH);
+		}
+
+		TEST_METHOD(ScalingFactorsTest)
+		{
+			// sizes that are not multiples of the grid nor of the scaling factors, so that the blocks of pixels
+			// cross the borders of the sub-matrices and the last rows and columns are dropped
+			const int ScalingFactors[] = { 1, 2, 3, 4, 7 };
+			for (int ScalingFactor : ScalingFactors)
+			{
+				CheckThumbnail(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 1023, 765, 3, ScalingFactor, AL_DEFAULT_STRENGTH);
+				CheckThumbnail(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 333, 251, 4, ScalingFactor, AL_MAX_STRENGTH);
+			}
+		}
+
+		TEST_METHOD(UnchangedImageTest)
+		{
+			// the lowest strength leaves the image as is without interpolating it, the thumbnail is still computed
+			CheckThumbnail(ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 640, 480, 3, 2, AL_MIN_STRENGTH - 4);
+		}
+
+		TEST_METHOD(DisabledTest)
+		{
+			std::vector<unsigned char> Image(640 * 480 * 4, 0x80);
+			std::vector<unsigned char> Thumbnail(320 * 240 * 4, 0);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(ALTALUX_FILTER_SERIAL, 640, 480);
+			Assert::IsNotNull(Filter);
+			Filter->SetThumbnailOutput(Thumbnail.data(), 2);
+			Filter->SetThumbnailOutput(nullptr, 2);
+			Assert::AreEqual(AL_OK, Filter->ProcessRGB32(Image.data()));
+			delete Filter;
+			Assert::IsTrue(Thumbnail == std::vector<unsigned char>(320 * 240 * 4, 0));
+		}
+	};
+}
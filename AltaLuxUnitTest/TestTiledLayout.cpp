@@ -0,0 +1,164 @@
+/*
+Project: AltaLux plugin for IrfanView
+Author: Stefano Tommesani
+Website: http://www.tommesani.com
+
+Microsoft Public License (MS-PL) [OSI Approved License]
+
+This license governs use of the accompanying software. If you use the software, you accept this license. If you do not accept the license, do not use the software.
+
+1. Definitions
+The terms "reproduce," "reproduction," "derivative works," and "distribution" have the same meaning here as under U.S. copyright law.
+A "contribution" is the original software, or any additions or changes to the software.
+A "contributor" is any person that distributes its contribution under this license.
+"Licensed patents" are a contributor's patent claims that read directly on its contribution.
+
+2. Grant of Rights
+(A) Copyright Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free copyright license to reproduce its contribution, prepare derivative works of its contribution, and distribute its contribution or any derivative works that you create.
+(B) Patent Grant- Subject to the terms of this license, including the license conditions and limitations in section 3, each contributor grants you a non-exclusive, worldwide, royalty-free license under its licensed patents to make, have made, use, sell, offer for sale, import, and/or otherwise dispose of its contribution in the software or derivative works of the contribution in the software.
+
+3. Conditions and Limitations
+(A) No Trademark License- This license does not grant you rights to use any contributors' name, logo, or trademarks.
+(B) If you bring a patent claim against any contributor over patents that you claim are infringed by the software, your patent license from such contributor to the software ends automatically.
+(C) If you distribute any portion of the software, you must retain all copyright, patent, trademark, and attribution notices that are present in the software.
+(D) If you distribute any portion of the software in source code form, you may do so only under this license by including a complete copy of this license with your distribution. If you distribute any portion of the software in compiled or object code form, you may only do so under a license that complies with this license.
+(E) The software is licensed "as-is." You bear the risk of using it. The contributors give no express warranties, guarantees or conditions. You may have additional consumer rights under your local laws which this license cannot change. To the extent permitted under your local laws, the contributors exclude the implied warranties of merchantability, fitness for a particular purpose and non-infringement.
+*/
+
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../AltaLux/Filter/CBaseAltaLuxFilter.h"
+#include "../AltaLux/Filter/CAltaLuxFilterFactory.h"
+#include "../AltaLux/Filter/CSerialAltaLuxFilter.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AltaLuxUnitTest
+{
+	/// <summary>
+	/// gives access to the luminance buffer and to the histograms of both layouts
+	/// </summary>
+	class CTiledLayoutFilter : public CSerialAltaLuxFilter
+	{
+	public:
+		CTiledLayoutFilter(int Width, int Height, int HorSlices, int VerSlices) :
+			CSerialAltaLuxFilter(Width, Height, HorSlices, VerSlices) {}
+
+		using CBaseAltaLuxFilter::MakeSubsampledHistogram;
+		using CBaseAltaLuxFilter::MakeTiledHistogram;
+		using CBaseAltaLuxFilter::GetSubMatrixRow;
+		using CBaseAltaLuxFilter::GetImageOffset;
+		using CBaseAltaLuxFilter::ExtractLuminance;
+		using CBaseAltaLuxFilter::GetLuminanceFactors;
+
+		void SetLumaTiled(bool Tiled) { LumaTiled = Tiled; }
+		PixelType* GetImageBuffer() { return ImageBuffer; }
+		unsigned int GetNumHorRegions() const { return NumHorRegions; }
+		unsigned int GetNumVertRegions() const { return NumVertRegions; }
+	};
+
+	/// <summary>
+	/// test the region-major layout of the luminance, against the row by row one
+	/// </summary>
+	TEST_CLASS(TestTiledLayout)
+	{
+	public:
+		/// <summary>
+		/// horizontal gradient with noise, so that the mappings of the regions differ from each other and from the identity
+		/// </summary>
+		static std::vector<unsigned char> MakeImage(int Width, int Height, int BytesPerPixel)
+		{
+			std::vector<unsigned char> Image(Width * Height * BytesPerPixel);
+			srand(Width * Height);
+			for (int y = 0; y < Height; y++)
+				for (int x = 0; x < Width; x++)
+					for (int Channel = 0; Channel < BytesPerPixel; Channel++)
+						Image[(y * Width + x) * BytesPerPixel + Channel] = static_cast<unsigned char>((x * 160) / Width + (rand() % 64));
+			return Image;
+		}
+
+		/// <summary>
+		/// processes Image with the given strategy and layout, and returns the result
+		/// </summary>
+		static std::vector<unsigned char> Process(const std::vector<unsigned char>& Image, int FilterType, int Width, int Height,
+		                                          int Slices, int BytesPerPixel, bool Tiled)
+		{
+			std::vector<unsigned char> Result(Image);
+			CBaseAltaLuxFilter *Filter = CAltaLuxFilterFactory::CreateSpecificAltaLuxFilter(FilterType, Width, Height, Slices, Slices);
+			Assert::IsNotNull(Filter);
+			Filter->SetStrength(AL_MAX_STRENGTH);
+			Filter->SetTiledLayout(Tiled);
+			Assert::AreEqual(Tiled, Filter->IsTiledLayout());
+			if (BytesPerPixel == 3)
+				Assert::AreEqual(AL_OK, Filter->ProcessRGB24(Result.data()));
+			else
+				Assert::AreEqual(AL_OK, Filter->ProcessBGR32(Result.data()));
+			delete Filter;
+			return Result;
+		}
+
+		TEST_METHOD(SameResultTest)
+		{
+			const int FilterTypes[] = { ALTALUX_FILTER_SERIAL, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP,
+			                            ALTALUX_FILTER_PARALLEL_EVENT, ALTALUX_FILTER_ACTIVE_WAIT };
+			for (int FilterType : FilterTypes)
+			{
+				const std::vector<unsigned char> Image = MakeImage(640, 480, 4);
+				Assert::IsTrue(Process(Image, FilterType, 640, 480, DEFAULT_HOR_REGIONS, 4, true) ==
+				               Process(Image, FilterType, 640, 480, DEFAULT_HOR_REGIONS, 4, false));
+			}
+		}
+
+		TEST_METHOD(OddGeometryTest)
+		{
+			// regions of odd sizes, whose last column and row are not interpolated, and images that are not
+			// multiples of the grid, whose right and bottom sub-matrices are larger
+			const int Slices[] = { 2, 7, 13, 64 };
+			for (int SliceCount : Slices)
+			{
+				const std::vector<unsigned char> Image = MakeImage(1023, 765, 3);
+				Assert::IsTrue(Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 1023, 765, SliceCount, 3, true) ==
+				               Process(Image, ALTALUX_FILTER_PARALLEL_SPLIT_LOOP, 1023, 765, SliceCount, 3, false));
+			}
+		}
+
+		TEST_METHOD(HistogramsTest)
+		{
+			const int Width = 1001;
+			const int Height = 605;
+			const std::vector<unsigned char> Image = MakeImage(Width, Height, 3);
+			// regions of 143x121 pixels
+			CTiledLayoutFilter Filter(Width, Height, 7, 5);
+			int FirstFactor, SecondFactor, ThirdFactor;
+			CTiledLayoutFilter::GetLuminanceFactors(false, FirstFactor, SecondFactor, ThirdFactor);
+
+			Filter.ExtractLuminance(Image.data(), FirstFactor, SecondFactor, ThirdFactor, 3);
+			std::vector<PixelType> Rows(Filter.GetImageBuffer(), Filter.GetImageBuffer() + Width * Height);
+			Filter.SetLumaTiled(true);
+			Filter.ExtractLuminance(Image.data(), FirstFactor, SecondFactor, ThirdFactor, 3);
+
+			// every pixel of the tiled layout is located in the image
+			for (int j = 0; j < Width * Height; j++)
+				Assert::AreEqual(Rows[Filter.GetImageOffset(Filter.GetImageBuffer() + j)], Filter.GetImageBuffer()[j]);
+
+			// the histograms count the same pixels, with and without subsampling
+			const unsigned int Steps[] = { 1, 2, 3, 4 };
+			for (unsigned int Step : Steps)
+				for (unsigned int uiY = 0; uiY < Filter.GetNumVertRegions(); uiY++)
+					for (unsigned int uiX = 0; uiX < Filter.GetNumHorRegions(); uiX++)
+					{
+						unsigned int Expected[NUM_GRAY_LEVELS], Histogram[NUM_GRAY_LEVELS];
+						PixelType* pRegion = Filter.GetSubMatrixRow(Rows.data(), uiY) + uiX * (Width / 7);
+						Filter.MakeSubsampledHistogram(pRegion, Expected, Step);
+						Filter.MakeTiledHistogram(Filter.GetImageBuffer(), uiX, uiY, Histogram, Step);
+						Assert::IsTrue(memcmp(Expected, Histogram, sizeof(Histogram)) == 0);
+					}
+			Filter.SetLumaTiled(false);
+		}
+	};
+}